@@ -27,6 +27,7 @@ setInterval(function () {
             var Humidity_bme280     = parseFloat(data[4]);
             var Pressure_bme280     = parseFloat(data[5]);
             var Altitude_bme280     = parseFloat(data[6]);
+            var Dew_point_bme280    = parseFloat(data[7]);
 
             // Update the data
             document.getElementById("time").innerHTML               = getTimeFromDate(time);
@@ -36,6 +37,7 @@ setInterval(function () {
             document.getElementById("humidity_bme280").innerHTML    = Humidity_bme280;
             document.getElementById("pressure_bme280").innerHTML    = Pressure_bme280;
             document.getElementById("altitude_bme280").innerHTML    = Altitude_bme280;
+            document.getElementById("dew_point_bme280").innerHTML   = Dew_point_bme280;
         };
     };
     xhttp.open("GET", "/data", true);
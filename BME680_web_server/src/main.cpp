@@ -3,8 +3,11 @@
 #include "ESPAsyncWebServer.h"
 #include "DHT.h"
 #include "CONFIGS.hpp"
+#include "LedEffects.hpp"
 #include "Adafruit_BME680.h"
-#include "NTPClient.h"
+#include "Dht11Driver.hpp"
+#include "Bme680Driver.hpp"
+#include "ClockService.hpp"
 #include "WiFiUdp.h"
 
 #define DHTPIN               4
@@ -12,18 +15,23 @@
 #define LED                  2
 #define SEALEVELPRESSURE_HPA 1023.0F
 
-// Create DHT object
+// Create DHT object, read through the shared sensor core
 DHT dht(DHTPIN, DHTTYPE);
+Sampler<Dht11Driver<DHT> > dhtSampler(dht);
 
-// Create BME680 object
+// Create BME680 object, read a whole conversion at a time
 Adafruit_BME680 bme;
+Sampler<Bme680Driver<Adafruit_BME680> > bmeSampler(bme, SEALEVELPRESSURE_HPA);
+
+// Create the LED effects engine
+LedEffects led;
 
 // Create AsyncWebServer object on port 80
 AsyncWebServer server(80);
 
-// Define NTP Client to get time
+// Define the clock kept from NTP in the background
 WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP);
+ClockService<WiFiUDP> clockService(ntpUDP);
 
 // Create struct to store sensor data
 typedef struct 
@@ -48,131 +56,44 @@ typedef struct
 Data data;
 
 /**
- * @brief Read temperature from DHT11 sensor
+ * @brief Read epoch in seconds from the clock kept from NTP, never blocks
  */
-float readDHTTemperature()
+unsigned long readTime()
 {
-    float t = dht.readTemperature();
-    static float t_mem;
-    if (isnan(t))
-    {
-        Serial.println("Failed to read temperature from DHT sensor ! Kept the old value");
-        return t_mem;
-    }
-    t_mem = t;
-    Serial.println("Read temperature : " + String(t) + "°C");
-    return t;
+    return clockService.now();
 }
 
 /**
- * @brief Read humidity from DHT11 sensor
+ * @brief Read the DHT11 sensor while the BME680 runs one conversion for all its values
  */
-float readDHTHumidity()
-{
-    float h = dht.readHumidity();
-    static float h_mem;
-    if (isnan(h))
-    {
-        Serial.println("Failed to read humidity from DHT sensor ! Kept the old value");
-        return h_mem;
-    }
-    h_mem = h;
-    Serial.println("Read humidity : " + String(h) + "°C");
-    return h;
-}
-
-float readBME280Temperature()
-{
-    float t = bme.readTemperature();
-    static float t_mem;
-    if (isnan(t))
-    {
-        Serial.println("Failed to read temperature from BME680 sensor ! Kept the old value");
-        return t_mem;
-    }
-    t_mem = t;
-    Serial.println("Read temperature : " + String(t) + "°C");
-    return t;
-}
-
-float readBME280Humidity()
+void updateData()
 {
-    float h = bme.readHumidity();
-    static float h_mem;
-    if (isnan(h))
+    Dht11_reading  dht11;
+    Bme680_reading reading;
+    if (!bmeSampler.start())
     {
-        Serial.println("Failed to read humidity from BME680 sensor ! Kept the old value");
-        return h_mem;
+        Serial.println("Failed to start a BME680 reading");
     }
-    h_mem = h;
-    Serial.println("Read humidity : " + String(h) + "°C");
-    return h;
-}
 
-float readBME280Pressure()
-{
-    float p = bme.readPressure() / 100.0F;
-    static float p_mem;
-    if (isnan(p))
+    data.time                   = readTime();
+    if (!dhtSampler.read(dht11))
     {
-        Serial.println("Failed to read pressure from BME680 sensor ! Kept the old value");
-        return p_mem;
+        Serial.println("Failed to read DHT sensor ! Kept the old values");
     }
-    p_mem = p;
-    Serial.println("Read pressure : " + String(p) + "hPa");
-    return p;
-}
+    data.dht11.temperature      = dht11.temperature;
+    data.dht11.humidity         = dht11.humidity;
+    dhtSampler.print(Serial, dht11);
 
-float readBME280Altitude()
-{
-    float a = bme.readAltitude(SEALEVELPRESSURE_HPA);
-    static float a_mem;
-    if (isnan(a))
+    if (!bmeSampler.finish(reading))
     {
-        Serial.println("Failed to read altitude from BME680 sensor ! Kept the old value");
-        return a_mem;
+        Serial.println("Failed to read BME680 sensor ! Kept the old values");
     }
-    a_mem = a;
-    Serial.println("Read altitude : " + String(a) + "m");
-    return a;
-}
-
-float readBME280GasResistance()
-{
-    float r = bme.gas_resistance / 1000.0F;
-    static float r_mem;
-    if (isnan(r))
-    {
-        Serial.println("Failed to read gas resistance from BME680 sensor ! Kept the old value");
-        return r_mem;
-    }
-    r_mem = r;
-    Serial.println("Read gas resistance : " + String(r) + "kOhm");
-    return r;
-}
-
-/**
- * @brief Read epoch from NTP server in milliseconds
- */
-unsigned long readTime()
-{
-    timeClient.update();
-    return timeClient.getEpochTime();
-}
-
-/**
- * @brief Read temperature and humidity from DHT11 sensor
- */
-void updateData()
-{
-    data.time                   = readTime();
-    data.dht11.temperature      = readDHTTemperature();
-    data.dht11.humidity         = readDHTHumidity();
-    data.bme680.temperature     = readBME280Temperature();
-    data.bme680.humidity        = readBME280Humidity();
-    data.bme680.pressure        = readBME280Pressure();
-    data.bme680.altitude        = readBME280Altitude();
-    data.bme680.gas_resistance  = readBME280GasResistance();
+    data.bme680.temperature     = reading.temperature;
+    data.bme680.humidity        = reading.humidity;
+    data.bme680.pressure        = reading.pressure;
+    data.bme680.altitude        = reading.altitude;
+    data.bme680.gas_resistance  = reading.gas_resistance;
+    bmeSampler.print(Serial, reading);
 }
 
 /**
@@ -203,30 +124,15 @@ String structToString()
     return str;
 }
 
-/**
- * @brief Blink LED 5 times when esp32 is ready
- */
-inline void blinkWhenReady()
-{
-    for (byte i = 0; i < 5; i++)
-    {
-        digitalWrite(LED, HIGH);
-        delay(100);
-        digitalWrite(LED, LOW);
-        delay(100);
-    }
-}
-
 void setup()
 {
     // Initialize variables
     unsigned char attempts  = 0;
-    bool led_on             = false;
     memset(&data, 0, sizeof(data));
 
     // Initialize serial 
     Serial.begin(115200);
-    pinMode(LED, OUTPUT);
+    led.begin(LED);
 
     // Initialize SPIFFS
     if (!SPIFFS.begin(true))
@@ -248,12 +154,11 @@ void setup()
 
     // Connect to Wi-Fi
     WiFi.begin(SSID, PASSWORD);
+    led.play(LedPatterns::blink(0, 2000));
     while (WiFi.status() != WL_CONNECTED)
     {
         delay(1000);
         Serial.println("Connecting to WiFi.. Attempt " + String(++attempts));
-        digitalWrite(LED, led_on);
-        led_on = !led_on;
         if (attempts > 10)
         {
             Serial.println("Failed to connect to WiFi");
@@ -264,10 +169,8 @@ void setup()
     // Print ESP32 Local IP Address
     Serial.println(WiFi.localIP());
 
-    // Initialize NTP client
-    timeClient.begin();
-    timeClient.setTimeOffset(0);
-    timeClient.setUpdateInterval(1000);
+    // Start syncing the clock with NTP
+    clockService.begin();
 
     // Route for root / web page
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
@@ -297,7 +200,7 @@ void setup()
     server.begin();
 
     // Light the LED when connected
-    blinkWhenReady();
+    led.play(LedPatterns::blink(5));
 }
 
 void loop()
@@ -3,7 +3,9 @@
 #include "ESPAsyncWebServer.h"
 #include "DHT.h"
 #include "CONFIGS.hpp"
-#include "NTPClient.h"
+#include "Dht11Driver.hpp"
+#include "LedEffects.hpp"
+#include "ClockService.hpp"
 #include "WiFiUdp.h"
 
 #define DHTPIN   14
@@ -13,13 +15,17 @@
 
 // Create DHT object
 DHT dht(DHTPIN, DHTTYPE);
+Sampler<Dht11Driver<DHT> > dhtSampler(dht);
+
+// Create the LED effects engine
+LedEffects led;
 
 // Create AsyncWebServer object on port 80
 AsyncWebServer server(80);
 
-// Define NTP Client to get time
+// Define the clock kept from NTP in the background
 WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP);
+ClockService<WiFiUDP> clockService(ntpUDP);
 
 // Create struct to store sensor data
 typedef struct 
@@ -32,46 +38,11 @@ Data data[MAX_DATA];
 static unsigned char data_size; // counter to store data
 
 /**
- * @brief Read temperature from DHT11 sensor
- */
-float readDHTTemperature()
-{
-    float t = dht.readTemperature();
-    static float t_mem;
-    if (isnan(t))
-    {
-        Serial.println("Failed to read temperature from DHT sensor ! Kept the old value");
-        return t_mem;
-    }
-    t_mem = t;
-    Serial.println("Read temperature : " + String(t) + "°C");
-    return t;
-}
-
-/**
- * @brief Read humidity from DHT11 sensor
- */
-float readDHTHumidity()
-{
-    float h = dht.readHumidity();
-    static float h_mem;
-    if (isnan(h))
-    {
-        Serial.println("Failed to read humidity from DHT sensor ! Kept the old value");
-        return h_mem;
-    }
-    h_mem = h;
-    Serial.println("Read humidity : " + String(h) + "°C");
-    return h;
-}
-
-/**
- * @brief Read epoch from NTP server in milliseconds
+ * @brief Read epoch in seconds from the clock kept from NTP, never blocks
  */
 unsigned long readTime()
 {
-    timeClient.update();
-    return timeClient.getEpochTime();
+    return clockService.now();
 }
 
 /**
@@ -79,20 +50,22 @@ unsigned long readTime()
  */
 void addDataToStruct()
 {
-    if (data_size == MAX_DATA)
+    Dht11_reading reading;
+    if (!dhtSampler.read(reading))
     {
-        memmove(data, data + 1, sizeof(data) - sizeof(data[0]));
-        data[MAX_DATA - 1].time        = readTime();
-        data[MAX_DATA - 1].temperature = readDHTTemperature();
-        data[MAX_DATA - 1].humidity    = readDHTHumidity();
+        Serial.println("Failed to read DHT sensor ! Kept the old values");
     }
-    else
+    dhtSampler.print(Serial, reading);
+
+    if (data_size == MAX_DATA)
     {
-        data[data_size].time        = readTime();
-        data[data_size].temperature = readDHTTemperature();
-        data[data_size].humidity    = readDHTHumidity();
-        data_size++;
+        memmove(data, data + 1, sizeof(data) - sizeof(data[0]));
+        data_size--;
     }
+    data[data_size].time        = readTime();
+    data[data_size].temperature = reading.temperature;
+    data[data_size].humidity    = reading.humidity;
+    data_size++;
 }
 
 /**
@@ -109,32 +82,16 @@ String convertStructToString()
     return str;
 }
 
-/**
- * @brief Blink LED 5 times when esp32 is ready
- */
-inline void blinkWhenReady()
-{
-    for (byte i = 0; i < 5; i++)
-    {
-        digitalWrite(LED, HIGH);
-        delay(100);
-        digitalWrite(LED, LOW);
-        delay(100);
-    }
-    digitalWrite(LED, HIGH);
-}
-
 void setup()
 {
     // Initialize variables
     unsigned char attempts  = 0;
-    bool led_on             = false;
     data_size               = 0;
     memset(&data[0], 0, sizeof(data));
 
     // Initialize serial 
     Serial.begin(115200);
-    pinMode(LED, OUTPUT);
+    led.begin(LED);
 
     // Initialize SPIFFS
     if (!SPIFFS.begin(true))
@@ -149,12 +106,11 @@ void setup()
 
     // Connect to Wi-Fi
     WiFi.begin(SSID, PASSWORD);
+    led.play(LedPatterns::blink(0, 2000));
     while (WiFi.status() != WL_CONNECTED)
     {
         delay(1000);
         Serial.println("Connecting to WiFi.. Attempt " + String(++attempts));
-        digitalWrite(LED, led_on);
-        led_on = !led_on;
         if (attempts > 10)
         {
             Serial.println("Failed to connect to WiFi");
@@ -165,10 +121,9 @@ void setup()
     // Print ESP32 Local IP Address
     Serial.println(WiFi.localIP());
 
-    // Initialize NTP client
-    timeClient.begin();
-    timeClient.setTimeOffset(7200);
-    timeClient.setUpdateInterval(2000);
+    // Start syncing the clock with NTP
+    clockService.setOffset(7200);
+    clockService.begin();
 
     // Route for root / web page
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
@@ -204,7 +159,8 @@ void setup()
     server.begin();
 
     // Light the LED when connected
-    blinkWhenReady();
+    led.play(LedPatterns::blink(5));
+    led.play(LedPatterns::on());
 }
 
 void loop()
@@ -1,9 +1,11 @@
 #include "DHT.h"
+#include "Dht11Driver.hpp"
 
 #define DHTPIN  14
 #define DHTTYPE DHT11
 
 DHT dht(DHTPIN, DHTTYPE);
+Sampler<Dht11Driver<DHT> > dhtSampler(dht);
 
 void setup() 
 {
@@ -14,33 +16,20 @@ void setup()
 
 void loop() 
 {
-    // Reading temperature or humidity takes about 250 milliseconds!
-    float h = dht.readHumidity();
+    // Reading temperature and humidity takes about 250 milliseconds!
+    Dht11_reading reading;
 
-    // Read temperature as Celsius (the default)
-    float t = dht.readTemperature();
-
-    // Check if any reads failed and exit early (to try again).
-    if (isnan(h)) 
-    {
-        Serial.println(F("Failed to read humidity from DHT sensor!"));
-        delay(2500);
-        return;
-    }
-    if (isnan(t)) 
+    // Check if any read failed and exit early (to try again).
+    if (!dhtSampler.read(reading)) 
     {
-        Serial.println(F("Failed to read temperature from DHT sensor!"));
+        Serial.println(F("Failed to read from DHT sensor!"));
         delay(2500);
         return;
     }
 
     // Print Results
-    Serial.print(F("Humidity : "));
-    Serial.print(h);
-    Serial.print(F("%  Temperature : "));
-    Serial.print(t);
-    Serial.print(F("°C\n"));
+    dhtSampler.print(Serial, reading);
 
     // Wait a few seconds between measurements.
     delay(3000);
-}
\ No newline at end of file
+}
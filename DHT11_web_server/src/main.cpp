@@ -3,12 +3,14 @@
 #include "ESPAsyncWebServer.h"
 #include "DHT.h"
 #include "CONFIGS.hpp"
+#include "Dht11Driver.hpp"
 
 #define DHTPIN 14
 #define DHTTYPE DHT11
 
 // Create DHT object
 DHT dht(DHTPIN, DHTTYPE);
+Sampler<Dht11Driver<DHT> > dhtSampler(dht);
 
 // Wifi settings
 const char led       = 2;
@@ -18,32 +20,19 @@ const char *password = PASSWORD;
 // Create AsyncWebServer object on port 80
 AsyncWebServer server(80);
 
-String readDHTTemperature()
+/***********************************************************************
+ * @brief Read temperature and humidity from DHT11 sensor in one transfer
+ * @return Read values, the last good ones where the sensor failed
+ ***********************************************************************/
+Dht11_reading readDHT()
 {
-    float t = dht.readTemperature();
-    static float t_mem;
-    if (isnan(t))
+    Dht11_reading reading;
+    if (!dhtSampler.read(reading))
     {
-        Serial.println("Failed to read temperature from DHT sensor ! Kept the old value");
-        return String(t_mem);
+        Serial.println("Failed to read DHT sensor ! Kept the old values");
     }
-    t_mem = t;
-    Serial.println("Read temperature : " + String(t) + "°C");
-    return String(t);
-}
-
-String readDHTHumidity()
-{
-    float h = dht.readHumidity();
-    static float h_mem;
-    if (isnan(h))
-    {
-        Serial.println("Failed to read humidity from DHT sensor ! Kept the old value");
-        return String(h_mem);
-    }
-    h_mem = h;
-    Serial.println("Read humidity : " + String(h) + "°C");
-    return String(h);
+    dhtSampler.print(Serial, reading);
+    return reading;
 }
 
 // Replace placeholder with DHT values
@@ -51,11 +40,12 @@ String processor(const String &var)
 {
     if (var == "TEMPERATURE")
     {
-        return readDHTTemperature();
+        // The page asks for the temperature first, read both values now
+        return String(readDHT().temperature);
     }
     else if (var == "HUMIDITY")
     {
-        return readDHTHumidity();
+        return String(dhtSampler.last().humidity);
     }
     return String("--");
 }
@@ -6,6 +6,7 @@
 #include "esp_camera.h"
 #include "CONFIGS.hpp"
 #include <UniversalTelegramBot.h>
+#include "BotCommands.hpp"
 
 #define FLASH_LED_PIN 4
 
@@ -89,6 +90,49 @@ void configInitCamera()
     s->set_framesize(s, FRAMESIZE_CIF); // UXGA|SXGA|XGA|SVGA|VGA|CIF|QVGA|HQVGA|QQVGA
 }
 
+// What a command handler gets
+struct Command_context
+{
+    String fromName;
+};
+
+void commandStart(Command_context &context, const char *args);
+
+void commandFlash(Command_context &context, const char *args)
+{
+    flashState = !flashState;
+    digitalWrite(FLASH_LED_PIN, flashState);
+    Serial.println("Change flash LED state");
+}
+
+void commandPhoto(Command_context &context, const char *args)
+{
+    sendPhoto = true;
+    Serial.println("New photo request");
+}
+
+// Commands of the bot, sorted by name
+constexpr Bot_command_entry<Command_context> botCommands[] =
+{
+    {"/flash", ": toggles flash LED",  commandFlash},
+    {"/photo", ": takes a new photo",  commandPhoto},
+    {"/start", NULL,                   commandStart},
+};
+static_assert(BotCommands::sorted(botCommands), "botCommands must be sorted by name");
+
+const CommandTable<Command_context, sizeof(botCommands) / sizeof(botCommands[0])> commandTable(botCommands);
+
+// Order of the commands in the welcome message
+const char *const botHelpOrder[] = {"/photo", "/flash"};
+
+void commandStart(Command_context &context, const char *args)
+{
+    String welcome = "Welcome , " + context.fromName + "\n";
+    welcome += "Use the following commands to interact with the ESP32-CAM \n";
+    commandTable.help(welcome, botHelpOrder);
+    bot.sendMessage(CHAT_ID_1, welcome, "");
+}
+
 void handleNewMessages(int numNewMessages)
 {
     Serial.print("Handle New Messages: ");
@@ -107,26 +151,8 @@ void handleNewMessages(int numNewMessages)
         String text = bot.messages[i].text;
         Serial.println(text);
 
-        String from_name = bot.messages[i].from_name;
-        if (text == "/start")
-        {
-            String welcome = "Welcome , " + from_name + "\n";
-            welcome += "Use the following commands to interact with the ESP32-CAM \n";
-            welcome += "/photo : takes a new photo\n";
-            welcome += "/flash : toggles flash LED \n";
-            bot.sendMessage(CHAT_ID_1, welcome, "");
-        }
-        if (text == "/flash")
-        {
-            flashState = !flashState;
-            digitalWrite(FLASH_LED_PIN, flashState);
-            Serial.println("Change flash LED state");
-        }
-        if (text == "/photo")
-        {
-            sendPhoto = true;
-            Serial.println("New photo request");
-        }
+        Command_context context = {bot.messages[i].from_name};
+        commandTable.dispatch(context, text.c_str());
     }
 }
 
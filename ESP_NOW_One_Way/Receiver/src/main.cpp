@@ -2,8 +2,13 @@
 #include <esp_now.h>
 #include <WiFi.h>
 #include "CONFIGS.hpp"
+#include "NodeFrame.hpp"
+#include "PeerStats.hpp"
+#include "SampleBatch.hpp"
+#include "GatewayPairing.hpp"
 
 #define LED                  2
+#define MAX_PEERS            8          // Max number of senders with statistics
 
 // Stores id of the rooms
 enum ID 
@@ -12,25 +17,60 @@ enum ID
     LIVING_ROOM
 };
 
-// Message to receive
-typedef struct  
-{
-    uint8_t id;
-    float temperature;
-    float humidity;
-    float pressure;
-    float altitude;
-    unsigned long time;
-} Message;
+// Loss, duplicates, reordering and round trip of each sender
+PeerTable<MAX_PEERS> peers;
 
 // string to store the message
 const String idToString[] = {"Bedroom", "Living room"};
 
+// Sender looking for a gateway, answered by loop()
+uint8_t       probeFrom[6];
+volatile bool probePending = false;
+
 // callback when data is received
 void OnDataRecv(const uint8_t *mac_addr, const uint8_t *incomingData, int len) 
 {
-    Message message;
-    memcpy(&message, incomingData, sizeof(Message));
+    // Check the frame where it was received, without copying it
+    const Frame_header *header = NULL;
+    const Frame_error   error  = NodeFrame::parse(incomingData, len, header);
+    if (error != FRAME_OK)
+    {
+        Serial.println("Invalid frame, error " + String(error));
+        return;
+    }
+    if (header->type == FRAME_PAIR_PROBE)
+    {
+        if (!probePending)
+        {
+            memcpy(probeFrom, mac_addr, 6);
+            probePending = true;
+        }
+        return;
+    }
+    if (header->node > LIVING_ROOM)
+    {
+        Serial.println("Unexpected node " + String(header->node));
+        return;
+    }
+
+    // No clock here to answer a node with, Home_Bot does. The request still takes
+    // a sequence number of the node, tracked so it is not counted as a lost frame.
+    if (header->type == FRAME_TIME_REQUEST)
+    {
+        peers.track(mac_addr, header->node, header->sequence, header->rtt_us, 0, len);
+        return;
+    }
+    BatchReader reader(header);
+    if (reader.count() == 0)
+    {
+        Serial.println("Unexpected frame of type " + String(header->type));
+        return;
+    }
+    if (peers.track(mac_addr, header->node, header->sequence, header->rtt_us, reader.count(), len) == PEER_DUPLICATE)
+    {
+        Serial.println("Duplicate frame " + String(header->sequence));
+        return;
+    }
 
     Serial.println("====================================");
 
@@ -42,21 +82,44 @@ void OnDataRecv(const uint8_t *mac_addr, const uint8_t *incomingData, int len)
             Serial.print(":");
     }
 
-    Serial.print("\nTime : ");
-    Serial.println(message.time);
-    Serial.print("ID : ");
-    Serial.println(idToString[message.id]);
-    Serial.print("Temperature : ");
-    Serial.print(message.temperature);
-    Serial.println(" °C");
-    Serial.print("Humidity : ");
-    Serial.print(message.humidity);
-    Serial.println(" %");
-    Serial.print("Pressure : ");
-    Serial.print(message.pressure);
-    Serial.println(" hPa");
-    Serial.print("Altitude : ");
-    Serial.println(message.altitude);
+    Serial.print("\nID : ");
+    Serial.println(idToString[header->node]);
+
+    // A batch carries several samples, each with its own time
+    Batch_sample message;
+    while (reader.next(message))
+    {
+        // The node got no time from a gateway, this one has none to date it with either
+        Serial.print("Time : ");
+        if (message.time == FRAME_NO_TIME)
+            Serial.println("unknown, received " + String(millis() / 1000) + " s after boot");
+        else
+            Serial.println(message.time);
+        Serial.print("Temperature : ");
+        Serial.print(message.temperature);
+        Serial.println(" °C");
+        Serial.print("Humidity : ");
+        Serial.print(message.humidity);
+        Serial.println(" %");
+        Serial.print("Pressure : ");
+        Serial.print(message.pressure);
+        Serial.println(" hPa");
+        Serial.print("Altitude : ");
+        Serial.println(message.altitude);
+    }
+
+    for (size_t i = 0; i < peers.count(); i++)
+    {
+        // A node only seen through its time requests sent no sample yet
+        const Peer_stats &peer    = peers.at(i);
+        String            airtime = "none yet";
+        if (peer.samples > 0)
+            airtime = String(peer.airtime_us / peer.samples) + " us";
+        Serial.println(idToString[peer.node] + " : received " + String(peer.received) + ", lost " + String(peer.lost) +
+                       ", duplicates " + String(peer.duplicates) + ", reordered " + String(peer.reordered) +
+                       ", restarts " + String(peer.restarts) + ", rtt " + String(peer.mean_rtt_us) + " us" +
+                       ", airtime per sample " + airtime);
+    }
     Serial.println("====================================");
 }
  
@@ -102,7 +165,38 @@ void setup()
     Serial.println("ESP-NOW Receiver ready on mac address : " + WiFi.macAddress());
 }
  
+/**
+ * @brief Answer a sender looking for a gateway with the address and channel of this one
+ */
+void answerProbe()
+{
+    static Frame_header header = {};
+    uint8_t             frame[FRAME_MAX_SIZE];
+    uint8_t             address[6];
+
+    if (!esp_now_is_peer_exist(probeFrom))
+    {
+        esp_now_peer_info_t peerInfo = {};
+        memcpy(peerInfo.peer_addr, probeFrom, 6);
+        peerInfo.channel = 0;
+        peerInfo.encrypt = false;
+        esp_now_add_peer(&peerInfo);
+    }
+
+    WiFi.macAddress(address);
+    const size_t length = PairingReply::write(frame, sizeof(frame), header, address, WiFi.channel());
+    header.sequence++;
+    esp_now_send(probeFrom, frame, length);
+    probePending = false;
+    Serial.println("Answered a sender looking for a gateway, channel " + String(WiFi.channel()));
+}
+ 
 void loop() 
 {
-    delay(100);
+    // The sender only waits a few ms for the answer
+    if (probePending)
+    {
+        answerProbe();
+    }
+    delay(1);
 }
\ No newline at end of file
@@ -1,19 +1,41 @@
 #include <Arduino.h>
 #include <esp_now.h>
 #include <esp_wifi.h>
+#include <esp_sleep.h>
 #include <WiFi.h>
 #include "CONFIGS.hpp"
-#include "Adafruit_BME280.h"
-#include "NTPClient.h"
-#include "WiFiUdp.h"
+#include <Wire.h>
+#include "Bme280Driver.hpp"
+#include "NodeFrame.hpp"
+#include "SampleBatch.hpp"
+#include "TimeSync.hpp"
+#include "DutyCycle.hpp"
+#include "GatewayPairing.hpp"
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <sys/time.h>
 
 #define LED                  2
 #define SEALEVELPRESSURE_HPA 1014.0F    // Sea level pressure in hPa
 #define TEMPERATURE_OFFSET   -2.0F      // offset to compensate the temperature sensor
 #define MY_ID                BEDROOM    // ID of the room
+#define SAMPLE_DELAY         1000       // Milliseconds between two samples
+#define BATCH_SIZE           10         // Samples sent in one frame, 1 to send each sample on its own
+#define BATCH_DELTA          true       // Delta encode the samples of a batch, fits up to 22 samples in a frame
+#define BATCH_FLUSH_DELAY    15000      // Max milliseconds a sample waits before being sent
+#define DUTY_CYCLE           0          // 0: Always awake, 1: Deep sleep between samples, for nodes on battery
+#define DUTY_PERIOD          60         // Seconds between two wakes
+#define DUTY_SEND_EVERY      10         // Wakes between two sends
+#define DUTY_RESYNC          (DUTY_PERIOD * DUTY_SEND_EVERY)  // Seconds between two time requests, on the wakes that send anyway
+#define ACK_TIMEOUT          50         // Max milliseconds to wait for the ack of a frame
+#define TIME_REPLY_TIMEOUT   20         // Max milliseconds to wait for the time of the gateway
+#define TIME_MAX_AGE         60         // Seconds without beacon before asking the time
+#define TIME_UNSYNCED_AFTER  3          // Time requests failed before the samples are sent with FRAME_NO_TIME
+#define PAIR_REPLY_TIMEOUT   15         // Max milliseconds to wait for the gateway on a channel
+#define PAIR_NAMESPACE       "pairing"  // NVS namespace of the gateway found
 
-// Mac address of the receiver and sender
-constexpr uint8_t receiverAddress[] = {0xC8, 0xF0, 0x9E, 0xA3, 0x52, 0xA8};
+// Broadcast address, for the probes looking for the gateway
+constexpr uint8_t broadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
 // Stores id of the rooms
 enum ID 
@@ -22,211 +44,510 @@ enum ID
     LIVING_ROOM
 };
 
-// Message to send or receive
-typedef struct  
-{
-    uint8_t id;
-    float temperature;
-    float humidity;
-    float pressure;
-    float altitude;
-    unsigned long time;
-} Message;
-Message message;
+// Header of the frames, it keeps the sequence number
+Frame_header header;
+
+// Samples waiting to be sent together
+SampleBatch   batch(BATCH_SIZE, BATCH_DELTA);
+unsigned long batchStartedAt;
+
+// Round trip of the last frame, from esp_now_send() to its ack
+volatile uint32_t sentAt;
+volatile uint32_t lastRtt;
+volatile bool     sendDone;
 
-// Create BME280 object
-Adafruit_BME280 bme;
+// Create BME280 object, one forced measure per sample
+Sampler<Bme280Driver<TwoWire> > bme(Wire, SEALEVELPRESSURE_HPA);
 
-// Define NTP Client to get time
-WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP);
+// Clock kept from the time beacons of the gateway
+TimeClient timeClient;
 
-// Create struct for peer info
-esp_now_peer_info_t peerInfo;
+// Gateway found, kept in RTC memory through deep sleep and in NVS through power cycles
+RTC_DATA_ATTR Pair_state pairState;
+RTC_DATA_ATTR bool       pairLoaded = false;
+
+// Answer to the last pairing probe, copied by the reception callback
+uint8_t         pairReply[FRAME_MAX_SIZE];
+volatile size_t pairLength;
+
+/**
+ * @brief Radio of the node for GatewayPairing
+ */
+class NodeRadio
+{
+    public:
+        size_t exchange(const uint8_t channel, const uint8_t *probe, const size_t length, uint8_t *reply, const size_t size)
+        {
+            const uint32_t start = millis();
+            pairLength           = 0;
+            esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+            if (esp_now_send(broadcastAddress, probe, length) != ESP_OK)
+            {
+                return 0;
+            }
+            while ((pairLength == 0) && (millis() - start < PAIR_REPLY_TIMEOUT))
+            {
+                delay(1);
+            }
+
+            const size_t got = (pairLength <= size) ? pairLength : 0;
+            memcpy(reply, pairReply, got);
+            return got;
+        }
+};
+
+NodeRadio                 radio;
+GatewayPairing<NodeRadio> pairing(radio, pairState);
 
 // callback when data is sent
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) 
 {
+    // The receiver gets the round trip with the next frame, 0 tells it the ack was lost
+    lastRtt  = (status == ESP_NOW_SEND_SUCCESS) ? micros() - sentAt : 0;
+    sendDone = true;
+#if !DUTY_CYCLE
     Serial.print("Last Packet Send Status :\t");
     Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+#endif
 }
 
-float readTemperature()
+// callback when data is received, the gateway sends its time and answers the pairing probes
+void OnDataRecv(const uint8_t *mac_addr, const uint8_t *data, int len)
 {
-    float t = bme.readTemperature();
-    static float t_mem;
-    if (isnan(t))
+    const int64_t       receivedAt = esp_timer_get_time();
+    const Frame_header *frame      = NULL;
+    if (NodeFrame::parse(data, len, frame) != FRAME_OK)
     {
-        Serial.println("Failed to read temperature from BME280 sensor ! Kept the old value");
-        return t_mem + TEMPERATURE_OFFSET;
+        return;
+    }
+    if (frame->type == FRAME_PAIR)
+    {
+        if (pairLength == 0)
+        {
+            memcpy(pairReply, data, len);
+            pairLength = len;
+        }
+        return;
     }
-    t_mem = t;
-    Serial.println("Read temperature : " + String(t + TEMPERATURE_OFFSET) + "°C");
-    return t + TEMPERATURE_OFFSET;
+    timeClient.receive(frame, len, receivedAt);
 }
 
-float readHumidity()
+/**
+ * @brief Add a peer, the gateway or the broadcast address
+ */
+bool addPeer(const uint8_t *mac)
 {
-    float h = bme.readHumidity();
-    static float h_mem;
-    if (isnan(h))
+    if (esp_now_is_peer_exist(mac))
+    {
+        return true;
+    }
+
+    // Channel 0 is the current one, the one of the gateway once found
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, mac, 6);
+    peerInfo.channel = 0;  
+    peerInfo.encrypt = false;
+    if (esp_now_add_peer(&peerInfo) != ESP_OK)
     {
-        Serial.println("Failed to read humidity from BME280 sensor ! Kept the old value");
-        return h_mem;
+        Serial.println("Failed to add peer");
+        return false;
     }
-    h_mem = h;
-    Serial.println("Read humidity : " + String(h) + "°C");
-    return h;
+    return true;
 }
 
-float readPressure()
+/**
+ * @brief Start WiFi without joining any AP, then ESP-NOW
+ */
+bool startEspNow()
 {
-    float p = bme.readPressure() / 100.0F;
-    static float p_mem;
-    if (isnan(p))
+    WiFi.mode(WIFI_STA);
+    if (esp_now_init() != ESP_OK)
+    {
+        Serial.println("Error initializing ESP-NOW");
+        return false;
+    }
+    if (!addPeer(broadcastAddress))
     {
-        Serial.println("Failed to read pressure from BME280 sensor ! Kept the old value");
-        return p_mem;
+        return false;
     }
-    p_mem = p;
-    Serial.println("Read pressure : " + String(p) + "hPa");
-    return p;
+
+    esp_now_register_send_cb(OnDataSent);
+    esp_now_register_recv_cb(OnDataRecv);
+    return true;
 }
 
-float readAltitude()
+/**
+ * @brief Get the gateway found before a power cycle, RTC memory keeps it through deep sleep
+ */
+void loadPairing()
 {
-    float a = bme.readAltitude(SEALEVELPRESSURE_HPA);
-    static float a_mem;
-    if (isnan(a))
+    if (pairLoaded || pairing.paired())
+    {
+        return;
+    }
+
+    Preferences preferences;
+    preferences.begin(PAIR_NAMESPACE, true);
+    if (preferences.getBytes("gateway", &pairState, sizeof(pairState)) != sizeof(pairState))
     {
-        Serial.println("Failed to read altitude from BME280 sensor ! Kept the old value");
-        return a_mem;
+        memset(&pairState, 0, sizeof(pairState));
     }
-    a_mem = a;
-    Serial.println("Read altitude : " + String(a) + "m");
-    return a;
+    // Search at once after a power cycle, the backoff goes on from where it was if it fails
+    pairState.failures = 0;
+    pairState.wait     = 0;
+    pairLoaded         = true;
+    preferences.end();
 }
 
 /**
- * @brief Read epoch from NTP server in milliseconds
+ * @brief Keep the gateway found and the backoff in NVS, only when they changed to spare the flash
+ */
+void savePairing(const Pair_state &previous)
+{
+    if ((previous.magic == pairState.magic) && (previous.channel == pairState.channel) && (memcmp(previous.mac, pairState.mac, 6) == 0) &&
+        (previous.searches == pairState.searches))
+    {
+        return;
+    }
+
+    Preferences preferences;
+    preferences.begin(PAIR_NAMESPACE, false);
+    preferences.putBytes("gateway", &pairState, sizeof(pairState));
+    preferences.end();
+}
+
+/**
+ * @brief Look for the gateway if needed, then send on its channel
+ * @return False if no gateway was ever found
+ */
+bool joinGateway()
+{
+    loadPairing();
+    if (pairing.due())
+    {
+        const Pair_state previous = pairState;
+        const uint32_t   start    = millis();
+        if (pairing.discover(MY_ID))
+        {
+            Serial.println("Gateway found on channel " + String(pairState.channel) + " in " + String(millis() - start) + " ms");
+        }
+        else
+        {
+            Serial.println("No gateway answered, next search in " + String(pairState.wait + 1) + " tries");
+        }
+        savePairing(previous);
+    }
+    if (!pairing.paired())
+    {
+        return false;
+    }
+
+    esp_wifi_set_channel(pairState.channel, WIFI_SECOND_CHAN_NONE);
+    return addPeer(pairState.mac);
+}
+
+/**
+ * @brief Send a frame to the gateway and wait for its ack, a few ms
+ * @return False if it was not acked, the gateway is looked for again after a few
+ */
+bool sendFrame(const uint8_t *frame, const size_t length)
+{
+    lastRtt  = 0;
+    sendDone = false;
+    sentAt   = micros();
+    if (esp_now_send(pairState.mac, frame, length) != ESP_OK)
+    {
+        pairing.sent(false);
+        return false;
+    }
+    while (!sendDone && (micros() - sentAt < ACK_TIMEOUT * 1000))
+    {
+        delay(1);
+    }
+    pairing.sent(lastRtt != 0);
+    return lastRtt != 0;
+}
+
+/**
+ * @brief Ask the gateway its time and wait for the answer, a few ms
+ * @param request Header of the request, its sequence number is the next one of the node
+ * @return False if the gateway did not answer in TIME_REPLY_TIMEOUT
+ */
+bool requestTime(const Frame_header &request)
+{
+    uint8_t        frame[FRAME_MAX_SIZE];
+    const uint32_t syncs  = timeClient.health().syncs;
+    const uint32_t start  = millis();
+    const size_t   length = timeClient.request(frame, sizeof(frame), request, esp_timer_get_time());
+    if (sendFrame(frame, length))
+    {
+        while ((timeClient.health().syncs == syncs) && (millis() - start < TIME_REPLY_TIMEOUT))
+        {
+            delay(1);
+        }
+    }
+    if (timeClient.health().syncs == syncs)
+    {
+        timeClient.failed();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read epoch in seconds from the clock kept from the gateway, never blocks
  */
 unsigned long readTime()
 {
-    timeClient.update();
-    return timeClient.getEpochTime();
+    return timeClient.epochUs(esp_timer_get_time()) / 1000000;
 }
 
 /**
- * @brief Read temperature and humidity from BME280 sensor
+ * @brief Read temperature, humidity, pressure and altitude from one BME280 measure
  */
-void updateData()
+Batch_sample updateData()
 {
-    // Read temperature, humidity, pressure and altitude from BME280 sensor
-    message.temperature = readTemperature();
-    message.humidity    = readHumidity();
-    message.pressure    = readPressure();
-    message.altitude    = readAltitude();
-    message.time        = readTime();
+    Bme280_reading reading;
+    Batch_sample   sample;
+    if (!bme.read(reading))
+    {
+        Serial.println("Failed to read BME280 sensor ! Kept the old values");
+    }
 
+    sample.temperature = reading.temperature + TEMPERATURE_OFFSET;
+    sample.humidity    = reading.humidity;
+    sample.pressure    = reading.pressure;
+    sample.altitude    = reading.altitude;
+    sample.time        = readTime();
+
+    bme.print(Serial, reading);
     Serial.println("Data updated");
+    return sample;
 }
 
 /**
- * @brief Send data to receiver
+ * @brief Send the samples waiting to the gateway, in one frame
  */ 
 void sendData()
 {
-    // Send message via ESP-NOW
-    esp_err_t result = esp_now_send(receiverAddress, (uint8_t *) &message, sizeof(message));
-    if (result == ESP_OK)
+    uint8_t frame[FRAME_MAX_SIZE];
+    header.rtt_us       = lastRtt;
+    const size_t length = batch.write(frame, sizeof(frame), header);
+    const size_t count  = batch.count();
+    batch.clear();
+
+    // Send message via ESP-NOW, a lost frame shows as a gap in the sequence numbers
+    const bool acked = sendFrame(frame, length);
+    header.sequence++;
+    if (acked)
     {
-        Serial.println("Data sent successfully");
+        Serial.println("Data sent successfully, " + String(count) + " sample(s), airtime per sample " + String(NodeFrame::airtimeUs(length) / count) + " us");
     }
     else
     {
-        Serial.println("Error sending the data : " + String(result));
+        Serial.println("Error sending the data, not acked by the gateway");
     }
 }
  
-void setup() 
+#if DUTY_CYCLE
+// Kept in RTC memory through deep sleep, cleared on a cold boot
+RTC_DATA_ATTR Duty_state dutyState;
+
+/**
+ * @brief Board of the node for DutyCycle
+ *
+ * The radio only starts on the wakes that ask the time or send, and
+ * nothing is printed on the others: every ms awake counts on a battery.
+ */
+class NodeBoard
 {
-    // Initialize variables
-    unsigned char attempts  = 0;
-    bool led_on             = false;
-    message.id              = MY_ID;
+    public:
+        NodeBoard() : _radio(false) {}
 
+        /**
+         * @brief Time of the RTC timer, the system time keeps counting in deep sleep
+         */
+        int64_t clockUs()
+        {
+            timeval now;
+            gettimeofday(&now, NULL);
+            return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+        }
+
+        uint32_t awakeUs()
+        {
+            return micros();
+        }
+
+        bool syncTime(const Frame_header &request, int64_t &epochUs)
+        {
+            if ((!_radio && !startRadio()) || !requestTime(request))
+            {
+                return false;
+            }
+            epochUs = timeClient.epochUs(esp_timer_get_time());
+            return true;
+        }
+
+        bool measure(Batch_sample &sample)
+        {
+            Bme280_reading reading;
+            if (!bme.read(reading))
+            {
+                return false;
+            }
+            sample.temperature = reading.temperature + TEMPERATURE_OFFSET;
+            sample.humidity    = reading.humidity;
+            sample.pressure    = reading.pressure;
+            sample.altitude    = reading.altitude;
+            return true;
+        }
+
+        /**
+         * @brief Send a frame and wait for its ack, a few ms
+         */
+        bool send(const uint8_t *frame, const size_t length, uint32_t &rttUs)
+        {
+            if ((!_radio && !startRadio()) || !sendFrame(frame, length))
+            {
+                return false;
+            }
+            rttUs = lastRtt;
+            return true;
+        }
+
+        void sleep(const uint64_t us)
+        {
+            Serial.flush();
+            esp_sleep_enable_timer_wakeup(us);
+            esp_deep_sleep_start();
+        }
+
+    private:
+        bool startRadio()
+        {
+            _radio = startEspNow() && joinGateway();
+            return _radio;
+        }
+
+        bool _radio;
+};
+
+/**
+ * @brief Take one sample, send the samples every DUTY_SEND_EVERY wakes, then deep sleep
+ */
+void runDutyCycle()
+{
+    const Duty_config    config = {MY_ID, DUTY_PERIOD, DUTY_SEND_EVERY, SampleBatch::MAX_DELTA, BATCH_DELTA, DUTY_RESYNC};
+    NodeBoard            board;
+    DutyCycle<NodeBoard> cycle(board, dutyState, config);
+
+    if (cycle.wake())
+    {
+        const Duty_state &state = cycle.state();
+        Serial.println("Wake " + String(state.wakes) + ", frames acked " + String(state.frames) + ", failed " + String(state.failed_sends) +
+                       ", dropped " + String(state.dropped) + ", awake last " + String(state.last_awake_us) + " us, max " + String(state.max_awake_us) + " us");
+    }
+    cycle.sleep();
+}
+#endif
+
+void setup() 
+{
     // Init Serial Monitor
     Serial.begin(115200);
 
-    // Initialize LED
-    pinMode(LED, OUTPUT);
-    digitalWrite(LED, led_on);
-
     // Init bme280 sensor
     if (!bme.begin(0x76))
     {
         Serial.println("Could not find a valid BME280 sensor, check wiring!");
+#if !DUTY_CYCLE
         ESP.restart();
+#endif
     }
 
-    // Set device in STA mode to begin with
-    WiFi.mode(WIFI_AP_STA);
-    WiFi.begin(WIFI_SSID, PASSWORD);
-    while (WiFi.status() != WL_CONNECTED)
-    {
-        delay(1000);
-        Serial.println("Connecting to WiFi.. Attempt " + String(++attempts));
-        digitalWrite(LED, led_on);
-        led_on = !led_on;
-        if (attempts > 10)
-        {
-            Serial.println("Failed to connect to WiFi");
-            delay(2000);
-            ESP.restart();
-        }
-    }
-    led_on = false;
-    digitalWrite(LED, led_on);
-    Serial.println(WiFi.localIP());
+#if DUTY_CYCLE
+    // Shorter I2C transfers, then sleep again, loop() is never reached
+    Wire.setClock(400000);
+    runDutyCycle();
+#else
+    // Initialize variables
+    memset(&header, 0, sizeof(header));
+    header.node             = MY_ID;
+    lastRtt                 = 0;
+    batchStartedAt          = 0;
 
-    // Initialize NTP client
-    timeClient.begin();
-    timeClient.setUpdateInterval(1000);
-    
-    // Init ESP-NOW
-    if (esp_now_init() != ESP_OK)
+    // Initialize LED
+    pinMode(LED, OUTPUT);
+    digitalWrite(LED, LOW);
+
+    // Init ESP-NOW, no AP to join, the gateway gives the time
+    if (!startEspNow())
     {
-        Serial.println("Error initializing ESP-NOW");
         delay(2000);
         ESP.restart();
     }
-
-    // Register peer
-    memcpy(peerInfo.peer_addr, receiverAddress, 6);
-    peerInfo.channel = 0;  
-    peerInfo.encrypt = false;
-    
-    // Add peer        
-    if (esp_now_add_peer(&peerInfo) != ESP_OK)
+    if (joinGateway() && requestTime(header))
     {
-        Serial.println("Failed to add peer");
-        delay(2000);
-        ESP.restart();
+        Serial.println("Time from the gateway after " + String(millis()) + " ms");
     }
-
-    esp_now_register_send_cb(OnDataSent);
+    else
+    {
+        Serial.println("No time from the gateway yet, samples are dated by the gateway if it never gives it");
+    }
+    header.sequence++;
 
     Serial.println(F("Sender ready"));
+#endif
 }
  
 void loop() 
 {
-    // Update data
-    updateData();
+    // Look for the gateway again once it stopped acking, it may have changed channel,
+    // less and less often while it does not answer
+    if (pairing.due())
+    {
+        joinGateway();
+    }
+
+    // Beacons keep the clock, ask the time if they stopped coming, less and less often while it is not answered
+    if (timeClient.due(esp_timer_get_time(), TIME_MAX_AGE))
+    {
+        requestTime(header);
+        header.sequence++;
+    }
+
+    // Update data, a sample that does not fit starts the next batch
+    Batch_sample sample = updateData();
+    if (!timeClient.synced())
+    {
+        // Its time counts from boot, the gateway would store it in 1970
+        if (timeClient.failures() < TIME_UNSYNCED_AFTER)
+        {
+            Serial.println("No time from the gateway yet, sample not sent");
+            delay(SAMPLE_DELAY);
+            return;
+        }
+
+        // The gateway never gives the time, like the Receiver: it dates the sample on receipt
+        sample.time = FRAME_NO_TIME;
+    }
+    if (!batch.add(sample))
+    {
+        sendData();
+        batch.add(sample);
+    }
+    if (batch.count() == 1)
+    {
+        batchStartedAt = millis();
+    }
 
-    // Send data
-    sendData();
+    // Send data once the frame is full or the oldest sample waited long enough
+    if (batch.full() || (millis() - batchStartedAt >= BATCH_FLUSH_DELAY))
+    {
+        sendData();
+    }
 
-    // Wait 1 seconds
-    delay(1000);
+    // Wait for the next sample
+    delay(SAMPLE_DELAY);
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/***********************************************************************
+ * Host stand-in of the Arduino core for the tests of the node. Time is
+ * simulated: it only moves when a test or delay() moves it, so measures
+ * and sleeps last exactly what they should and cost nothing.
+ ***********************************************************************/
+
+/***********************************************************************
+ * @brief Simulated time since boot in µs, tests may set it
+ ***********************************************************************/
+inline int64_t &simulatedMicros()
+{
+    static int64_t us = 0;
+    return us;
+}
+
+inline uint32_t micros()
+{
+    return (uint32_t)simulatedMicros();
+}
+
+inline uint32_t millis()
+{
+    return (uint32_t)(simulatedMicros() / 1000);
+}
+
+inline void delay(const uint32_t ms)
+{
+    simulatedMicros() += (int64_t)ms * 1000;
+}
+
+inline void delayMicroseconds(const uint32_t us)
+{
+    simulatedMicros() += us;
+}
+
+#endif
@@ -0,0 +1,235 @@
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "DutyCycle.hpp"
+#include "SimulatedNode.hpp"
+
+#define PERIOD_S                60         // DUTY_PERIOD
+#define SEND_EVERY              10         // DUTY_SEND_EVERY
+#define RESYNC_S                (PERIOD_S * SEND_EVERY)
+
+static const Duty_config config = {3, PERIOD_S, SEND_EVERY, 22, true, RESYNC_S};
+
+/***********************************************************************
+ * @brief What the gateway got from the node
+ ***********************************************************************/
+class Gateway
+{
+    public:
+        explicit Gateway(const SimulatedNode &node) : _read(node.sends) {}
+
+        std::vector<Batch_sample> samples;
+        std::vector<int64_t>      taken;        // Real epoch in µs of each sample taken by the node
+        std::vector<uint16_t>     sequences;    // Of the frames acked and of the time requests
+
+        /***********************************************************************
+         * @brief Read the frames sent since the last call, acked or not
+         ***********************************************************************/
+        void receive(const SimulatedNode &node, const bool acked)
+        {
+            for (uint32_t idx = node.sends - _read; idx > 0; idx--)
+            {
+                size_t              length = 0;
+                const uint8_t      *data   = node.frame(idx - 1, length);
+                const Frame_header *header = NULL;
+                TEST_ASSERT_NOT_NULL(data);
+                TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(data, length, header));
+                if(acked == false)
+                {
+                    continue;
+                }
+
+                BatchReader  reader(header);
+                Batch_sample sample;
+                TEST_ASSERT_GREATER_THAN_size_t(0, reader.count());
+                while(reader.next(sample))
+                {
+                    samples.push_back(sample);
+                }
+                sequences.push_back(header->sequence);
+            }
+            _read = node.sends;
+        }
+
+    private:
+        uint32_t _read;             // Frames already read
+};
+
+/***********************************************************************
+ * @brief Run wakes of the node, one boot each, like the deep sleep does
+ ***********************************************************************/
+static void runWakes(SimulatedNode &node, Duty_state &state, Gateway &gateway, const uint32_t wakes)
+{
+    for (uint32_t i = 0; i < wakes; i++)
+    {
+        const uint32_t syncs = node.syncs;
+        const int64_t  start = node.realEpochUs();
+        DutyCycle<SimulatedNode> cycle(node, state, config);
+        cycle.wake();
+
+        // The sample is taken after the sync, if any
+        const bool synced = (node.syncs != syncs);
+        gateway.taken.push_back(start + (synced ? node.sync_us : 0) + node.measure_us);
+        if(synced == true)
+        {
+            gateway.sequences.push_back(node.sync_sequence);
+        }
+        gateway.receive(node, node.send_answer);
+        cycle.sleep();
+    }
+}
+
+/***********************************************************************
+ * @brief Check the time of each sample received against the real time it was taken at
+ ***********************************************************************/
+static void checkTimes(const Gateway &gateway)
+{
+    for (size_t i = 0; i < gateway.samples.size(); i++)
+    {
+        TEST_ASSERT_INT64_WITHIN(1, gateway.taken[i] / 1000000, (int64_t)gateway.samples[i].time);
+    }
+}
+
+static Duty_state state;
+
+void setUp()
+{
+    memset(&state, 0, sizeof(state));
+}
+
+void tearDown() {}
+
+void test_duty_cycle()
+{
+    SimulatedNode node;
+    Gateway       gateway(node);
+
+    // 100 wakes: one frame of 10 samples every 10 wakes, one sync every 10 minutes
+    runWakes(node, state, gateway, 100);
+    TEST_ASSERT_EQUAL_UINT32(10, node.sends);
+    TEST_ASSERT_EQUAL_UINT32(10, node.syncs);
+    TEST_ASSERT_EQUAL_size_t(100, gateway.samples.size());
+    TEST_ASSERT_EQUAL_UINT32(0, state.count);
+    TEST_ASSERT_EQUAL_UINT32(0, state.dropped);
+    checkTimes(gateway);
+
+    // Frames and time requests share the sequence numbers, without gap
+    for (size_t i = 0; i < gateway.sequences.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(i, gateway.sequences[i]);
+    }
+
+    // The period does not slip with the time awake, wakes stay one boot after the first one
+    TEST_ASSERT_EQUAL_INT64(100LL * PERIOD_S * 1000000 + 2 * node.boot_us, node.now_us);
+
+    const double awake = (double)state.awake_us / node.now_us;
+    char         line[128];
+    snprintf(line, sizeof(line), "awake %.3f %% of the time, %u us per wake on average, %u us at most",
+             awake * 100, (unsigned)(state.awake_us / state.wakes), (unsigned)state.max_awake_us);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN_UINT32(node.boot_us + node.measure_us + node.sync_us + node.send_us + 1, state.max_awake_us);
+}
+
+void test_clock_drift()
+{
+    SimulatedNode node;
+    Gateway       gateway(node);
+
+    // 200 ppm is 0.12 s per period, the syncs keep the samples within the second
+    node.drift_ppm = 200;
+    runWakes(node, state, gateway, 200);
+    TEST_ASSERT_EQUAL_size_t(200, gateway.samples.size());
+    checkTimes(gateway);
+}
+
+void test_gateway_off()
+{
+    SimulatedNode node;
+    Gateway       gateway(node);
+
+    // Samples wait while the gateway does not ack, then leave in full batches
+    runWakes(node, state, gateway, 10);
+    node.send_answer = false;
+    runWakes(node, state, gateway, 30);
+    TEST_ASSERT_EQUAL_UINT32(30, state.count);
+    TEST_ASSERT_EQUAL_UINT32(3, state.failed_sends);
+    TEST_ASSERT_EQUAL_UINT32(0, state.last_rtt_us);
+
+    node.send_answer = true;
+    const uint32_t sends = node.sends;
+    runWakes(node, state, gateway, 10);
+    TEST_ASSERT_EQUAL_UINT32(2, node.sends - sends);
+    TEST_ASSERT_EQUAL_size_t(50, gateway.samples.size());
+    TEST_ASSERT_EQUAL_UINT32(0, state.count);
+    checkTimes(gateway);
+
+    // Off for longer than the buffer holds: the oldest samples are dropped
+    node.send_answer = false;
+    runWakes(node, state, gateway, 60);
+    TEST_ASSERT_EQUAL_UINT32(DUTY_MAX_SAMPLES, state.count);
+    TEST_ASSERT_EQUAL_UINT32(60 - DUTY_MAX_SAMPLES, state.dropped);
+}
+
+void test_samples_before_the_first_sync()
+{
+    SimulatedNode node;
+    Gateway       gateway(node);
+
+    // No time yet: nothing is sent, the samples are kept
+    node.sync_answer = false;
+    runWakes(node, state, gateway, 19);
+    TEST_ASSERT_FALSE(state.synced);
+    TEST_ASSERT_EQUAL_UINT32(DUTY_UNSYNCED_AFTER - 1, state.failed_syncs);
+    TEST_ASSERT_EQUAL_UINT32(0, node.sends);
+    TEST_ASSERT_EQUAL_UINT32(19, state.count);
+
+    // A gateway that never gives the time, like the Receiver: they leave undated
+    runWakes(node, state, gateway, 1);
+    TEST_ASSERT_EQUAL_UINT32(DUTY_UNSYNCED_AFTER, state.failed_syncs);
+    TEST_ASSERT_EQUAL_UINT32(1, node.sends);
+    TEST_ASSERT_EQUAL_UINT32(0, state.count);
+    TEST_ASSERT_EQUAL_size_t(20, gateway.samples.size());
+    for (size_t i = 0; i < gateway.samples.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(FRAME_NO_TIME, gateway.samples[i].time);
+    }
+
+    // Once the gateway answers, the next ones leave dated like the others
+    node.sync_answer = true;
+    runWakes(node, state, gateway, 10);
+    TEST_ASSERT_TRUE(state.synced);
+    TEST_ASSERT_EQUAL_size_t(30, gateway.samples.size());
+    for (size_t i = 20; i < gateway.samples.size(); i++)
+    {
+        TEST_ASSERT_INT64_WITHIN(1, gateway.taken[i] / 1000000, (int64_t)gateway.samples[i].time);
+    }
+}
+
+void test_cold_boot()
+{
+    SimulatedNode node;
+    Gateway       gateway(node);
+    runWakes(node, state, gateway, 15);
+    TEST_ASSERT_EQUAL_UINT32(5, state.count);
+
+    // RTC memory lost: the state starts over, the samples kept are gone
+    memset(&state, 0, sizeof(state));
+    node.powerOn();
+    node.epoch_us += 15LL * PERIOD_S * 1000000;
+    Gateway after(node);
+    runWakes(node, state, after, 10);
+    TEST_ASSERT_EQUAL_UINT32(10, state.wakes);
+    TEST_ASSERT_EQUAL_size_t(10, after.samples.size());
+    checkTimes(after);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_duty_cycle);
+    RUN_TEST(test_clock_drift);
+    RUN_TEST(test_gateway_off);
+    RUN_TEST(test_samples_before_the_first_sync);
+    RUN_TEST(test_cold_boot);
+    return UNITY_END();
+}
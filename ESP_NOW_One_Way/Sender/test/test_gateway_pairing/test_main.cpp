@@ -0,0 +1,163 @@
+#include <unity.h>
+#include "GatewayPairing.hpp"
+#include "SimulatedGateway.hpp"
+
+#define NODE_ID                 3
+#define CHANCES                 200        // Chances to send while the gateway is off
+
+static Pair_state state;
+
+/***********************************************************************
+ * @brief Count the chances to send until the pairing is due again
+ * @return Chances, the one the search is due at included
+ ***********************************************************************/
+static uint32_t chancesUntilDue(GatewayPairing<SimulatedGateway> &pairing)
+{
+    for (uint32_t chances = 1; chances <= CHANCES; chances++)
+    {
+        if(pairing.due())
+        {
+            return chances;
+        }
+    }
+    return 0;
+}
+
+void setUp()
+{
+    memset(&state, 0, sizeof(state));
+}
+
+void tearDown() {}
+
+void test_channel_hop()
+{
+    SimulatedGateway                 gateway;
+    GatewayPairing<SimulatedGateway> pairing(gateway, state);
+    TEST_ASSERT_FALSE(pairing.paired());
+    TEST_ASSERT_TRUE(pairing.due());
+
+    // Nothing known: channels 1 to 5 time out, 6 answers
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+    TEST_ASSERT_TRUE(pairing.paired());
+    TEST_ASSERT_FALSE(pairing.due());
+    TEST_ASSERT_EQUAL_UINT8(6, state.channel);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(gateway.mac, state.mac, 6);
+    TEST_ASSERT_EQUAL_UINT32(6, gateway.probes);
+    TEST_ASSERT_EQUAL_UINT32(5 * gateway.timeout_ms + gateway.answer_ms, gateway.waited_ms);
+    TEST_ASSERT_EQUAL_UINT8(NODE_ID, gateway.last_node);
+}
+
+void test_known_channel_first()
+{
+    SimulatedGateway                 gateway;
+    GatewayPairing<SimulatedGateway> pairing(gateway, state);
+    gateway.channel = 11;
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+
+    // Probed first, one answer timeout at most
+    gateway.probes = 0;
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+    TEST_ASSERT_EQUAL_UINT32(1, gateway.probes);
+
+    // Moved to channel 3: 11 first, then 1 to 3
+    gateway.channel = 3;
+    gateway.probes  = 0;
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+    TEST_ASSERT_EQUAL_UINT8(3, state.channel);
+    TEST_ASSERT_EQUAL_UINT32(4, gateway.probes);
+}
+
+void test_pair_again_after_failures()
+{
+    SimulatedGateway                 gateway;
+    GatewayPairing<SimulatedGateway> pairing(gateway, state);
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+
+    // One ack between the failures, they start over
+    for (uint8_t i = 1; i < PAIR_MAX_FAILURES; i++)
+    {
+        pairing.sent(false);
+    }
+    pairing.sent(true);
+    TEST_ASSERT_FALSE(pairing.due());
+    for (uint8_t i = 1; i < PAIR_MAX_FAILURES; i++)
+    {
+        pairing.sent(false);
+        TEST_ASSERT_FALSE(pairing.due());
+    }
+
+    // The gateway moved, found again on its new channel
+    gateway.channel = 9;
+    pairing.sent(false);
+    TEST_ASSERT_TRUE(pairing.due());
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+    TEST_ASSERT_EQUAL_UINT8(9, state.channel);
+    TEST_ASSERT_EQUAL_UINT8(0, state.failures);
+    TEST_ASSERT_FALSE(pairing.due());
+}
+
+void test_backoff_while_the_gateway_is_off()
+{
+    SimulatedGateway                 gateway;
+    GatewayPairing<SimulatedGateway> pairing(gateway, state);
+
+    // Each search fails after a full scan, the next one comes twice as late
+    gateway.answer    = false;
+    uint32_t chances  = 0;
+    uint32_t searches = 0;
+    for (uint32_t every = 1; chances + every <= CHANCES; every = (every < (1U << PAIR_MAX_BACKOFF)) ? every * 2 : every)
+    {
+        TEST_ASSERT_EQUAL_UINT32(every, chancesUntilDue(pairing));
+        TEST_ASSERT_FALSE(pairing.discover(NODE_ID));
+        TEST_ASSERT_FALSE(pairing.paired());
+        chances += every;
+        searches++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(searches * PAIR_CHANNELS, gateway.probes);
+    TEST_ASSERT_EQUAL_UINT8(PAIR_MAX_BACKOFF, state.searches);
+
+    // Back on, found at the next search, which ends the backoff
+    gateway.answer = true;
+    TEST_ASSERT_EQUAL_UINT32(1U << PAIR_MAX_BACKOFF, chancesUntilDue(pairing));
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+    TEST_ASSERT_EQUAL_UINT8(0, state.searches);
+    TEST_ASSERT_EQUAL_UINT8(0, state.wait);
+}
+
+void test_ack_ends_the_backoff()
+{
+    SimulatedGateway                 gateway;
+    GatewayPairing<SimulatedGateway> pairing(gateway, state);
+    TEST_ASSERT_TRUE(pairing.discover(NODE_ID));
+
+    // Off for a while: the old pairing is kept, searched less and less often
+    gateway.answer = false;
+    for (uint8_t i = 0; i < PAIR_MAX_FAILURES; i++)
+    {
+        pairing.sent(false);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, chancesUntilDue(pairing));
+    TEST_ASSERT_FALSE(pairing.discover(NODE_ID));
+    TEST_ASSERT_FALSE(pairing.discover(NODE_ID));
+    TEST_ASSERT_TRUE(pairing.paired());
+    TEST_ASSERT_FALSE(pairing.due());
+
+    // Back on the same channel, the frames sent meanwhile are acked again
+    gateway.answer = true;
+    pairing.sent(true);
+    TEST_ASSERT_EQUAL_UINT8(0, state.searches);
+    TEST_ASSERT_EQUAL_UINT8(0, state.wait);
+    TEST_ASSERT_FALSE(pairing.due());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_channel_hop);
+    RUN_TEST(test_known_channel_first);
+    RUN_TEST(test_pair_again_after_failures);
+    RUN_TEST(test_backoff_while_the_gateway_is_off);
+    RUN_TEST(test_ack_ends_the_backoff);
+    return UNITY_END();
+}
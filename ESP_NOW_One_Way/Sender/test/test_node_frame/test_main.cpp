@@ -0,0 +1,282 @@
+#include <unity.h>
+#include "NodeFrame.hpp"
+#include "PeerStats.hpp"
+
+#define FRAME_OVERHEAD          (sizeof(Frame_header) + FRAME_CRC_SIZE)
+
+static const uint8_t macA[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x01};
+static const uint8_t macB[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x02};
+static const uint8_t macC[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x03};
+
+/***********************************************************************
+ * @brief Build a FRAME_BME280 frame
+ * @return Size of the frame
+ ***********************************************************************/
+static size_t sampleFrame(uint8_t *buffer, const uint16_t sequence)
+{
+    Frame_header   header  = {0, 0, FRAME_BME280, 3, 0, sequence, 1700000000, 1500};
+    Payload_bme280 payload = {21.5F, 48.0F, 1008.25F, 52.5F};
+    return NodeFrame::write(buffer, FRAME_MAX_SIZE, header, payload);
+}
+
+static Frame_error parse(const uint8_t *data, const size_t len)
+{
+    const Frame_header *header = NULL;
+    return NodeFrame::parse(data, len, header);
+}
+
+/***********************************************************************
+ * @brief Track a frame of one sample, of any size
+ ***********************************************************************/
+static Peer_verdict track(PeerTracker &peer, const uint16_t sequence)
+{
+    return peer.track(3, sequence, 0, 1, 40);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip()
+{
+    uint8_t             buffer[FRAME_MAX_SIZE];
+    const Frame_header *header = NULL;
+    const size_t        length = sampleFrame(buffer, 513);
+    TEST_ASSERT_EQUAL_size_t(FRAME_OVERHEAD + sizeof(Payload_bme280), length);
+
+    // Header as written, magic, version and length set by write()
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(buffer, length, header));
+    TEST_ASSERT_TRUE(header == (const Frame_header *)buffer);
+    TEST_ASSERT_EQUAL_UINT16(FRAME_MAGIC, header->magic);
+    TEST_ASSERT_EQUAL_UINT8(FRAME_VERSION, header->version);
+    TEST_ASSERT_EQUAL_UINT8(FRAME_BME280, header->type);
+    TEST_ASSERT_EQUAL_UINT8(3, header->node);
+    TEST_ASSERT_EQUAL_UINT8(sizeof(Payload_bme280), header->length);
+    TEST_ASSERT_EQUAL_UINT16(513, header->sequence);
+    TEST_ASSERT_EQUAL_UINT32(1700000000, header->timestamp);
+    TEST_ASSERT_EQUAL_UINT32(1500, header->rtt_us);
+
+    // Little-endian on the air, whatever the host
+    TEST_ASSERT_EQUAL_UINT8(0x48, buffer[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x4E, buffer[1]);
+    TEST_ASSERT_EQUAL_UINT8(0x01, buffer[6]);
+    TEST_ASSERT_EQUAL_UINT8(0x02, buffer[7]);
+
+    // Payload in place, only with its own size
+    const Payload_bme280 *sample = NodeFrame::payload<Payload_bme280>(header);
+    TEST_ASSERT_NOT_NULL(sample);
+    TEST_ASSERT_EQUAL_FLOAT(21.5F, sample->temperature);
+    TEST_ASSERT_EQUAL_FLOAT(1008.25F, sample->pressure);
+    TEST_ASSERT_NULL(NodeFrame::payload<Payload_time>(header));
+
+    // Frames without payload
+    Frame_header request = {0, 0, FRAME_TIME_REQUEST, 3, 0, 7, 0, 0};
+    const size_t empty   = NodeFrame::write(buffer, sizeof(buffer), request, NULL, 0);
+    TEST_ASSERT_EQUAL_size_t(FRAME_OVERHEAD, empty);
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(buffer, empty, header));
+    TEST_ASSERT_EQUAL_UINT8(0, header->length);
+}
+
+void test_size_limits()
+{
+    uint8_t      buffer[FRAME_MAX_SIZE + 1];
+    uint8_t      payload[FRAME_MAX_SIZE] = {0};
+    Frame_header header                  = {0, 0, FRAME_BME280_BATCH, 3, 0, 0, 0, 0};
+
+    // The largest payload of an ESP-NOW frame, not one byte more
+    const size_t largest = FRAME_MAX_SIZE - FRAME_OVERHEAD;
+    TEST_ASSERT_EQUAL_size_t(FRAME_MAX_SIZE, NodeFrame::write(buffer, sizeof(buffer), header, payload, largest));
+    TEST_ASSERT_EQUAL(FRAME_OK, parse(buffer, FRAME_MAX_SIZE));
+    TEST_ASSERT_EQUAL_size_t(0, NodeFrame::write(buffer, sizeof(buffer), header, payload, largest + 1));
+
+    // Nor more than the buffer
+    TEST_ASSERT_EQUAL_size_t(0, NodeFrame::write(buffer, FRAME_OVERHEAD + 9, header, payload, 10));
+    TEST_ASSERT_EQUAL_size_t(FRAME_OVERHEAD + 10, NodeFrame::write(buffer, FRAME_OVERHEAD + 10, header, payload, 10));
+}
+
+void test_rejected_frames()
+{
+    uint8_t      buffer[FRAME_MAX_SIZE];
+    uint8_t      bad[FRAME_MAX_SIZE];
+    const size_t length = sampleFrame(buffer, 1);
+
+    memcpy(bad, buffer, length);
+    bad[1] = 0x4F;
+    TEST_ASSERT_EQUAL(FRAME_BAD_MAGIC, parse(bad, length));
+
+    memcpy(bad, buffer, length);
+    bad[2] = FRAME_VERSION + 1;
+    TEST_ASSERT_EQUAL(FRAME_BAD_VERSION, parse(bad, length));
+
+    // The length of the header against the size received
+    memcpy(bad, buffer, length);
+    bad[5]++;
+    TEST_ASSERT_EQUAL(FRAME_BAD_LENGTH, parse(bad, length));
+    TEST_ASSERT_EQUAL(FRAME_BAD_LENGTH, parse(buffer, length + 1));
+
+    // Any bit flipped in the header or the payload, or in the CRC itself
+    for (size_t i = 0; i < length; i++)
+    {
+        if((i < 3) || (i == 5))
+        {
+            continue;
+        }
+        memcpy(bad, buffer, length);
+        bad[i] ^= 0x10;
+        TEST_ASSERT_EQUAL(FRAME_BAD_CRC, parse(bad, length));
+    }
+}
+
+void test_truncated_frames()
+{
+    uint8_t      buffer[FRAME_MAX_SIZE];
+    const size_t length = sampleFrame(buffer, 1);
+
+    TEST_ASSERT_EQUAL(FRAME_TOO_SHORT, parse(NULL, length));
+    for (size_t len = 0; len < length; len++)
+    {
+        TEST_ASSERT_EQUAL((len < FRAME_OVERHEAD) ? FRAME_TOO_SHORT : FRAME_BAD_LENGTH, parse(buffer, len));
+    }
+}
+
+void test_crc_and_airtime()
+{
+    // Check value of CRC-16/CCITT-FALSE
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, NodeFrame::crc16((const uint8_t *)"123456789", 9));
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, NodeFrame::crc16(NULL, 0));
+
+    TEST_ASSERT_EQUAL_UINT32(FRAME_AIR_OVERHEAD_US + FRAME_AIR_HEADER_SIZE * FRAME_AIR_BYTE_US, NodeFrame::airtimeUs(0));
+    TEST_ASSERT_EQUAL_UINT32(NodeFrame::airtimeUs(0) + FRAME_MAX_SIZE * FRAME_AIR_BYTE_US, NodeFrame::airtimeUs(FRAME_MAX_SIZE));
+}
+
+void test_lost_late_and_duplicates()
+{
+    PeerTracker peer;
+
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 10));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 11));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 14));
+    TEST_ASSERT_EQUAL_UINT32(2, peer.stats().lost);
+
+    // A skipped frame shows up, then copies resent after lost acks
+    TEST_ASSERT_EQUAL(PEER_LATE, track(peer, 12));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, track(peer, 12));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, track(peer, 14));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, track(peer, 10));
+
+    // The oldest one the window remembers
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 14 + PEER_WINDOW + 8));
+    TEST_ASSERT_EQUAL(PEER_LATE, track(peer, 14 + 9));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, track(peer, 14 + 9));
+
+    const Peer_stats &stats = peer.stats();
+    TEST_ASSERT_EQUAL_UINT32(1 + PEER_WINDOW + 7 - 1, stats.lost);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.received);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.duplicates);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.reordered);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.restarts);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.samples);
+    TEST_ASSERT_EQUAL_UINT32(10 * NodeFrame::airtimeUs(40), stats.airtime_us);
+}
+
+void test_sequence_wrap()
+{
+    PeerTracker peer;
+
+    // 65535 is followed by 0, which is not a reboot
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 65533));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 65535));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 0));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 1));
+
+    // The window spans the wrap
+    TEST_ASSERT_EQUAL(PEER_LATE, track(peer, 65534));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, track(peer, 65535));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, track(peer, 0));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 3));
+
+    // Once the window is past the wrap, 0 is a reboot again
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, PEER_WINDOW));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, PEER_WINDOW + 1));
+    TEST_ASSERT_EQUAL(PEER_RESTART, track(peer, 0));
+
+    const Peer_stats &stats = peer.stats();
+    TEST_ASSERT_EQUAL_UINT32(1 + PEER_WINDOW - 4, stats.lost);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.restarts);
+    TEST_ASSERT_EQUAL_UINT32(9, stats.received);
+}
+
+void test_restarts()
+{
+    PeerTracker peer;
+
+    // A node counting again from 0 rebooted, even within the window
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 500));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 501));
+    TEST_ASSERT_EQUAL(PEER_RESTART, track(peer, 0));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, track(peer, 0));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 1));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, 2));
+    TEST_ASSERT_EQUAL(PEER_RESTART, track(peer, 0));
+
+    // A jump too far ahead or behind the window is one too
+    TEST_ASSERT_EQUAL(PEER_RESTART, track(peer, PEER_MAX_GAP + 1));
+    TEST_ASSERT_EQUAL(PEER_NEXT, track(peer, PEER_MAX_GAP + 2));
+    TEST_ASSERT_EQUAL(PEER_RESTART, track(peer, 2));
+
+    const Peer_stats &stats = peer.stats();
+    TEST_ASSERT_EQUAL_UINT32(4, stats.restarts);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.lost);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.duplicates);
+    TEST_ASSERT_EQUAL_UINT32(9, stats.received);
+}
+
+void test_rtt()
+{
+    PeerTracker peer;
+
+    // 0 means unknown, the mean moves by 1/8 of each gap
+    peer.track(3, 1, 0, 1, 40);
+    TEST_ASSERT_EQUAL_UINT32(0, peer.stats().mean_rtt_us);
+    peer.track(3, 2, 1000, 1, 40);
+    peer.track(3, 3, 2000, 1, 40);
+    peer.track(3, 4, 0, 1, 40);
+    TEST_ASSERT_EQUAL_UINT32(2000, peer.stats().last_rtt_us);
+    TEST_ASSERT_EQUAL_UINT32(1000 + (1000 >> PEER_RTT_SHIFT), peer.stats().mean_rtt_us);
+    TEST_ASSERT_EQUAL_UINT32(2000, peer.stats().max_rtt_us);
+    peer.track(3, 5, 500, 1, 40);
+    TEST_ASSERT_EQUAL_UINT32(1125 + ((500 - 1125) >> PEER_RTT_SHIFT), peer.stats().mean_rtt_us);
+}
+
+void test_peer_table()
+{
+    PeerTable<2> table;
+
+    TEST_ASSERT_EQUAL_size_t(0, table.count());
+    TEST_ASSERT_EQUAL(PEER_NEXT, table.track(macA, 1, 7, 0, 10, 60));
+    TEST_ASSERT_EQUAL(PEER_NEXT, table.track(macB, 2, 7, 0, 1, 40));
+    TEST_ASSERT_EQUAL(PEER_DUPLICATE, table.track(macA, 1, 7, 0, 10, 60));
+    TEST_ASSERT_EQUAL(PEER_UNTRACKED, table.track(macC, 3, 7, 0, 1, 40));
+    TEST_ASSERT_EQUAL_size_t(2, table.count());
+
+    // Samples of duplicates are not counted twice, their airtime is
+    TEST_ASSERT_EQUAL_MEMORY(macA, table.at(0).mac, 6);
+    TEST_ASSERT_EQUAL_UINT32(10, table.at(0).samples);
+    TEST_ASSERT_EQUAL_UINT32(2 * NodeFrame::airtimeUs(60), table.at(0).airtime_us);
+    TEST_ASSERT_EQUAL_UINT8(2, table.at(1).node);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_size_limits);
+    RUN_TEST(test_rejected_frames);
+    RUN_TEST(test_truncated_frames);
+    RUN_TEST(test_crc_and_airtime);
+    RUN_TEST(test_lost_late_and_duplicates);
+    RUN_TEST(test_sequence_wrap);
+    RUN_TEST(test_restarts);
+    RUN_TEST(test_rtt);
+    RUN_TEST(test_peer_table);
+    return UNITY_END();
+}
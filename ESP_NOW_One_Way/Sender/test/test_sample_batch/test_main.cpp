@@ -0,0 +1,241 @@
+#include <unity.h>
+#include "SampleBatch.hpp"
+
+#define START_TIME              1700000000 // Epoch of the first sample
+#define PERIOD                  60         // Seconds between two samples
+
+static uint8_t frame[FRAME_MAX_SIZE];
+
+/***********************************************************************
+ * @return Sample i of a slowly changing series
+ ***********************************************************************/
+static Batch_sample sampleAt(const uint32_t i)
+{
+    Batch_sample sample;
+    sample.time        = START_TIME + i * PERIOD;
+    sample.temperature = 21.37F + 0.013F * i;
+    sample.humidity    = 47.5F - 0.21F * i;
+    sample.pressure    = 1008.17F + 0.031F * i;
+    sample.altitude    = 49.83F - 0.26F * i;
+    return sample;
+}
+
+/***********************************************************************
+ * @brief Build the frame of a batch and parse it again
+ * @return Reader of its samples
+ ***********************************************************************/
+static BatchReader sendAndReceive(const SampleBatch &batch, size_t &length)
+{
+    const Frame_header  header   = {0, 0, 0, 3, 0, 42, 0, 0};
+    const Frame_header *received = NULL;
+    length                       = batch.write(frame, sizeof(frame), header);
+    TEST_ASSERT_GREATER_THAN_size_t(0, length);
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(frame, length, received));
+    return BatchReader(received);
+}
+
+static void checkSample(const Batch_sample &expected, const Batch_sample &sample, const float tolerance)
+{
+    TEST_ASSERT_EQUAL_UINT32(expected.time, sample.time);
+    TEST_ASSERT_FLOAT_WITHIN(tolerance, expected.temperature, sample.temperature);
+    TEST_ASSERT_FLOAT_WITHIN(tolerance, expected.humidity, sample.humidity);
+    TEST_ASSERT_FLOAT_WITHIN(tolerance, expected.pressure, sample.pressure);
+    TEST_ASSERT_FLOAT_WITHIN(tolerance, expected.altitude, sample.altitude);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_raw_round_trip()
+{
+    SampleBatch batch(SampleBatch::MAX_RAW, false);
+    for (uint32_t i = 0; i < SampleBatch::MAX_RAW; i++)
+    {
+        TEST_ASSERT_TRUE(batch.add(sampleAt(i)));
+    }
+    TEST_ASSERT_TRUE(batch.full());
+    TEST_ASSERT_FALSE(batch.add(sampleAt(SampleBatch::MAX_RAW)));
+
+    // Floats as they were, in one frame
+    size_t       length;
+    BatchReader  reader = sendAndReceive(batch, length);
+    Batch_sample sample;
+    TEST_ASSERT_EQUAL_UINT8(FRAME_BME280_BATCH, ((const Frame_header *)frame)->type);
+    TEST_ASSERT_EQUAL_size_t(SampleBatch::MAX_RAW, reader.count());
+    for (uint32_t i = 0; i < SampleBatch::MAX_RAW; i++)
+    {
+        TEST_ASSERT_TRUE(reader.next(sample));
+        checkSample(sampleAt(i), sample, 0.0F);
+    }
+    TEST_ASSERT_FALSE(reader.next(sample));
+}
+
+void test_delta_round_trip()
+{
+    SampleBatch batch(SampleBatch::MAX_DELTA, true);
+    for (uint32_t i = 0; i < SampleBatch::MAX_DELTA; i++)
+    {
+        TEST_ASSERT_TRUE(batch.add(sampleAt(i)));
+    }
+    TEST_ASSERT_TRUE(batch.full());
+    TEST_ASSERT_EQUAL_size_t(22, SampleBatch::MAX_DELTA);
+
+    // Rounded to hundredths, the rounding does not add up over the batch
+    size_t       length;
+    BatchReader  reader = sendAndReceive(batch, length);
+    Batch_sample sample;
+    TEST_ASSERT_LESS_OR_EQUAL_size_t(FRAME_MAX_SIZE, length);
+    TEST_ASSERT_EQUAL_size_t(SampleBatch::MAX_DELTA, reader.count());
+    for (uint32_t i = 0; i < SampleBatch::MAX_DELTA; i++)
+    {
+        TEST_ASSERT_TRUE(reader.next(sample));
+        checkSample(sampleAt(i), sample, 0.0051F);
+    }
+    TEST_ASSERT_FALSE(reader.next(sample));
+}
+
+void test_single_sample()
+{
+    SampleBatch  batch(10, true);
+    size_t       length;
+    Batch_sample sample;
+    TEST_ASSERT_EQUAL_size_t(0, batch.write(frame, sizeof(frame), Frame_header()));
+
+    // A plain FRAME_BME280, as before batching
+    TEST_ASSERT_TRUE(batch.add(sampleAt(3)));
+    BatchReader reader = sendAndReceive(batch, length);
+    TEST_ASSERT_EQUAL_UINT8(FRAME_BME280, ((const Frame_header *)frame)->type);
+    TEST_ASSERT_EQUAL_size_t(sizeof(Frame_header) + sizeof(Payload_bme280) + FRAME_CRC_SIZE, length);
+    TEST_ASSERT_EQUAL_size_t(1, reader.count());
+    TEST_ASSERT_TRUE(reader.next(sample));
+    checkSample(sampleAt(3), sample, 0.0F);
+}
+
+void test_delta_too_large_starts_a_new_batch()
+{
+    SampleBatch  batch(10, true);
+    Batch_sample jump = sampleAt(2);
+    TEST_ASSERT_TRUE(batch.add(sampleAt(0)));
+    TEST_ASSERT_TRUE(batch.add(sampleAt(1)));
+
+    // 327.68 hPa away does not fit a delta: the batch is sent as it is
+    jump.pressure = sampleAt(1).pressure + 327.68F;
+    TEST_ASSERT_FALSE(batch.add(jump));
+    TEST_ASSERT_EQUAL_size_t(2, batch.count());
+
+    size_t       length;
+    Batch_sample sample;
+    BatchReader  first = sendAndReceive(batch, length);
+    TEST_ASSERT_EQUAL_size_t(2, first.count());
+
+    // The sample refused starts the next batch, delta encoded again
+    batch.clear();
+    TEST_ASSERT_TRUE(batch.add(jump));
+    jump.time += PERIOD;
+    jump.pressure -= 327.0F;
+    TEST_ASSERT_TRUE(batch.add(jump));
+    BatchReader second = sendAndReceive(batch, length);
+    TEST_ASSERT_EQUAL_size_t(2, second.count());
+    TEST_ASSERT_EQUAL_size_t(sizeof(Frame_header) + sizeof(Batch_header) + sizeof(Batch_base) + sizeof(Batch_delta) + FRAME_CRC_SIZE, length);
+    TEST_ASSERT_TRUE(second.next(sample));
+    TEST_ASSERT_FLOAT_WITHIN(0.0051F, sampleAt(1).pressure + 327.68F, sample.pressure);
+    TEST_ASSERT_TRUE(second.next(sample));
+    TEST_ASSERT_FLOAT_WITHIN(0.0051F, sampleAt(1).pressure + 0.68F, sample.pressure);
+}
+
+void test_values_delta_cannot_hold()
+{
+    SampleBatch  batch(10, true);
+    Batch_sample sample = sampleAt(0);
+    Batch_sample read;
+    size_t       length;
+
+    // Hundredths past the int32 range once rounded to a float: raw batch, exact values
+    sample.pressure = 21474836.0F;
+    TEST_ASSERT_TRUE(batch.add(sample));
+    TEST_ASSERT_TRUE(batch.add(sampleAt(1)));
+    BatchReader huge = sendAndReceive(batch, length);
+    TEST_ASSERT_EQUAL_size_t(2, huge.count());
+    TEST_ASSERT_TRUE(huge.next(read));
+    TEST_ASSERT_EQUAL_FLOAT(21474836.0F, read.pressure);
+    TEST_ASSERT_EQUAL_size_t(sizeof(Frame_header) + sizeof(Batch_header) + 2 * sizeof(Batch_raw) + FRAME_CRC_SIZE, length);
+
+    // The largest value still delta encoded
+    batch.clear();
+    sample.pressure = BATCH_MAX_VALUE;
+    TEST_ASSERT_TRUE(batch.add(sample));
+    TEST_ASSERT_TRUE(batch.add(sample));
+    BatchReader largest = sendAndReceive(batch, length);
+    TEST_ASSERT_TRUE(largest.next(read));
+    TEST_ASSERT_EQUAL_FLOAT(BATCH_MAX_VALUE, read.pressure);
+    TEST_ASSERT_EQUAL_size_t(sizeof(Frame_header) + sizeof(Batch_header) + sizeof(Batch_base) + sizeof(Batch_delta) + FRAME_CRC_SIZE, length);
+
+    // A value the sensor failed to give ends a delta batch, starts a raw one
+    batch.clear();
+    sample          = sampleAt(1);
+    sample.humidity = NAN;
+    TEST_ASSERT_TRUE(batch.add(sampleAt(0)));
+    TEST_ASSERT_FALSE(batch.add(sample));
+    batch.clear();
+    TEST_ASSERT_TRUE(batch.add(sample));
+    TEST_ASSERT_TRUE(batch.add(sampleAt(2)));
+    BatchReader missing = sendAndReceive(batch, length);
+    TEST_ASSERT_TRUE(missing.next(read));
+    TEST_ASSERT_TRUE(isnan(read.humidity));
+    TEST_ASSERT_EQUAL_size_t(sizeof(Frame_header) + sizeof(Batch_header) + 2 * sizeof(Batch_raw) + FRAME_CRC_SIZE, length);
+}
+
+void test_time_span()
+{
+    SampleBatch  batch(10, true);
+    Batch_sample sample = sampleAt(0);
+    TEST_ASSERT_TRUE(batch.add(sample));
+
+    // Offsets are 16 bits, from the first sample on
+    sample.time = START_TIME - 1;
+    TEST_ASSERT_FALSE(batch.add(sample));
+    sample.time = START_TIME + UINT16_MAX + 1;
+    TEST_ASSERT_FALSE(batch.add(sample));
+    sample.time = START_TIME + UINT16_MAX;
+    TEST_ASSERT_TRUE(batch.add(sample));
+}
+
+void test_invalid_payloads()
+{
+    uint8_t             payload[sizeof(Batch_header) + 2 * sizeof(Batch_raw)] = {0};
+    Batch_header       *batch                                                = (Batch_header *)payload;
+    const Frame_header *header                                               = NULL;
+    Frame_header        sent                                                 = {0, 0, FRAME_BME280_BATCH, 3, 0, 1, START_TIME, 0};
+
+    // The count must match the length
+    batch->count    = 3;
+    batch->encoding = BATCH_RAW;
+    size_t length   = NodeFrame::write(frame, sizeof(frame), sent, payload, sizeof(payload));
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(frame, length, header));
+    TEST_ASSERT_EQUAL_size_t(0, BatchReader(header).count());
+
+    batch->count    = 2;
+    batch->encoding = 7;
+    length          = NodeFrame::write(frame, sizeof(frame), sent, payload, sizeof(payload));
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(frame, length, header));
+    TEST_ASSERT_EQUAL_size_t(0, BatchReader(header).count());
+
+    // Other frames carry no sample
+    sent.type = FRAME_TIME_REQUEST;
+    length    = NodeFrame::write(frame, sizeof(frame), sent, NULL, 0);
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(frame, length, header));
+    TEST_ASSERT_EQUAL_size_t(0, BatchReader(header).count());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_raw_round_trip);
+    RUN_TEST(test_delta_round_trip);
+    RUN_TEST(test_single_sample);
+    RUN_TEST(test_delta_too_large_starts_a_new_batch);
+    RUN_TEST(test_values_delta_cannot_hold);
+    RUN_TEST(test_time_span);
+    RUN_TEST(test_invalid_payloads);
+    return UNITY_END();
+}
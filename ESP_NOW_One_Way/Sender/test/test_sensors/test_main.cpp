@@ -0,0 +1,190 @@
+#include <unity.h>
+#include "Bme280Driver.hpp"
+#include "Bme680Driver.hpp"
+#include "Dht11Driver.hpp"
+#include "SimulatedSensors.hpp"
+
+#define SEA_LEVEL               1014.0F    // hPa
+
+typedef Sampler<Bme280Driver<SimulatedBme280> > Bme280Sampler;
+typedef Sampler<Bme680Driver<SimulatedBme680> > Bme680Sampler;
+typedef Sampler<Dht11Driver<SimulatedDht> >     Dht11Sampler;
+
+void setUp()
+{
+    simulatedMicros() = 0;
+}
+
+void tearDown() {}
+
+void test_bme280_one_burst_per_sample()
+{
+    SimulatedBme280 device;
+    Bme280Sampler   bme(device, SEA_LEVEL);
+    Bme280_reading  reading;
+    TEST_ASSERT_TRUE(bme.begin());
+
+    // Compensated values of the datasheet, the derived ones from the same burst
+    const uint32_t transfers = device.transfers;
+    TEST_ASSERT_TRUE(bme.read(reading));
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 25.08F, reading.temperature);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 1006.5327F, reading.pressure);
+    TEST_ASSERT_TRUE((reading.humidity > 0.0F) && (reading.humidity <= 100.0F));
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, Weather::altitude(reading.pressure, SEA_LEVEL), reading.altitude);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, Weather::dewPoint(reading.temperature, reading.humidity), reading.dew_point);
+
+    // One forced measure: the trigger, then the 8 byte burst
+    TEST_ASSERT_EQUAL_UINT32(1, device.measures);
+    TEST_ASSERT_EQUAL_UINT32(3, device.transfers - transfers);
+    TEST_ASSERT_EQUAL_UINT32(1, bme.samples());
+    TEST_ASSERT_EQUAL_UINT32(0, bme.failures());
+}
+
+void test_bme280_missing_values_keep_the_last_good_ones()
+{
+    SimulatedBme280 device;
+    Bme280Sampler   bme(device, SEA_LEVEL);
+    Bme280_reading  good;
+    Bme280_reading  reading;
+    TEST_ASSERT_TRUE(bme.begin());
+    TEST_ASSERT_TRUE(bme.read(good));
+
+    // Humidity skipped: the new temperature, the last humidity
+    device.setRaw(530000, 415148, 0x8000);
+    TEST_ASSERT_FALSE(bme.read(reading));
+    TEST_ASSERT_TRUE(reading.temperature > good.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(good.humidity, reading.humidity);
+    TEST_ASSERT_EQUAL_FLOAT(good.dew_point, reading.dew_point);
+    TEST_ASSERT_EQUAL_UINT32(1, bme.failures());
+
+    // Temperature skipped: nothing can be compensated
+    device.setRaw(0x80000, 415148, 30000);
+    TEST_ASSERT_FALSE(bme.read(reading));
+    TEST_ASSERT_EQUAL_FLOAT(bme.last().temperature, reading.temperature);
+    TEST_ASSERT_TRUE(reading.temperature > good.temperature);
+    TEST_ASSERT_EQUAL_UINT32(2, bme.failures());
+
+    // Sensor gone: the trigger fails, the last values are kept
+    device.answer = false;
+    TEST_ASSERT_FALSE(bme.read(reading));
+    TEST_ASSERT_EQUAL_FLOAT(bme.last().pressure, reading.pressure);
+    TEST_ASSERT_EQUAL_UINT32(3, bme.failures());
+    TEST_ASSERT_EQUAL_UINT32(3, bme.samples());
+}
+
+void test_bme280_absent()
+{
+    SimulatedBme280 device;
+    Bme280Sampler   bme(device, SEA_LEVEL);
+
+    device.registers[BME280_REG_CHIP_ID] = 0x61;
+    TEST_ASSERT_FALSE(bme.begin());
+    device.registers[BME280_REG_CHIP_ID] = BME280_CHIP_ID;
+    device.answer                        = false;
+    TEST_ASSERT_FALSE(bme.begin());
+}
+
+void test_bme680_finish_before_ready()
+{
+    SimulatedBme680 device;
+    Bme680Sampler   bme(device, SEA_LEVEL);
+    Bme680_reading  reading;
+
+    // Nothing started: the last values, not counted as a failure
+    TEST_ASSERT_FALSE(bme.finish(reading));
+    TEST_ASSERT_EQUAL_UINT32(0, bme.failures());
+
+    // One conversion at a time, the caller is free while it runs
+    TEST_ASSERT_TRUE(bme.start());
+    TEST_ASSERT_FALSE(bme.start());
+    TEST_ASSERT_TRUE(bme.busy());
+    TEST_ASSERT_FALSE(bme.ready());
+    TEST_ASSERT_EQUAL_UINT32(device.conversion_ms, bme.remaining());
+    delay(50);
+    TEST_ASSERT_EQUAL_UINT32(device.conversion_ms - 50, bme.remaining());
+
+    // Collected early, finish() waits for the end of the conversion
+    TEST_ASSERT_TRUE(bme.finish(reading));
+    TEST_ASSERT_EQUAL_UINT32(device.conversion_ms, millis());
+    TEST_ASSERT_FALSE(bme.busy());
+    TEST_ASSERT_EQUAL_UINT32(0, bme.remaining());
+    TEST_ASSERT_EQUAL_UINT32(1, device.conversions);
+    TEST_ASSERT_EQUAL_FLOAT(20.0F, reading.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(1013.25F, reading.pressure);
+    TEST_ASSERT_EQUAL_FLOAT(50.0F, reading.gas_resistance);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, Weather::altitude(1013.25F, SEA_LEVEL), reading.altitude);
+
+    // Collected once ready, no wait
+    TEST_ASSERT_TRUE(bme.start());
+    delay(device.conversion_ms + 10);
+    TEST_ASSERT_TRUE(bme.ready());
+    const uint32_t before = millis();
+    TEST_ASSERT_TRUE(bme.finish(reading));
+    TEST_ASSERT_EQUAL_UINT32(before, millis());
+}
+
+void test_bme680_failures()
+{
+    SimulatedBme680 device;
+    Bme680Sampler   bme(device, SEA_LEVEL);
+    Bme680_reading  reading;
+    TEST_ASSERT_TRUE(bme.read(reading));
+
+    // A gas reading the heater did not give
+    device.gas_resistance = NAN;
+    device.temperature    = 21.5F;
+    TEST_ASSERT_FALSE(bme.read(reading));
+    TEST_ASSERT_EQUAL_FLOAT(21.5F, reading.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(50.0F, reading.gas_resistance);
+    TEST_ASSERT_EQUAL_UINT32(1, bme.failures());
+
+    // No answer: no conversion started
+    device.answer = false;
+    TEST_ASSERT_FALSE(bme.start());
+    TEST_ASSERT_FALSE(bme.read(reading));
+    TEST_ASSERT_EQUAL_FLOAT(21.5F, reading.temperature);
+    TEST_ASSERT_EQUAL_UINT32(2, device.conversions);
+    TEST_ASSERT_EQUAL_UINT32(2, bme.failures());
+    TEST_ASSERT_EQUAL_UINT32(2, bme.samples());
+}
+
+void test_dht11()
+{
+    SimulatedDht  dht;
+    Dht11Sampler  sampler(dht);
+    Dht11_reading reading;
+
+    // Both values from one transfer, no wait
+    TEST_ASSERT_TRUE(sampler.read(reading));
+    TEST_ASSERT_EQUAL_UINT32(0, millis());
+    TEST_ASSERT_EQUAL_UINT32(2, dht.reads);
+    TEST_ASSERT_EQUAL_FLOAT(20.0F, reading.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(50.0F, reading.humidity);
+
+    // One value missing falls back alone
+    dht.temperature = 22.0F;
+    dht.humidity    = NAN;
+    TEST_ASSERT_FALSE(sampler.read(reading));
+    TEST_ASSERT_EQUAL_FLOAT(22.0F, reading.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(50.0F, reading.humidity);
+
+    // Both missing, the transfer failed
+    dht.temperature = NAN;
+    TEST_ASSERT_FALSE(sampler.read(reading));
+    TEST_ASSERT_EQUAL_FLOAT(22.0F, reading.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(50.0F, reading.humidity);
+    TEST_ASSERT_EQUAL_UINT32(2, sampler.failures());
+    TEST_ASSERT_EQUAL_UINT32(3, sampler.samples());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bme280_one_burst_per_sample);
+    RUN_TEST(test_bme280_missing_values_keep_the_last_good_ones);
+    RUN_TEST(test_bme280_absent);
+    RUN_TEST(test_bme680_finish_before_ready);
+    RUN_TEST(test_bme680_failures);
+    RUN_TEST(test_dht11);
+    return UNITY_END();
+}
@@ -0,0 +1,122 @@
+#include <unity.h>
+#include "TimeSync.hpp"
+
+#define OFFSET_US               1700000000000000LL // Gateway epoch minus node local time
+#define SENT_US                 2000000            // Local time of the request
+#define WAIT_US                 3000               // Time the request waits in the gateway
+#define TIME_MAX_AGE_S          60                 // Seconds without sync before asking the time
+
+static uint8_t frame[FRAME_MAX_SIZE];
+
+static const Frame_header node    = {0, 0, 0, 1, 0, 7, 0, 0};
+static const Frame_header gateway = {0, 0, 0, 0, 0, 0, 0, 0};
+
+/***********************************************************************
+ * @brief Build a FRAME_TIME of the gateway and hand it to the client
+ * @param readUs Local time the gateway reads its clock at
+ * @return What TimeClient::receive() returned
+ ***********************************************************************/
+static bool answer(TimeClient &client, const int64_t readUs, const uint16_t request, const uint8_t flags)
+{
+    const Frame_header *header = NULL;
+    const size_t        length = TimeBeacon::write(frame, sizeof(frame), gateway, readUs + OFFSET_US, request, flags);
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(frame, length, header));
+    return client.receive(header, length, readUs + NodeFrame::airtimeUs(length));
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_reply_waited_in_the_gateway()
+{
+    TimeClient client;
+    TEST_ASSERT_FALSE(client.synced());
+    TEST_ASSERT_EQUAL_INT64(SENT_US, client.epochUs(SENT_US));
+
+    // The wait in the gateway is before the clock is read, it does not bias the node
+    const size_t  length = client.request(frame, sizeof(frame), node, SENT_US);
+    const int64_t readUs = SENT_US + NodeFrame::airtimeUs(length) + WAIT_US;
+    TEST_ASSERT_TRUE(answer(client, readUs, node.sequence, TIME_REPLY));
+    TEST_ASSERT_TRUE(client.synced());
+    TEST_ASSERT_INT64_WITHIN(1, readUs + 5000 + OFFSET_US, client.epochUs(readUs + 5000));
+    TEST_ASSERT_EQUAL_UINT32(readUs + NodeFrame::airtimeUs(sizeof(Frame_header) + sizeof(Payload_time) + FRAME_CRC_SIZE) - SENT_US,
+                             client.health().last_rtt_us);
+}
+
+void test_beacon()
+{
+    TimeClient client;
+
+    // Nothing asked, a broadcast still sets the clock
+    TEST_ASSERT_TRUE(answer(client, SENT_US, 0, 0));
+    TEST_ASSERT_INT64_WITHIN(1, SENT_US + OFFSET_US, client.epochUs(SENT_US));
+    TEST_ASSERT_EQUAL_UINT32(0, client.health().last_rtt_us);
+    TEST_ASSERT_EQUAL_UINT32(1, client.health().syncs);
+}
+
+void test_unusable_frames()
+{
+    TimeClient          client;
+    const Frame_header *header = NULL;
+
+    // Replies to no request, to an older request, or answered twice
+    TEST_ASSERT_FALSE(answer(client, SENT_US, 0, TIME_REPLY));
+    client.request(frame, sizeof(frame), node, SENT_US);
+    TEST_ASSERT_FALSE(answer(client, SENT_US + WAIT_US, node.sequence - 1, TIME_REPLY));
+    TEST_ASSERT_TRUE(answer(client, SENT_US + WAIT_US, node.sequence, TIME_REPLY));
+    TEST_ASSERT_FALSE(answer(client, SENT_US + WAIT_US, node.sequence, TIME_REPLY));
+
+    // A time sent by a node, and a request
+    Frame_header other = gateway;
+    Payload_time time  = {OFFSET_US, 0, 0};
+    other.type         = FRAME_TIME;
+    other.node         = 2;
+    size_t length      = NodeFrame::write(frame, sizeof(frame), other, time);
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(frame, length, header));
+    TEST_ASSERT_FALSE(client.receive(header, length, SENT_US));
+    length = client.request(frame, sizeof(frame), node, SENT_US);
+    TEST_ASSERT_EQUAL(FRAME_OK, NodeFrame::parse(frame, length, header));
+    TEST_ASSERT_FALSE(client.receive(header, length, SENT_US));
+    TEST_ASSERT_EQUAL_UINT32(1, client.health().syncs);
+}
+
+void test_backoff_while_unanswered()
+{
+    TimeClient client;
+    uint32_t   chances = 0;
+
+    // A gateway without clock: each request failed doubles the wait, up to 2^TIME_MAX_BACKOFF
+    for (uint32_t every = 1; every <= (1U << TIME_MAX_BACKOFF); every *= 2)
+    {
+        for (chances = 1; client.due(SENT_US, TIME_MAX_AGE_S) == false; chances++)
+        {
+            TEST_ASSERT_LESS_THAN_UINT32(every + 1, chances);
+        }
+        TEST_ASSERT_EQUAL_UINT32(every, chances);
+        client.request(frame, sizeof(frame), node, SENT_US);
+        client.failed();
+    }
+    TEST_ASSERT_EQUAL_UINT8(TIME_MAX_BACKOFF + 1, client.failures());
+    TEST_ASSERT_EQUAL_UINT32(TIME_MAX_BACKOFF + 1, client.health().failures);
+
+    // The answer to a request given up is late, it is dropped
+    client.request(frame, sizeof(frame), node, SENT_US);
+    client.failed();
+    TEST_ASSERT_FALSE(answer(client, SENT_US + WAIT_US, node.sequence, TIME_REPLY));
+
+    // A beacon sets the clock, the backoff ends with it
+    TEST_ASSERT_TRUE(answer(client, SENT_US, 0, 0));
+    TEST_ASSERT_FALSE(client.due(SENT_US, TIME_MAX_AGE_S));
+    TEST_ASSERT_EQUAL_UINT8(0, client.failures());
+    TEST_ASSERT_TRUE(client.due(SENT_US + (TIME_MAX_AGE_S + 1) * 1000000LL, TIME_MAX_AGE_S));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reply_waited_in_the_gateway);
+    RUN_TEST(test_beacon);
+    RUN_TEST(test_unusable_frames);
+    RUN_TEST(test_backoff_while_unanswered);
+    return UNITY_END();
+}
@@ -94,6 +94,7 @@ var chartP = new Highcharts.Chart({
 setInterval(function () {
     // Get the data and update the chart each time values are measured
     var xhttp = new XMLHttpRequest();
+    xhttp.responseType = "arraybuffer";
     xhttp.onreadystatechange = function () 
     {
         if ((this.readyState == 4) && (this.status == 200)) 
@@ -103,18 +104,16 @@ setInterval(function () {
             var PChart = [];
 
             // Get data from the server
-            var data   = this.responseText.split('\n');
-            var room   = data[1].split(';');  
+            var room   = decodeAllData(this.response)[0];
             
             for (var i = 0; i < room.length; i++) 
             {
                 // Update the charts
-                var labels = room[i].split(',');
-                var time   = parseInt(labels[1] + "000");
+                var time   = room[i].time * 1000;
                 
-                TChart.push([time, parseFloat(labels[2])]);
-                HChart.push([time, parseFloat(labels[3])]);
-                PChart.push([time, parseFloat(labels[4])]);
+                TChart.push([time, room[i].temperature]);
+                HChart.push([time, room[i].humidity]);
+                PChart.push([time, room[i].pressure]);
             }
 
             chartT.series[0].setData(TChart, true);
@@ -122,6 +121,6 @@ setInterval(function () {
             chartP.series[0].setData(PChart, true);
         };
     };
-    xhttp.open("GET", "/all_data", true);
+    xhttp.open("GET", "/all_data.bin", true);
     xhttp.send();
 }, 2000);
@@ -0,0 +1,54 @@
+/* Layout of /all_data.bin, see writeBinaryData() in main.cpp */
+const BINARY_MAGIC   = "HB";
+const BINARY_VERSION = 1;
+const BINARY_BME680  = 1;
+
+/*
+ * Decode the binary data of all rooms
+ * Returns an object indexed by room id, each room being an array of samples
+ * ordered from the oldest to the newest
+ */
+function decodeAllData(buffer) 
+{
+    var view   = new DataView(buffer);
+    var offset = 0;
+    var rooms  = {};
+
+    var magic = String.fromCharCode(view.getUint8(0), view.getUint8(1));
+    if ((magic != BINARY_MAGIC) || (view.getUint8(2) != BINARY_VERSION))
+    {
+        throw new Error("Unsupported data format");
+    }
+    var nbRooms = view.getUint8(3);
+    offset      = 4;
+
+    for (var r = 0; r < nbRooms; r++)
+    {
+        var id      = view.getUint8(offset);
+        var type    = view.getUint8(offset + 1);
+        var count   = view.getUint16(offset + 2, true);
+        var samples = [];
+        offset     += 4;
+
+        for (var i = 0; i < count; i++)
+        {
+            var sample = {
+                time        : view.getUint32(offset,       true),
+                temperature : view.getFloat32(offset + 4,  true),
+                humidity    : view.getFloat32(offset + 8,  true),
+                pressure    : view.getFloat32(offset + 12, true),
+                altitude    : view.getFloat32(offset + 16, true)
+            };
+            offset += 20;
+
+            if (type == BINARY_BME680)
+            {
+                sample.gas_resistance = view.getFloat32(offset, true);
+                offset += 4;
+            }
+            samples.push(sample);
+        }
+        rooms[id] = samples;
+    }
+    return rooms;
+}
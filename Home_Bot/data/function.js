@@ -12,42 +12,49 @@ function getTimeFromDate(timestamp)
     return hours + " : " + minutes + " : " + seconds
 }
 
-setInterval(function () {
-    var xhttp = new XMLHttpRequest();
-    xhttp.onreadystatechange = function () 
+/* Slot of each room on the page */
+const ROOM_SLOTS = 
+{
+    "Living room" : "room0",
+    "Bedroom"     : "room1",
+    "Bathroom"    : "room2"
+};
+
+/* Update the slot of a room from one line of /last_data */
+function updateRoom(line) 
+{
+    var room = line.split(';');
+    var slot = ROOM_SLOTS[room[0]];
+    if (slot === undefined)
+    {
+        return;
+    }
+
+    document.getElementById(slot + "_id").innerHTML             = room[0];
+    // document.getElementById(slot + "_time").innerHTML           = getTimeFromDate(parseInt(room[1]));
+    document.getElementById(slot + "_temperature").innerHTML    = parseFloat(room[2]);
+    document.getElementById(slot + "_humidity").innerHTML       = parseFloat(room[3]);
+    document.getElementById(slot + "_pressure").innerHTML       = parseFloat(room[4]);
+    document.getElementById(slot + "_altitude").innerHTML       = parseFloat(room[5]);
+    // document.getElementById(slot + "_gas_resistance").innerHTML = parseFloat(room[6]);
+}
+
+/* The ESP pushes each new sample once, the last sample of every room is sent on connection */
+if (!!window.EventSource) 
+{
+    var source = new EventSource("/events");
+
+    source.addEventListener("snapshot", function (e) 
     {
-        if ((this.readyState == 4) && (this.status == 200)) 
+        var lines = e.data.split('\n');
+        for (var i = 0; i < lines.length; i++)
         {
-            // Get data from the server
-            var data     = this.responseText.split('\n');
-            var room0   = data[0].split(';');
-            var room1   = data[1].split(';');
-            var room2   = data[2].split(';');
-
-            // Update the data
-            document.getElementById("room0_id").innerHTML             = room0[0];
-            // document.getElementById("room0_time").innerHTML           = getTimeFromDate(parseInt(room0[1]));
-            document.getElementById("room0_temperature").innerHTML    = parseFloat(room0[2]);
-            document.getElementById("room0_humidity").innerHTML       = parseFloat(room0[3]);
-            document.getElementById("room0_pressure").innerHTML       = parseFloat(room0[4]);
-            document.getElementById("room0_altitude").innerHTML       = parseFloat(room0[5]);
-            // document.getElementById("room0_gas_resistance").innerHTML = parseFloat(room0[6]);
-
-            document.getElementById("room1_id").innerHTML             = room1[0];
-            // document.getElementById("room1_time").innerHTML           = getTimeFromDate(parseInt(room1[1]));
-            document.getElementById("room1_temperature").innerHTML    = parseFloat(room1[2]);
-            document.getElementById("room1_humidity").innerHTML       = parseFloat(room1[3]);
-            document.getElementById("room1_pressure").innerHTML       = parseFloat(room1[4]);
-            document.getElementById("room1_altitude").innerHTML       = parseFloat(room1[5]);
-
-            document.getElementById("room2_id").innerHTML             = room2[0];
-            // document.getElementById("room2_time").innerHTML           = getTimeFromDate(parseInt(room2[1]));
-            document.getElementById("room2_temperature").innerHTML    = parseFloat(room2[2]);
-            document.getElementById("room2_humidity").innerHTML       = parseFloat(room2[3]);
-            document.getElementById("room2_pressure").innerHTML       = parseFloat(room2[4]);
-            document.getElementById("room2_altitude").innerHTML       = parseFloat(room2[5]);
-        };
-    };
-    xhttp.open("GET", "/last_data", true);
-    xhttp.send();
-}, 1000);
+            updateRoom(lines[i]);
+        }
+    }, false);
+
+    source.addEventListener("sample", function (e) 
+    {
+        updateRoom(e.data);
+    }, false);
+}
@@ -0,0 +1,96 @@
+#ifndef BINARY_WRITER_HPP
+#define BINARY_WRITER_HPP
+
+#include <Print.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/***********************************************************************
+ * @brief Writes little-endian binary data without any heap allocation
+ *
+ * Works like TextWriter: bytes either go into a caller supplied buffer
+ * or are streamed to a Print, and the writer keeps counting so the size
+ * needed can be known up front.
+ ***********************************************************************/
+class BinaryWriter
+{
+    public:
+        /***********************************************************************
+         * @brief Write into a buffer
+         * @param buffer Buffer to fill, may be NULL to only measure the data
+         * @param size Size of the buffer in bytes
+         ***********************************************************************/
+        BinaryWriter(uint8_t *buffer, const size_t size) : _buffer(buffer), _size(size), _print(NULL), _length(0) {}
+
+        /***********************************************************************
+         * @brief Stream into a Print
+         * @param print Destination of the data
+         ***********************************************************************/
+        explicit BinaryWriter(Print &print) : _buffer(NULL), _size(0), _print(&print), _length(0) {}
+
+        /***********************************************************************
+         * @return Size of the whole data, even the part that did not fit
+         ***********************************************************************/
+        size_t length() const
+        {
+            return _length;
+        }
+
+        /***********************************************************************
+         * @return True if the buffer was too small for the whole data
+         ***********************************************************************/
+        bool truncated() const
+        {
+            return (_print == NULL) && (_length > _size);
+        }
+
+        void write(const uint8_t *data, const size_t len)
+        {
+            if(_print != NULL)
+            {
+                _print->write(data, len);
+            }
+            else if((_buffer != NULL) && (_length < _size))
+            {
+                const size_t room = _size - _length;
+                memcpy(_buffer + _length, data, (len < room) ? len : room);
+            }
+            _length += len;
+        }
+
+        void writeU8(const uint8_t value)
+        {
+            write(&value, 1);
+        }
+
+        void writeU16(const uint16_t value)
+        {
+            const uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+            write(bytes, sizeof(bytes));
+        }
+
+        void writeU32(const uint32_t value)
+        {
+            const uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+            write(bytes, sizeof(bytes));
+        }
+
+        /***********************************************************************
+         * @brief Write an IEEE 754 single precision float
+         ***********************************************************************/
+        void writeFloat(const float value)
+        {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            writeU32(bits);
+        }
+
+    private:
+        uint8_t *_buffer;
+        size_t   _size;
+        Print   *_print;
+        size_t   _length;
+};
+
+#endif
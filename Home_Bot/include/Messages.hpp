@@ -0,0 +1,112 @@
+#ifndef MESSAGES_HPP
+#define MESSAGES_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BME680_FIELDS           5          // Temperature, humidity, pressure, altitude, gas resistance
+#define BME280_FIELDS           4          // Temperature, humidity, pressure, altitude
+#define MAX_FIELDS              5          // Most values carried by a sample
+
+// Sensor of a room, values are also used by the binary data and the log
+enum Sensor_type
+{
+    SENSOR_BME280,
+    SENSOR_BME680,
+    SENSOR_NONE = 0xFF              // Frame or message without any sample, never stored
+};
+
+// BME680 data
+typedef struct
+{
+    uint8_t id;
+    float temperature;
+    float humidity;
+    float pressure;
+    float altitude;
+    float gas_resistance;
+    uint32_t time;
+} Message_bme680;
+
+// BME280 data
+typedef struct
+{
+    uint8_t id;
+    float temperature;
+    float humidity;
+    float pressure;
+    float altitude;
+    uint32_t time;
+} Message_bme280;
+
+/***********************************************************************
+ * @brief What generic code needs to know about a type of sample
+ *
+ * Values always start with temperature, humidity, pressure and altitude,
+ * in this order, so rollups, logs and writers do not depend on the sensor.
+ * @tparam Message Type of sample
+ ***********************************************************************/
+template <typename Message>
+struct Message_traits;
+
+template <>
+struct Message_traits<Message_bme680>
+{
+    static constexpr Sensor_type SENSOR = SENSOR_BME680;
+    static constexpr size_t      FIELDS = BME680_FIELDS;
+
+    static void toValues(const Message_bme680 &sample, float values[BME680_FIELDS])
+    {
+        values[0] = sample.temperature;
+        values[1] = sample.humidity;
+        values[2] = sample.pressure;
+        values[3] = sample.altitude;
+        values[4] = sample.gas_resistance;
+    }
+
+    static void fromValues(Message_bme680 &sample, const float values[BME680_FIELDS])
+    {
+        sample.temperature    = values[0];
+        sample.humidity       = values[1];
+        sample.pressure       = values[2];
+        sample.altitude       = values[3];
+        sample.gas_resistance = values[4];
+    }
+
+    static const char *label(const size_t field)
+    {
+        static const char *const labels[BME680_FIELDS] = {"Temperature", "Humidity", "Pressure", "Altitude", "Gas resistance"};
+        return labels[field];
+    }
+};
+
+template <>
+struct Message_traits<Message_bme280>
+{
+    static constexpr Sensor_type SENSOR = SENSOR_BME280;
+    static constexpr size_t      FIELDS = BME280_FIELDS;
+
+    static void toValues(const Message_bme280 &sample, float values[BME280_FIELDS])
+    {
+        values[0] = sample.temperature;
+        values[1] = sample.humidity;
+        values[2] = sample.pressure;
+        values[3] = sample.altitude;
+    }
+
+    static void fromValues(Message_bme280 &sample, const float values[BME280_FIELDS])
+    {
+        sample.temperature = values[0];
+        sample.humidity    = values[1];
+        sample.pressure    = values[2];
+        sample.altitude    = values[3];
+    }
+
+    static const char *label(const size_t field)
+    {
+        static const char *const labels[BME280_FIELDS] = {"Temperature", "Humidity", "Pressure", "Altitude"};
+        return labels[field];
+    }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/***********************************************************************
+ * @brief Fixed capacity ring buffer keeping the N most recent items
+ *
+ * One task pushes (single producer), any number of tasks may read at
+ * the same time without taking a lock. Readers copy the items they need
+ * and drop the ones the producer overwrote during the copy, so the
+ * producer never waits for them.
+ * @tparam T Type of the stored items (must be trivially copyable)
+ * @tparam N Number of items kept
+ ***********************************************************************/
+template <typename T, size_t N>
+class RingBuffer
+{
+    static_assert(N > 0, "RingBuffer capacity must be greater than 0");
+
+    public:
+        RingBuffer() : _items(), _begin(0), _head(0) {}
+
+        /***********************************************************************
+         * @brief Store a new item, overwriting the oldest one when full
+         * @param item Item to store
+         * @note Must only be called from one task
+         ***********************************************************************/
+        void push(const T &item)
+        {
+            const uint32_t head = _head.load(std::memory_order_relaxed);
+
+            // Announce which slot is about to be overwritten before writing it
+            _begin.store(head + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            _items[head % N] = item;
+            _head.store(head + 1, std::memory_order_release);
+        }
+
+        /***********************************************************************
+         * @brief Remove all items
+         * @note Must only be called from the producer task
+         ***********************************************************************/
+        void clear()
+        {
+            _head.store(0, std::memory_order_release);
+            _begin.store(0, std::memory_order_release);
+        }
+
+        /***********************************************************************
+         * @return Number of items currently stored
+         ***********************************************************************/
+        size_t size() const
+        {
+            const uint32_t head = _head.load(std::memory_order_acquire);
+            return (head < N) ? head : N;
+        }
+
+        /***********************************************************************
+         * @return Maximum number of items stored
+         ***********************************************************************/
+        static constexpr size_t capacity()
+        {
+            return N;
+        }
+
+        /***********************************************************************
+         * @return True if no item has been stored yet
+         ***********************************************************************/
+        bool empty() const
+        {
+            return _head.load(std::memory_order_acquire) == 0;
+        }
+
+        /***********************************************************************
+         * @brief Copy the most recent item
+         * @param item Where to copy the item
+         * @return False if the buffer is empty
+         ***********************************************************************/
+        bool last(T &item) const
+        {
+            while(true)
+            {
+                const uint32_t head = _head.load(std::memory_order_acquire);
+                if(head == 0)
+                {
+                    return false;
+                }
+                item = _items[(head - 1) % N];
+
+                // Retry if the producer went around the whole buffer meanwhile
+                if(isIntact(head - 1))
+                {
+                    return true;
+                }
+            }
+        }
+
+        /***********************************************************************
+         * @brief Copy up to maxItems of the most recent items, oldest first
+         * @param items Where to copy the items
+         * @param maxItems Maximum number of items to copy
+         * @return Number of items copied
+         ***********************************************************************/
+        size_t snapshot(T *items, const size_t maxItems) const
+        {
+            const uint32_t head  = _head.load(std::memory_order_acquire);
+            const size_t   count = lower(lower((size_t)head, N), maxItems);
+            const uint32_t first = head - count;
+
+            for(size_t i = 0; i < count; i++)
+            {
+                items[i] = _items[(first + i) % N];
+            }
+
+            // Drop the oldest items if the producer overwrote them during the copy
+            size_t torn = 0;
+            while((torn < count) && (isIntact(first + torn) == false))
+            {
+                torn++;
+            }
+            if(torn > 0)
+            {
+                for(size_t i = torn; i < count; i++)
+                {
+                    items[i - torn] = items[i];
+                }
+            }
+            return count - torn;
+        }
+
+        /***********************************************************************
+         * @brief Access an item, 0 being the oldest
+         * @param idx Index of the item, must be lower than size()
+         * @note Only safe from the producer task, readers must use snapshot()
+         ***********************************************************************/
+        const T &operator[](const size_t idx) const
+        {
+            const uint32_t head = _head.load(std::memory_order_relaxed);
+            return _items[(head - ((head < N) ? head : N) + idx) % N];
+        }
+
+        /***********************************************************************
+         * @brief Check an item was not overwritten while it was being copied
+         * @param idx Absolute index of the item, the first pushed being 0
+         ***********************************************************************/
+        bool isIntact(const uint32_t idx) const
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint32_t begin = _begin.load(std::memory_order_relaxed);
+
+            // Writing item "begin - 1" overwrites item "begin - 1 - N"
+            return (begin < N) || (idx >= begin - N);
+        }
+
+    private:
+        static constexpr size_t lower(const size_t a, const size_t b)
+        {
+            return (a < b) ? a : b;
+        }
+
+        T                     _items[N];
+        std::atomic<uint32_t> _begin;
+        std::atomic<uint32_t> _head;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef ROLLUP_HPP
+#define ROLLUP_HPP
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "RingBuffer.hpp"
+
+#define ROLLUP_METRICS          3          // Temperature, humidity and pressure
+
+// Index of each metric in a bucket
+enum Rollup_metric
+{
+    ROLLUP_TEMPERATURE,
+    ROLLUP_HUMIDITY,
+    ROLLUP_PRESSURE
+};
+
+// Resolutions kept by a rollup
+enum Rollup_level
+{
+    ROLLUP_MINUTE,
+    ROLLUP_HOUR,
+    ROLLUP_DAY
+};
+
+// Summary of the samples received during one period
+typedef struct
+{
+    uint32_t start;                        // Epoch of the beginning of the period
+    uint32_t count;                        // Number of samples
+    bool     partial;                      // True while the period is still running
+    float    min[ROLLUP_METRICS];
+    float    max[ROLLUP_METRICS];
+    float    mean[ROLLUP_METRICS];
+} Rollup_bucket;
+
+/***********************************************************************
+ * @brief Closed buckets of one resolution plus the one being filled
+ * @tparam N Number of closed buckets kept
+ ***********************************************************************/
+template <size_t N>
+class RollupLevel
+{
+    public:
+        explicit RollupLevel(const uint32_t period) : _period(period), _open(false), _current(), _valid() {}
+
+        /***********************************************************************
+         * @brief Account a sample, closing the current bucket if the period is over
+         * @param time Epoch of the sample
+         * @param values One value per metric, the ones not finite are skipped
+         ***********************************************************************/
+        void add(const uint32_t time, const float values[ROLLUP_METRICS])
+        {
+            const uint32_t start = time - (time % _period);
+
+            // Late samples are merged in the current bucket rather than going back in time
+            if((_open == true) && (start > _current.start))
+            {
+                _current.partial = false;
+                _closed.push(_current);
+                _open = false;
+            }
+
+            if(_open == false)
+            {
+                _current.start   = start;
+                _current.count   = 0;
+                _current.partial = true;
+                for(uint8_t i = 0; i < ROLLUP_METRICS; i++)
+                {
+                    _current.min[i]  = NAN;
+                    _current.max[i]  = NAN;
+                    _current.mean[i] = NAN;
+                    _valid[i]        = 0;
+                }
+                _open = true;
+            }
+
+            _current.count++;
+            for(uint8_t i = 0; i < ROLLUP_METRICS; i++)
+            {
+                // A NaN would stay in the mean until the bucket is closed
+                if(isfinite(values[i]) == false)
+                {
+                    continue;
+                }
+
+                _valid[i]++;
+                if((_valid[i] == 1) || (values[i] < _current.min[i]))
+                {
+                    _current.min[i] = values[i];
+                }
+                if((_valid[i] == 1) || (values[i] > _current.max[i]))
+                {
+                    _current.max[i] = values[i];
+                }
+
+                // Running mean, a float sum would lose precision over a day of pressure samples
+                if(_valid[i] == 1)
+                {
+                    _current.mean[i] = values[i];
+                }
+                else
+                {
+                    _current.mean[i] += (values[i] - _current.mean[i]) / _valid[i];
+                }
+            }
+
+            // Published after the closed bucket, see snapshot()
+            _latest.push(_current);
+        }
+
+        /***********************************************************************
+         * @brief Copy the closed buckets, oldest first, then the open one
+         * marked as partial, without locking
+         ***********************************************************************/
+        size_t snapshot(Rollup_bucket *buckets, const size_t maxBuckets) const
+        {
+            if(maxBuckets == 0)
+            {
+                return 0;
+            }
+
+            // The open bucket is read first: if it gets closed meanwhile, the closed ones read after already hold it
+            Rollup_bucket open;
+            const bool    hasOpen = _latest.last(open);
+            size_t        count   = _closed.snapshot(buckets, hasOpen ? maxBuckets - 1 : maxBuckets);
+            if((hasOpen == true) && ((count == 0) || (open.start > buckets[count - 1].start)))
+            {
+                buckets[count++] = open;
+            }
+            return count;
+        }
+
+        uint32_t period() const
+        {
+            return _period;
+        }
+
+    private:
+        const uint32_t                 _period;
+        bool                           _open;
+        Rollup_bucket                  _current;
+        uint32_t                       _valid[ROLLUP_METRICS];  // Finite values of each metric in _current
+        RingBuffer<Rollup_bucket, N>   _closed;
+        RingBuffer<Rollup_bucket, 2>   _latest;                 // Copies of _current for the readers
+};
+
+/***********************************************************************
+ * @brief Incremental downsampling of one room at several resolutions
+ *
+ * Every sample is accounted in a minute, an hour and a day bucket, each
+ * keeping min, max, mean and count. Memory is fixed: only the latest
+ * buckets of each resolution are kept. The bucket still being filled is
+ * given too, marked as partial, so a day is summarized before it ends.
+ * @tparam MINUTES Number of minute buckets kept
+ * @tparam HOURS Number of hour buckets kept
+ * @tparam DAYS Number of day buckets kept
+ * @note add() must only be called from one task, snapshot() from any
+ ***********************************************************************/
+template <size_t MINUTES, size_t HOURS, size_t DAYS>
+class Rollup
+{
+    public:
+        Rollup() : _minutes(60), _hours(3600), _days(86400) {}
+
+        void add(const uint32_t time, const float values[ROLLUP_METRICS])
+        {
+            _minutes.add(time, values);
+            _hours.add(time, values);
+            _days.add(time, values);
+        }
+
+        /***********************************************************************
+         * @brief Copy the buckets of a resolution, oldest first, the last one
+         * being partial if its period is still running
+         * @param level Resolution wanted
+         * @param buckets Where to copy the buckets, capacity(level) + 1 holds them all
+         * @param maxBuckets Maximum number of buckets to copy
+         * @return Number of buckets copied
+         ***********************************************************************/
+        size_t snapshot(const Rollup_level level, Rollup_bucket *buckets, const size_t maxBuckets) const
+        {
+            switch(level)
+            {
+                case ROLLUP_MINUTE:
+                    return _minutes.snapshot(buckets, maxBuckets);
+                case ROLLUP_HOUR:
+                    return _hours.snapshot(buckets, maxBuckets);
+                case ROLLUP_DAY:
+                    return _days.snapshot(buckets, maxBuckets);
+            }
+            return 0;
+        }
+
+        static constexpr size_t capacity(const Rollup_level level)
+        {
+            return (level == ROLLUP_MINUTE) ? MINUTES : ((level == ROLLUP_HOUR) ? HOURS : DAYS);
+        }
+
+    private:
+        RollupLevel<MINUTES> _minutes;
+        RollupLevel<HOURS>   _hours;
+        RollupLevel<DAYS>    _days;
+};
+
+#endif
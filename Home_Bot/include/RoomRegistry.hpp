@@ -0,0 +1,373 @@
+#ifndef ROOM_REGISTRY_HPP
+#define ROOM_REGISTRY_HPP
+
+#include <atomic>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "Messages.hpp"
+#include "RingBuffer.hpp"
+#include "Rollup.hpp"
+#include "SeriesCodec.hpp"
+#include "TextWriter.hpp"
+#include "BinaryWriter.hpp"
+
+#define ROOM_MAX                32         // Max number of rooms, ids go from 0 to ROOM_MAX - 1
+#define ROOM_NAME_SIZE          24         // Max size of a room name, NUL included
+#define ROOM_MAC_SLOTS          64         // Size of the sender address table, a power of 2 above ROOM_MAX
+#define MAX_DATA                10         // Max number of data to store per room
+#define ROLLUP_MINUTES          30         // Number of minute summaries kept per room
+#define ROLLUP_HOURS            48         // Number of hour summaries kept per room
+#define ROLLUP_DAYS             7          // Number of day summaries kept per room
+#define SERIES_BLOCK_BYTES      512        // Size of a block of compressed samples
+#define SERIES_BLOCKS           4          // Number of blocks of compressed samples kept per room
+
+// Minute, hour and day summaries of a room
+typedef Rollup<ROLLUP_MINUTES, ROLLUP_HOURS, ROLLUP_DAYS> Room_rollup;
+
+/***********************************************************************
+ * @brief A room and everything kept about it, whatever its sensor
+ *
+ * Readers only go through this interface, so serialization never needs
+ * to know which sensor a room has.
+ ***********************************************************************/
+class Room
+{
+    public:
+        Room(const uint8_t id, const char *name, const Sensor_type sensor) : _id(id), _sensor(sensor)
+        {
+            snprintf(_name, sizeof(_name), "%s", name);
+        }
+
+        virtual ~Room() {}
+
+        uint8_t id() const
+        {
+            return _id;
+        }
+
+        const char *name() const
+        {
+            return _name;
+        }
+
+        Sensor_type sensor() const
+        {
+            return _sensor;
+        }
+
+        const Room_rollup &rollup() const
+        {
+            return _rollup;
+        }
+
+        /***********************************************************************
+         * @brief Write the samples kept in RAM, oldest first
+         * @note Fields are separated by ',' and samples by ';', like /all_data
+         ***********************************************************************/
+        virtual void writeHistory(TextWriter &out) const = 0;
+
+        /***********************************************************************
+         * @brief Write the last sample, zeroed if the room has none yet
+         * @param out Where to write
+         * @param verbose True for a human readable text, else fields are separated by ';'
+         ***********************************************************************/
+        virtual void writeLast(TextWriter &out, const bool verbose) const = 0;
+
+        /***********************************************************************
+         * @brief Write the samples kept in RAM as one room of /all_data.bin
+         * @note id (1), sensor type (1), number of samples (2), then for each
+         *       sample the time (4) and every value (4 each as float)
+         ***********************************************************************/
+        virtual void writeBinary(BinaryWriter &out) const = 0;
+
+        /***********************************************************************
+         * @brief Decode the sealed blocks of the compressed history, in the /all_data format
+         ***********************************************************************/
+        virtual void writeSeries(TextWriter &out) const = 0;
+
+    protected:
+        Room_rollup   _rollup;
+
+    private:
+        const uint8_t     _id;
+        const Sensor_type _sensor;
+        char              _name[ROOM_NAME_SIZE];
+};
+
+/***********************************************************************
+ * @brief Room fed with one type of sample
+ * @tparam Message Type of sample, see Message_traits
+ * @note store() must only be called from one task, the readers from any
+ ***********************************************************************/
+template <typename Message>
+class TypedRoom : public Room
+{
+    public:
+        typedef Message_traits<Message> Traits;
+
+        TypedRoom(const uint8_t id, const char *name) : Room(id, name, Traits::SENSOR) {}
+
+        /***********************************************************************
+         * @brief Add a sample to the history, the summaries and the compressed history
+         * @param sample Sample to store, its id is not checked
+         ***********************************************************************/
+        void store(const Message &sample)
+        {
+            float values[Traits::FIELDS];
+            Traits::toValues(sample, values);
+
+            _data.push(sample);
+            _rollup.add(sample.time, values);
+            _series.add(sample.time, values);
+        }
+
+        /***********************************************************************
+         * @brief Write the name of the room and the fields of a sample
+         * @param out Where to write
+         * @param sample Sample to write
+         * @param separator Character written between fields
+         ***********************************************************************/
+        void writeFields(TextWriter &out, const Message &sample, const char separator) const
+        {
+            float values[Traits::FIELDS];
+            Traits::toValues(sample, values);
+
+            out.write(name());
+            out.write(separator);
+            out.writeUInt(sample.time);
+            for (size_t i = 0; i < Traits::FIELDS; i++)
+            {
+                out.write(separator);
+                out.writeFloat(values[i]);
+            }
+        }
+
+        void writeHistory(TextWriter &out) const override
+        {
+            Message      samples[MAX_DATA];
+            const size_t count = _data.snapshot(samples, MAX_DATA);
+            for (size_t i = 0; i < count; i++)
+            {
+                writeFields(out, samples[i], ',');
+                out.write(';');
+            }
+        }
+
+        void writeLast(TextWriter &out, const bool verbose) const override
+        {
+            Message sample;
+            memset(&sample, 0, sizeof(sample));
+            _data.last(sample);
+
+            if(verbose == false)
+            {
+                writeFields(out, sample, ';');
+                return;
+            }
+
+            float values[Traits::FIELDS];
+            Traits::toValues(sample, values);
+
+            out.write("In ");
+            for (const char *c = name(); *c != '\0'; c++)
+            {
+                out.write((char)tolower(*c));
+            }
+            out.write(":\n\t\tTime: ");
+            out.writeUInt(sample.time);
+            for (size_t i = 0; i < Traits::FIELDS; i++)
+            {
+                out.write(";\t\t");
+                out.write(Traits::label(i));
+                out.write(": ");
+                out.writeFloat(values[i]);
+            }
+        }
+
+        void writeBinary(BinaryWriter &out) const override
+        {
+            // Header and samples come from the same copy
+            Message      samples[MAX_DATA];
+            const size_t count = _data.snapshot(samples, MAX_DATA);
+
+            out.writeU8(id());
+            out.writeU8(Traits::SENSOR);
+            out.writeU16(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                float values[Traits::FIELDS];
+                Traits::toValues(samples[i], values);
+                out.writeU32(samples[i].time);
+                for (size_t f = 0; f < Traits::FIELDS; f++)
+                {
+                    out.writeFloat(values[f]);
+                }
+            }
+        }
+
+        void writeSeries(TextWriter &out) const override
+        {
+            typename Series::Block blocks[SERIES_BLOCKS];
+            const size_t           count = _series.snapshot(blocks, SERIES_BLOCKS);
+
+            for (size_t b = 0; b < count; b++)
+            {
+                SeriesDecoder<Traits::FIELDS, SERIES_BLOCK_BYTES> decoder(blocks[b]);
+                Message                                           sample;
+                float                                             values[Traits::FIELDS];
+                sample.id = id();
+                while(decoder.next(sample.time, values))
+                {
+                    Traits::fromValues(sample, values);
+                    writeFields(out, sample, ',');
+                    out.write(';');
+                }
+            }
+        }
+
+    private:
+        typedef SeriesHistory<Traits::FIELDS, SERIES_BLOCK_BYTES, SERIES_BLOCKS> Series;
+
+        RingBuffer<Message, MAX_DATA>   _data;
+        Series                          _series;
+};
+
+/***********************************************************************
+ * @brief Every room of the house, found by id or by sender address
+ *
+ * Rooms are registered at runtime and never removed, so readers can walk
+ * the registry without locking while a room is being added. Lookups by id
+ * index an array, lookups by address hash the MAC, both are O(1).
+ * @note add() and bind() must only be called from one task at a time
+ ***********************************************************************/
+class RoomRegistry
+{
+    public:
+        RoomRegistry() : _count(0)
+        {
+            for (size_t i = 0; i < ROOM_MAX; i++)
+            {
+                _byId[i].store(NULL, std::memory_order_relaxed);
+            }
+            memset(_macs, 0, sizeof(_macs));
+        }
+
+        /***********************************************************************
+         * @brief Register a room, it must live as long as the registry
+         * @return False if the id is out of range or taken, or the registry is full
+         ***********************************************************************/
+        bool add(Room *room)
+        {
+            const size_t count = _count.load(std::memory_order_relaxed);
+            if((room->id() >= ROOM_MAX) || (find(room->id()) != NULL) || (count >= ROOM_MAX))
+            {
+                return false;
+            }
+
+            _rooms[count] = room;
+            _byId[room->id()].store(room, std::memory_order_release);
+            _count.store(count + 1, std::memory_order_release);
+            return true;
+        }
+
+        /***********************************************************************
+         * @return Room with this id, NULL if none
+         ***********************************************************************/
+        Room *find(const uint8_t id) const
+        {
+            if(id >= ROOM_MAX)
+            {
+                return NULL;
+            }
+            return _byId[id].load(std::memory_order_acquire);
+        }
+
+        /***********************************************************************
+         * @brief Remember that a sender feeds a room
+         * @param mac Address of the sender
+         * @param id Id of a registered room
+         * @return False if the table is full
+         ***********************************************************************/
+        bool bind(const uint8_t mac[6], const uint8_t id)
+        {
+            for (size_t probe = 0; probe < ROOM_MAC_SLOTS; probe++)
+            {
+                Mac_slot &slot = _macs[(hash(mac) + probe) & (ROOM_MAC_SLOTS - 1)];
+                if((slot.used == false) || (memcmp(slot.mac, mac, 6) == 0))
+                {
+                    memcpy(slot.mac, mac, 6);
+                    slot.id   = id;
+                    slot.used = true;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /***********************************************************************
+         * @return Room fed by this sender, NULL if it was never bound
+         ***********************************************************************/
+        Room *findByMac(const uint8_t mac[6]) const
+        {
+            for (size_t probe = 0; probe < ROOM_MAC_SLOTS; probe++)
+            {
+                const Mac_slot &slot = _macs[(hash(mac) + probe) & (ROOM_MAC_SLOTS - 1)];
+                if(slot.used == false)
+                {
+                    return NULL;
+                }
+                if(memcmp(slot.mac, mac, 6) == 0)
+                {
+                    return find(slot.id);
+                }
+            }
+            return NULL;
+        }
+
+        /***********************************************************************
+         * @return Number of rooms, use with at() to walk them in registration order
+         ***********************************************************************/
+        size_t count() const
+        {
+            return _count.load(std::memory_order_acquire);
+        }
+
+        Room *at(const size_t idx) const
+        {
+            return _rooms[idx];
+        }
+
+    private:
+        static_assert((ROOM_MAC_SLOTS & (ROOM_MAC_SLOTS - 1)) == 0, "ROOM_MAC_SLOTS must be a power of 2");
+        static_assert(ROOM_MAC_SLOTS > ROOM_MAX, "ROOM_MAC_SLOTS must be greater than ROOM_MAX");
+
+        typedef struct
+        {
+            uint8_t mac[6];
+            uint8_t id;
+            bool    used;
+        } Mac_slot;
+
+        /***********************************************************************
+         * @brief FNV-1a of the address, the last bytes alone are often alike
+         ***********************************************************************/
+        static uint32_t hash(const uint8_t mac[6])
+        {
+            uint32_t h = 2166136261U;
+            for (uint8_t i = 0; i < 6; i++)
+            {
+                h = (h ^ mac[i]) * 16777619U;
+            }
+            return h;
+        }
+
+        Room                *_rooms[ROOM_MAX];
+        std::atomic<Room *>  _byId[ROOM_MAX];
+        Mac_slot             _macs[ROOM_MAC_SLOTS];
+        std::atomic<size_t>  _count;
+};
+
+#endif
@@ -0,0 +1,455 @@
+#ifndef SAMPLE_LOG_HPP
+#define SAMPLE_LOG_HPP
+
+#include <FS.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_SEGMENT_RECORDS     1024       // Max number of records in a segment file
+#define LOG_MAX_SEGMENTS        8          // Max number of segment files kept, the oldest is removed
+#define LOG_BATCH_RECORDS       32         // Number of records buffered in RAM before writing to flash
+#define LOG_SCAN_CHUNK          8          // Number of records read from flash at once
+#define LOG_PREFIX              "log_"     // Name of the segment files is log_<number>.bin
+
+// One sample of one room, as stored on flash
+typedef struct __attribute__((packed))
+{
+    uint32_t time;
+    uint8_t  room;
+    uint8_t  sensor;
+    uint16_t reserved;
+    float    temperature;
+    float    humidity;
+    float    pressure;
+    float    altitude;
+    float    gas_resistance;
+    uint32_t crc;                   // CRC-32 of all the previous fields
+} Log_record;
+
+static_assert(sizeof(Log_record) == 32, "Log_record must stay 32 bytes long");
+
+// Oldest and newest times of the records of a segment, kept in RAM
+typedef struct
+{
+    uint32_t oldest;
+    uint32_t newest;
+} Log_range;
+
+// Where a scan stopped, so the log can be read a few records at a time
+typedef struct
+{
+    uint32_t segment;               // Segment read next, 0 to start from the oldest
+    uint32_t record;                // Record read next in that segment
+} Log_cursor;
+
+// Log statistics
+typedef struct
+{
+    uint32_t appended;              // Records given to append()
+    uint32_t written;               // Records written to flash
+    uint32_t flushes;               // Number of writes to flash
+    uint32_t segments_removed;      // Segments removed by retention
+    uint32_t crc_errors;            // Records skipped by scan() because of a bad CRC
+    uint32_t dropped;               // Records lost because flash could not be written
+} Log_stats;
+
+/***********************************************************************
+ * @brief Append-only log of samples on a flash file system
+ *
+ * Records have a fixed size and their own CRC. They are buffered in RAM
+ * and written LOG_BATCH_RECORDS at a time to the newest segment file. A
+ * new segment is started when it is full, and the oldest one is removed
+ * when more than LOG_MAX_SEGMENTS exist.
+ *
+ * Records are kept in the order they arrive, which is not the order of
+ * their times: a batch of a node comes late, a node not synced yet gives
+ * times since its boot. The range of times of each segment is kept in
+ * RAM so a scan only skips the segments with no time in its range.
+ * @note Not thread safe, calls must be serialized by the caller
+ ***********************************************************************/
+class SampleLog
+{
+    public:
+        explicit SampleLog(fs::FS &fs) : _fs(fs), _first(0), _last(0), _records(0), _pending(0)
+        {
+            memset(&_stats, 0, sizeof(_stats));
+            for(size_t i = 0; i < LOG_MAX_SEGMENTS; i++)
+            {
+                clearRange(_ranges[i]);
+            }
+        }
+
+        /***********************************************************************
+         * @brief Find the segments left by a previous run and read their time ranges
+         * @return False if no segment can be created
+         ***********************************************************************/
+        bool begin()
+        {
+            bool  found = false;
+            File  root  = _fs.open("/");
+            File  file  = root.openNextFile();
+            while(file)
+            {
+                uint32_t segment;
+                if(parseSegment(file.name(), segment) == true)
+                {
+                    if((found == false) || (segment < _first))
+                    {
+                        _first = segment;
+                    }
+                    if((found == false) || (segment > _last))
+                    {
+                        _last    = segment;
+                        _records = file.size() / sizeof(Log_record);
+
+                        // A partial record means power was lost while writing, start a clean segment
+                        if((file.size() % sizeof(Log_record)) != 0)
+                        {
+                            _records = LOG_SEGMENT_RECORDS;
+                        }
+                    }
+                    found = true;
+                }
+                file.close();
+                file = root.openNextFile();
+            }
+            root.close();
+
+            if(found == false)
+            {
+                _first   = 0;
+                _last    = 0;
+                _records = 0;
+            }
+
+            // Only LOG_MAX_SEGMENTS ranges are kept, as many segments as retention allows
+            char path[32];
+            while((_last - _first + 1) > LOG_MAX_SEGMENTS)
+            {
+                _fs.remove(segmentPath(_first, path));
+                _first++;
+                _stats.segments_removed++;
+            }
+
+            for(uint32_t segment = _first; segment <= _last; segment++)
+            {
+                Log_range &range = _ranges[segment % LOG_MAX_SEGMENTS];
+                clearRange(range);
+
+                File file = _fs.open(segmentPath(segment, path), FILE_READ);
+                if(!file)
+                {
+                    continue;
+                }
+                Log_record chunk[LOG_SCAN_CHUNK];
+                size_t     read;
+                while((read = file.read((uint8_t *)chunk, sizeof(chunk)) / sizeof(Log_record)) > 0)
+                {
+                    for(size_t i = 0; i < read; i++)
+                    {
+                        if(check(chunk[i]) == true)
+                        {
+                            widenRange(range, chunk[i].time);
+                        }
+                    }
+                }
+                file.close();
+            }
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Add a record, flash is only written once a batch is full
+         * @param record Record to add, its CRC is computed here
+         * @return False if the batch could not be written
+         ***********************************************************************/
+        bool append(const Log_record &record)
+        {
+            // The last flush failed, retry it before losing the record
+            if((_pending == LOG_BATCH_RECORDS) && (flush() == false))
+            {
+                _stats.dropped++;
+                return false;
+            }
+
+            _batch[_pending]     = record;
+            _batch[_pending].crc = crc32((const uint8_t *)&record, offsetof(Log_record, crc));
+            _pending++;
+            _stats.appended++;
+
+            if(_pending == LOG_BATCH_RECORDS)
+            {
+                return flush();
+            }
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Write the buffered records to flash
+         * @return False if the segment could not be written
+         ***********************************************************************/
+        bool flush()
+        {
+            size_t done = 0;
+            while(done < _pending)
+            {
+                if(_records >= LOG_SEGMENT_RECORDS)
+                {
+                    startSegment();
+                }
+
+                char path[32];
+                segmentPath(_last, path);
+                File file = _fs.open(path, FILE_APPEND);
+                if(!file)
+                {
+                    keepPending(done);
+                    return false;
+                }
+
+                // Never write a segment past its size
+                const size_t room  = LOG_SEGMENT_RECORDS - _records;
+                const size_t count = ((_pending - done) < room) ? (_pending - done) : room;
+                const size_t bytes = count * sizeof(Log_record);
+                const size_t wrote = file.write((const uint8_t *)&_batch[done], bytes);
+                file.close();
+
+                _stats.flushes++;
+                if(wrote != bytes)
+                {
+                    // Records of a partial write are not trusted, move to a new segment
+                    _records = LOG_SEGMENT_RECORDS;
+                    keepPending(done);
+                    return false;
+                }
+                for(size_t i = done; i < done + count; i++)
+                {
+                    widenRange(_ranges[_last % LOG_MAX_SEGMENTS], _batch[i].time);
+                }
+                _records       += count;
+                _stats.written += count;
+                done           += count;
+            }
+            _pending = 0;
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Copy the records of a room within a time range, in the order they were logged
+         *
+         * The log is read from the cursor on, so a caller can copy a few
+         * records at a time and let the log be written in between. Segments
+         * removed meanwhile are skipped.
+         * @param room Id of the room
+         * @param from First time included
+         * @param to Last time included
+         * @param cursor Where to start, zeroed for the first call, then moved after the last record read
+         * @param records Where to copy the records
+         * @param maxRecords Maximum number of records to copy
+         * @return Number of records copied, less than maxRecords once the whole log was read
+         * @note Records still in the RAM batch are not seen, flush() first if needed
+         ***********************************************************************/
+        size_t scan(const uint8_t room, const uint32_t from, const uint32_t to, Log_cursor &cursor, Log_record *records, const size_t maxRecords)
+        {
+            size_t copied = 0;
+            if(cursor.segment < _first)
+            {
+                cursor.segment = _first;
+                cursor.record  = 0;
+            }
+
+            while((copied < maxRecords) && (cursor.segment <= _last))
+            {
+                // Skip the segments with no time in the range, whatever the order of their records
+                const Log_range &range = _ranges[cursor.segment % LOG_MAX_SEGMENTS];
+                File             file;
+                char             path[32];
+                if((range.oldest <= to) && (range.newest >= from))
+                {
+                    file = _fs.open(segmentPath(cursor.segment, path), FILE_READ);
+                }
+                if(!file || (file.seek(cursor.record * sizeof(Log_record)) == false))
+                {
+                    cursor.segment++;
+                    cursor.record = 0;
+                    continue;
+                }
+
+                Log_record chunk[LOG_SCAN_CHUNK];
+                size_t     read = 0;
+                while((copied < maxRecords) && ((read = file.read((uint8_t *)chunk, sizeof(chunk)) / sizeof(Log_record)) > 0))
+                {
+                    size_t i = 0;
+                    while((i < read) && (copied < maxRecords))
+                    {
+                        const Log_record &record = chunk[i++];
+                        if(check(record) == false)
+                        {
+                            _stats.crc_errors++;
+                        }
+                        else if((record.room == room) && (record.time >= from) && (record.time <= to))
+                        {
+                            records[copied++] = record;
+                        }
+                    }
+                    cursor.record += i;
+                }
+                file.close();
+
+                // Go on with the next segment once this one was read to its end
+                if(read == 0)
+                {
+                    cursor.segment++;
+                    cursor.record = 0;
+                }
+            }
+            return copied;
+        }
+
+        /***********************************************************************
+         * @return Range of times of a segment, empty (oldest > newest) if it is not kept
+         ***********************************************************************/
+        Log_range range(const uint32_t segment) const
+        {
+            Log_range empty;
+            clearRange(empty);
+            return ((segment >= _first) && (segment <= _last)) ? _ranges[segment % LOG_MAX_SEGMENTS] : empty;
+        }
+
+        /***********************************************************************
+         * @return Number of records waiting in RAM
+         ***********************************************************************/
+        size_t pending() const
+        {
+            return _pending;
+        }
+
+        /***********************************************************************
+         * @return Number of segment files
+         ***********************************************************************/
+        uint32_t segments() const
+        {
+            return _last - _first + 1;
+        }
+
+        const Log_stats &stats() const
+        {
+            return _stats;
+        }
+
+        /***********************************************************************
+         * @brief Check the CRC of a record
+         ***********************************************************************/
+        static bool check(const Log_record &record)
+        {
+            return record.crc == crc32((const uint8_t *)&record, offsetof(Log_record, crc));
+        }
+
+        /***********************************************************************
+         * @brief CRC-32 (IEEE 802.3, the one of zip and Ethernet)
+         ***********************************************************************/
+        static uint32_t crc32(const uint8_t *data, const size_t len)
+        {
+            uint32_t crc = 0xFFFFFFFF;
+            for(size_t i = 0; i < len; i++)
+            {
+                crc ^= data[i];
+                for(uint8_t bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+                }
+            }
+            return ~crc;
+        }
+
+    private:
+        /***********************************************************************
+         * @brief Keep only the records not written yet after a failed flush
+         * @param written Number of records of the batch already on flash
+         ***********************************************************************/
+        void keepPending(const size_t written)
+        {
+            memmove(&_batch[0], &_batch[written], (_pending - written) * sizeof(Log_record));
+            _pending -= written;
+        }
+
+        void startSegment()
+        {
+            char path[32];
+
+            // The very first segment of an empty log keeps its number
+            if((_records > 0) || _fs.exists(segmentPath(_last, path)))
+            {
+                _last++;
+            }
+            _records = 0;
+
+            // Apply retention
+            while((_last - _first + 1) > LOG_MAX_SEGMENTS)
+            {
+                _fs.remove(segmentPath(_first, path));
+                _first++;
+                _stats.segments_removed++;
+            }
+
+            // The slot of the removed segment is reused
+            clearRange(_ranges[_last % LOG_MAX_SEGMENTS]);
+        }
+
+        static void clearRange(Log_range &range)
+        {
+            range.oldest = UINT32_MAX;
+            range.newest = 0;
+        }
+
+        static void widenRange(Log_range &range, const uint32_t time)
+        {
+            range.oldest = (time < range.oldest) ? time : range.oldest;
+            range.newest = (time > range.newest) ? time : range.newest;
+        }
+
+        static const char *segmentPath(const uint32_t segment, char *path)
+        {
+            snprintf(path, 32, "/" LOG_PREFIX "%08lu.bin", (unsigned long)segment);
+            return path;
+        }
+
+        /***********************************************************************
+         * @brief Get the number of a segment from its file name
+         * @param name File name, with or without the leading directory
+         * @param segment Where to store the number
+         * @return False if the file is not a segment
+         ***********************************************************************/
+        static bool parseSegment(const char *name, uint32_t &segment)
+        {
+            const char *base = strrchr(name, '/');
+            base             = (base == NULL) ? name : base + 1;
+            if(strncmp(base, LOG_PREFIX, strlen(LOG_PREFIX)) != 0)
+            {
+                return false;
+            }
+
+            char          *end;
+            unsigned long  value = strtoul(base + strlen(LOG_PREFIX), &end, 10);
+            if(strcmp(end, ".bin") != 0)
+            {
+                return false;
+            }
+            segment = value;
+            return true;
+        }
+
+        fs::FS     &_fs;
+        uint32_t    _first;
+        uint32_t    _last;
+        size_t      _records;               // Records in the newest segment
+        size_t      _pending;               // Records in the RAM batch
+        Log_record  _batch[LOG_BATCH_RECORDS];
+        Log_range   _ranges[LOG_MAX_SEGMENTS];  // Indexed by segment % LOG_MAX_SEGMENTS
+        Log_stats   _stats;
+};
+
+#endif
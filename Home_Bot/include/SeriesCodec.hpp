@@ -0,0 +1,368 @@
+#ifndef SERIES_CODEC_HPP
+#define SERIES_CODEC_HPP
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "RingBuffer.hpp"
+
+#define SERIES_SCALE            100.0F     // Values are stored with 0.01 resolution, like they are displayed
+#define SERIES_MAX_VALUE        20000000.0F // Largest value stored, its hundredths fit an int32 once rounded to a float, like BATCH_MAX_VALUE
+#define SERIES_MISSING          INT32_MIN  // Quantized value of a sample without a usable value, decoded as NaN
+
+/***********************************************************************
+ * @brief Block of compressed samples
+ * @tparam BYTES Size of the compressed data
+ ***********************************************************************/
+template <size_t BYTES>
+struct Series_block
+{
+    uint16_t count;                        // Number of samples
+    uint16_t bits;                         // Number of bits used in data
+    uint8_t  data[BYTES];
+};
+
+/***********************************************************************
+ * @brief Encoding shared by the encoder and the decoder
+ *
+ * The first sample of a block is stored raw. Then, Gorilla style:
+ *  - time: delta of delta, '0' when samples are evenly spaced, else
+ *    '10' + 7 bits, '110' + 12 bits or '111' + 32 bits (zigzag)
+ *  - values: quantized to 0.01 and stored as delta to the previous one,
+ *    '0' when unchanged, else '10' + 4 bits, '110' + 8 bits,
+ *    '1110' + 16 bits or '1111' + 32 bits (zigzag)
+ * A value that is not finite or above SERIES_MAX_VALUE is SERIES_MISSING,
+ * it comes unchecked from the nodes.
+ ***********************************************************************/
+class SeriesCoding
+{
+    public:
+        static constexpr uint8_t TIME_MAX_BITS  = 3 + 32;
+        static constexpr uint8_t VALUE_MAX_BITS = 4 + 32;
+
+        static uint32_t zigzag(const int32_t value)
+        {
+            return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        }
+
+        static int32_t unzigzag(const uint32_t value)
+        {
+            return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        }
+
+        static int32_t quantize(const float value)
+        {
+            if((isfinite(value) == false) || (fabsf(value) > SERIES_MAX_VALUE))
+            {
+                return SERIES_MISSING;
+            }
+            return (int32_t)lroundf(value * SERIES_SCALE);
+        }
+
+        static float dequantize(const int32_t value)
+        {
+            return (value == SERIES_MISSING) ? NAN : value / SERIES_SCALE;
+        }
+};
+
+/***********************************************************************
+ * @brief Streaming encoder of samples made of a time and FIELDS floats
+ * @tparam FIELDS Number of values in a sample
+ * @tparam BYTES Size of the block filled
+ ***********************************************************************/
+template <size_t FIELDS, size_t BYTES>
+class SeriesEncoder
+{
+    static_assert(BYTES * 8 <= UINT16_MAX, "Series_block bits must fit on 16 bits");
+
+    public:
+        SeriesEncoder()
+        {
+            reset();
+        }
+
+        /***********************************************************************
+         * @brief Start a new empty block
+         ***********************************************************************/
+        void reset()
+        {
+            memset(&_block, 0, sizeof(_block));
+            memset(_values, 0, sizeof(_values));
+            _time  = 0;
+            _delta = 0;
+        }
+
+        /***********************************************************************
+         * @brief Add a sample to the block
+         * @param time Epoch of the sample
+         * @param values FIELDS values, one missing is stored as the previous value,
+         *        as SERIES_MISSING in the first sample of the block
+         * @return False if the block is full, the sample is then not added
+         ***********************************************************************/
+        bool append(const uint32_t time, const float values[FIELDS])
+        {
+            // Make sure the worst case fits so a sample is never split
+            if((_block.bits + SeriesCoding::TIME_MAX_BITS + FIELDS * SeriesCoding::VALUE_MAX_BITS) > (BYTES * 8))
+            {
+                return false;
+            }
+
+            int32_t quantized[FIELDS];
+            for(size_t i = 0; i < FIELDS; i++)
+            {
+                const int32_t value = SeriesCoding::quantize(values[i]);
+                quantized[i]        = ((value == SERIES_MISSING) && (_block.count > 0)) ? _values[i] : value;
+            }
+
+            if(_block.count == 0)
+            {
+                writeBits(time, 32);
+                for(size_t i = 0; i < FIELDS; i++)
+                {
+                    writeBits((uint32_t)quantized[i], 32);
+                }
+            }
+            else
+            {
+                const int32_t delta = (int32_t)(time - _time);
+                writeTime(SeriesCoding::zigzag((int32_t)((uint32_t)delta - (uint32_t)_delta)));
+                _delta = delta;
+
+                for(size_t i = 0; i < FIELDS; i++)
+                {
+                    writeValue(SeriesCoding::zigzag((int32_t)((uint32_t)quantized[i] - (uint32_t)_values[i])));
+                }
+            }
+
+            _time = time;
+            memcpy(_values, quantized, sizeof(_values));
+            _block.count++;
+            return true;
+        }
+
+        const Series_block<BYTES> &block() const
+        {
+            return _block;
+        }
+
+    private:
+        void writeBits(const uint32_t value, const uint8_t count)
+        {
+            for(int8_t bit = count - 1; bit >= 0; bit--)
+            {
+                if((value >> bit) & 1)
+                {
+                    _block.data[_block.bits >> 3] |= 0x80 >> (_block.bits & 7);
+                }
+                _block.bits++;
+            }
+        }
+
+        void writeTime(const uint32_t dod)
+        {
+            if(dod == 0)
+            {
+                writeBits(0b0, 1);
+            }
+            else if(dod < (1U << 7))
+            {
+                writeBits(0b10, 2);
+                writeBits(dod, 7);
+            }
+            else if(dod < (1U << 12))
+            {
+                writeBits(0b110, 3);
+                writeBits(dod, 12);
+            }
+            else
+            {
+                writeBits(0b111, 3);
+                writeBits(dod, 32);
+            }
+        }
+
+        void writeValue(const uint32_t delta)
+        {
+            if(delta == 0)
+            {
+                writeBits(0b0, 1);
+            }
+            else if(delta < (1U << 4))
+            {
+                writeBits(0b10, 2);
+                writeBits(delta, 4);
+            }
+            else if(delta < (1U << 8))
+            {
+                writeBits(0b110, 3);
+                writeBits(delta, 8);
+            }
+            else if(delta < (1U << 16))
+            {
+                writeBits(0b1110, 4);
+                writeBits(delta, 16);
+            }
+            else
+            {
+                writeBits(0b1111, 4);
+                writeBits(delta, 32);
+            }
+        }
+
+        Series_block<BYTES> _block;
+        uint32_t            _time;
+        int32_t             _delta;
+        int32_t             _values[FIELDS];
+};
+
+/***********************************************************************
+ * @brief Streaming decoder of a block filled by SeriesEncoder
+ * @tparam FIELDS Number of values in a sample
+ * @tparam BYTES Size of the block read
+ ***********************************************************************/
+template <size_t FIELDS, size_t BYTES>
+class SeriesDecoder
+{
+    public:
+        explicit SeriesDecoder(const Series_block<BYTES> &block) : _block(block), _bit(0), _read(0), _time(0), _delta(0), _values() {}
+
+        /***********************************************************************
+         * @brief Decode the next sample
+         * @param time Where to store the epoch of the sample
+         * @param values Where to store the FIELDS values
+         * @return False once all samples are decoded
+         ***********************************************************************/
+        bool next(uint32_t &time, float values[FIELDS])
+        {
+            if(_read >= _block.count)
+            {
+                return false;
+            }
+
+            if(_read == 0)
+            {
+                _time = readBits(32);
+                for(size_t i = 0; i < FIELDS; i++)
+                {
+                    _values[i] = (int32_t)readBits(32);
+                }
+            }
+            else
+            {
+                _delta  = (int32_t)((uint32_t)_delta + (uint32_t)SeriesCoding::unzigzag(readTime()));
+                _time  += _delta;
+                for(size_t i = 0; i < FIELDS; i++)
+                {
+                    _values[i] = (int32_t)((uint32_t)_values[i] + (uint32_t)SeriesCoding::unzigzag(readValue()));
+                }
+            }
+
+            time = _time;
+            for(size_t i = 0; i < FIELDS; i++)
+            {
+                values[i] = SeriesCoding::dequantize(_values[i]);
+            }
+            _read++;
+            return true;
+        }
+
+    private:
+        uint32_t readBits(const uint8_t count)
+        {
+            uint32_t value = 0;
+            for(uint8_t i = 0; i < count; i++)
+            {
+                value = (value << 1) | ((_block.data[_bit >> 3] >> (7 - (_bit & 7))) & 1);
+                _bit++;
+            }
+            return value;
+        }
+
+        /***********************************************************************
+         * @brief Count the leading '1' of a prefix, up to max
+         ***********************************************************************/
+        uint8_t readPrefix(const uint8_t max)
+        {
+            uint8_t ones = 0;
+            while((ones < max) && (readBits(1) == 1))
+            {
+                ones++;
+            }
+            return ones;
+        }
+
+        uint32_t readTime()
+        {
+            const uint8_t sizes[] = {0, 7, 12, 32};
+            const uint8_t prefix  = readPrefix(3);
+            return (prefix == 0) ? 0 : readBits(sizes[prefix]);
+        }
+
+        uint32_t readValue()
+        {
+            const uint8_t sizes[] = {0, 4, 8, 16, 32};
+            const uint8_t prefix  = readPrefix(4);
+            return (prefix == 0) ? 0 : readBits(sizes[prefix]);
+        }
+
+        const Series_block<BYTES> &_block;
+        uint16_t                   _bit;
+        uint16_t                   _read;
+        uint32_t                   _time;
+        int32_t                    _delta;
+        int32_t                    _values[FIELDS];
+};
+
+/***********************************************************************
+ * @brief Compressed history: the block being filled plus the last sealed ones
+ *
+ * Sealed blocks never change, they can be copied by readers without
+ * locking or written as is to flash.
+ * @tparam FIELDS Number of values in a sample
+ * @tparam BYTES Size of a block
+ * @tparam BLOCKS Number of sealed blocks kept
+ * @note add() must only be called from one task, snapshot() from any
+ ***********************************************************************/
+template <size_t FIELDS, size_t BYTES, size_t BLOCKS>
+class SeriesHistory
+{
+    public:
+        typedef Series_block<BYTES> Block;
+
+        SeriesHistory() : _samples(0) {}
+
+        void add(const uint32_t time, const float values[FIELDS])
+        {
+            if(_encoder.append(time, values) == false)
+            {
+                _sealed.push(_encoder.block());
+                _encoder.reset();
+                _encoder.append(time, values);
+            }
+            _samples++;
+        }
+
+        /***********************************************************************
+         * @brief Copy the sealed blocks, oldest first
+         ***********************************************************************/
+        size_t snapshot(Block *blocks, const size_t maxBlocks) const
+        {
+            return _sealed.snapshot(blocks, maxBlocks);
+        }
+
+        /***********************************************************************
+         * @return Number of samples added since boot
+         ***********************************************************************/
+        uint32_t samples() const
+        {
+            return _samples;
+        }
+
+    private:
+        SeriesEncoder<FIELDS, BYTES>  _encoder;
+        RingBuffer<Block, BLOCKS>     _sealed;
+        volatile uint32_t             _samples;
+};
+
+#endif
@@ -0,0 +1,679 @@
+#ifndef TASK_METRICS_HPP
+#define TASK_METRICS_HPP
+
+#include <Arduino.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "TextWriter.hpp"
+
+#define METRICS_BUCKETS         12         // Buckets of a time histogram, the last one has no upper bound
+#define METRICS_MAX_TASKS       6          // Max number of tasks watched
+#define METRICS_MAX_MUTEXES     4          // Max number of mutexes watched
+#define METRICS_MAX_QUEUES      6          // Max number of queues watched
+#define SEQLOCK_SPINS           64         // Retries of a SeqLock reader before it sleeps
+
+/***********************************************************************
+ * @brief Histogram of durations in microseconds, with fixed buckets
+ *
+ * Buckets go from 10 us to 1 s, 1-5 steps per decade, which is enough to
+ * tell a loop of a few us from one stuck on I/O. Adding a value is a
+ * handful of compares, no division.
+ * @note Not thread safe, wrap it in a SeqLock to read it from other tasks
+ ***********************************************************************/
+class TimeHistogram
+{
+    public:
+        TimeHistogram() : _count(0), _sum(0), _max(0)
+        {
+            memset(_buckets, 0, sizeof(_buckets));
+        }
+
+        void add(const uint32_t us)
+        {
+            uint8_t idx = 0;
+            while((idx < METRICS_BUCKETS - 1) && (us > bound(idx)))
+            {
+                idx++;
+            }
+            _buckets[idx]++;
+            _count++;
+            _sum += us;
+            if(us > _max)
+            {
+                _max = us;
+            }
+        }
+
+        /***********************************************************************
+         * @return Upper bound in us of a bucket, the last one has none
+         ***********************************************************************/
+        static uint32_t bound(const uint8_t idx)
+        {
+            static const uint32_t bounds[METRICS_BUCKETS - 1] = {10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000};
+            return bounds[idx];
+        }
+
+        /***********************************************************************
+         * @return Number of values in a bucket only, not cumulative
+         ***********************************************************************/
+        uint32_t bucket(const uint8_t idx) const
+        {
+            return _buckets[idx];
+        }
+
+        uint32_t count() const
+        {
+            return _count;
+        }
+
+        uint64_t sum() const
+        {
+            return _sum;
+        }
+
+        uint32_t max() const
+        {
+            return _max;
+        }
+
+    private:
+        uint32_t _buckets[METRICS_BUCKETS];
+        uint32_t _count;
+        uint64_t _sum;
+        uint32_t _max;
+};
+
+/***********************************************************************
+ * @brief Value written by one task at a time and read by any task without lock
+ *
+ * The writer makes the sequence odd while it writes. A reader retries if
+ * the sequence was odd or changed during its copy. A writer on the other
+ * core is done within a few µs, so the first SEQLOCK_SPINS retries only
+ * yield. Past them the writer was preempted by the reader itself, which
+ * then sleeps a tick so that a lower priority writer can finish.
+ * @tparam T Type of the value (must be trivially copyable)
+ ***********************************************************************/
+template <typename T>
+class SeqLock
+{
+    public:
+        SeqLock() : _sequence(0), _value() {}
+
+        /***********************************************************************
+         * @brief Start writing
+         * @return Value to update, commit() must follow
+         ***********************************************************************/
+        T &begin()
+        {
+            _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            return _value;
+        }
+
+        void commit()
+        {
+            _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /***********************************************************************
+         * @brief Copy a consistent value
+         ***********************************************************************/
+        void read(T &copy) const
+        {
+            for (uint32_t tries = 0; ; tries++)
+            {
+                const uint32_t before = _sequence.load(std::memory_order_acquire);
+                if((before & 1) == 0)
+                {
+                    copy = _value;
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if(_sequence.load(std::memory_order_relaxed) == before)
+                    {
+                        return;
+                    }
+                }
+                if(tries < SEQLOCK_SPINS)
+                {
+                    taskYIELD();
+                }
+                else
+                {
+                    vTaskDelay(1);
+                }
+            }
+        }
+
+    private:
+        std::atomic<uint32_t> _sequence;
+        T                     _value;
+};
+
+// What a task did, written by TaskProbe
+typedef struct
+{
+    uint32_t      loops;            // Calls to wake()
+    uint64_t      busy_us;          // Time between wake() and sleep(), pauses excluded
+    uint32_t      last_period_us;   // Time between the last two wake()
+    TimeHistogram run;              // Time of each loop, pauses excluded
+    TimeHistogram jitter;           // Gap between each period and the expected one, periodic tasks only
+} Task_counters;
+
+/***********************************************************************
+ * @brief Measures the loop of a task, from inside the task
+ *
+ * The task calls wake() when its blocking call returns and sleep() just
+ * before the next one, pause() and resume() around any other wait. The
+ * busy time is then the CPU time of the task, plus the time it was
+ * preempted. The run time stats of FreeRTOS would tell them apart, but
+ * the Arduino core is built without them.
+ * Each loop costs two micros() and one SeqLock write.
+ ***********************************************************************/
+class TaskProbe
+{
+    public:
+        /***********************************************************************
+         * @param name Name of the task, given to xTaskCreate()
+         * @param stackSize Stack size given to xTaskCreate(), in bytes
+         * @param periodUs Expected time between two wake(), 0 if the task waits for events
+         ***********************************************************************/
+        TaskProbe(const char *name, const uint32_t stackSize, const uint32_t periodUs = 0) :
+            _name(name), _stackSize(stackSize), _periodUs(periodUs), _task(NULL),
+            _wokeAt(0), _pausedAt(0), _paused(0), _period(0), _loops(0) {}
+
+        /***********************************************************************
+         * @brief Bind the probe to the calling task, needed for its stack
+         ***********************************************************************/
+        void attach()
+        {
+            _task.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+        }
+
+        void wake()
+        {
+            const uint32_t now = micros();
+            _period            = (_loops > 0) ? now - _wokeAt : 0;
+            _wokeAt            = now;
+            _paused            = 0;
+            _loops++;
+        }
+
+        void pause()
+        {
+            _pausedAt = micros();
+        }
+
+        void resume()
+        {
+            _paused += micros() - _pausedAt;
+        }
+
+        void sleep()
+        {
+            const uint32_t run      = micros() - _wokeAt - _paused;
+            Task_counters &counters = _counters.begin();
+            counters.loops          = _loops;
+            counters.busy_us       += run;
+            counters.run.add(run);
+            if(_period > 0)
+            {
+                counters.last_period_us = _period;
+                if(_periodUs > 0)
+                {
+                    counters.jitter.add((_period > _periodUs) ? _period - _periodUs : _periodUs - _period);
+                }
+            }
+            _counters.commit();
+        }
+
+        void snapshot(Task_counters &counters) const
+        {
+            _counters.read(counters);
+        }
+
+        /***********************************************************************
+         * @return Bytes of stack never used so far, 0 before attach()
+         ***********************************************************************/
+        uint32_t stackFree() const
+        {
+            const TaskHandle_t task = _task.load(std::memory_order_acquire);
+            return (task != NULL) ? uxTaskGetStackHighWaterMark(task) : 0;
+        }
+
+        const char *name() const
+        {
+            return _name;
+        }
+
+        uint32_t stackSize() const
+        {
+            return _stackSize;
+        }
+
+        bool periodic() const
+        {
+            return _periodUs > 0;
+        }
+
+    private:
+        const char                *_name;
+        const uint32_t             _stackSize;
+        const uint32_t             _periodUs;
+        std::atomic<TaskHandle_t>  _task;
+        SeqLock<Task_counters>     _counters;
+
+        // Only used by the task
+        uint32_t                   _wokeAt;
+        uint32_t                   _pausedAt;
+        uint32_t                   _paused;
+        uint32_t                   _period;
+        uint32_t                   _loops;
+};
+
+// How long a mutex is waited for and held, written by TimedMutex
+typedef struct
+{
+    TimeHistogram wait;
+    TimeHistogram hold;
+} Mutex_counters;
+
+/***********************************************************************
+ * @brief FreeRTOS mutex measuring the wait to take it and the time it is held
+ *
+ * Both are recorded by give(), while the mutex is still held, so the
+ * holders write the counters one after the other without more locking.
+ ***********************************************************************/
+class TimedMutex
+{
+    public:
+        explicit TimedMutex(const char *name) : _name(name), _handle(NULL), _timeouts(0), _takenAt(0), _waited(0) {}
+
+        /***********************************************************************
+         * @return False if the mutex could not be created
+         ***********************************************************************/
+        bool begin()
+        {
+            _handle = xSemaphoreCreateMutex();
+            return _handle != NULL;
+        }
+
+        /***********************************************************************
+         * @param timeout Max ticks to wait
+         * @return False if the mutex was not taken in time
+         ***********************************************************************/
+        bool take(const TickType_t timeout)
+        {
+            const uint32_t start = micros();
+            if(xSemaphoreTake(_handle, timeout) != pdTRUE)
+            {
+                _timeouts.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            _takenAt = micros();
+            _waited  = _takenAt - start;
+            return true;
+        }
+
+        void give()
+        {
+            const uint32_t  held     = micros() - _takenAt;
+            Mutex_counters &counters = _counters.begin();
+            counters.wait.add(_waited);
+            counters.hold.add(held);
+            _counters.commit();
+            xSemaphoreGive(_handle);
+        }
+
+        void snapshot(Mutex_counters &counters) const
+        {
+            _counters.read(counters);
+        }
+
+        uint32_t timeouts() const
+        {
+            return _timeouts.load(std::memory_order_relaxed);
+        }
+
+        const char *name() const
+        {
+            return _name;
+        }
+
+    private:
+        const char              *_name;
+        SemaphoreHandle_t        _handle;
+        SeqLock<Mutex_counters>  _counters;
+        std::atomic<uint32_t>    _timeouts;
+
+        // Only used by the holder
+        uint32_t                 _takenAt;
+        uint32_t                 _waited;
+};
+
+// A queue watched by TaskMetrics
+typedef struct
+{
+    const char    *name;
+    QueueHandle_t  handle;
+    uint32_t       size;            // Length given to xQueueCreate()
+} Queue_probe;
+
+/***********************************************************************
+ * @brief Tasks, mutexes, queues and heap of the board, as Prometheus text or a summary
+ *
+ * Everything is registered in setup(), before the tasks start. Counters
+ * are only copied when asked for, the tasks pay nothing more than their
+ * probes.
+ ***********************************************************************/
+class TaskMetrics
+{
+    public:
+        /***********************************************************************
+         * @param prefix Prefix of the Prometheus metric names
+         ***********************************************************************/
+        explicit TaskMetrics(const char *prefix) : _prefix(prefix), _nbTasks(0), _nbMutexes(0), _nbQueues(0), _summaryAt(0)
+        {
+            memset(_summaryBusy, 0, sizeof(_summaryBusy));
+        }
+
+        bool add(TaskProbe &probe)
+        {
+            if(_nbTasks >= METRICS_MAX_TASKS)
+            {
+                return false;
+            }
+            _tasks[_nbTasks++] = &probe;
+            return true;
+        }
+
+        bool add(TimedMutex &mutex)
+        {
+            if(_nbMutexes >= METRICS_MAX_MUTEXES)
+            {
+                return false;
+            }
+            _mutexes[_nbMutexes++] = &mutex;
+            return true;
+        }
+
+        bool addQueue(const char *name, const QueueHandle_t handle, const uint32_t size)
+        {
+            if(_nbQueues >= METRICS_MAX_QUEUES)
+            {
+                return false;
+            }
+            _queues[_nbQueues].name   = name;
+            _queues[_nbQueues].handle = handle;
+            _queues[_nbQueues].size   = size;
+            _nbQueues++;
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Write every metric in the Prometheus text format
+         * @param out Where to write
+         * @note Times are in microseconds, counters since boot
+         ***********************************************************************/
+        void writePrometheus(TextWriter &out) const
+        {
+            Task_counters  tasks[METRICS_MAX_TASKS];
+            Mutex_counters mutexes[METRICS_MAX_MUTEXES];
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                _tasks[i]->snapshot(tasks[i]);
+            }
+            for (size_t i = 0; i < _nbMutexes; i++)
+            {
+                _mutexes[i]->snapshot(mutexes[i]);
+            }
+
+            writeHeader(out, "uptime_microseconds", "Time since boot", "counter");
+            writeSample(out, "uptime_microseconds", NULL, NULL, esp_timer_get_time());
+
+            writeHeader(out, "task_loops_total", "Loops run by the task", "counter");
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                writeSample(out, "task_loops_total", "task", _tasks[i]->name(), tasks[i].loops);
+            }
+            writeHeader(out, "task_busy_microseconds_total", "Time the task was running, rate() gives its CPU share", "counter");
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                writeSample(out, "task_busy_microseconds_total", "task", _tasks[i]->name(), tasks[i].busy_us);
+            }
+            writeHeader(out, "task_stack_free_bytes", "Stack never used by the task", "gauge");
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                writeSample(out, "task_stack_free_bytes", "task", _tasks[i]->name(), _tasks[i]->stackFree());
+            }
+            writeHeader(out, "task_stack_size_bytes", "Stack given to the task", "gauge");
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                writeSample(out, "task_stack_size_bytes", "task", _tasks[i]->name(), _tasks[i]->stackSize());
+            }
+            writeHeader(out, "task_period_microseconds", "Time between the last two loops", "gauge");
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                writeSample(out, "task_period_microseconds", "task", _tasks[i]->name(), tasks[i].last_period_us);
+            }
+            writeHeader(out, "task_run_microseconds", "Time of a loop", "histogram");
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                writeHistogram(out, "task_run_microseconds", "task", _tasks[i]->name(), tasks[i].run);
+            }
+            writeHeader(out, "task_jitter_microseconds", "Gap between a period and the expected one", "histogram");
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                if(_tasks[i]->periodic() == true)
+                {
+                    writeHistogram(out, "task_jitter_microseconds", "task", _tasks[i]->name(), tasks[i].jitter);
+                }
+            }
+
+            writeHeader(out, "mutex_wait_microseconds", "Wait to take the mutex", "histogram");
+            for (size_t i = 0; i < _nbMutexes; i++)
+            {
+                writeHistogram(out, "mutex_wait_microseconds", "mutex", _mutexes[i]->name(), mutexes[i].wait);
+            }
+            writeHeader(out, "mutex_hold_microseconds", "Time the mutex was held", "histogram");
+            for (size_t i = 0; i < _nbMutexes; i++)
+            {
+                writeHistogram(out, "mutex_hold_microseconds", "mutex", _mutexes[i]->name(), mutexes[i].hold);
+            }
+            writeHeader(out, "mutex_timeouts_total", "Takes given up", "counter");
+            for (size_t i = 0; i < _nbMutexes; i++)
+            {
+                writeSample(out, "mutex_timeouts_total", "mutex", _mutexes[i]->name(), _mutexes[i]->timeouts());
+            }
+
+            writeHeader(out, "queue_depth", "Items waiting in the queue", "gauge");
+            for (size_t i = 0; i < _nbQueues; i++)
+            {
+                writeSample(out, "queue_depth", "queue", _queues[i].name, uxQueueMessagesWaiting(_queues[i].handle));
+            }
+            writeHeader(out, "queue_size", "Max items in the queue", "gauge");
+            for (size_t i = 0; i < _nbQueues; i++)
+            {
+                writeSample(out, "queue_size", "queue", _queues[i].name, _queues[i].size);
+            }
+
+            writeHeader(out, "heap_free_bytes", "Free heap", "gauge");
+            writeSample(out, "heap_free_bytes", NULL, NULL, ESP.getFreeHeap());
+            writeHeader(out, "heap_min_free_bytes", "Lowest free heap since boot", "gauge");
+            writeSample(out, "heap_min_free_bytes", NULL, NULL, ESP.getMinFreeHeap());
+            writeHeader(out, "heap_largest_free_block_bytes", "Largest block that can be allocated", "gauge");
+            writeSample(out, "heap_largest_free_block_bytes", NULL, NULL, ESP.getMaxAllocHeap());
+        }
+
+        /***********************************************************************
+         * @brief Write a human readable summary
+         * @param out Where to write
+         * @note The CPU share is over the time since the previous summary, so
+         *       only one task may ask for summaries
+         ***********************************************************************/
+        void writeSummary(TextWriter &out)
+        {
+            const uint64_t now     = esp_timer_get_time();
+            const uint64_t elapsed = now - _summaryAt;
+
+            out.write("Heap free (B): ");
+            out.writeUInt(ESP.getFreeHeap());
+            out.write(", min ");
+            out.writeUInt(ESP.getMinFreeHeap());
+            out.write(", largest block ");
+            out.writeUInt(ESP.getMaxAllocHeap());
+            out.write("\nCPU over the last ");
+            out.writeUInt(elapsed / 1000000);
+            out.write(" s\n");
+
+            for (size_t i = 0; i < _nbTasks; i++)
+            {
+                Task_counters counters;
+                _tasks[i]->snapshot(counters);
+                const uint64_t busy = counters.busy_us - _summaryBusy[i];
+                _summaryBusy[i]     = counters.busy_us;
+
+                out.write(_tasks[i]->name());
+                out.write(": cpu ");
+                out.writeFloat((elapsed > 0) ? (float)busy * 100.0F / (float)elapsed : 0.0F);
+                out.write(" %, stack free ");
+                out.writeUInt(_tasks[i]->stackFree());
+                out.write(" / ");
+                out.writeUInt(_tasks[i]->stackSize());
+                out.write(" B, loops ");
+                out.writeUInt(counters.loops);
+                out.write(", max run ");
+                out.writeUInt(counters.run.max());
+                out.write(" us");
+                if(_tasks[i]->periodic() == true)
+                {
+                    out.write(", max jitter ");
+                    out.writeUInt(counters.jitter.max());
+                    out.write(" us");
+                }
+                out.write('\n');
+            }
+            _summaryAt = now;
+
+            for (size_t i = 0; i < _nbMutexes; i++)
+            {
+                Mutex_counters counters;
+                _mutexes[i]->snapshot(counters);
+                out.write(_mutexes[i]->name());
+                out.write(": max wait ");
+                out.writeUInt(counters.wait.max());
+                out.write(" us, max hold ");
+                out.writeUInt(counters.hold.max());
+                out.write(" us, timeouts ");
+                out.writeUInt(_mutexes[i]->timeouts());
+                out.write('\n');
+            }
+
+            for (size_t i = 0; i < _nbQueues; i++)
+            {
+                out.write(_queues[i].name);
+                out.write(": ");
+                out.writeUInt(uxQueueMessagesWaiting(_queues[i].handle));
+                out.write(" / ");
+                out.writeUInt(_queues[i].size);
+                out.write(" waiting\n");
+            }
+        }
+
+    private:
+        void writeName(TextWriter &out, const char *name) const
+        {
+            out.write(_prefix);
+            out.write('_');
+            out.write(name);
+        }
+
+        void writeHeader(TextWriter &out, const char *name, const char *help, const char *type) const
+        {
+            out.write("# HELP ");
+            writeName(out, name);
+            out.write(' ');
+            out.write(help);
+            out.write("\n# TYPE ");
+            writeName(out, name);
+            out.write(' ');
+            out.write(type);
+            out.write('\n');
+        }
+
+        /***********************************************************************
+         * @brief Write one sample line, without label if label is NULL
+         ***********************************************************************/
+        void writeSample(TextWriter &out, const char *name, const char *label, const char *value, const uint64_t number) const
+        {
+            writeName(out, name);
+            if(label != NULL)
+            {
+                out.write('{');
+                out.write(label);
+                out.write("=\"");
+                out.write(value);
+                out.write("\"}");
+            }
+            out.write(' ');
+            out.writeUInt64(number);
+            out.write('\n');
+        }
+
+        void writeHistogram(TextWriter &out, const char *name, const char *label, const char *value, const TimeHistogram &histogram) const
+        {
+            uint32_t cumulated = 0;
+            for (uint8_t b = 0; b < METRICS_BUCKETS; b++)
+            {
+                cumulated += histogram.bucket(b);
+                writeName(out, name);
+                out.write("_bucket{");
+                out.write(label);
+                out.write("=\"");
+                out.write(value);
+                out.write("\",le=\"");
+                if(b < METRICS_BUCKETS - 1)
+                {
+                    out.writeUInt(TimeHistogram::bound(b));
+                }
+                else
+                {
+                    out.write("+Inf");
+                }
+                out.write("\"} ");
+                out.writeUInt(cumulated);
+                out.write('\n');
+            }
+            writeName(out, name);
+            out.write("_sum{");
+            out.write(label);
+            out.write("=\"");
+            out.write(value);
+            out.write("\"} ");
+            out.writeUInt64(histogram.sum());
+            out.write('\n');
+            writeName(out, name);
+            out.write("_count{");
+            out.write(label);
+            out.write("=\"");
+            out.write(value);
+            out.write("\"} ");
+            out.writeUInt(histogram.count());
+            out.write('\n');
+        }
+
+        const char  *_prefix;
+        TaskProbe   *_tasks[METRICS_MAX_TASKS];
+        TimedMutex  *_mutexes[METRICS_MAX_MUTEXES];
+        Queue_probe  _queues[METRICS_MAX_QUEUES];
+        size_t       _nbTasks;
+        size_t       _nbMutexes;
+        size_t       _nbQueues;
+
+        // Only used by writeSummary()
+        uint64_t     _summaryAt;
+        uint64_t     _summaryBusy[METRICS_MAX_TASKS];
+};
+
+#endif
@@ -0,0 +1,298 @@
+#ifndef TELEGRAM_OUTBOX_HPP
+#define TELEGRAM_OUTBOX_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define OUTBOX_COALESCE_MS      250        // Messages to one chat queued within this window are sent as one
+#define OUTBOX_CHAT_INTERVAL_MS 1000       // Min time between two messages to one chat (Telegram: 1 per second)
+#define OUTBOX_GLOBAL_INTERVAL_MS 34       // Min time between two messages to any chat (Telegram: 30 per second)
+#define OUTBOX_RETRY_MS         1000       // Wait after a first failure, doubled after each new one
+#define OUTBOX_MAX_RETRY_MS     60000      // Longest wait after a failure
+#define OUTBOX_MAX_ATTEMPTS     6          // A message is dropped after this many failures
+
+// Outbox statistics
+typedef struct
+{
+    uint32_t queued;                // Messages given to add()
+    uint32_t merged;                // Messages appended to another one of the same chat
+    uint32_t sent;                  // Requests that succeeded
+    uint32_t retries;               // Requests that failed and will be tried again
+    uint32_t failed;                // Messages dropped after OUTBOX_MAX_ATTEMPTS failures
+    uint32_t dropped;               // Messages dropped because the outbox was full
+    uint32_t last_latency_ms;       // Time between add() and the success of the last message
+    uint32_t max_latency_ms;        // Highest time between add() and success
+} Outbox_stats;
+
+/***********************************************************************
+ * @brief Messages waiting to be sent to Telegram, merged and paced
+ *
+ * Messages to the same chat queued within OUTBOX_COALESCE_MS are merged
+ * into one request, one per line. Requests are spaced to stay within the
+ * per chat and global rate limits of Telegram. A failed request, 429
+ * included, is retried with an exponential backoff.
+ * The outbox does no I/O: the owner asks next() for a message to send,
+ * sends it, and reports the outcome with done().
+ * @tparam CHAT_ID Max size of a chat id
+ * @tparam TEXT Max size of a message
+ * @tparam SLOTS Max number of messages waiting
+ * @note Not thread safe, only the task sending the messages uses it
+ ***********************************************************************/
+template <size_t CHAT_ID, size_t TEXT, size_t SLOTS>
+class TelegramOutbox
+{
+    public:
+        // A message waiting to be sent
+        typedef struct
+        {
+            char     chat_id[CHAT_ID];
+            char     text[TEXT];
+            size_t   length;
+            uint32_t queued_at;     // millis() of the first add()
+            uint32_t retry_at;      // millis() before which it must not be sent again
+            uint8_t  attempts;      // Failed requests so far
+            bool     used;
+        } Message;
+
+        TelegramOutbox() : _lastSend(0), _sentOnce(false)
+        {
+            memset(_slots, 0, sizeof(_slots));
+            memset(_chats, 0, sizeof(_chats));
+            memset(&_stats, 0, sizeof(_stats));
+        }
+
+        /***********************************************************************
+         * @brief Queue a message, merging it with a recent one to the same chat
+         * @param chatId Chat to send to
+         * @param text Text to send
+         * @param now Current millis()
+         * @return False if the outbox is full, the message is then dropped
+         ***********************************************************************/
+        bool add(const char *chatId, const char *text, const uint32_t now)
+        {
+            const size_t length = strlen(text);
+            _stats.queued++;
+
+            for (size_t i = 0; i < SLOTS; i++)
+            {
+                Message &slot = _slots[i];
+                if((slot.used == true) && (slot.attempts == 0) && (strcmp(slot.chat_id, chatId) == 0) &&
+                   ((now - slot.queued_at) < OUTBOX_COALESCE_MS) && (slot.length + 1 + length < TEXT))
+                {
+                    slot.text[slot.length] = '\n';
+                    memcpy(&slot.text[slot.length + 1], text, length + 1);
+                    slot.length += 1 + length;
+                    _stats.merged++;
+                    return true;
+                }
+            }
+
+            for (size_t i = 0; i < SLOTS; i++)
+            {
+                Message &slot = _slots[i];
+                if(slot.used == false)
+                {
+                    copy(slot.chat_id, chatId, CHAT_ID);
+                    copy(slot.text, text, TEXT);
+                    slot.length    = strlen(slot.text);
+                    slot.queued_at = now;
+                    slot.retry_at  = now;
+                    slot.attempts  = 0;
+                    slot.used      = true;
+                    return true;
+                }
+            }
+
+            _stats.dropped++;
+            return false;
+        }
+
+        /***********************************************************************
+         * @brief Get the oldest message allowed to be sent now
+         * @param now Current millis()
+         * @return NULL if none, else report the outcome with done()
+         ***********************************************************************/
+        Message *next(const uint32_t now)
+        {
+            Message *oldest = NULL;
+            for (size_t i = 0; i < SLOTS; i++)
+            {
+                if((_slots[i].used == true) && (readyIn(_slots[i], now) == 0) &&
+                   ((oldest == NULL) || ((int32_t)(_slots[i].queued_at - oldest->queued_at) < 0)))
+                {
+                    oldest = &_slots[i];
+                }
+            }
+            return oldest;
+        }
+
+        /***********************************************************************
+         * @brief Report the outcome of the request sending a message
+         * @param message Message given by next()
+         * @param sent True if Telegram accepted it
+         * @param now Current millis()
+         ***********************************************************************/
+        void done(Message *message, const bool sent, const uint32_t now)
+        {
+            _lastSend = now;
+            _sentOnce = true;
+            chatSent(message->chat_id, now);
+
+            if(sent == true)
+            {
+                const uint32_t latency = now - message->queued_at;
+                _stats.sent++;
+                _stats.last_latency_ms = latency;
+                if(latency > _stats.max_latency_ms)
+                {
+                    _stats.max_latency_ms = latency;
+                }
+                message->used = false;
+                return;
+            }
+
+            message->attempts++;
+            if(message->attempts >= OUTBOX_MAX_ATTEMPTS)
+            {
+                _stats.failed++;
+                message->used = false;
+                return;
+            }
+
+            uint32_t backoff = OUTBOX_RETRY_MS << (message->attempts - 1);
+            if(backoff > OUTBOX_MAX_RETRY_MS)
+            {
+                backoff = OUTBOX_MAX_RETRY_MS;
+            }
+            message->retry_at = now + backoff;
+            _stats.retries++;
+        }
+
+        /***********************************************************************
+         * @param now Current millis()
+         * @return Milliseconds before next() may return a message, UINT32_MAX if empty
+         ***********************************************************************/
+        uint32_t wait(const uint32_t now) const
+        {
+            uint32_t shortest = UINT32_MAX;
+            for (size_t i = 0; i < SLOTS; i++)
+            {
+                if(_slots[i].used == true)
+                {
+                    const uint32_t in = readyIn(_slots[i], now);
+                    shortest          = (in < shortest) ? in : shortest;
+                }
+            }
+            return shortest;
+        }
+
+        /***********************************************************************
+         * @return Number of messages waiting
+         ***********************************************************************/
+        size_t depth() const
+        {
+            size_t count = 0;
+            for (size_t i = 0; i < SLOTS; i++)
+            {
+                count += (_slots[i].used == true) ? 1 : 0;
+            }
+            return count;
+        }
+
+        bool empty() const
+        {
+            return depth() == 0;
+        }
+
+        const Outbox_stats &stats() const
+        {
+            return _stats;
+        }
+
+    private:
+        // Time of the last request to a chat, for the per chat rate limit
+        typedef struct
+        {
+            char     chat_id[CHAT_ID];
+            uint32_t sent_at;
+        } Chat_pace;
+
+        /***********************************************************************
+         * @return Milliseconds before a message may be sent, 0 if now
+         ***********************************************************************/
+        uint32_t readyIn(const Message &message, const uint32_t now) const
+        {
+            uint32_t at = message.retry_at;
+
+            // A first attempt waits for the other messages of the window
+            if(message.attempts == 0)
+            {
+                at = later(at, message.queued_at + OUTBOX_COALESCE_MS);
+            }
+            if(_sentOnce == true)
+            {
+                at = later(at, _lastSend + OUTBOX_GLOBAL_INTERVAL_MS);
+            }
+
+            const Chat_pace *chat = findChat(message.chat_id);
+            if(chat != NULL)
+            {
+                at = later(at, chat->sent_at + OUTBOX_CHAT_INTERVAL_MS);
+            }
+            return ((int32_t)(at - now) > 0) ? (at - now) : 0;
+        }
+
+        const Chat_pace *findChat(const char *chatId) const
+        {
+            for (size_t i = 0; i < SLOTS; i++)
+            {
+                if((_chats[i].chat_id[0] != '\0') && (strcmp(_chats[i].chat_id, chatId) == 0))
+                {
+                    return &_chats[i];
+                }
+            }
+            return NULL;
+        }
+
+        /***********************************************************************
+         * @brief Remember when a chat was last sent to, forgetting the oldest chat if needed
+         ***********************************************************************/
+        void chatSent(const char *chatId, const uint32_t now)
+        {
+            Chat_pace *chat = (Chat_pace *)findChat(chatId);
+            if(chat == NULL)
+            {
+                chat = &_chats[0];
+                for (size_t i = 1; i < SLOTS; i++)
+                {
+                    if((int32_t)(_chats[i].sent_at - chat->sent_at) < 0)
+                    {
+                        chat = &_chats[i];
+                    }
+                }
+                copy(chat->chat_id, chatId, CHAT_ID);
+            }
+            chat->sent_at = now;
+        }
+
+        // Wrap-around safe max of two millis()
+        static uint32_t later(const uint32_t a, const uint32_t b)
+        {
+            return ((int32_t)(a - b) > 0) ? a : b;
+        }
+
+        static void copy(char *dest, const char *src, const size_t size)
+        {
+            snprintf(dest, size, "%s", src);
+        }
+
+        Message       _slots[SLOTS];
+        Chat_pace     _chats[SLOTS];
+        uint32_t      _lastSend;
+        bool          _sentOnce;
+        Outbox_stats  _stats;
+};
+
+#endif
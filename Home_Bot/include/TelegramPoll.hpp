@@ -0,0 +1,76 @@
+#ifndef TELEGRAM_POLL_HPP
+#define TELEGRAM_POLL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***********************************************************************
+ * @brief When to poll Telegram for commands, and for how long
+ *
+ * Polls are long polls: Telegram holds getUpdates open until a command
+ * arrives or the timeout ends. An empty answer well before the timeout
+ * means the request failed, the next poll then waits a little so a
+ * network error does not turn into a busy loop. While a message waits to
+ * be sent, polls are shortened so it leaves on time rather than at the
+ * end of a long poll.
+ * The poll does no I/O: the owner asks timeout(), polls, and reports
+ * the outcome with done().
+ * @note Not thread safe, only the task polling Telegram uses it
+ ***********************************************************************/
+class TelegramPoll
+{
+    public:
+        /***********************************************************************
+         * @param longPoll Seconds Telegram may hold a poll open
+         * @param retryDelay Milliseconds to wait after a failed poll
+         ***********************************************************************/
+        TelegramPoll(const uint16_t longPoll, const uint32_t retryDelay) : _longPoll(longPoll), _retryDelay(retryDelay), _polls(0), _failures(0) {}
+
+        /***********************************************************************
+         * @param wait Milliseconds before a message is to be sent, UINT32_MAX if none
+         * @return Seconds the next poll may be held open by Telegram
+         ***********************************************************************/
+        uint16_t timeout(const uint32_t wait = UINT32_MAX) const
+        {
+            const uint32_t seconds = (wait / 1000) + (((wait % 1000) > 0) ? 1 : 0);
+            return (seconds < _longPoll) ? seconds : _longPoll;
+        }
+
+        /***********************************************************************
+         * @brief Account a poll that returned
+         * @param timeout Timeout the poll was sent with, in seconds
+         * @param elapsed Milliseconds the poll took
+         * @param messages Number of messages it returned
+         * @return Milliseconds to wait before the next poll
+         ***********************************************************************/
+        uint32_t done(const uint16_t timeout, const uint32_t elapsed, const int32_t messages)
+        {
+            _polls++;
+
+            // A timeout too short to tell an early answer from a normal one is never a failure
+            if((messages > 0) || (timeout < 2) || (elapsed >= timeout * 1000UL / 2))
+            {
+                return 0;
+            }
+            _failures++;
+            return _retryDelay;
+        }
+
+        uint32_t polls() const
+        {
+            return _polls;
+        }
+
+        uint32_t failures() const
+        {
+            return _failures;
+        }
+
+    private:
+        const uint16_t _longPoll;
+        const uint32_t _retryDelay;
+        uint32_t       _polls;
+        uint32_t       _failures;
+};
+
+#endif
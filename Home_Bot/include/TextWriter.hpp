@@ -0,0 +1,183 @@
+#ifndef TEXT_WRITER_HPP
+#define TEXT_WRITER_HPP
+
+#include <Print.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/***********************************************************************
+ * @brief Formats text without any heap allocation
+ *
+ * Text is either written into a caller supplied buffer or streamed to a
+ * Print (Serial, AsyncResponseStream, ...). In both cases the writer
+ * keeps counting, so running it with an empty buffer gives the size
+ * needed up front.
+ * @note The writer never allocates, but a Print may: AsyncResponseStream
+ *       reallocates its buffer on each write past its end, so it should
+ *       be created with the size measured first
+ ***********************************************************************/
+class TextWriter
+{
+    public:
+        /***********************************************************************
+         * @brief Write into a buffer, always NUL terminated when size > 0
+         * @param buffer Buffer to fill, may be NULL to only measure the text
+         * @param size Size of the buffer in bytes
+         ***********************************************************************/
+        TextWriter(char *buffer, const size_t size) : _buffer(buffer), _size(size), _print(NULL), _length(0)
+        {
+            if((_buffer != NULL) && (_size > 0))
+            {
+                _buffer[0] = '\0';
+            }
+        }
+
+        /***********************************************************************
+         * @brief Stream into a Print
+         * @param print Destination of the text
+         ***********************************************************************/
+        explicit TextWriter(Print &print) : _buffer(NULL), _size(0), _print(&print), _length(0) {}
+
+        /***********************************************************************
+         * @return Length of the whole text, even the part that did not fit
+         ***********************************************************************/
+        size_t length() const
+        {
+            return _length;
+        }
+
+        /***********************************************************************
+         * @return True if the buffer was too small for the whole text
+         ***********************************************************************/
+        bool truncated() const
+        {
+            return (_print == NULL) && (_length >= _size);
+        }
+
+        void write(const char *str, const size_t len)
+        {
+            if(_print != NULL)
+            {
+                _print->write((const uint8_t *)str, len);
+            }
+            else if((_buffer != NULL) && (_length + 1 < _size))
+            {
+                const size_t room = _size - 1 - _length;
+                const size_t n    = (len < room) ? len : room;
+                memcpy(_buffer + _length, str, n);
+                _buffer[_length + n] = '\0';
+            }
+            _length += len;
+        }
+
+        void write(const char *str)
+        {
+            write(str, strlen(str));
+        }
+
+        void write(const char c)
+        {
+            write(&c, 1);
+        }
+
+        /***********************************************************************
+         * @brief Write an unsigned integer in base 10, like String(uint32_t)
+         ***********************************************************************/
+        void writeUInt(uint32_t value)
+        {
+            char     digits[10];
+            uint8_t  count = 0;
+            do
+            {
+                digits[sizeof(digits) - 1 - count++] = '0' + (value % 10);
+                value /= 10;
+            } while(value != 0);
+            write(&digits[sizeof(digits) - count], count);
+        }
+
+        /***********************************************************************
+         * @brief Write a 64 bit unsigned integer in base 10, for counters that outgrow 32 bits
+         ***********************************************************************/
+        void writeUInt64(uint64_t value)
+        {
+            char     digits[20];
+            uint8_t  count = 0;
+            do
+            {
+                digits[sizeof(digits) - 1 - count++] = '0' + (value % 10);
+                value /= 10;
+            } while(value != 0);
+            write(&digits[sizeof(digits) - count], count);
+        }
+
+        /***********************************************************************
+         * @brief Write a float with 2 decimals, byte for byte like String(float)
+         *
+         * Follows the rounding and digit extraction of the Arduino dtostrf()
+         * so the text does not change compared to String based code.
+         ***********************************************************************/
+        void writeFloat(const float value)
+        {
+            char     text[48];
+            uint8_t  pos    = 0;
+            double   number = value;
+
+            if(isnan(number))
+            {
+                write("nan", 3);
+                return;
+            }
+            if(isinf(number))
+            {
+                write("inf", 3);
+                return;
+            }
+            if(number < 0.0)
+            {
+                text[pos++] = '-';
+                number      = -number;
+            }
+
+            // Round so that 1.999 is written as "2.00"
+            number += 0.005;
+
+            double  tenpow     = 1.0;
+            uint8_t digitcount = 1;
+            while((number >= 10.0 * tenpow) && (digitcount < 39))
+            {
+                tenpow *= 10.0;
+                digitcount++;
+            }
+            number /= tenpow;
+
+            digitcount += FLOAT_DECIMALS;
+            while(digitcount-- > 0)
+            {
+                int8_t digit = (int8_t)number;
+                if(digit > 9)
+                {
+                    digit = 9;
+                }
+                text[pos++] = '0' + digit;
+                if(digitcount == FLOAT_DECIMALS)
+                {
+                    text[pos++] = '.';
+                }
+                number -= digit;
+                number *= 10.0;
+            }
+            write(text, pos);
+        }
+
+    private:
+        static constexpr uint8_t FLOAT_DECIMALS = 2;
+
+        char   *_buffer;
+        size_t  _size;
+        Print  *_print;
+        size_t  _length;
+};
+
+#endif
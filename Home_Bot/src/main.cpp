@@ -2,23 +2,65 @@
 #include <WiFiClientSecure.h>
 #include <UniversalTelegramBot.h> 
 #include "CONFIGS.hpp"
-#include <mutex>
+#include <new>
 #include "Adafruit_BME680.h"
-#include "NTPClient.h"
+#include "ClockService.hpp"
+#include "Bme680Driver.hpp"
 #include "WiFiUdp.h"
 #include "esp_now.h"
 #include "SPIFFS.h"
 #include "ESPAsyncWebServer.h"
+#include "TextWriter.hpp"
+#include "BinaryWriter.hpp"
+#include "SampleLog.hpp"
+#include "RoomRegistry.hpp"
+#include "TelegramOutbox.hpp"
+#include "TelegramPoll.hpp"
+#include "BotCommands.hpp"
+#include "LedEffects.hpp"
+#include "TaskMetrics.hpp"
+#include "NodeFrame.hpp"
+#include "PeerStats.hpp"
+#include "SampleBatch.hpp"
+#include "TimeSync.hpp"
+#include "GatewayPairing.hpp"
 
 #define VERBOSITY               0          // 0: No debug, 1: Debug
 
 #define LED                     2
-#define BOT_DELAY               800        // Milliseconds between updates of bot
+#define BOT_DELAY               800        // Milliseconds before polling again after a failed poll
+#define BOT_LONG_POLL           20         // Seconds Telegram holds a poll open while no message arrives
+#define BOT_REPLY_WAIT          3000       // Max milliseconds waiting for the replies to the commands of a poll
+#define BOT_REPLY_POLL          1000       // Max milliseconds a poll is held while a reply is still expected
+#define BOT_REPLY_LATE          30000      // Milliseconds after a command its reply is no longer waited for
 #define SENSOR_DELAY            1000       // Milliseconds between updates of sensors
-#define ESP_NOW_DELAY           1000       // Milliseconds between updates of ESP-NOW
+#define ESP_NOW_QUEUE_SIZE      16         // Max number of ESP-NOW packets waiting to be stored
+#define ESP_NOW_BATCH_SIZE      8          // Max number of ESP-NOW packets handled before sleeping again
+#define TIME_BEACON_DELAY       10000      // Milliseconds between two time beacons broadcast to the nodes
+#define NODE_ID_MAX             16         // Ids of unknown ESP-NOW senders must be lower, ROOM_MAX at most
+#define NODE_ROOMS_MAX          4          // Max number of rooms added for unknown senders, about 7.5 KB each
 #define SEALEVELPRESSURE_HPA    1014.0F    // Sea level pressure in hPa
 #define TEMPERATURE_OFFSET      -2.0F      // offset to compensate the temperature sensor
-#define MAX_DATA                10         // Max number of data to store
+#define MAX_TEXT                512        // Max size of a text sent by the bot
+#define MAX_EVENT               128        // Max size of a sample pushed to the dashboards
+#define BINARY_MAGIC_0          'H'        // First byte of the binary data
+#define BINARY_MAGIC_1          'B'        // Second byte of the binary data
+#define BINARY_VERSION          1          // Version of the binary data layout
+#define LOG_QUEUE_SIZE          16         // Max number of samples waiting to be logged on flash
+#define LOG_FLUSH_DELAY         30000      // Max milliseconds a sample waits in RAM before being written on flash
+#define LOG_MAX_SCAN            1000       // Max number of samples returned by /history
+#define LOG_HISTORY_CHUNK       32         // Samples copied from the log at a time by /history
+#define ROLLUP_BOT_HOURS        8          // Number of hour summaries sent by the bot per room
+#define BOT_QUEUE_SIZE          4          // Max number of commands or replies waiting
+#define BOT_OUTBOX_SIZE         4          // Max number of merged replies waiting to be sent
+#define BLINK_DEFAULT           10         // Number of blinks of /blink without argument
+#define BLINK_MAX               50         // Max number of blinks asked with /blink
+#define MAX_CHAT_ID             24         // Max size of a Telegram chat id
+#define MAX_FROM_NAME           32         // Max size of the name of a Telegram user
+#define MAX_COMMAND             64         // Max size of a command sent to the bot
+#define MAX_REPLY               1536       // Max size of a reply of the bot, /rollup being the longest
+#define TELEGRAM_STACK          8192       // Stack of the Telegram network task, TLS needs more
+#define TASK_STACK              4096       // Stack of the other tasks
 
 using namespace std;
 
@@ -26,20 +68,46 @@ using namespace std;
 WiFiClientSecure client;
 UniversalTelegramBot bot(BOT_TOKEN, client);
 
-// Create a mutex
-SemaphoreHandle_t mtx;
+// Create the queues between the Telegram network task and the command task
+QueueHandle_t botCommandQueue;
+QueueHandle_t botReplyQueue;
 
-// Define NTP Client to get time
+// Create a queue for incoming ESP-NOW packets
+QueueHandle_t espNowQueue;
+
+// Create a queue and a mutex for the samples logged on flash
+QueueHandle_t     logQueue;
+TimedMutex        logMtx("log");
+
+// Create the log of all samples on flash
+SampleLog sampleLog(SPIFFS);
+
+// Define the clock kept from NTP in the background
 WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP);
+ClockService<WiFiUDP> clockService(ntpUDP);
 
-// Create BME680 object
+// Create BME680 object, read a whole conversion at a time
 Adafruit_BME680 bme;
+Sampler<Bme680Driver<Adafruit_BME680> > bmeSampler(bme, SEALEVELPRESSURE_HPA);
+
+// Create the LED effects engine
+LedEffects led;
+
+// Create the probes of the tasks, the Telegram task waits on the network so only its stack is watched
+TaskProbe   telegramProbe("telegramTask", TELEGRAM_STACK);
+TaskProbe   botProbe("botTask", TASK_STACK);
+TaskProbe   sensorProbe("sensorTask", TASK_STACK, SENSOR_DELAY * 1000UL);
+TaskProbe   espNowProbe("espNowTask", TASK_STACK);
+TaskProbe   logProbe("logTask", TASK_STACK);
+TaskMetrics metrics("homebot");
 
 // Create AsyncWebServer object on port 80
 AsyncWebServer server(80);
 
-// Stores id of the rooms
+// Create an event source on /events to push new samples to the dashboards
+AsyncEventSource events("/events");
+
+// Ids of the rooms known at build time, other ESP-NOW rooms are added when they first send
 enum ID 
 {
     BEDROOM,
@@ -47,417 +115,844 @@ enum ID
     BATHROOM
 };
 
-// BME680 data
+// ESP-NOW frame checked by the reception callback, a batch is unpacked by the ESP-NOW task
 typedef struct  
 {
-    uint8_t id;
-    float temperature;
-    float humidity;
-    float pressure;
-    float altitude;
-    float gas_resistance;
-    uint32_t time;
-} Message_bme680;
+    uint32_t       received_at;   // micros() when the packet was received
+    uint8_t        mac[6];        // Address of the sender
+    uint8_t        frame[FRAME_MAX_SIZE];
+} Incoming_data;
 
-// BME280 data
-typedef struct  
+// ESP-NOW statistics
+typedef struct
 {
-    uint8_t id;
-    float temperature;
-    float humidity;
-    float pressure;
-    float altitude;
-    uint32_t time;
-} Message_bme280;
-
-// Data for living room
+    uint32_t received;            // Packets queued
+    uint32_t dropped;             // Packets lost because the queue was full
+    uint32_t invalid;             // Packets rejected by the parser or with no room to store them
+    uint32_t bad_version;         // Packets sent by a node with another frame layout
+    uint32_t bad_crc;             // Packets corrupted
+    uint32_t duplicates;          // Packets received twice, not stored again
+    uint32_t time_requests;       // Time asked by a node
+    uint32_t time_sent;           // Beacons and answers sent, none until the clock is synced
+    uint32_t pair_probes;         // Nodes looking for the gateway, each one is answered with its address and channel
+    uint32_t stored;              // Samples stored in a room history, a packet may carry several
+    uint32_t max_depth;           // Highest number of packets waiting at once
+    uint32_t last_latency_us;     // Time between reception and storage of the last packet
+    uint32_t max_latency_us;      // Highest time between reception and storage
+} Esp_now_stats;
+
+// Command received from Telegram
 typedef struct
 {
-    uint8_t count;
-    Message_bme680 data[MAX_DATA];
-} Data_living_room;
+    char chat_id[MAX_CHAT_ID];
+    char from_name[MAX_FROM_NAME];
+    char text[MAX_COMMAND];
+} Bot_command;
 
-// Data for bathroom
+// What a command handler gets
 typedef struct
 {
-    uint8_t count;
-    Message_bme280 data[MAX_DATA];
-} Data_bathroom;
+    const Bot_command *command;
+    TextWriter        *out;           // Reply
+} Command_context;
 
-// Data for bedroom
+// Reply waiting to be sent to Telegram
 typedef struct
 {
-    uint8_t count;
-    Message_bme280 data[MAX_DATA];
-} Data_bedroom;
+    char chat_id[MAX_CHAT_ID];
+    char text[MAX_REPLY];
+} Bot_reply;
 
-// ESP-NOW data
-typedef struct  
+// Bot statistics
+typedef struct
 {
-    bool received;
-    Message_bme280 bme280_tmp;
-} Incoming_data;
+    uint32_t polls;               // Requests sent to Telegram to get commands
+    uint32_t failed_polls;        // Polls that returned before the long poll timeout without any command
+    uint32_t commands;            // Commands handled
+    uint32_t replies_dropped;     // Replies lost because the queue was full
+    uint32_t max_handle_us;       // Longest time to handle a command, network excluded
+    uint32_t last_send_us;        // Duration of the last request sending a reply
+    uint32_t max_send_us;         // Longest request sending a reply
+} Bot_stats;
+
+// Timing of the sensor task
+typedef struct
+{
+    uint32_t samples;             // Samples read
+    uint32_t last_period_us;      // Time between the last two samples
+    uint32_t max_jitter_us;       // Largest gap between a period and SENSOR_DELAY
+    uint32_t last_read_us;        // Time to read and store the last sample
+    uint32_t max_read_us;         // Longest time to read and store a sample
+} Sensor_timing;
+
+// Replies waiting to be sent, only used by the Telegram network task
+typedef TelegramOutbox<MAX_CHAT_ID, MAX_REPLY, BOT_OUTBOX_SIZE> Bot_outbox;
+Bot_outbox outbox;
 
 // Create global variables
 volatile bool             ledState;
-volatile Incoming_data    incoming_data;
-volatile Data_living_room data_living_room;
-volatile Data_bathroom    data_bathroom;
-volatile Data_bedroom     data_bedroom;
-const String rooms[] = 
-{
-    "Bedroom", 
-    "Living room", 
-    "Bathroom"
-};
+volatile Esp_now_stats    esp_now_stats;
+PeerTable<ROOM_MAX>       peers;
+Frame_header              gatewayHeader;    // Header of the frames sent to the nodes, only used by the ESP-NOW task
+volatile Bot_stats        bot_stats;
+volatile Sensor_timing    sensor_timing;
+volatile uint32_t         log_dropped;
+RoomRegistry              rooms;
+TypedRoom<Message_bme680> livingRoom(LIVING_ROOM, "Living room");
+TypedRoom<Message_bme280> bedroom(BEDROOM, "Bedroom");
+TypedRoom<Message_bme280> bathroom(BATHROOM, "Bathroom");
 
 /* =================================================================== */
 
 /***********************************************************************
- * @brief Blink LED
- * @param nbBlink Number of blink (default 10)
- * @param delayBlink Delay between blink (default 100ms)
+ * @brief Read epoch in seconds from the clock kept from NTP, never blocks
  ***********************************************************************/
-inline void blinkLED(const uint8_t nbBlink = 10, const uint8_t delayTime = 100)
+uint32_t readTime()
 {
-    for (uint8_t i = 0; i < nbBlink; i++)
-    {
-        digitalWrite(LED, HIGH);
-        delay(delayTime);
-        digitalWrite(LED, LOW);
-        delay(delayTime);
-    }
+    return clockService.now();
 }
 
 
 /***********************************************************************
- * @brief Read temperature from BME680 sensor
- * @return Temperature in °C
+ * @brief Read all data from BME680 sensor
+ * @return Sample of the living room, with the last good values if the sensor fails
  ***********************************************************************/
-float readBME680Temperature()
+Message_bme680 updateBME680Data()
 {
-    float t = bme.readTemperature();
-    static float t_mem;
-    if(isnan(t))
+    Message_bme680 sample;
+    Bme680_reading reading;
+
+    sample.id             = LIVING_ROOM;
+    sample.time           = readTime();
+
+    // One conversion for every value, the task sleeps while the gas heater runs
+    if(bmeSampler.start() == true)
+    {
+        sensorProbe.pause();
+        delay(bmeSampler.remaining());
+        sensorProbe.resume();
+    }
+    if(bmeSampler.finish(reading) == false)
     {
         #if VERBOSITY
-        Serial.println("Failed to read temperature from BME680 sensor ! Kept the old value");
+        Serial.println("Failed to read BME680 sensor ! Kept the old values");
         #endif
-        return t_mem + TEMPERATURE_OFFSET;
     }
-    t_mem = t;
-    return t + TEMPERATURE_OFFSET;
+    sample.temperature    = reading.temperature + TEMPERATURE_OFFSET;
+    sample.humidity       = reading.humidity;
+    sample.pressure       = reading.pressure;
+    sample.altitude       = reading.altitude;
+    sample.gas_resistance = reading.gas_resistance;
+    return sample;
 }
 
 
 /***********************************************************************
- * @brief Read humidity from BME680 sensor
- * @return Humidity in %
+ * @brief Write the fields of a sample logged on flash
+ * @param out Where to write
+ * @param record Sample to write
+ * @param separator Character written between fields
  ***********************************************************************/
-float readBME680Humidity()
+void writeFields(TextWriter &out, const Log_record &record, const char separator)
 {
-    float h = bme.readHumidity();
-    static float h_mem;
-    if(isnan(h))
+    const Room *room = rooms.find(record.room);
+    out.write((room != NULL) ? room->name() : "Unknown");
+    out.write(separator);
+    out.writeUInt(record.time);
+    out.write(separator);
+    out.writeFloat(record.temperature);
+    out.write(separator);
+    out.writeFloat(record.humidity);
+    out.write(separator);
+    out.writeFloat(record.pressure);
+    out.write(separator);
+    out.writeFloat(record.altitude);
+    if(record.sensor == SENSOR_BME680)
     {
-        #if VERBOSITY
-        Serial.println("Failed to read humidity from BME680 sensor ! Kept the old value");
-        #endif
-        return h_mem;
+        out.write(separator);
+        out.writeFloat(record.gas_resistance);
     }
-    h_mem = h;
-    return h;
 }
 
 
 /***********************************************************************
- * @brief Read pressure from BME680 sensor
- * @return Pressure in hPa
+ * @brief Write the data of all rooms as text
+ * @param out Where to write
+ * @param lastOnly True if only the value of the last data is needed, false if all data is needed (default false)
+ * @param verbose True for a human readable text, only used with lastOnly (default false)
+ * @note All data is separated by ',' for each label, ";" for each data and '\n' for each room
+ * @note Each room is copied once without locking, so what is written about a room is consistent
  ***********************************************************************/
-float readBME680Pressure()
+void writeData(TextWriter &out, const bool lastOnly = false, const bool verbose = false)
 {
-    float p = bme.readPressure() / 100.0F;
-    static float p_mem;
-    if(isnan(p))
+    const size_t count = rooms.count();
+    for (size_t i = 0; i < count; i++)
     {
-        #if VERBOSITY
-        Serial.println("Failed to read pressure from BME680 sensor ! Kept the old value");
-        #endif
-        return p_mem;
+        if(lastOnly == false)
+        {
+            if(i > 0)
+            {
+                out.write('\n');
+            }
+            rooms.at(i)->writeHistory(out);
+        }
+        else
+        {
+            // Rooms without data yet are reported with zeroed values
+            rooms.at(i)->writeLast(out, verbose);
+            out.write('\n');
+        }
     }
-    p_mem = p;
-    return p;
 }
 
 
 /***********************************************************************
- * @brief Read altitude from BME680 sensor
- * @return Altitude in meters
+ * @brief Convert struct to text in a fixed buffer
+ * @param buffer Buffer to fill, may be NULL to only compute the size needed
+ * @param size Size of the buffer
+ * @param lastOnly True if only the value of the last data is needed, false if all data is needed (default false)
+ * @param verbose True for a human readable text, only used with lastOnly (default false)
+ * @return Length of the whole text, the buffer was too small if it is greater or equal to size
+ ***********************************************************************/
+size_t structToBuffer(char *buffer, const size_t size, const bool lastOnly = false, const bool verbose = false)
+{
+    TextWriter out(buffer, size);
+    writeData(out, lastOnly, verbose);
+    return out.length();
+}
+
+
+/***********************************************************************
+ * @brief Send data of all rooms as text to an HTTP client
+ * @param request Request to answer
+ * @param lastOnly True if only the value of the last data is needed, false if all data is needed
  ***********************************************************************/
-float readBME680Altitude()
+void sendData(AsyncWebServerRequest *request, const bool lastOnly)
 {
-    float a = bme.readAltitude(SEALEVELPRESSURE_HPA);
-    static float a_mem;
-    if(isnan(a))
+    // Size the response once, else its buffer is reallocated by every write past its end
+    const size_t         length   = structToBuffer(NULL, 0, lastOnly);
+    AsyncResponseStream *response = request->beginResponseStream("text/plain", length + 1);
+    TextWriter           out(*response);
+    writeData(out, lastOnly);
+    request->send(response);
+}
+
+
+/***********************************************************************
+ * @brief Push a new sample once to every dashboard listening on /events
+ * @param room Room of the sample
+ * @param sample Sample just stored, same format as a line of /last_data
+ ***********************************************************************/
+template <typename Message>
+void publishSample(const TypedRoom<Message> &room, const Message &sample)
+{
+    if(events.count() == 0)
     {
-        #if VERBOSITY
-        Serial.println("Failed to read altitude from BME680 sensor ! Kept the old value");
-        #endif
-        return a_mem;
+        return;
     }
-    a_mem = a;
-    return a;
+
+    char       text[MAX_EVENT];
+    TextWriter out(text, sizeof(text));
+    room.writeFields(out, sample, ';');
+    events.send(text, "sample", millis());
 }
 
 
 /***********************************************************************
- * @brief Read gas resistance from BME680 sensor
- * @return Gas resistance in kOhm
+ * @brief Send the last sample of each room to a dashboard that just connected
+ * @param client Client that just connected
  ***********************************************************************/
-float readBME680GasResistance()
+void sendSnapshot(AsyncEventSourceClient *client)
 {
-    float r = bme.readGas() / 1000.0F;
-    static float r_mem;
-    if(isnan(r))
+    char text[MAX_TEXT];
+    structToBuffer(text, sizeof(text), true);
+    client->send(text, "snapshot", millis());
+}
+
+
+/***********************************************************************
+ * @brief Write the data of all rooms as a binary blob
+ * @param out Where to write
+ * @note Little-endian layout, decoded by decoder.js:
+ *       header : magic "HB" (2), version (1), number of rooms (1)
+ *       room   : id (1), sensor type (1, 0: BME280, 1: BME680), number of samples (2)
+ *       sample : time (4), temperature, humidity, pressure, altitude (4 each as float),
+ *                gas resistance (4 as float, BME680 only)
+ ***********************************************************************/
+void writeBinaryData(BinaryWriter &out)
+{
+    const size_t count = rooms.count();
+
+    out.writeU8(BINARY_MAGIC_0);
+    out.writeU8(BINARY_MAGIC_1);
+    out.writeU8(BINARY_VERSION);
+    out.writeU8(count);
+    for (size_t i = 0; i < count; i++)
     {
-        #if VERBOSITY
-        Serial.println("Failed to read gas resistance from BME680 sensor ! Kept the old value");
-        #endif
-        return r_mem;
+        rooms.at(i)->writeBinary(out);
     }
-    r_mem = r;
-    return r;
 }
 
 
 /***********************************************************************
- * @brief Read epoch from NTP server in seconds
+ * @brief Send data of all rooms as a binary blob to an HTTP client
+ * @param request Request to answer
  ***********************************************************************/
-uint32_t readTime()
+void sendBinaryData(AsyncWebServerRequest *request)
+{
+    // Size the response once, a sample stored meanwhile only grows it again
+    BinaryWriter size(NULL, 0);
+    writeBinaryData(size);
+    AsyncResponseStream *response = request->beginResponseStream("application/octet-stream", size.length() + 1);
+    BinaryWriter         out(*response);
+    writeBinaryData(out);
+    request->send(response);
+}
+
+
+/***********************************************************************
+ * @brief Convert a sample to a log record
+ ***********************************************************************/
+template <typename Message>
+Log_record toLogRecord(const Message &sample)
 {
-    timeClient.update();
-    return timeClient.getEpochTime();
+    float      values[MAX_FIELDS] = {0};
+    Log_record record;
+    Message_traits<Message>::toValues(sample, values);
+
+    memset(&record, 0, sizeof(record));
+    record.time           = sample.time;
+    record.room           = sample.id;
+    record.sensor         = Message_traits<Message>::SENSOR;
+    record.temperature    = values[0];
+    record.humidity       = values[1];
+    record.pressure       = values[2];
+    record.altitude       = values[3];
+    record.gas_resistance = values[4];
+    return record;
 }
 
 
 /***********************************************************************
- * @brief Read all data from BME280 sensor and store it in all_data
+ * @brief Hand a new sample to the log task, never blocks
+ * @param sample Sample just stored
  ***********************************************************************/
-void updateBME680Data()
+template <typename Message>
+void logSample(const Message &sample)
 {
-    uint8_t idx;
+    const Log_record record = toLogRecord(sample);
+    if(xQueueSend(logQueue, &record, 0) != pdTRUE)
+    {
+        log_dropped++;
+    }
+}
 
-    if (data_living_room.count == MAX_DATA)
+
+/***********************************************************************
+ * @brief Get the room asked by an HTTP client
+ * @param request Request with the room id
+ * @return NULL if the id is missing or the room does not exist
+ ***********************************************************************/
+const Room *requestedRoom(AsyncWebServerRequest *request)
+{
+    if(request->hasParam("room") == false)
     {
-        // Shift data
-        for (uint8_t i = 0; i < MAX_DATA - 1; i++)
-        {
-            memcpy((void *)&data_living_room.data[i], (void *)&data_living_room.data[i + 1], sizeof(data_living_room.data[0]));
-        }
-        idx = MAX_DATA - 1;
+        return NULL;
     }
-    else if (data_living_room.count == 0)
+    const long id = request->getParam("room")->value().toInt();
+    return ((id < 0) || (id >= ROOM_MAX)) ? NULL : rooms.find(id);
+}
+
+
+/***********************************************************************
+ * @brief Get an epoch bound asked by an HTTP client
+ * @param request Request with the bound, optional
+ * @param name Name of the parameter
+ * @param time Where to store the bound, left as is if the parameter is missing
+ * @return False if the bound is negative
+ ***********************************************************************/
+bool requestedTime(AsyncWebServerRequest *request, const char *name, uint32_t &time)
+{
+    if(request->hasParam(name) == false)
     {
-        idx = 0;
-        data_living_room.count++;
+        return true;
     }
-    else
+    const long value = request->getParam(name)->value().toInt();
+    if(value < 0)
     {
-        idx = data_living_room.count - 1;
-        data_living_room.count++;
+        return false;
     }
-    
-    data_living_room.data[idx].time           = readTime();
-    data_living_room.data[idx].temperature    = readBME680Temperature();
-    data_living_room.data[idx].humidity       = readBME680Humidity();
-    data_living_room.data[idx].pressure       = readBME680Pressure();
-    data_living_room.data[idx].altitude       = readBME680Altitude();
-    data_living_room.data[idx].gas_resistance = readBME680GasResistance();
+    time = (uint32_t)value;
+    return true;
 }
 
 
 /***********************************************************************
- * @brief Convert struct to string
- * @param lastOnly True if only the value of the last data is needed, false if all data is needed (default false)
- * @return String with all data, separated by ',' for each label, ";" for each data and '\n' for each room
+ * @brief Send the summaries of a room to an HTTP client
+ * @param request Request with the room id and the level (minute, hour or day)
+ * @note One bucket per ';', fields are start,count then min,mean,max of
+ *       temperature, humidity and pressure, then 1 if the period is still
+ *       running else 0, separated by ','
  ***********************************************************************/
-String structToString(const bool lastOnly = false, const bool verbose = false)
+void sendRollup(AsyncWebServerRequest *request)
 {
-    String str = "";
-    if(lastOnly == false)
+    const Room *room = requestedRoom(request);
+    if(room == NULL)
     {
-        // Convert living room data
-        for (uint8_t i = 0; i < data_living_room.count; i++)
+        request->send(400, "text/plain", "Missing or invalid room");
+        return;
+    }
+
+    Rollup_level level = ROLLUP_HOUR;
+    if(request->hasParam("level"))
+    {
+        const String name = request->getParam("level")->value();
+        level = (name == "minute") ? ROLLUP_MINUTE : ((name == "day") ? ROLLUP_DAY : ROLLUP_HOUR);
+    }
+
+    Rollup_bucket        buckets[(ROLLUP_MINUTES > ROLLUP_HOURS ? ROLLUP_MINUTES : ROLLUP_HOURS) + 1];
+    const size_t         count    = room->rollup().snapshot(level, buckets, sizeof(buckets) / sizeof(buckets[0]));
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    TextWriter           out(*response);
+    for (size_t i = 0; i < count; i++)
+    {
+        out.writeUInt(buckets[i].start);
+        out.write(',');
+        out.writeUInt(buckets[i].count);
+        for (uint8_t m = 0; m < ROLLUP_METRICS; m++)
         {
-            str += rooms[data_living_room.data[i].id];
-            str += ",";
-            str += String(data_living_room.data[i].time);
-            str += ",";
-            str += String(data_living_room.data[i].temperature);
-            str += ",";
-            str += String(data_living_room.data[i].humidity);
-            str += ",";
-            str += String(data_living_room.data[i].pressure);
-            str += ",";
-            str += String(data_living_room.data[i].altitude);
-            str += ",";
-            str += String(data_living_room.data[i].gas_resistance);
-            str += ";";
+            out.write(',');
+            out.writeFloat(buckets[i].min[m]);
+            out.write(',');
+            out.writeFloat(buckets[i].mean[m]);
+            out.write(',');
+            out.writeFloat(buckets[i].max[m]);
         }
-        str += "\n";
+        out.write(buckets[i].partial ? ",1;" : ",0;");
+    }
+    request->send(response);
+}
 
-        // Convert bedroom data
-        for (uint8_t i = 0; i < data_bedroom.count; i++)
+
+/***********************************************************************
+ * @brief Write the last hour summaries of every room in a human readable way
+ * @param out Where to write
+ ***********************************************************************/
+void writeRollup(TextWriter &out)
+{
+    const size_t nbRooms = rooms.count();
+
+    for (size_t r = 0; r < nbRooms; r++)
+    {
+        Rollup_bucket buckets[ROLLUP_BOT_HOURS];
+        const size_t  count = rooms.at(r)->rollup().snapshot(ROLLUP_HOUR, buckets, ROLLUP_BOT_HOURS);
+
+        out.write(rooms.at(r)->name());
+        out.write(":\n");
+        for (size_t i = 0; i < count; i++)
         {
-            str += rooms[data_bedroom.data[i].id];
-            str += ",";
-            str += String(data_bedroom.data[i].time);
-            str += ",";
-            str += String(data_bedroom.data[i].temperature);
-            str += ",";
-            str += String(data_bedroom.data[i].humidity);
-            str += ",";
-            str += String(data_bedroom.data[i].pressure);
-            str += ",";
-            str += String(data_bedroom.data[i].altitude);
-            str += ";";
+            // Hours are in UTC, like the time of the samples
+            const uint32_t hour = (buckets[i].start / 3600) % 24;
+            out.write("\t\t");
+            out.write((hour < 10) ? "0" : "");
+            out.writeUInt(hour);
+            out.write("h: ");
+            out.writeFloat(buckets[i].min[ROLLUP_TEMPERATURE]);
+            out.write(" / ");
+            out.writeFloat(buckets[i].mean[ROLLUP_TEMPERATURE]);
+            out.write(" / ");
+            out.writeFloat(buckets[i].max[ROLLUP_TEMPERATURE]);
+            out.write(" C, ");
+            out.writeFloat(buckets[i].mean[ROLLUP_HUMIDITY]);
+            out.write(buckets[i].partial ? " % (so far)\n" : " %\n");
         }
-        str += "\n";
-
-        // Convert bathroom data
-        for (uint8_t i = 0; i < data_bathroom.count; i++)
+        if(count == 0)
         {
-            str += rooms[data_bathroom.data[i].id];
-            str += ",";
-            str += String(data_bathroom.data[i].time);
-            str += ",";
-            str += String(data_bathroom.data[i].temperature);
-            str += ",";
-            str += String(data_bathroom.data[i].humidity);
-            str += ",";
-            str += String(data_bathroom.data[i].pressure);
-            str += ",";
-            str += String(data_bathroom.data[i].altitude);
-            str += ";";
+            out.write("\t\tNo data yet\n");
         }
     }
-    else 
+}
+
+
+/***********************************************************************
+ * @brief Send the compressed history of a room to an HTTP client
+ * @param request Request with the room id
+ * @note Only sealed blocks are sent, the latest samples are in /all_data
+ ***********************************************************************/
+void sendSeries(AsyncWebServerRequest *request)
+{
+    const Room *room = requestedRoom(request);
+    if(room == NULL)
+    {
+        request->send(400, "text/plain", "Missing or invalid room");
+        return;
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    TextWriter           out(*response);
+    room->writeSeries(out);
+    request->send(response);
+}
+
+
+/***********************************************************************
+ * @brief Store a new sample in its room, then push it to the dashboards and the log
+ * @param room Room of the sample
+ * @param sample New sample
+ * @note Must only be called from the task feeding this room
+ ***********************************************************************/
+template <typename Message>
+void onSample(TypedRoom<Message> &room, Message sample)
+{
+    sample.id = room.id();
+    room.store(sample);
+    publishSample(room, sample);
+    logSample(sample);
+}
+
+
+/***********************************************************************
+ * @brief Send the samples of a room logged on flash to an HTTP client
+ * @param request Request with the room id and optionally a time range (from, to)
+ * @note Answers in the /all_data format, at most LOG_MAX_SCAN samples in the order they were logged
+ ***********************************************************************/
+void sendHistory(AsyncWebServerRequest *request)
+{
+    const Room *room = requestedRoom(request);
+    uint32_t    from = 0;
+    uint32_t    to   = UINT32_MAX;
+    if(room == NULL)
+    {
+        request->send(400, "text/plain", "Missing or invalid room");
+        return;
+    }
+    if((requestedTime(request, "from", from) == false) || (requestedTime(request, "to", to) == false))
     {
-        const uint8_t lastIdx_living_room = (data_living_room.count == 0) ? 0 : data_living_room.count - 1;
-        const uint8_t lastIdx_bedroom     = (data_bedroom.count == 0)     ? 0 : data_bedroom.count - 1;
-        const uint8_t lastIdx_bathroom    = (data_bathroom.count == 0)    ? 0 : data_bathroom.count - 1;
+        request->send(400, "text/plain", "Invalid time range");
+        return;
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    TextWriter           out(*response);
+    Log_cursor           cursor   = {0, 0};
+    Log_record           records[LOG_HISTORY_CHUNK];
+    size_t               total    = 0;
 
-        if (verbose == true)
+    // Copy a few samples at a time, the log task can append between two chunks
+    while(total < LOG_MAX_SCAN)
+    {
+        // Do not hold the async_tcp task for long if the log task is writing on flash
+        if(logMtx.take(100 / portTICK_PERIOD_MS) == false)
         {
-            str += "In living room:\n";
-            str += "\t\tTime: ";
-            str += String(data_living_room.data[lastIdx_living_room].time);
-            str += ";";
-            str += "\t\tTemperature: ";
-            str += String(data_living_room.data[lastIdx_living_room].temperature);
-            str += ";";
-            str += "\t\tHumidity: ";
-            str += String(data_living_room.data[lastIdx_living_room].humidity);
-            str += ";";
-            str += "\t\tPressure: ";
-            str += String(data_living_room.data[lastIdx_living_room].pressure);
-            str += ";";
-            str += "\t\tAltitude: ";
-            str += String(data_living_room.data[lastIdx_living_room].altitude);
-            str += ";";
-            str += "\t\tGas resistance: ";
-            str += String(data_living_room.data[lastIdx_living_room].gas_resistance);
-            str += "\n";
-
-            str += "In bedroom:\n";
-            str += "\t\tTime: ";
-            str += String(data_bedroom.data[lastIdx_bedroom].time);
-            str += ";";
-            str += "\t\tTemperature: ";
-            str += String(data_bedroom.data[lastIdx_bedroom].temperature);
-            str += ";";
-            str += "\t\tHumidity: ";
-            str += String(data_bedroom.data[lastIdx_bedroom].humidity);
-            str += ";";
-            str += "\t\tPressure: ";
-            str += String(data_bedroom.data[lastIdx_bedroom].pressure);
-            str += ";";
-            str += "\t\tAltitude: ";
-            str += String(data_bedroom.data[lastIdx_bedroom].altitude);
-            str += "\n";
-
-            str += "In bathroom:\n";
-            str += "\t\tTime: ";
-            str += String(data_bathroom.data[lastIdx_bathroom].time);
-            str += ";";
-            str += "\t\tTemperature: ";
-            str += String(data_bathroom.data[lastIdx_bathroom].temperature);
-            str += ";";
-            str += "\t\tHumidity: ";
-            str += String(data_bathroom.data[lastIdx_bathroom].humidity);
-            str += ";";
-            str += "\t\tPressure: ";
-            str += String(data_bathroom.data[lastIdx_bathroom].pressure);
-            str += ";";
-            str += "\t\tAltitude: ";
-            str += String(data_bathroom.data[lastIdx_bathroom].altitude);
-            str += "\n";
+            delete response;
+            request->send(503, "text/plain", "Log busy");
+            return;
         }
-        else
+        const size_t wanted = ((LOG_MAX_SCAN - total) < LOG_HISTORY_CHUNK) ? (LOG_MAX_SCAN - total) : LOG_HISTORY_CHUNK;
+        const size_t count  = sampleLog.scan(room->id(), from, to, cursor, records, wanted);
+        logMtx.give();
+
+        for (size_t i = 0; i < count; i++)
+        {
+            writeFields(out, records[i], ',');
+            out.write(';');
+        }
+        total += count;
+        if(count < wanted)
         {
-            str += rooms[data_living_room.data[lastIdx_living_room].id];
-            str += ";";
-            str += String(data_living_room.data[lastIdx_living_room].time);
-            str += ";";
-            str += String(data_living_room.data[lastIdx_living_room].temperature);
-            str += ";";
-            str += String(data_living_room.data[lastIdx_living_room].humidity);
-            str += ";";
-            str += String(data_living_room.data[lastIdx_living_room].pressure);
-            str += ";";
-            str += String(data_living_room.data[lastIdx_living_room].altitude);
-            str += ";";
-            str += String(data_living_room.data[lastIdx_living_room].gas_resistance);
-            str += "\n";
-
-            str += rooms[data_bedroom.data[lastIdx_bedroom].id];
-            str += ";";
-            str += String(data_bedroom.data[lastIdx_bedroom].time);
-            str += ";";
-            str += String(data_bedroom.data[lastIdx_bedroom].temperature);
-            str += ";";
-            str += String(data_bedroom.data[lastIdx_bedroom].humidity);
-            str += ";";
-            str += String(data_bedroom.data[lastIdx_bedroom].pressure);
-            str += ";";
-            str += String(data_bedroom.data[lastIdx_bedroom].altitude);
-            str += "\n";
-
-            str += rooms[data_bathroom.data[lastIdx_bathroom].id];
-            str += ";";
-            str += String(data_bathroom.data[lastIdx_bathroom].time);
-            str += ";";
-            str += String(data_bathroom.data[lastIdx_bathroom].temperature);
-            str += ";";
-            str += String(data_bathroom.data[lastIdx_bathroom].humidity);
-            str += ";";
-            str += String(data_bathroom.data[lastIdx_bathroom].pressure);
-            str += ";";
-            str += String(data_bathroom.data[lastIdx_bathroom].altitude);
-            str += "\n";
+            break;
         }
     }
+    request->send(response);
+}
+
+
+/***********************************************************************
+ * @brief Send the metrics of the tasks to an HTTP client, in the Prometheus text format
+ * @param request Request to answer
+ ***********************************************************************/
+void sendMetrics(AsyncWebServerRequest *request)
+{
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    TextWriter           out(*response);
+    metrics.writePrometheus(out);
+    request->send(response);
+}
+
+
+/***********************************************************************
+ * @brief Convert ESP-NOW statistics to string
+ * @return String with one counter per line
+ ***********************************************************************/
+String espNowStatsToString()
+{
+    String str = "";
+    str += "Received: "           + String(esp_now_stats.received)                + "\n";
+    str += "Stored: "             + String(esp_now_stats.stored)                  + "\n";
+    str += "Dropped: "            + String(esp_now_stats.dropped)                 + "\n";
+    str += "Invalid: "            + String(esp_now_stats.invalid)                 + "\n";
+    str += "Waiting: "            + String(uxQueueMessagesWaiting(espNowQueue))   + "\n";
+    str += "Max waiting: "        + String(esp_now_stats.max_depth)               + "\n";
+    str += "Last latency (us): "  + String(esp_now_stats.last_latency_us)         + "\n";
+    str += "Max latency (us): "   + String(esp_now_stats.max_latency_us)          + "\n";
+    str += "Bad version: "        + String(esp_now_stats.bad_version)             + "\n";
+    str += "Bad CRC: "            + String(esp_now_stats.bad_crc)                 + "\n";
+    str += "Duplicates: "         + String(esp_now_stats.duplicates)              + "\n";
+    str += "Time requests: "      + String(esp_now_stats.time_requests)           + "\n";
+    str += "Time sent: "          + String(esp_now_stats.time_sent)               + "\n";
+    str += "Pairing probes: "     + String(esp_now_stats.pair_probes)             + "\n";
+
+    // One line per node, loss is given by the gaps in the sequence numbers
+    const size_t count = peers.count();
+    for (size_t i = 0; i < count; i++)
+    {
+        const Peer_stats &peer = peers.at(i);
+        const Room       *room = rooms.find(peer.node);
+        str += String((room != NULL) ? room->name() : "Unknown") + ": ";
+        str += "received "      + String(peer.received);
+        str += ", lost "        + String(peer.lost);
+        str += ", duplicates "  + String(peer.duplicates);
+        str += ", reordered "   + String(peer.reordered);
+        str += ", restarts "    + String(peer.restarts);
+        str += ", airtime per sample (us) " + String((peer.samples > 0) ? peer.airtime_us / peer.samples : 0);
+        str += ", rtt (us) "    + String(peer.last_rtt_us) + " / mean " + String(peer.mean_rtt_us) + " / max " + String(peer.max_rtt_us) + "\n";
+    }
+    return str;
+}
+
+
+/***********************************************************************
+ * @brief Convert bot and sensor task timing to string
+ * @return String with one counter per line
+ ***********************************************************************/
+String taskStatsToString()
+{
+    String str = "";
+    str += "Polls: "                  + String(bot_stats.polls)                     + "\n";
+    str += "Failed polls: "           + String(bot_stats.failed_polls)              + "\n";
+    str += "Commands: "               + String(bot_stats.commands)                  + "\n";
+    str += "Max handle time (us): "   + String(bot_stats.max_handle_us)             + "\n";
+    str += "Replies waiting: "        + String(uxQueueMessagesWaiting(botReplyQueue) + outbox.depth()) + "\n";
+    str += "Replies queued: "         + String(outbox.stats().queued)               + "\n";
+    str += "Replies merged: "         + String(outbox.stats().merged)               + "\n";
+    str += "Replies sent: "           + String(outbox.stats().sent)                 + "\n";
+    str += "Replies retried: "        + String(outbox.stats().retries)              + "\n";
+    str += "Replies failed: "         + String(outbox.stats().failed)               + "\n";
+    str += "Replies dropped: "        + String(bot_stats.replies_dropped + outbox.stats().dropped) + "\n";
+    str += "Reply latency (ms): "     + String(outbox.stats().last_latency_ms)      + "\n";
+    str += "Max reply latency (ms): " + String(outbox.stats().max_latency_ms)       + "\n";
+    str += "Send time (us): "         + String(bot_stats.last_send_us)              + "\n";
+    str += "Max send time (us): "     + String(bot_stats.max_send_us)               + "\n";
+    str += "Sensor samples: "         + String(sensor_timing.samples)               + "\n";
+    str += "Sensor period (us): "     + String(sensor_timing.last_period_us)        + "\n";
+    str += "Sensor max jitter (us): " + String(sensor_timing.max_jitter_us)         + "\n";
+    str += "Sensor read time (us): "  + String(sensor_timing.last_read_us)          + "\n";
+    str += "Sensor max read (us): "   + String(sensor_timing.max_read_us)           + "\n";
     return str;
 }
 
 
+/***********************************************************************
+ * @brief Convert the NTP sync health of the clock to string
+ * @return String with one counter per line
+ ***********************************************************************/
+String clockStatsToString()
+{
+    const Clock_health &health = clockService.health();
+    String str = "";
+    str += "Synced: "                 + String(clockService.synced() ? "yes" : "no") + "\n";
+    str += "Healthy: "                + String(clockService.healthy() ? "yes" : "no") + "\n";
+    str += "Last sync (s ago): "      + String(clockService.age())                  + "\n";
+    str += "Syncs: "                  + String(health.syncs)                        + "\n";
+    str += "Failures: "               + String(health.failures)                     + "\n";
+    str += "Steps: "                  + String(health.steps)                        + "\n";
+    str += "Last error (us): "        + String(health.last_error_us)                + "\n";
+    str += "Drift (ppb): "            + String(health.drift_ppb)                    + "\n";
+    str += "Round trip (us): "        + String(health.last_rtt_us)                  + "\n";
+    return str;
+}
+
+
+String returnWelcomeMessage(const String &name, bool help = false);
+
+
+/***********************************************************************
+ * @brief /start: welcome the user and list the commands
+ ***********************************************************************/
+void commandStart(Command_context &context, const char *args)
+{
+    context.out->write(returnWelcomeMessage(context.command->from_name).c_str());
+}
+
+
+/***********************************************************************
+ * @brief /help: list the commands
+ ***********************************************************************/
+void commandHelp(Command_context &context, const char *args)
+{
+    context.out->write(returnWelcomeMessage(context.command->from_name, true).c_str());
+}
+
+
+/***********************************************************************
+ * @brief /led_on: turn the LED on
+ ***********************************************************************/
+void commandLedOn(Command_context &context, const char *args)
+{
+    context.out->write("LED state set to ON");
+    ledState = HIGH;
+    led.show(LedPatterns::on());
+}
+
+
+/***********************************************************************
+ * @brief /led_off: turn the LED off
+ ***********************************************************************/
+void commandLedOff(Command_context &context, const char *args)
+{
+    context.out->write("LED state set to OFF");
+    ledState = LOW;
+    led.show(LedPatterns::off());
+}
+
+
+/***********************************************************************
+ * @brief /state: tell whether the LED is on
+ ***********************************************************************/
+void commandState(Command_context &context, const char *args)
+{
+    if(ledState == true)
+    {
+        context.out->write("LED is ON");
+    }
+    else
+    {
+        context.out->write("LED is OFF");
+    }
+}
+
+
+/***********************************************************************
+ * @brief /blink [count]: blink the LED, BLINK_DEFAULT times by default
+ ***********************************************************************/
+void commandBlink(Command_context &context, const char *args)
+{
+    const int count = (*args != '\0') ? atoi(args) : BLINK_DEFAULT;
+    if((count <= 0) || (count > BLINK_MAX))
+    {
+        context.out->write("Number of blinks must be between 1 and ");
+        context.out->writeUInt(BLINK_MAX);
+        return;
+    }
+    if(led.play(LedPatterns::blink(count)) == false)
+    {
+        context.out->write("LED is busy");
+        return;
+    }
+    context.out->write("LED will blink");
+}
+
+
+/***********************************************************************
+ * @brief /coreID: tell which core runs the bot
+ ***********************************************************************/
+void commandCoreId(Command_context &context, const char *args)
+{
+    context.out->write("This bot is running on core ");
+    context.out->writeUInt(xPortGetCoreID());
+}
+
+
+/***********************************************************************
+ * @brief /read_sensor: last sample of each room
+ ***********************************************************************/
+void commandReadSensor(Command_context &context, const char *args)
+{
+    writeData(*context.out, true);
+}
+
+
+/***********************************************************************
+ * @brief /esp_now_stats: ESP-NOW reception statistics
+ ***********************************************************************/
+void commandEspNowStats(Command_context &context, const char *args)
+{
+    context.out->write(espNowStatsToString().c_str());
+}
+
+
+/***********************************************************************
+ * @brief /rollup: last hour summaries of each room
+ ***********************************************************************/
+void commandRollup(Command_context &context, const char *args)
+{
+    writeRollup(*context.out);
+}
+
+
+/***********************************************************************
+ * @brief /clock: NTP sync health
+ ***********************************************************************/
+void commandClock(Command_context &context, const char *args)
+{
+    context.out->write(clockStatsToString().c_str());
+}
+
+
+/***********************************************************************
+ * @brief /metrics: CPU, stack and loop time of the tasks, mutexes, queues and heap
+ ***********************************************************************/
+void commandMetrics(Command_context &context, const char *args)
+{
+    metrics.writeSummary(*context.out);
+}
+
+
+/***********************************************************************
+ * @brief /task_stats: bot and sensor timing
+ ***********************************************************************/
+void commandTaskStats(Command_context &context, const char *args)
+{
+    context.out->write(taskStatsToString().c_str());
+}
+
+
+// Commands of the bot, sorted by name for the binary search
+constexpr Bot_command_entry<Command_context> botCommands[] =
+{
+    {"/blink",          "to blink LED",                                                 commandBlink},
+    {"/clock",          "to display NTP sync health",                                   commandClock},
+    {"/coreID",         "to display which core is used by this bot",                    commandCoreId},
+    {"/esp_now_stats",  "to display ESP-NOW reception statistics",                      commandEspNowStats},
+    {"/help",           "to display this message",                                      commandHelp},
+    {"/led_off",        "to turn GPIO OFF",                                             commandLedOff},
+    {"/led_on",         "to turn GPIO ON",                                              commandLedOn},
+    {"/metrics",        "to display CPU, stack, mutex, queue and heap usage",           commandMetrics},
+    {"/read_sensor",    "to display sensor data",                                       commandReadSensor},
+    {"/rollup",         "to display min / mean / max temperature of the last hours",    commandRollup},
+    {"/start",          NULL,                                                           commandStart},
+    {"/state",          "to request current GPIO state",                                commandState},
+    {"/task_stats",     "to display bot and sensor timing",                             commandTaskStats},
+};
+static_assert(BotCommands::sorted(botCommands), "botCommands must be sorted by name");
+
+const CommandTable<Command_context, sizeof(botCommands) / sizeof(botCommands[0])> commandTable(botCommands);
+
+// Order of the commands in /help, the GPIO ones first
+const char *const botHelpOrder[] =
+{
+    "/led_on", "/led_off", "/state", "/blink", "/help", "/coreID", "/read_sensor",
+    "/esp_now_stats", "/rollup", "/task_stats", "/metrics", "/clock"
+};
+
+
 /***********************************************************************
  * @brief Return welcome message
  * @param name Name to welcome
  * @param help Help message
  * @return Welcome message
  ***********************************************************************/
-String returnWelcomeMessage(const String &name, bool help = false)
+String returnWelcomeMessage(const String &name, bool help)
 {
     String welcome = "";
     if(help == false)
@@ -467,120 +962,207 @@ String returnWelcomeMessage(const String &name, bool help = false)
         welcome += "!\n";
     }
     welcome += "Use the following commands to control your bot :\n\n";
-    welcome += "/led_on to turn GPIO ON \n";
-    welcome += "/led_off to turn GPIO OFF \n";
-    welcome += "/state to request current GPIO state \n";
-    welcome += "/blink to blink LED \n";
-    welcome += "/help to display this message \n";
-    welcome += "/coreID to display which core is used by this bot \n";
-    welcome += "/read_sensor to display sensor data \n";
+    commandTable.help(welcome, botHelpOrder);
     return welcome;
 }
 
 
 /***********************************************************************
- * @brief Randle what happens when you receive new messages
- * @param numNewMessages Number of new messages received
+ * @brief Hand a reply to the Telegram network task, never blocks
+ * @param reply Reply to send
  ***********************************************************************/
-void handleNewMessages(const int32_t numNewMessages)
+void queueReply(const Bot_reply &reply)
 {
-    for (int32_t i = 0; i < numNewMessages; i++)
+    if(xQueueSend(botReplyQueue, &reply, 0) != pdTRUE)
     {
-        // Chat id of the requester
-        String chatID = String(bot.messages[i].chat_id);
-        if((chatID != CHAT_ID_1) && (chatID != CHAT_ID_2) && (chatID != CHAT_ID_GROUP))
-        {
-            bot.sendMessage(chatID, "You are not authorized to use this bot.");
-            continue;
-        }
+        bot_stats.replies_dropped++;
+    }
+}
 
-        String text     = bot.messages[i].text;
-        String fromName = bot.messages[i].from_name;
 
-        if(text == "/start")
-        {
-            bot.sendMessage(chatID, returnWelcomeMessage(fromName));
-        }
+/***********************************************************************
+ * @brief Handle a command received from Telegram
+ * @param command Command to handle
+ * @note Reads data through lock-free snapshots and never waits for the network
+ ***********************************************************************/
+void handleCommand(const Bot_command &command)
+{
+    static Bot_reply reply;         // Too large for the stack of the task
+    TextWriter       out(reply.text, sizeof(reply.text));
+    Command_context  context = {&command, &out};
+    const String     chatID  = command.chat_id;
+    const uint32_t   start   = micros();
+
+    strlcpy(reply.chat_id, command.chat_id, sizeof(reply.chat_id));
+
+    // Chat id of the requester
+    if((chatID != CHAT_ID_1) && (chatID != CHAT_ID_2) && (chatID != CHAT_ID_GROUP))
+    {
+        out.write("You are not authorized to use this bot.");
+    }
+    else if(commandTable.dispatch(context, command.text) == false)
+    {
+        out.write("Invalid command");
+    }
+
+    queueReply(reply);
+
+    const uint32_t elapsed = micros() - start;
+    bot_stats.commands++;
+    if(elapsed > bot_stats.max_handle_us)
+    {
+        bot_stats.max_handle_us = elapsed;
+    }
+}
 
-        else if(text == "/led_on")
+
+/***********************************************************************
+ * @brief Send the next reply the outbox allows, if any
+ * @return False if no reply may be sent now
+ ***********************************************************************/
+bool sendNextReply()
+{
+    Bot_outbox::Message *message = outbox.next(millis());
+    if(message == NULL)
+    {
+        return false;
+    }
+
+    const uint32_t start = micros();
+    const bool     sent  = bot.sendMessage(message->chat_id, message->text);
+    const uint32_t took  = micros() - start;
+    outbox.done(message, sent, millis());
+
+    bot_stats.last_send_us = took;
+    if(took > bot_stats.max_send_us)
+    {
+        bot_stats.max_send_us = took;
+    }
+    return true;
+}
+
+
+/***********************************************************************
+ * @brief Move queued replies to the outbox and send them, up to BOT_REPLY_WAIT
+ * @param awaited Number of replies still expected for the commands polled
+ * @return Number of replies still expected
+ * @note Replies not sent in time, because of a backoff or a slow command, are
+ *       sent after the next poll, which is then shortened
+ ***********************************************************************/
+int32_t sendReplies(int32_t awaited)
+{
+    static Bot_reply reply;         // Too large for the stack of the task
+    const uint32_t   deadline = millis() + BOT_REPLY_WAIT;
+
+    while(true)
+    {
+        while(xQueueReceive(botReplyQueue, &reply, 0) == pdTRUE)
         {
-            bot.sendMessage(chatID, "LED state set to ON");
-            ledState = HIGH;
-            digitalWrite(LED, ledState);
+            outbox.add(reply.chat_id, reply.text, millis());
+            awaited--;
         }
-
-        else if(text == "/led_off")
+        if(sendNextReply() == true)
         {
-            bot.sendMessage(chatID, "LED state set to OFF");
-            ledState = LOW;
-            digitalWrite(LED, ledState);
+            continue;
         }
 
-        else if(text == "/state")
+        // Stop once nothing more is expected and nothing can be sent before the deadline
+        const uint32_t now  = millis();
+        const int32_t  left = (int32_t)(deadline - now);
+        const uint32_t wait = outbox.wait(now);
+        if((left <= 0) || ((awaited <= 0) && (wait >= (uint32_t)left)))
         {
-            if(ledState == true)
-            {
-                bot.sendMessage(chatID, "LED is ON");
-            }
-            else
-            {
-                bot.sendMessage(chatID, "LED is OFF");
-            }
+            return (awaited > 0) ? awaited : 0;
         }
 
-        else if(text == "/blink")
+        const uint32_t timeout = (wait < (uint32_t)left) ? wait : (uint32_t)left;
+        if(xQueueReceive(botReplyQueue, &reply, (timeout / portTICK_PERIOD_MS) + 1) == pdTRUE)
         {
-            bot.sendMessage(chatID, "LED will blink");
-            blinkLED();
+            outbox.add(reply.chat_id, reply.text, millis());
+            awaited--;
         }
+    }
+}
+
+
+/***********************************************************************
+ * @brief Task owning the Telegram connection, polls commands and sends replies
+ * @param pvParameters Task parameters
+ * @note Polls are long polls: Telegram answers as soon as a command arrives or
+ *       after BOT_LONG_POLL seconds, always on the same kept-alive TLS connection.
+ *       They are shortened while a reply is expected or waits in the outbox.
+ ***********************************************************************/
+void telegramTask(void *pvParameters)
+{
+    Bot_command  command;
+    TelegramPoll poll(BOT_LONG_POLL, BOT_DELAY);
+    int32_t      pending  = 0;      // Replies expected for the commands polled
+    uint32_t     polledAt = 0;      // millis() of the last poll that returned commands
+    telegramProbe.attach();
 
-        else if(text == "/help")
+    while(true)
+    {
+        // A retry or a paced reply leaves when due, a late reply soon after it is queued
+        uint32_t wait = outbox.wait(millis());
+        if((pending > 0) && ((millis() - polledAt) < BOT_REPLY_LATE) && (wait > BOT_REPLY_POLL))
         {
-            bot.sendMessage(chatID, returnWelcomeMessage(fromName, true));
+            wait = BOT_REPLY_POLL;
         }
-
-        else if(text == "/coreID")
+        const uint16_t timeout        = poll.timeout(wait);
+        bot.longPoll                  = timeout;
+        const uint32_t start          = millis();
+        const int32_t  numNewMessages = bot.getUpdates(bot.last_message_received + 1);
+        const uint32_t elapsed        = millis() - start;
+        telegramProbe.wake();
+        bot_stats.polls++;
+
+        for (int32_t i = 0; i < numNewMessages; i++)
         {
-            bot.sendMessage(chatID, "This bot is running on core " + String(xPortGetCoreID()));
+            #if VERBOSITY
+            Serial.println("Telegram task, got a message from Telegram.");
+            #endif
+            strlcpy(command.chat_id,   bot.messages[i].chat_id.c_str(),   sizeof(command.chat_id));
+            strlcpy(command.from_name, bot.messages[i].from_name.c_str(), sizeof(command.from_name));
+            strlcpy(command.text,      bot.messages[i].text.c_str(),      sizeof(command.text));
+            xQueueSend(botCommandQueue, &command, portMAX_DELAY);
         }
 
-        else if(text == "/read_sensor")
+        // Each command gets one reply, send them before the next poll holds the connection
+        if(numNewMessages > 0)
         {
-            bot.sendMessage(chatID, structToString(true));
+            polledAt = millis();
         }
+        pending = sendReplies(pending + numNewMessages);
+        telegramProbe.sleep();
 
-        else
+        // After a failed poll, do not hammer Telegram
+        const uint32_t pause = poll.done(timeout, elapsed, numNewMessages);
+        if(pause > 0)
         {
-            bot.sendMessage(chatID, "Invalid command");
+            bot_stats.failed_polls++;
+            vTaskDelay(pause / portTICK_PERIOD_MS);
         }
     }
 }
 
 
 /***********************************************************************
- * @brief Task executed by Bot to send and receive messages to Telegram
+ * @brief Task executed by Bot to handle the commands received from Telegram
  * @param pvParameters Task parameters
  ***********************************************************************/
 void botTask(void *pvParameters)
 {
+    Bot_command command;
+    botProbe.attach();
+
     while(true)
     {
-        int32_t numNewMessages = bot.getUpdates(bot.last_message_received + 1);
-        while(numNewMessages)
+        if(xQueueReceive(botCommandQueue, &command, portMAX_DELAY) == pdTRUE)
         {
-            if(xSemaphoreTake(mtx, portMAX_DELAY))
-            {
-                #if VERBOSITY
-                Serial.println("Bot task, got a message from Telegram.");
-                #endif
-                handleNewMessages(numNewMessages);
-                xSemaphoreGive(mtx);
-            }
-            numNewMessages = bot.getUpdates(bot.last_message_received + 1);
+            botProbe.wake();
+            handleCommand(command);
+            botProbe.sleep();
         }
-
-        // Wait for BOT_DELAY
-        vTaskDelay(BOT_DELAY / portTICK_PERIOD_MS);
     }
 }
 
@@ -591,34 +1173,312 @@ void botTask(void *pvParameters)
  ***********************************************************************/
 void sensorTask(void *pvParameters)
 {
+    TickType_t lastWake  = xTaskGetTickCount();
+    uint32_t   lastStart = 0;
+    sensorProbe.attach();
+
     while(true)
     {
-        // Read data from BME680 sensor
-        if(xSemaphoreTake(mtx, portMAX_DELAY))
+        sensorProbe.wake();
+        const uint32_t start = micros();
+        if(sensor_timing.samples > 0)
         {
-            #if VERBOSITY
-            Serial.println("Sensor task, reading data from BME680 sensor.");
-            #endif
-            updateBME680Data();
-            xSemaphoreGive(mtx);
+            const uint32_t period = start - lastStart;
+            const int32_t  jitter = (int32_t)(period - SENSOR_DELAY * 1000UL);
+            sensor_timing.last_period_us = period;
+            if((uint32_t)abs(jitter) > sensor_timing.max_jitter_us)
+            {
+                sensor_timing.max_jitter_us = abs(jitter);
+            }
+        }
+        lastStart = start;
+
+        // Read data from BME680 sensor, the history is lock-free for readers
+        #if VERBOSITY
+        Serial.println("Sensor task, reading data from BME680 sensor.");
+        #endif
+        onSample(livingRoom, updateBME680Data());
+
+        const uint32_t read = micros() - start;
+        sensor_timing.last_read_us = read;
+        if(read > sensor_timing.max_read_us)
+        {
+            sensor_timing.max_read_us = read;
         }
+        sensor_timing.samples++;
+        sensorProbe.sleep();
 
-        // Wait for SENSOR_DELAY
-        vTaskDelay(SENSOR_DELAY / portTICK_PERIOD_MS);
+        // Wake up every SENSOR_DELAY, whatever the time spent reading
+        vTaskDelayUntil(&lastWake, SENSOR_DELAY / portTICK_PERIOD_MS);
     }
 }
 
 
 /***********************************************************************
  * @brief Callback function to handle esp now reception
- * @param mac_addr 
- * @param incomingData 
- * @param len 
+ * @param mac_addr Mac address of the sender
+ * @param incomingData Data received
+ * @param len Size of the data received
  ***********************************************************************/
 void receiveData(const uint8_t *mac_addr, const uint8_t *incomingData, int32_t len)
 {
-    memcpy((uint8_t *)&incoming_data.bme280_tmp, incomingData, sizeof(Message_bme280));
-    incoming_data.received = true;
+    static Incoming_data incoming;  // Only used by the Wi-Fi task, too large for its stack
+    const Frame_header  *header = NULL;
+
+    // The frame is checked where the radio left it
+    const Frame_error error = NodeFrame::parse(incomingData, len, header);
+    if(error != FRAME_OK)
+    {
+        esp_now_stats.bad_version += (error == FRAME_BAD_VERSION) ? 1 : 0;
+        esp_now_stats.bad_crc     += (error == FRAME_BAD_CRC) ? 1 : 0;
+        esp_now_stats.invalid++;
+        return;
+    }
+    const BatchReader reader(header);
+    const bool        probe = (header->type == FRAME_PAIR_PROBE);
+    if((probe == false) && (header->type != FRAME_TIME_REQUEST) && (reader.count() == 0))
+    {
+        esp_now_stats.invalid++;
+        return;
+    }
+
+    // ESP-NOW sends a frame again when its ack is lost, keep it once, probes carry no sequence number
+    if((probe == false) && peers.track(mac_addr, header->node, header->sequence, header->rtt_us, reader.count(), len) == PEER_DUPLICATE)
+    {
+        esp_now_stats.duplicates++;
+        return;
+    }
+
+    incoming.received_at = micros();
+    memcpy(incoming.mac, mac_addr, sizeof(incoming.mac));
+    memcpy(incoming.frame, incomingData, len);
+
+    // Never block the Wi-Fi task, count the packet as dropped instead
+    if(xQueueSend(espNowQueue, &incoming, 0) != pdTRUE)
+    {
+        esp_now_stats.dropped++;
+        return;
+    }
+    esp_now_stats.received++;
+}
+
+
+/***********************************************************************
+ * @brief Kind of room fed by a frame of samples
+ * @param type Frame_type of the frame
+ * @return SENSOR_NONE if the frame carries no sample
+ ***********************************************************************/
+Sensor_type frameSensor(const uint8_t type)
+{
+    switch(type)
+    {
+        case FRAME_BME280:
+        case FRAME_BME280_BATCH:
+            return SENSOR_BME280;
+    }
+    return SENSOR_NONE;
+}
+
+
+/***********************************************************************
+ * @brief Find the room fed by an ESP-NOW sender, adding it on its first packet
+ * @param mac Address of the sender
+ * @param id Id of the room given by the sender
+ * @param sensor Kind of room the samples are for
+ * @return NULL if the room cannot be found nor added
+ * @note Senders are looked up by address first, a sender given another id
+ *       is bound again to the room of that id
+ ***********************************************************************/
+Room *incomingRoom(const uint8_t mac[6], const uint8_t id, const Sensor_type sensor)
+{
+    static uint8_t added = 0;    // Rooms added for unknown senders, only the ESP-NOW task calls this
+
+    Room *room = rooms.findByMac(mac);
+    if((room != NULL) && (room->id() == id))
+    {
+        return room;
+    }
+
+    // Any sender can claim an id, so their number and the memory they take are bounded
+    room = rooms.find(id);
+    if((room == NULL) && (id < NODE_ID_MAX) && (added < NODE_ROOMS_MAX) && (sensor == SENSOR_BME280))
+    {
+        char name[ROOM_NAME_SIZE];
+        snprintf(name, sizeof(name), "Room %u", id);
+        room = new (std::nothrow) TypedRoom<Message_bme280>(id, name);
+        if((room != NULL) && (rooms.add(room) == false))
+        {
+            delete room;
+            room = NULL;
+        }
+        added += (room != NULL) ? 1 : 0;
+    }
+
+    if(room != NULL)
+    {
+        rooms.bind(mac, room->id());
+    }
+    return room;
+}
+
+
+/***********************************************************************
+ * @brief Store the samples of an ESP-NOW packet in the history of its room
+ * @param incoming Packet to store, checked by receiveData()
+ ***********************************************************************/
+void storeIncomingData(const Incoming_data &incoming)
+{
+    const Frame_header *header = (const Frame_header *)incoming.frame;
+    const Sensor_type   sensor = frameSensor(header->type);
+    Room               *room   = incomingRoom(incoming.mac, header->node, sensor);
+    if((room == NULL) || (room->sensor() != sensor))
+    {
+        #if VERBOSITY
+        Serial.println("Esp now task, no room for id " + String(header->node) + ".");
+        #endif
+        esp_now_stats.invalid++;
+        return;
+    }
+
+    // Samples of a batch keep the time they were taken at, those of a node that never got it are dated on receipt
+    BatchReader    reader(header);
+    Batch_sample   sample;
+    Message_bme280 message;
+    while(reader.next(sample) == true)
+    {
+        message.id          = header->node;
+        message.time        = (sample.time == FRAME_NO_TIME) ? (uint32_t)(clockService.nowMicros() / 1000000) : sample.time;
+        message.temperature = sample.temperature;
+        message.humidity    = sample.humidity;
+        message.pressure    = sample.pressure;
+        message.altitude    = sample.altitude;
+        onSample(*static_cast<TypedRoom<Message_bme280> *>(room), message);
+        esp_now_stats.stored++;
+    }
+
+    const uint32_t latency = micros() - incoming.received_at;
+    esp_now_stats.last_latency_us = latency;
+    if(latency > esp_now_stats.max_latency_us)
+    {
+        esp_now_stats.max_latency_us = latency;
+    }
+}
+
+
+/***********************************************************************
+ * @brief Add an ESP-NOW peer
+ * @param mac Address of the node, or the broadcast address
+ * @return False if there is no room left for it
+ ***********************************************************************/
+bool addEspNowPeer(const uint8_t mac[6])
+{
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, sizeof(peer.peer_addr));
+    peer.channel = 0;
+    peer.encrypt = false;
+    return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+
+/***********************************************************************
+ * @brief Send a frame to a node or to the broadcast address
+ * @param mac Address of the node, or the broadcast address
+ * @param frame Frame to send
+ * @param length Size of the frame
+ * @return False if the frame cannot be sent
+ * @note Unicast frames need a peer, they are then acked and resent if lost.
+ *       ESP-NOW has only 20 peers, so nodes share one: the node answered
+ *       last keeps it until another one is answered, rather than deleting
+ *       it while its frame may still be resent.
+ ***********************************************************************/
+bool sendEspNow(const uint8_t mac[6], const uint8_t *frame, const size_t length)
+{
+    static uint8_t replyPeer[6];        // Node holding the shared peer
+    static bool    hasReplyPeer = false;
+
+    if(esp_now_is_peer_exist(mac) == false)
+    {
+        if(hasReplyPeer == true)
+        {
+            esp_now_del_peer(replyPeer);
+            hasReplyPeer = false;
+        }
+        if(addEspNowPeer(mac) == false)
+        {
+            return false;
+        }
+        memcpy(replyPeer, mac, sizeof(replyPeer));
+        hasReplyPeer = true;
+    }
+    return esp_now_send(mac, frame, length) == ESP_OK;
+}
+
+
+/***********************************************************************
+ * @brief Send the time of the clock to the nodes
+ * @param mac Address of the node, the broadcast address for a beacon
+ * @param request Sequence number of the request answered, 0 for a beacon
+ * @param flags TIME_REPLY when answering a request
+ * @return False if the clock is not synced yet or the frame cannot be sent
+ ***********************************************************************/
+bool sendTime(const uint8_t mac[6], const uint16_t request, const uint8_t flags)
+{
+    if(clockService.synced() == false)
+    {
+        return false;
+    }
+
+    // Read the clock last, right before the frame leaves
+    uint8_t      frame[FRAME_MAX_SIZE];
+    const size_t length = TimeBeacon::write(frame, sizeof(frame), gatewayHeader, clockService.nowMicros(), request, flags);
+    gatewayHeader.sequence++;
+    if(sendEspNow(mac, frame, length) == false)
+    {
+        return false;
+    }
+    esp_now_stats.time_sent++;
+    return true;
+}
+
+
+/***********************************************************************
+ * @brief Answer a node looking for the gateway with its address and channel
+ * @param mac Address of the node
+ * @return False if the frame cannot be sent
+ ***********************************************************************/
+bool sendPairing(const uint8_t mac[6])
+{
+    uint8_t gateway[6];
+    uint8_t frame[FRAME_MAX_SIZE];
+
+    // ESP-NOW frames leave from the station interface, on the channel of the AP
+    WiFi.macAddress(gateway);
+    const size_t length = PairingReply::write(frame, sizeof(frame), gatewayHeader, gateway, WiFi.channel());
+    gatewayHeader.sequence++;
+    return sendEspNow(mac, frame, length);
+}
+
+
+/***********************************************************************
+ * @brief Answer a time request or a pairing probe at once, store the samples of any other packet
+ * @param incoming Packet checked by receiveData()
+ ***********************************************************************/
+void handleIncomingData(const Incoming_data &incoming)
+{
+    const Frame_header *header = (const Frame_header *)incoming.frame;
+    if(header->type == FRAME_TIME_REQUEST)
+    {
+        esp_now_stats.time_requests++;
+        sendTime(incoming.mac, header->sequence, TIME_REPLY);
+        return;
+    }
+    if(header->type == FRAME_PAIR_PROBE)
+    {
+        esp_now_stats.pair_probes++;
+        sendPairing(incoming.mac);
+        return;
+    }
+    storeIncomingData(incoming);
 }
 
 
@@ -628,41 +1488,113 @@ void receiveData(const uint8_t *mac_addr, const uint8_t *incomingData, int32_t l
  ***********************************************************************/
 void espNowTask(void *pvParameters)
 {
+    static Incoming_data incoming;  // Too large for the stack of the task
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    TickType_t           nextBeacon   = xTaskGetTickCount();
+    espNowProbe.attach();
+
+    while(true)
+    {
+        // Nodes awake between two beacons keep their clock from them
+        if((int32_t)(xTaskGetTickCount() - nextBeacon) >= 0)
+        {
+            espNowProbe.wake();
+            sendTime(broadcast, 0, 0);
+            nextBeacon = xTaskGetTickCount() + TIME_BEACON_DELAY / portTICK_PERIOD_MS;
+            espNowProbe.sleep();
+        }
+
+        // Sleep until the reception callback queues a packet or the next beacon is due
+        const TickType_t now  = xTaskGetTickCount();
+        const TickType_t wait = ((int32_t)(nextBeacon - now) > 0) ? nextBeacon - now : 0;
+        if(xQueueReceive(espNowQueue, &incoming, wait) != pdTRUE)
+        {
+            continue;
+        }
+        espNowProbe.wake();
+
+        const uint32_t depth = uxQueueMessagesWaiting(espNowQueue) + 1;
+        if(depth > esp_now_stats.max_depth)
+        {
+            esp_now_stats.max_depth = depth;
+        }
+
+        // Handle whatever else arrived meanwhile
+        uint8_t count = 0;
+        do
+        {
+            handleIncomingData(incoming);
+            count++;
+        } while((count < ESP_NOW_BATCH_SIZE) && (xQueueReceive(espNowQueue, &incoming, 0) == pdTRUE));
+
+        #if VERBOSITY
+        Serial.println("Esp now task, got " + String(count) + " packet(s) from esp now.");
+        #endif
+        espNowProbe.sleep();
+    }
+}
+
+
+/***********************************************************************
+ * @brief Task writing the samples on flash, in batches
+ * @param pvParameters Task parameters
+ ***********************************************************************/
+void logTask(void *pvParameters)
+{
+    Log_record record;
+    TickType_t lastFlush = xTaskGetTickCount();
+    logProbe.attach();
+
     while(true)
     {
-        if(incoming_data.received)
+        const bool received = (xQueueReceive(logQueue, &record, LOG_FLUSH_DELAY / portTICK_PERIOD_MS) == pdTRUE);
+        logProbe.wake();
+
+        if(logMtx.take(portMAX_DELAY) == true)
         {
-            if(xSemaphoreTake(mtx, portMAX_DELAY))
+            if(received == true)
+            {
+                sampleLog.append(record);
+            }
+
+            // A full batch is written by append(), make sure a slow room does not stay in RAM forever
+            if((sampleLog.pending() > 0) && ((xTaskGetTickCount() - lastFlush) >= (LOG_FLUSH_DELAY / portTICK_PERIOD_MS)))
             {
-                /* Make sure IDs are the same on the emittor side */
-                #if VERBOSITY
-                Serial.println("Esp now task, got data from esp now.");
-                #endif
-                if (incoming_data.bme280_tmp.id == BEDROOM)
-                {
-                    memcpy((void *)&data_bedroom.data[data_bedroom.count], (void *)&incoming_data.bme280_tmp, sizeof(Message_bme280));
-                    data_bedroom.count++;
-                }
-                else if (incoming_data.bme280_tmp.id == BATHROOM)
-                {
-                    memcpy((void *)&data_bathroom.data[data_bathroom.count], (void *)&incoming_data.bme280_tmp, sizeof(Message_bme280));
-                    data_bathroom.count++;
-                }
-                else
-                {
-                    #if VERBOSITY
-                    Serial.println("Esp now task, invalid id received.");
-                    #endif
-                }
-
-                incoming_data.received = false;
-                xSemaphoreGive(mtx);
+                sampleLog.flush();
             }
+            if(sampleLog.pending() == 0)
+            {
+                lastFlush = xTaskGetTickCount();
+            }
+            logMtx.give();
         }
+        logProbe.sleep();
+    }
+}
 
-        // Wait for ESP_NOW_DELAY
-        vTaskDelay(ESP_NOW_DELAY / portTICK_PERIOD_MS);
+
+/***********************************************************************
+ * @brief Convert log statistics to string
+ * @return String with one counter per line
+ ***********************************************************************/
+String logStatsToString()
+{
+    String str = "";
+    if(logMtx.take(100 / portTICK_PERIOD_MS) == true)
+    {
+        const Log_stats stats = sampleLog.stats();
+        str += "Segments: "          + String(sampleLog.segments())    + "\n";
+        str += "Pending: "           + String(sampleLog.pending())     + "\n";
+        str += "Appended: "          + String(stats.appended)          + "\n";
+        str += "Written: "           + String(stats.written)           + "\n";
+        str += "Flushes: "           + String(stats.flushes)           + "\n";
+        str += "Segments removed: "  + String(stats.segments_removed)  + "\n";
+        str += "CRC errors: "        + String(stats.crc_errors)        + "\n";
+        str += "Dropped on flash: "  + String(stats.dropped)           + "\n";
+        logMtx.give();
     }
+    str += "Dropped in queue: "  + String(log_dropped)             + "\n";
+    return str;
 }
 
 
@@ -673,24 +1605,33 @@ void setup()
 {
     uint8_t attempts = 0;
     ledState         = false;
-    memset((void *)&incoming_data,    0, sizeof(incoming_data));
-    memset((void *)&data_bedroom,     0, sizeof(data_bedroom));
-    memset((void *)&data_bathroom,    0, sizeof(data_bathroom));
-    memset((void *)&data_living_room, 0, sizeof(data_living_room));
-    for (uint8_t i = 0; i < MAX_DATA; i++)
-    {
-        data_living_room.data[i].id = LIVING_ROOM;
-    }
+    memset((void *)&esp_now_stats,    0, sizeof(esp_now_stats));
+    memset(&gatewayHeader,            0, sizeof(gatewayHeader));
+    memset((void *)&bot_stats,        0, sizeof(bot_stats));
+    memset((void *)&sensor_timing,    0, sizeof(sensor_timing));
 
     // Initialize serial
     Serial.begin(115200);
 
-    // Create a mutex
-    mtx = xSemaphoreCreateMutex();
+    // Create bot queues
+    botCommandQueue = xQueueCreate(BOT_QUEUE_SIZE, sizeof(Bot_command));
+    botReplyQueue   = xQueueCreate(BOT_QUEUE_SIZE, sizeof(Bot_reply));
+
+    // Register the rooms known at build time, in the order they are displayed
+    rooms.add(&livingRoom);
+    rooms.add(&bedroom);
+    rooms.add(&bathroom);
+
+    // Create ESP-NOW queue
+    espNowQueue = xQueueCreate(ESP_NOW_QUEUE_SIZE, sizeof(Incoming_data));
+
+    // Create log queue and mutex
+    logQueue    = xQueueCreate(LOG_QUEUE_SIZE, sizeof(Log_record));
+    logMtx.begin();
+    log_dropped = 0;
 
     // Initialize LED
-    pinMode(LED, OUTPUT);
-    digitalWrite(LED, LOW);
+    led.begin(LED);
 
     // Initialize BME680
     if(!bme.begin())
@@ -705,31 +1646,29 @@ void setup()
         Serial.println("An Error has occurred while mounting SPIFFS");
         ESP.restart();
     }
+    sampleLog.begin();
 
     // Connect to Wi-Fi
     WiFi.mode(WIFI_AP_STA);
     WiFi.begin(SSID, PASSWORD);
     client.setCACert(TELEGRAM_CERTIFICATE_ROOT); 
+    led.play(LedPatterns::blink(0, 1000));
     while(WiFi.status() != WL_CONNECTED)
     {
         delay(500);
         Serial.println("Connecting to WiFi.. Attempt " + String(++attempts));
-        digitalWrite(LED, ledState);
-        ledState = !ledState;
         if(attempts > 10)
         {
             Serial.println("Failed to connect to WiFi. Restarting... \n\n");
             ESP.restart();
         }
     }
-    ledState = false;
-    digitalWrite(LED, ledState);
+    led.show(LedPatterns::off());
     Serial.print("Connected to wifi at address : ");
     Serial.println(WiFi.localIP());
 
-    // Initialize NTP client
-    timeClient.begin();
-    timeClient.setUpdateInterval(1000);
+    // Start syncing the clock with NTP
+    clockService.begin();
 
     // Initialize ESPNOW
     if(esp_now_init() != ESP_OK)
@@ -739,6 +1678,10 @@ void setup()
     }
     esp_now_register_recv_cb(receiveData);
 
+    // The beacons keep their own peer, the replies to the nodes share another one
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    addEspNowPeer(broadcast);
+
     // Initialize web server
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
     {
@@ -754,11 +1697,51 @@ void setup()
     });
     server.on("/all_data", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        request->send(200, "text/plain", structToString(false).c_str());
+        sendData(request, false);
+    });
+    server.on("/all_data.bin", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        sendBinaryData(request);
+    });
+    server.on("/history", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        sendHistory(request);
+    });
+    server.on("/rollup", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        sendRollup(request);
+    });
+    server.on("/series", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        sendSeries(request);
+    });
+    server.on("/log_stats", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        request->send(200, "text/plain", logStatsToString().c_str());
+    });
+    server.on("/decoder.js", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        request->send(SPIFFS, "/decoder.js", "text/javascript");
     });
     server.on("/last_data", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        request->send(200, "text/plain", structToString(true, false).c_str());
+        sendData(request, true);
+    });
+    server.on("/esp_now_stats", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        request->send(200, "text/plain", espNowStatsToString().c_str());
+    });
+    server.on("/clock_stats", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        request->send(200, "text/plain", clockStatsToString().c_str());
+    });
+    server.on("/task_stats", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        request->send(200, "text/plain", taskStatsToString().c_str());
+    });
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        sendMetrics(request);
     });
     server.on("/living_room.html", HTTP_GET, [](AsyncWebServerRequest *request)
     {
@@ -777,13 +1760,30 @@ void setup()
         request->send(SPIFFS, "/bedroom/bedroom.js", "text/javascript");
     });
 
+    events.onConnect(sendSnapshot);
+    server.addHandler(&events);
+
     server.begin();
     
+    // Register what /metrics reports, before the tasks use it
+    metrics.add(telegramProbe);
+    metrics.add(botProbe);
+    metrics.add(sensorProbe);
+    metrics.add(espNowProbe);
+    metrics.add(logProbe);
+    metrics.add(logMtx);
+    metrics.addQueue("botCommandQueue", botCommandQueue, BOT_QUEUE_SIZE);
+    metrics.addQueue("botReplyQueue",   botReplyQueue,   BOT_QUEUE_SIZE);
+    metrics.addQueue("espNowQueue",     espNowQueue,     ESP_NOW_QUEUE_SIZE);
+    metrics.addQueue("logQueue",        logQueue,        LOG_QUEUE_SIZE);
+
     // Start tasks
     Serial.println("Starting tasks...");
-    xTaskCreatePinnedToCore(botTask,       "botTask", 8192, NULL, 1, NULL, 0);
-    xTaskCreatePinnedToCore(sensorTask, "sensorTask", 4096, NULL, 1, NULL, 1);
-    xTaskCreatePinnedToCore(espNowTask, "espNowTask", 4096, NULL, 2, NULL, 1);
+    xTaskCreatePinnedToCore(telegramTask, "telegramTask", TELEGRAM_STACK, NULL, 1, NULL, 0);
+    xTaskCreatePinnedToCore(botTask,       "botTask", TASK_STACK, NULL, 1, NULL, 0);
+    xTaskCreatePinnedToCore(sensorTask, "sensorTask", TASK_STACK, NULL, 1, NULL, 1);
+    xTaskCreatePinnedToCore(espNowTask, "espNowTask", TASK_STACK, NULL, 2, NULL, 1);
+    xTaskCreatePinnedToCore(logTask,       "logTask", TASK_STACK, NULL, 1, NULL, 1);
 }
 
 
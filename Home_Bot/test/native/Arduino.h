@@ -0,0 +1,166 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <chrono>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include "Print.h"
+
+/***********************************************************************
+ * Host stand-in of the Arduino core and of the FreeRTOS calls the headers
+ * make. A tick is a millisecond, tasks are threads and a mutex is a
+ * std::timed_mutex, which is enough to time them on the host.
+ ***********************************************************************/
+
+typedef uint32_t              TickType_t;
+typedef std::timed_mutex     *SemaphoreHandle_t;
+typedef void                 *TaskHandle_t;
+typedef void                 *QueueHandle_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       (ms)
+#define portMAX_DELAY           UINT32_MAX
+
+/***********************************************************************
+ * @brief Clock of a test that moves time itself, negative to follow the host
+ * @note Once set, delay() moves it instead of sleeping, only for tests
+ *       running on one thread
+ ***********************************************************************/
+inline int64_t &simulatedMicros()
+{
+    static int64_t us = -1;
+    return us;
+}
+
+inline uint64_t hostMicros()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    if(simulatedMicros() >= 0)
+    {
+        return (uint64_t)simulatedMicros();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline uint32_t micros()
+{
+    return (uint32_t)hostMicros();
+}
+
+inline uint32_t millis()
+{
+    return (uint32_t)(hostMicros() / 1000);
+}
+
+inline void delayMicroseconds(const uint32_t us)
+{
+    if(simulatedMicros() >= 0)
+    {
+        simulatedMicros() += us;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+inline void delay(const uint32_t ms)
+{
+    if(simulatedMicros() >= 0)
+    {
+        simulatedMicros() += (int64_t)ms * 1000;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline TickType_t xTaskGetTickCount()
+{
+    return millis();
+}
+
+inline void vTaskDelay(const TickType_t ticks)
+{
+    delay(ticks);
+}
+
+inline void vTaskDelayUntil(TickType_t *previous, const TickType_t ticks)
+{
+    *previous += ticks;
+    const int32_t left = (int32_t)(*previous - xTaskGetTickCount());
+    if(left > 0)
+    {
+        delay(left);
+    }
+}
+
+inline void taskYIELD()
+{
+    std::this_thread::yield();
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    static thread_local char task;
+    return &task;
+}
+
+inline uint32_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+    return 0;
+}
+
+inline uint32_t uxQueueMessagesWaiting(QueueHandle_t)
+{
+    return 0;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new std::timed_mutex();
+}
+
+inline int xSemaphoreTake(SemaphoreHandle_t handle, const TickType_t ticks)
+{
+    if(ticks == portMAX_DELAY)
+    {
+        handle->lock();
+        return pdTRUE;
+    }
+    return handle->try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+inline int xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    handle->unlock();
+    return pdTRUE;
+}
+
+/***********************************************************************
+ * @brief Host stand-in of the ESP object, a heap that never changes
+ ***********************************************************************/
+class EspClass
+{
+    public:
+        uint32_t getFreeHeap()
+        {
+            return 200000;
+        }
+
+        uint32_t getMinFreeHeap()
+        {
+            return 200000;
+        }
+
+        uint32_t getMaxAllocHeap()
+        {
+            return 110000;
+        }
+};
+
+inline EspClass ESP;
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef FS_H
+#define FS_H
+
+#include <dirent.h>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define FILE_READ       "r"
+#define FILE_WRITE      "w"
+#define FILE_APPEND     "a"
+
+namespace fs
+{
+
+class FS;
+
+/***********************************************************************
+ * @brief Host stand-in of the Arduino File, backed by a real file
+ ***********************************************************************/
+class File
+{
+    public:
+        File() {}
+
+        size_t write(const uint8_t *buffer, const size_t size);
+
+        size_t read(uint8_t *buffer, const size_t size)
+        {
+            return (_impl && _impl->file) ? fread(buffer, 1, size, _impl->file) : 0;
+        }
+
+        bool seek(const uint32_t pos)
+        {
+            return _impl && _impl->file && (pos <= this->size()) && (fseek(_impl->file, pos, SEEK_SET) == 0);
+        }
+
+        size_t size() const
+        {
+            struct stat info;
+            return (_impl && (stat(_impl->path.c_str(), &info) == 0)) ? (size_t)info.st_size : 0;
+        }
+
+        const char *name() const
+        {
+            return _impl ? _impl->name.c_str() : "";
+        }
+
+        void close()
+        {
+            if(_impl && _impl->file)
+            {
+                fclose(_impl->file);
+                _impl->file = NULL;
+            }
+            _impl.reset();
+        }
+
+        File openNextFile();
+
+        operator bool() const
+        {
+            return (bool)_impl;
+        }
+
+    private:
+        friend class FS;
+
+        typedef struct Impl
+        {
+            FS                       *fs;
+            std::string               path;     // Path on the host
+            std::string               name;     // Path on the flash, "/" included
+            FILE                     *file;     // NULL for a directory
+            std::vector<std::string>  entries;  // Files of a directory
+            size_t                    next;     // Next entry given by openNextFile()
+
+            ~Impl()
+            {
+                if(file != NULL)
+                {
+                    fclose(file);
+                }
+            }
+        } Impl;
+
+        std::shared_ptr<Impl> _impl;
+};
+
+/***********************************************************************
+ * @brief Host stand-in of a flash file system (SPIFFS, LittleFS), kept
+ * in a directory of the host, one level only
+ *
+ * Counts the writes so tests can measure how often flash is hit, and
+ * can be given a capacity to test a full flash. Pages are counted the way
+ * SPIFFS programs them: every data page an append touches, plus the index
+ * page of the file it updates.
+ ***********************************************************************/
+class FS
+{
+    public:
+        size_t capacity;        // Bytes the flash holds, writes past it are cut
+        size_t used;            // Bytes in the files
+        size_t write_calls;     // Calls to File::write()
+        size_t bytes_written;   // Bytes written by them
+        size_t page_size;       // Size of a flash page
+        size_t pages_written;   // Pages programmed by them
+
+        explicit FS(const std::string &root) : capacity(SIZE_MAX), used(0), write_calls(0), bytes_written(0), page_size(256), pages_written(0), _root(root) {}
+
+        File open(const char *path, const char *mode = FILE_READ, const bool create = false)
+        {
+            (void)create;
+            File file;
+            if(strcmp(path, "/") == 0)
+            {
+                file._impl.reset(new File::Impl{this, _root, "/", NULL, {}, 0});
+                DIR *dir = opendir(_root.c_str());
+                for (struct dirent *entry = (dir != NULL) ? readdir(dir) : NULL; entry != NULL; entry = readdir(dir))
+                {
+                    if(entry->d_name[0] != '.')
+                    {
+                        file._impl->entries.push_back(std::string("/") + entry->d_name);
+                    }
+                }
+                if(dir != NULL)
+                {
+                    closedir(dir);
+                }
+                return file;
+            }
+
+            const std::string host = _root + path;
+            if((mode[0] == 'w') && exists(path))
+            {
+                used -= sizeOf(host);
+            }
+            FILE *handle = fopen(host.c_str(), (mode[0] == 'r') ? "rb" : ((mode[0] == 'w') ? "wb" : "ab"));
+            if(handle != NULL)
+            {
+                file._impl.reset(new File::Impl{this, host, path, handle, {}, 0});
+            }
+            return file;
+        }
+
+        bool exists(const char *path)
+        {
+            struct stat info;
+            return stat((_root + path).c_str(), &info) == 0;
+        }
+
+        bool remove(const char *path)
+        {
+            const std::string host = _root + path;
+            const size_t      size = sizeOf(host);
+            if(unlink(host.c_str()) != 0)
+            {
+                return false;
+            }
+            used -= size;
+            return true;
+        }
+
+    private:
+        friend class File;
+
+        static size_t sizeOf(const std::string &host)
+        {
+            struct stat info;
+            return (stat(host.c_str(), &info) == 0) ? (size_t)info.st_size : 0;
+        }
+
+        std::string _root;
+};
+
+inline size_t File::write(const uint8_t *buffer, const size_t size)
+{
+    if(!_impl || (_impl->file == NULL))
+    {
+        return 0;
+    }
+
+    FS          &fs     = *_impl->fs;
+    const size_t offset = this->size();
+    const size_t room   = (fs.used < fs.capacity) ? fs.capacity - fs.used : 0;
+    const size_t wrote  = fwrite(buffer, 1, (size < room) ? size : room, _impl->file);
+    fflush(_impl->file);
+    fs.used          += wrote;
+    fs.write_calls   += 1;
+    fs.bytes_written += wrote;
+    fs.pages_written += ((offset % fs.page_size) + wrote + fs.page_size - 1) / fs.page_size + 1;
+    return wrote;
+}
+
+inline File File::openNextFile()
+{
+    File file;
+    if(_impl && (_impl->file == NULL) && (_impl->next < _impl->entries.size()))
+    {
+        const std::string name = _impl->entries[_impl->next++];
+        file                   = _impl->fs->open(name.c_str(), FILE_READ);
+    }
+    return file;
+}
+
+}
+
+using fs::FS;
+using fs::File;
+
+#endif
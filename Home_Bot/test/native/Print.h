@@ -0,0 +1,28 @@
+#ifndef PRINT_H
+#define PRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***********************************************************************
+ * @brief Host stand-in of the Arduino Print, only what the writers use
+ ***********************************************************************/
+class Print
+{
+    public:
+        virtual ~Print() {}
+
+        virtual size_t write(const uint8_t c) = 0;
+
+        virtual size_t write(const uint8_t *buffer, const size_t size)
+        {
+            size_t n = 0;
+            while((n < size) && (write(buffer[n]) == 1))
+            {
+                n++;
+            }
+            return n;
+        }
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include "Arduino.h"
+
+inline int64_t esp_timer_get_time()
+{
+    return (int64_t)hostMicros();
+}
+
+#endif
@@ -0,0 +1,221 @@
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "BinaryWriter.hpp"
+#include "RoomRegistry.hpp"
+
+/***********************************************************************
+ * @brief Reads /all_data.bin the way data/decoder.js does
+ ***********************************************************************/
+class BinaryReader
+{
+    public:
+        BinaryReader(const uint8_t *data, const size_t size) : _data(data), _size(size), _offset(0), _overrun(false) {}
+
+        uint8_t u8()
+        {
+            return (uint8_t)take(1);
+        }
+
+        uint16_t u16()
+        {
+            return (uint16_t)take(2);
+        }
+
+        uint32_t u32()
+        {
+            return take(4);
+        }
+
+        float f32()
+        {
+            const uint32_t bits = take(4);
+            float          value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        bool done() const
+        {
+            return (_overrun == false) && (_offset == _size);
+        }
+
+    private:
+        // Little-endian, like DataView with littleEndian set
+        uint32_t take(const size_t count)
+        {
+            uint32_t value = 0;
+            if(_offset + count > _size)
+            {
+                _overrun = true;
+                return 0;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                value |= (uint32_t)_data[_offset + i] << (8 * i);
+            }
+            _offset += count;
+            return value;
+        }
+
+        const uint8_t *_data;
+        size_t         _size;
+        size_t         _offset;
+        bool           _overrun;
+};
+
+/***********************************************************************
+ * @brief Print keeping what is streamed to it
+ ***********************************************************************/
+class BytePrint : public Print
+{
+    public:
+        std::vector<uint8_t> bytes;
+
+        size_t write(const uint8_t c) override
+        {
+            bytes.push_back(c);
+            return 1;
+        }
+};
+
+static TypedRoom<Message_bme680> livingRoom(1, "Living room");
+static TypedRoom<Message_bme280> bedroom(0, "Bedroom");
+static TypedRoom<Message_bme280> bathroom(2, "Bathroom");
+
+/***********************************************************************
+ * @brief Same layout as writeBinaryData() in main.cpp
+ ***********************************************************************/
+static void writeBlob(BinaryWriter &out)
+{
+    const Room *rooms[] = {&bedroom, &livingRoom, &bathroom};
+    out.writeU8('H');
+    out.writeU8('B');
+    out.writeU8(1);
+    out.writeU8(3);
+    for (size_t i = 0; i < 3; i++)
+    {
+        rooms[i]->writeBinary(out);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_little_endian()
+{
+    uint8_t      bytes[11];
+    BinaryWriter out(bytes, sizeof(bytes));
+    out.writeU8(0xA5);
+    out.writeU16(0x1234);
+    out.writeU32(0xDEADBEEF);
+    out.writeFloat(1.0F);
+
+    const uint8_t expected[] = {0xA5, 0x34, 0x12, 0xEF, 0xBE, 0xAD, 0xDE, 0x00, 0x00, 0x80, 0x3F};
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected), out.length());
+    TEST_ASSERT_FALSE(out.truncated());
+    TEST_ASSERT_EQUAL_MEMORY(expected, bytes, sizeof(expected));
+}
+
+void test_truncated()
+{
+    uint8_t      bytes[3];
+    BinaryWriter out(bytes, sizeof(bytes));
+    out.writeU32(0x04030201);
+
+    // The bytes that fit are written, the length counts them all
+    TEST_ASSERT_TRUE(out.truncated());
+    TEST_ASSERT_EQUAL_size_t(4, out.length());
+    TEST_ASSERT_EQUAL_UINT8(0x01, bytes[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x03, bytes[2]);
+
+    BinaryWriter size(NULL, 0);
+    size.writeU32(0);
+    TEST_ASSERT_EQUAL_size_t(4, size.length());
+}
+
+void test_round_trip()
+{
+    // One room full and wrapped, one partly filled, one empty
+    for (uint32_t i = 0; i < MAX_DATA + 3; i++)
+    {
+        const Message_bme680 sample = {1, 21.5F + i, 40.25F, 1013.25F, 98.5F, 51000.0F + i, 1700000000 + i};
+        livingRoom.store(sample);
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        const Message_bme280 sample = {0, -12.75F - i, 99.5F, 990.0F, -3.0F, 1700000100 + i};
+        bedroom.store(sample);
+    }
+    const Message_bme280 odd = {0, NAN, INFINITY, -0.0F, 3.4e38F, UINT32_MAX};
+    bedroom.store(odd);
+
+    BinaryWriter size(NULL, 0);
+    writeBlob(size);
+    std::vector<uint8_t> blob(size.length());
+    BinaryWriter         out(blob.data(), blob.size());
+    writeBlob(out);
+    TEST_ASSERT_FALSE(out.truncated());
+    TEST_ASSERT_EQUAL_size_t(4 + 3 * 4 + MAX_DATA * 24 + 5 * 20, blob.size());
+
+    // Streamed, the blob is the same
+    BytePrint    print;
+    BinaryWriter stream(print);
+    writeBlob(stream);
+    TEST_ASSERT_EQUAL_size_t(blob.size(), print.bytes.size());
+    TEST_ASSERT_EQUAL_MEMORY(blob.data(), print.bytes.data(), blob.size());
+
+    BinaryReader in(blob.data(), blob.size());
+    TEST_ASSERT_EQUAL_UINT8('H', in.u8());
+    TEST_ASSERT_EQUAL_UINT8('B', in.u8());
+    TEST_ASSERT_EQUAL_UINT8(1, in.u8());
+    TEST_ASSERT_EQUAL_UINT8(3, in.u8());
+
+    // Bedroom, the last sample keeps its special values bit for bit
+    TEST_ASSERT_EQUAL_UINT8(0, in.u8());
+    TEST_ASSERT_EQUAL_UINT8(SENSOR_BME280, in.u8());
+    TEST_ASSERT_EQUAL_UINT16(5, in.u16());
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1700000100 + i, in.u32());
+        TEST_ASSERT_EQUAL_FLOAT(-12.75F - i, in.f32());
+        TEST_ASSERT_EQUAL_FLOAT(99.5F, in.f32());
+        TEST_ASSERT_EQUAL_FLOAT(990.0F, in.f32());
+        TEST_ASSERT_EQUAL_FLOAT(-3.0F, in.f32());
+    }
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, in.u32());
+    TEST_ASSERT_FLOAT_IS_NAN(in.f32());
+    TEST_ASSERT_TRUE(isinf(in.f32()));
+    TEST_ASSERT_TRUE(signbit(in.f32()));
+    TEST_ASSERT_EQUAL_FLOAT(3.4e38F, in.f32());
+
+    // Living room, the oldest samples were overwritten
+    TEST_ASSERT_EQUAL_UINT8(1, in.u8());
+    TEST_ASSERT_EQUAL_UINT8(SENSOR_BME680, in.u8());
+    TEST_ASSERT_EQUAL_UINT16(MAX_DATA, in.u16());
+    for (uint32_t i = 3; i < MAX_DATA + 3; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1700000000 + i, in.u32());
+        TEST_ASSERT_EQUAL_FLOAT(21.5F + i, in.f32());
+        TEST_ASSERT_EQUAL_FLOAT(40.25F, in.f32());
+        TEST_ASSERT_EQUAL_FLOAT(1013.25F, in.f32());
+        TEST_ASSERT_EQUAL_FLOAT(98.5F, in.f32());
+        TEST_ASSERT_EQUAL_FLOAT(51000.0F + i, in.f32());
+    }
+
+    // Bathroom, no sample yet
+    TEST_ASSERT_EQUAL_UINT8(2, in.u8());
+    TEST_ASSERT_EQUAL_UINT8(SENSOR_BME280, in.u8());
+    TEST_ASSERT_EQUAL_UINT16(0, in.u16());
+    TEST_ASSERT_TRUE(in.done());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_little_endian);
+    RUN_TEST(test_truncated);
+    RUN_TEST(test_round_trip);
+    return UNITY_END();
+}
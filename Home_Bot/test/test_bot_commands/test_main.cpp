@@ -0,0 +1,256 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "BotCommands.hpp"
+
+#define BENCH_COMMANDS          50         // Size of the table of the benchmark
+#define BENCH_ROUNDS            20000      // Times every command is looked up
+
+// What a handler saw
+typedef struct
+{
+    const char *called;
+    std::string args;
+} Test_context;
+
+static void handleLed(Test_context &context, const char *args)
+{
+    context.called = "/led";
+    context.args   = args;
+}
+
+static void handleLedOff(Test_context &context, const char *args)
+{
+    context.called = "/led_off";
+    context.args   = args;
+}
+
+static void handleLedOn(Test_context &context, const char *args)
+{
+    context.called = "/led_on";
+    context.args   = args;
+}
+
+static void handleStart(Test_context &context, const char *args)
+{
+    context.called = "/start";
+    context.args   = args;
+}
+
+constexpr Bot_command_entry<Test_context> commands[] =
+{
+    {"/led",     "to show the LED",    handleLed},
+    {"/led_off", "to turn GPIO OFF",   handleLedOff},
+    {"/led_on",  "to turn GPIO ON",    handleLedOn},
+    {"/start",   NULL,                 handleStart},
+};
+static_assert(BotCommands::sorted(commands), "commands must be sorted by name");
+
+constexpr Bot_command_entry<Test_context> unsorted[] =
+{
+    {"/led_on",  NULL, handleLedOn},
+    {"/led_off", NULL, handleLedOff},
+};
+static_assert(BotCommands::sorted(unsorted) == false, "an unsorted table must be refused");
+
+constexpr Bot_command_entry<Test_context> duplicates[] =
+{
+    {"/led",     NULL, handleLed},
+    {"/led",     NULL, handleLed},
+};
+static_assert(BotCommands::sorted(duplicates) == false, "a table with duplicates must be refused");
+
+// A prefix sorts before the longer name, '_' (0x5F) before lower case letters
+static_assert(BotCommands::compare("/led", "/led_on") < 0, "a prefix sorts first");
+static_assert(BotCommands::compare("/led_off", "/led_on") < 0, "sorted as strcmp");
+static_assert(BotCommands::compare("/B", "/a") < 0, "upper case sorts before lower case");
+
+static const CommandTable<Test_context, sizeof(commands) / sizeof(commands[0])> table(commands);
+
+/***********************************************************************
+ * @brief Dispatch a message, check which handler ran and with which arguments
+ ***********************************************************************/
+static void checkDispatch(const char *text, const char *called, const char *args)
+{
+    Test_context context = {NULL, ""};
+    const bool   found   = table.dispatch(context, text);
+    TEST_ASSERT_EQUAL(called != NULL, found);
+    if(called == NULL)
+    {
+        TEST_ASSERT_NULL(context.called);
+        return;
+    }
+    TEST_ASSERT_EQUAL_STRING(called, context.called);
+    TEST_ASSERT_EQUAL_STRING(args, context.args.c_str());
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_exact_and_prefix_names()
+{
+    checkDispatch("/led", "/led", "");
+    checkDispatch("/led_on", "/led_on", "");
+    checkDispatch("/led_off", "/led_off", "");
+    checkDispatch("/start", "/start", "");
+
+    // A prefix or an extension of a name is another command
+    checkDispatch("/le", NULL, NULL);
+    checkDispatch("/led_", NULL, NULL);
+    checkDispatch("/led_o", NULL, NULL);
+    checkDispatch("/led_onn", NULL, NULL);
+    checkDispatch("/startled", NULL, NULL);
+}
+
+void test_arguments()
+{
+    checkDispatch("/led_on 5", "/led_on", "5");
+    checkDispatch("  /led_on   5 10  ", "/led_on", "5 10  ");
+}
+
+void test_bot_name()
+{
+    // As sent by Telegram in groups
+    checkDispatch("/led_on@home_bot", "/led_on", "");
+    checkDispatch("/led_on@home_bot 5", "/led_on", "5");
+    checkDispatch("/led@home_bot", "/led", "");
+    checkDispatch("/led_o@home_bot", NULL, NULL);
+}
+
+void test_unknown_commands()
+{
+    checkDispatch("", NULL, NULL);
+    checkDispatch("   ", NULL, NULL);
+    checkDispatch("/", NULL, NULL);
+    checkDispatch("led_on", NULL, NULL);
+    checkDispatch("/LED_ON", NULL, NULL);
+    checkDispatch("/a", NULL, NULL);
+    checkDispatch("/zzz", NULL, NULL);
+    checkDispatch("hello /led_on", NULL, NULL);
+}
+
+void test_help_order()
+{
+    std::string sorted;
+    table.help(sorted);
+    TEST_ASSERT_EQUAL_STRING("/led to show the LED \n/led_off to turn GPIO OFF \n/led_on to turn GPIO ON \n", sorted.c_str());
+
+    // Listed commands first, in their order, then the others, hidden ones never shown
+    const char *const order[] = {"/led_on", "/start", "/unknown", "/led_off"};
+    std::string       ordered;
+    table.help(ordered, order);
+    TEST_ASSERT_EQUAL_STRING("/led_on to turn GPIO ON \n/led_off to turn GPIO OFF \n/led to show the LED \n", ordered.c_str());
+}
+
+// Table of the benchmark, names built at compile time: "/cmd_00" to "/cmd_49"
+typedef struct
+{
+    char text[8];
+} Bench_name;
+
+static constexpr Bench_name benchName(const size_t idx)
+{
+    return Bench_name{{'/', 'c', 'm', 'd', '_', (char)('0' + idx / 10), (char)('0' + idx % 10), '\0'}};
+}
+
+static constexpr Bench_name benchNames[BENCH_COMMANDS] =
+{
+    benchName(0),  benchName(1),  benchName(2),  benchName(3),  benchName(4),  benchName(5),  benchName(6),  benchName(7),  benchName(8),  benchName(9),
+    benchName(10), benchName(11), benchName(12), benchName(13), benchName(14), benchName(15), benchName(16), benchName(17), benchName(18), benchName(19),
+    benchName(20), benchName(21), benchName(22), benchName(23), benchName(24), benchName(25), benchName(26), benchName(27), benchName(28), benchName(29),
+    benchName(30), benchName(31), benchName(32), benchName(33), benchName(34), benchName(35), benchName(36), benchName(37), benchName(38), benchName(39),
+    benchName(40), benchName(41), benchName(42), benchName(43), benchName(44), benchName(45), benchName(46), benchName(47), benchName(48), benchName(49),
+};
+
+static uint32_t benchCalls = 0;
+
+static void handleBench(Test_context &, const char *)
+{
+    benchCalls++;
+}
+
+#define BENCH_ENTRY(i) {benchNames[i].text, "", handleBench}
+
+static constexpr Bot_command_entry<Test_context> benchCommands[BENCH_COMMANDS] =
+{
+    BENCH_ENTRY(0),  BENCH_ENTRY(1),  BENCH_ENTRY(2),  BENCH_ENTRY(3),  BENCH_ENTRY(4),  BENCH_ENTRY(5),  BENCH_ENTRY(6),  BENCH_ENTRY(7),  BENCH_ENTRY(8),  BENCH_ENTRY(9),
+    BENCH_ENTRY(10), BENCH_ENTRY(11), BENCH_ENTRY(12), BENCH_ENTRY(13), BENCH_ENTRY(14), BENCH_ENTRY(15), BENCH_ENTRY(16), BENCH_ENTRY(17), BENCH_ENTRY(18), BENCH_ENTRY(19),
+    BENCH_ENTRY(20), BENCH_ENTRY(21), BENCH_ENTRY(22), BENCH_ENTRY(23), BENCH_ENTRY(24), BENCH_ENTRY(25), BENCH_ENTRY(26), BENCH_ENTRY(27), BENCH_ENTRY(28), BENCH_ENTRY(29),
+    BENCH_ENTRY(30), BENCH_ENTRY(31), BENCH_ENTRY(32), BENCH_ENTRY(33), BENCH_ENTRY(34), BENCH_ENTRY(35), BENCH_ENTRY(36), BENCH_ENTRY(37), BENCH_ENTRY(38), BENCH_ENTRY(39),
+    BENCH_ENTRY(40), BENCH_ENTRY(41), BENCH_ENTRY(42), BENCH_ENTRY(43), BENCH_ENTRY(44), BENCH_ENTRY(45), BENCH_ENTRY(46), BENCH_ENTRY(47), BENCH_ENTRY(48), BENCH_ENTRY(49),
+};
+static_assert(BotCommands::sorted(benchCommands), "benchCommands must be sorted by name");
+
+/***********************************************************************
+ * @brief The if / else chain the table replaced: one String compare per command
+ ***********************************************************************/
+static bool chainDispatch(Test_context &context, const std::string &text)
+{
+    for (size_t i = 0; i < BENCH_COMMANDS; i++)
+    {
+        if(text == benchCommands[i].name)
+        {
+            benchCommands[i].handler(context, "");
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_benchmark()
+{
+    static const CommandTable<Test_context, BENCH_COMMANDS> benchTable(benchCommands);
+    Test_context                                            context = {NULL, ""};
+    const char                                              *texts[BENCH_COMMANDS + 1];
+    for (size_t i = 0; i < BENCH_COMMANDS; i++)
+    {
+        texts[i] = benchNames[i].text;
+    }
+    texts[BENCH_COMMANDS] = "/unknown";
+
+    benchCalls       = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (size_t i = 0; i <= BENCH_COMMANDS; i++)
+        {
+            benchTable.dispatch(context, texts[i]);
+        }
+    }
+    const auto tableEnd = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL_UINT32(BENCH_ROUNDS * BENCH_COMMANDS, benchCalls);
+
+    // Telegram hands the text over as a String, built once per message like before
+    benchCalls = 0;
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (size_t i = 0; i <= BENCH_COMMANDS; i++)
+        {
+            chainDispatch(context, std::string(texts[i]));
+        }
+    }
+    const auto chainEnd = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL_UINT32(BENCH_ROUNDS * BENCH_COMMANDS, benchCalls);
+
+    const double lookups = BENCH_ROUNDS * (BENCH_COMMANDS + 1.0);
+    const double tableNs = std::chrono::duration<double, std::nano>(tableEnd - start).count() / lookups;
+    const double chainNs = std::chrono::duration<double, std::nano>(chainEnd - tableEnd).count() / lookups;
+    char         line[128];
+    snprintf(line, sizeof(line), "%u commands: table %.1f ns/lookup, if / else chain %.1f ns/lookup", BENCH_COMMANDS, tableNs, chainNs);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE(tableNs < chainNs);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_exact_and_prefix_names);
+    RUN_TEST(test_arguments);
+    RUN_TEST(test_bot_name);
+    RUN_TEST(test_unknown_commands);
+    RUN_TEST(test_help_order);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
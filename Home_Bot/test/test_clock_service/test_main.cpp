@@ -0,0 +1,192 @@
+#include <unity.h>
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+#include "ClockService.hpp"
+#include "NtpStandIn.hpp"
+
+#define SYNC_US                 (CLOCK_SYNC_MS * 1000LL)
+#define BOOT_US                 5000000    // Local time of the first sync
+#define RACE_SYNCS              200000     // Syncs of the reader / writer race
+#define RACE_OFFSET_A           1000000    // Epochs the writer switches between, µs
+#define RACE_OFFSET_B           1050000
+
+static NtpStandIn server;
+
+/***********************************************************************
+ * @return Clock minus server at the current simulated time, in µs
+ ***********************************************************************/
+static int64_t clockError(const ClockService<NtpStandIn> &clock)
+{
+    return clock.nowMicros() - server.serverTime(esp_timer_get_time());
+}
+
+void setUp()
+{
+    server            = NtpStandIn();
+    simulatedMicros()    = BOOT_US;
+}
+
+void tearDown()
+{
+    simulatedMicros() = -1;
+}
+
+void test_first_sync()
+{
+    ClockService<NtpStandIn> clock(server);
+
+    // Time since boot until then
+    TEST_ASSERT_FALSE(clock.synced());
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, clock.age());
+    TEST_ASSERT_EQUAL_INT64(BOOT_US, clock.nowMicros());
+
+    TEST_ASSERT_TRUE(clock.sync());
+    TEST_ASSERT_TRUE(clock.synced());
+    TEST_ASSERT_EQUAL_UINT32(1, server.requests);
+    TEST_ASSERT_INT64_WITHIN(1, 0, clockError(clock));
+    TEST_ASSERT_EQUAL_UINT32(1, clock.health().syncs);
+    TEST_ASSERT_EQUAL_INT32(0, clock.health().last_error_us);
+
+    clock.setOffset(3600);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(server.serverTime(esp_timer_get_time()) / 1000000) + 3600, clock.now());
+    TEST_ASSERT_EQUAL_UINT32(0, clock.age());
+}
+
+void test_round_trip_excluded()
+{
+    ClockService<NtpStandIn> clock(server);
+
+    // A symmetric delay and the time in the server do not bias the clock
+    server.delay_us   = 40000;
+    server.process_us = 7000;
+    TEST_ASSERT_TRUE(clock.sync());
+    TEST_ASSERT_INT64_WITHIN(2, 0, clockError(clock));
+    TEST_ASSERT_EQUAL_UINT32(2 * 40000, clock.health().last_rtt_us);
+}
+
+void test_drift_trained()
+{
+    ClockService<NtpStandIn> clock(server);
+
+    // The server runs 50 ppm faster: 15 ms between two syncs if uncorrected
+    server.drift_ppb = 50000;
+    server.delay_us  = 3000;
+    TEST_ASSERT_TRUE(clock.sync());
+    int64_t firstError = 0;
+    int64_t lastError  = 0;
+    for (uint8_t i = 0; i < 12; i++)
+    {
+        delay(CLOCK_SYNC_MS - 1);
+        lastError  = clockError(clock);
+        firstError = (i == 0) ? lastError : firstError;
+        TEST_ASSERT_TRUE(clock.sync());
+    }
+
+    char line[96];
+    snprintf(line, sizeof(line), "50 ppm: %lld us off after the first interval, %lld us after 12", (long long)firstError, (long long)lastError);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_INT64_WITHIN(500, -SYNC_US * 50000 / 1000000000LL, firstError);
+    TEST_ASSERT_INT64_WITHIN(100, 0, lastError);
+    TEST_ASSERT_INT32_WITHIN(500, 50000, clock.health().drift_ppb);
+    TEST_ASSERT_EQUAL_UINT32(0, clock.health().steps);
+}
+
+void test_step()
+{
+    ClockService<NtpStandIn> clock(server);
+
+    TEST_ASSERT_TRUE(clock.sync());
+    delay(CLOCK_SYNC_MS);
+
+    // Far from the clock: followed at once, the drift left alone
+    server.epoch_us += 2000000;
+    TEST_ASSERT_TRUE(clock.sync());
+    TEST_ASSERT_EQUAL_UINT32(1, clock.health().steps);
+    TEST_ASSERT_EQUAL_INT32(-2000000, clock.health().last_error_us);
+    TEST_ASSERT_EQUAL_INT32(0, clock.health().drift_ppb);
+    TEST_ASSERT_INT64_WITHIN(1, 0, clockError(clock));
+}
+
+void test_unusable_answers()
+{
+    ClockService<NtpStandIn> clock(server);
+
+    // No answer, given up after the timeout
+    server.answer = false;
+    TEST_ASSERT_FALSE(clock.sync());
+    TEST_ASSERT_INT64_WITHIN(2000, BOOT_US + CLOCK_TIMEOUT_MS * 1000LL, esp_timer_get_time());
+
+    // Unsynchronized server
+    server.answer  = true;
+    server.stratum = 0;
+    TEST_ASSERT_FALSE(clock.sync());
+
+    // Too slow to be precise
+    server.stratum  = 2;
+    server.delay_us = CLOCK_MAX_RTT_US / 2 + 1000;
+    TEST_ASSERT_FALSE(clock.sync());
+
+    TEST_ASSERT_FALSE(clock.synced());
+    TEST_ASSERT_EQUAL_UINT32(3, clock.health().failures);
+    TEST_ASSERT_EQUAL_UINT32(0, clock.health().syncs);
+
+    // A late answer to the slow request is dropped, the next one is used
+    server.delay_us = 1000;
+    TEST_ASSERT_TRUE(clock.sync());
+    TEST_ASSERT_INT64_WITHIN(1, 0, clockError(clock));
+}
+
+void test_readers_never_torn()
+{
+    DisciplinedClock      clock;
+    std::atomic<bool>     stop(false);
+    std::atomic<bool>     torn(false);
+    std::atomic<uint32_t> reads(0);
+
+    // Readers only see the time since boot or a whole synced snapshot
+    std::thread reader([&]()
+    {
+        while(stop.load() == false)
+        {
+            const bool    synced = clock.synced();
+            const int64_t epoch  = clock.at(0);
+            if((synced == true) && (epoch != RACE_OFFSET_A) && (epoch != RACE_OFFSET_B))
+            {
+                torn = true;
+            }
+            reads++;
+        }
+    });
+
+    // Epoch is local + one of two offsets, a mixed snapshot reads neither.
+    // Syncs are closer than CLOCK_MIN_DRIFT_US so the drift stays 0.
+    while(reads.load() == 0)
+    {
+        std::this_thread::yield();
+    }
+    for (int64_t i = 1; i <= RACE_SYNCS; i++)
+    {
+        clock.sync(i * 10, i * 10 + (((i & 1) == 0) ? RACE_OFFSET_A : RACE_OFFSET_B), 0);
+    }
+    stop = true;
+    reader.join();
+
+    char line[64];
+    snprintf(line, sizeof(line), "%u reads during %u syncs", (unsigned)reads.load(), RACE_SYNCS);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_FALSE(torn.load());
+    TEST_ASSERT_EQUAL_INT32(0, clock.health().drift_ppb);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_sync);
+    RUN_TEST(test_round_trip_excluded);
+    RUN_TEST(test_drift_trained);
+    RUN_TEST(test_step);
+    RUN_TEST(test_unusable_answers);
+    RUN_TEST(test_readers_never_torn);
+    return UNITY_END();
+}
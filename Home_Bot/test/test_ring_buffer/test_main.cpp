@@ -0,0 +1,220 @@
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "Messages.hpp"
+#include "RingBuffer.hpp"
+
+// Item whose four fields are always equal, a torn copy shows as a mismatch
+typedef struct
+{
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t d;
+} Item;
+
+static Item item(const uint32_t value)
+{
+    return Item{value, value, value, value};
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_empty()
+{
+    RingBuffer<Item, 4> buffer;
+    Item                items[4];
+    Item                last;
+
+    TEST_ASSERT_TRUE(buffer.empty());
+    TEST_ASSERT_EQUAL_size_t(0, buffer.size());
+    TEST_ASSERT_EQUAL_size_t(0, buffer.snapshot(items, 4));
+    TEST_ASSERT_FALSE(buffer.last(last));
+}
+
+void test_wraparound()
+{
+    RingBuffer<Item, 10> buffer;
+    Item                 items[10];
+    Item                 last;
+
+    for(uint32_t i = 0; i < 25; i++)
+    {
+        buffer.push(item(i));
+        TEST_ASSERT_EQUAL_size_t((i < 10) ? i + 1 : 10, buffer.size());
+    }
+
+    // Oldest first, the 15 first items were overwritten
+    TEST_ASSERT_EQUAL_size_t(10, buffer.snapshot(items, 10));
+    for(uint32_t i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(15 + i, items[i].a);
+        TEST_ASSERT_EQUAL_UINT32(15 + i, buffer[i].a);
+    }
+    TEST_ASSERT_TRUE(buffer.last(last));
+    TEST_ASSERT_EQUAL_UINT32(24, last.a);
+
+    // Fewer items than stored gives the most recent ones
+    TEST_ASSERT_EQUAL_size_t(3, buffer.snapshot(items, 3));
+    TEST_ASSERT_EQUAL_UINT32(22, items[0].a);
+    TEST_ASSERT_EQUAL_UINT32(24, items[2].a);
+
+    buffer.clear();
+    TEST_ASSERT_TRUE(buffer.empty());
+    TEST_ASSERT_EQUAL_size_t(0, buffer.snapshot(items, 10));
+}
+
+void test_is_intact_after_overwrite()
+{
+    RingBuffer<Item, 4> buffer;
+
+    // Nothing is overwritten until the buffer went around once
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        buffer.push(item(i));
+    }
+    TEST_ASSERT_TRUE(buffer.isIntact(0));
+    TEST_ASSERT_TRUE(buffer.isIntact(3));
+
+    // Item 4 goes in the slot of item 0, item 9 in the one of item 5
+    for(uint32_t i = 4; i < 10; i++)
+    {
+        buffer.push(item(i));
+    }
+    TEST_ASSERT_FALSE(buffer.isIntact(0));
+    TEST_ASSERT_FALSE(buffer.isIntact(5));
+    TEST_ASSERT_TRUE(buffer.isIntact(6));
+    TEST_ASSERT_TRUE(buffer.isIntact(9));
+}
+
+void test_reader_races_writer()
+{
+    RingBuffer<Item, 3> buffer;
+    std::atomic<bool>   stop(false);
+    std::atomic<long>   torn(0);
+    std::atomic<long>   reads(0);
+
+    // Several readers copy while the writer keeps going around the small buffer
+    auto reader = [&]()
+    {
+        while(stop.load() == false)
+        {
+            Item         items[3];
+            const size_t count = buffer.snapshot(items, 3);
+            for(size_t i = 0; i < count; i++)
+            {
+                const bool consistent = (items[i].a == items[i].b) && (items[i].b == items[i].c) && (items[i].c == items[i].d);
+                const bool ordered    = (i == 0) || (items[i].a == items[i - 1].a + 1);
+                if((consistent == false) || (ordered == false))
+                {
+                    torn++;
+                }
+            }
+
+            Item last;
+            if((buffer.last(last) == true) && ((last.a != last.b) || (last.c != last.d)))
+            {
+                torn++;
+            }
+            reads++;
+        }
+    };
+
+    std::thread first(reader);
+    std::thread second(reader);
+
+    // The writer could be done before a reader is scheduled
+    while(reads.load() == 0)
+    {
+        std::this_thread::yield();
+    }
+    for(uint32_t i = 0; i < 2000000; i++)
+    {
+        buffer.push(item(i));
+    }
+    stop = true;
+    first.join();
+    second.join();
+
+    TEST_ASSERT_GREATER_THAN(0, reads.load());
+    TEST_ASSERT_EQUAL_INT(0, torn.load());
+}
+
+/***********************************************************************
+ * @brief Time one push into a history of N samples, the ring against
+ * the memcpy shift loop it replaced in updateBME680Data()
+ ***********************************************************************/
+template <size_t N>
+static void benchmark()
+{
+    static RingBuffer<Message_bme680, N> ring;
+    static Message_bme680                shifted[N];
+    const size_t                         pushes = (N < 1000) ? 1000000 : 100000000 / N;
+    Message_bme680                       sample;
+    memset(&sample, 0, sizeof(sample));
+
+    // Both start full, a push then always drops the oldest sample
+    for(size_t i = 0; i < N; i++)
+    {
+        sample.time = i;
+        ring.push(sample);
+        shifted[i] = sample;
+    }
+
+    const auto ringStart = std::chrono::steady_clock::now();
+    for(size_t i = N; i < N + pushes; i++)
+    {
+        sample.time = i;
+        ring.push(sample);
+    }
+    const auto ringEnd = std::chrono::steady_clock::now();
+
+    for(size_t i = N; i < N + pushes; i++)
+    {
+        sample.time = i;
+        for(size_t j = 0; j < N - 1; j++)
+        {
+            memcpy(&shifted[j], &shifted[j + 1], sizeof(shifted[0]));
+        }
+        memcpy(&shifted[N - 1], &sample, sizeof(sample));
+    }
+    const auto shiftEnd = std::chrono::steady_clock::now();
+
+    // Both hold the same history
+    Message_bme680 last;
+    TEST_ASSERT_TRUE(ring.last(last));
+    TEST_ASSERT_EQUAL_UINT32(shifted[N - 1].time, last.time);
+    TEST_ASSERT_EQUAL_UINT32(shifted[0].time, ring[0].time);
+
+    const double ringNs  = std::chrono::duration<double, std::nano>(ringEnd - ringStart).count() / pushes;
+    const double shiftNs = std::chrono::duration<double, std::nano>(shiftEnd - ringEnd).count() / pushes;
+    char         line[128];
+    snprintf(line, sizeof(line), "N = %6u: ring %8.1f ns/push, shift %12.1f ns/push", (unsigned)N, ringNs, shiftNs);
+    TEST_MESSAGE(line);
+    if(N >= 1000)
+    {
+        TEST_ASSERT_TRUE(ringNs < shiftNs);
+    }
+}
+
+void test_benchmark_push()
+{
+    benchmark<10>();
+    benchmark<1000>();
+    benchmark<100000>();
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_is_intact_after_overwrite);
+    RUN_TEST(test_reader_races_writer);
+    RUN_TEST(test_benchmark_push);
+    return UNITY_END();
+}
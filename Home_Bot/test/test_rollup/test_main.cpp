@@ -0,0 +1,121 @@
+#include <unity.h>
+#include <math.h>
+#include "Rollup.hpp"
+
+typedef Rollup<4, 3, 2> Test_rollup;
+
+static void add(Test_rollup &rollup, const uint32_t time, const float temperature, const float humidity, const float pressure)
+{
+    const float values[ROLLUP_METRICS] = {temperature, humidity, pressure};
+    rollup.add(time, values);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_empty()
+{
+    Test_rollup   rollup;
+    Rollup_bucket buckets[5];
+    TEST_ASSERT_EQUAL_size_t(0, rollup.snapshot(ROLLUP_DAY, buckets, 5));
+}
+
+void test_open_bucket_is_partial()
+{
+    Test_rollup   rollup;
+    Rollup_bucket buckets[5];
+
+    // First day, nothing is closed yet but the day is summarized
+    add(rollup, 86400 + 10, 20.0F, 50.0F, 1000.0F);
+    add(rollup, 86400 + 70, 22.0F, 60.0F, 1010.0F);
+    TEST_ASSERT_EQUAL_size_t(1, rollup.snapshot(ROLLUP_DAY, buckets, 5));
+    TEST_ASSERT_TRUE(buckets[0].partial);
+    TEST_ASSERT_EQUAL_UINT32(86400, buckets[0].start);
+    TEST_ASSERT_EQUAL_UINT32(2, buckets[0].count);
+    TEST_ASSERT_EQUAL_FLOAT(20.0F, buckets[0].min[ROLLUP_TEMPERATURE]);
+    TEST_ASSERT_EQUAL_FLOAT(21.0F, buckets[0].mean[ROLLUP_TEMPERATURE]);
+    TEST_ASSERT_EQUAL_FLOAT(22.0F, buckets[0].max[ROLLUP_TEMPERATURE]);
+
+    // The first minute is closed by the sample of the second one
+    TEST_ASSERT_EQUAL_size_t(2, rollup.snapshot(ROLLUP_MINUTE, buckets, 5));
+    TEST_ASSERT_FALSE(buckets[0].partial);
+    TEST_ASSERT_EQUAL_UINT32(86400, buckets[0].start);
+    TEST_ASSERT_TRUE(buckets[1].partial);
+    TEST_ASSERT_EQUAL_UINT32(86460, buckets[1].start);
+
+    // With room for one bucket only, the open one is the most recent
+    TEST_ASSERT_EQUAL_size_t(1, rollup.snapshot(ROLLUP_MINUTE, buckets, 1));
+    TEST_ASSERT_TRUE(buckets[0].partial);
+    TEST_ASSERT_EQUAL_size_t(0, rollup.snapshot(ROLLUP_MINUTE, buckets, 0));
+}
+
+void test_capacity_plus_open()
+{
+    Test_rollup   rollup;
+    Rollup_bucket buckets[Test_rollup::capacity(ROLLUP_MINUTE) + 1];
+
+    for(uint32_t minute = 0; minute < 10; minute++)
+    {
+        add(rollup, minute * 60, (float)minute, 50.0F, 1000.0F);
+    }
+
+    // The 4 last closed minutes, then the open one
+    TEST_ASSERT_EQUAL_size_t(5, rollup.snapshot(ROLLUP_MINUTE, buckets, 5));
+    for(uint32_t i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32((5 + i) * 60, buckets[i].start);
+        TEST_ASSERT_EQUAL(i == 4, buckets[i].partial);
+    }
+}
+
+void test_late_sample_merged()
+{
+    Test_rollup   rollup;
+    Rollup_bucket buckets[5];
+
+    add(rollup, 120, 10.0F, 50.0F, 1000.0F);
+    add(rollup, 30, 30.0F, 50.0F, 1000.0F);
+    TEST_ASSERT_EQUAL_size_t(1, rollup.snapshot(ROLLUP_MINUTE, buckets, 5));
+    TEST_ASSERT_EQUAL_UINT32(120, buckets[0].start);
+    TEST_ASSERT_EQUAL_UINT32(2, buckets[0].count);
+    TEST_ASSERT_EQUAL_FLOAT(20.0F, buckets[0].mean[ROLLUP_TEMPERATURE]);
+}
+
+void test_non_finite_skipped()
+{
+    Test_rollup   rollup;
+    Rollup_bucket buckets[5];
+
+    add(rollup, 0, 20.0F, NAN, 1000.0F);
+    add(rollup, 1, NAN, 40.0F, INFINITY);
+    add(rollup, 2, 24.0F, 60.0F, -INFINITY);
+    TEST_ASSERT_EQUAL_size_t(1, rollup.snapshot(ROLLUP_HOUR, buckets, 5));
+
+    // Each metric is summarized over its finite values only
+    TEST_ASSERT_EQUAL_UINT32(3, buckets[0].count);
+    TEST_ASSERT_EQUAL_FLOAT(22.0F, buckets[0].mean[ROLLUP_TEMPERATURE]);
+    TEST_ASSERT_EQUAL_FLOAT(20.0F, buckets[0].min[ROLLUP_TEMPERATURE]);
+    TEST_ASSERT_EQUAL_FLOAT(50.0F, buckets[0].mean[ROLLUP_HUMIDITY]);
+    TEST_ASSERT_EQUAL_FLOAT(40.0F, buckets[0].min[ROLLUP_HUMIDITY]);
+    TEST_ASSERT_EQUAL_FLOAT(1000.0F, buckets[0].mean[ROLLUP_PRESSURE]);
+    TEST_ASSERT_EQUAL_FLOAT(1000.0F, buckets[0].max[ROLLUP_PRESSURE]);
+
+    // A metric without any finite value stays NaN, the next bucket starts clean
+    add(rollup, 3600, NAN, 55.0F, 1005.0F);
+    add(rollup, 7200, 18.0F, 55.0F, 1005.0F);
+    TEST_ASSERT_EQUAL_size_t(3, rollup.snapshot(ROLLUP_HOUR, buckets, 5));
+    TEST_ASSERT_FLOAT_IS_NAN(buckets[1].mean[ROLLUP_TEMPERATURE]);
+    TEST_ASSERT_FLOAT_IS_NAN(buckets[1].min[ROLLUP_TEMPERATURE]);
+    TEST_ASSERT_EQUAL_FLOAT(18.0F, buckets[2].mean[ROLLUP_TEMPERATURE]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_open_bucket_is_partial);
+    RUN_TEST(test_capacity_plus_open);
+    RUN_TEST(test_late_sample_merged);
+    RUN_TEST(test_non_finite_skipped);
+    return UNITY_END();
+}
@@ -0,0 +1,354 @@
+#include <unity.h>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "SampleLog.hpp"
+
+#define BENCH_RECORDS           (LOG_SEGMENT_RECORDS * LOG_MAX_SEGMENTS)
+#define BENCH_ROOMS             4
+
+// Directory of the flash of the running test, emptied after it
+static std::string root;
+
+static std::unique_ptr<fs::FS> newFlash()
+{
+    char path[] = "/tmp/sample_log_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(path));
+    root = path;
+    return std::unique_ptr<fs::FS>(new fs::FS(root));
+}
+
+static Log_record record(const uint8_t room, const uint32_t time)
+{
+    Log_record record;
+    memset(&record, 0, sizeof(record));
+    record.room        = room;
+    record.time        = time;
+    record.temperature = 20.0F + (time % 100) / 10.0F;
+    record.humidity    = 50.0F;
+    record.pressure    = 1013.25F;
+    return record;
+}
+
+/***********************************************************************
+ * @brief Scan the whole log a chunk at a time
+ ***********************************************************************/
+static std::vector<Log_record> scanAll(SampleLog &log, const uint8_t room, const uint32_t from, const uint32_t to, const size_t chunk = 64)
+{
+    std::vector<Log_record> found;
+    std::vector<Log_record> records(chunk);
+    Log_cursor              cursor = {0, 0};
+    size_t                  count;
+    do
+    {
+        count = log.scan(room, from, to, cursor, records.data(), chunk);
+        found.insert(found.end(), records.begin(), records.begin() + count);
+    } while(count == chunk);
+    return found;
+}
+
+void setUp() {}
+
+void tearDown()
+{
+    if(root.empty() == false)
+    {
+        const std::string command = "rm -rf " + root;
+        TEST_ASSERT_EQUAL_INT(0, system(command.c_str()));
+        root.clear();
+    }
+}
+
+void test_batches_writes()
+{
+    std::unique_ptr<fs::FS> flash = newFlash();
+    SampleLog               log(*flash);
+    TEST_ASSERT_TRUE(log.begin());
+
+    // Nothing hits flash until a batch is full
+    for (uint32_t i = 0; i < LOG_BATCH_RECORDS - 1; i++)
+    {
+        TEST_ASSERT_TRUE(log.append(record(1, 1000 + i)));
+    }
+    TEST_ASSERT_EQUAL_size_t(0, flash->write_calls);
+    TEST_ASSERT_EQUAL_size_t(LOG_BATCH_RECORDS - 1, log.pending());
+
+    TEST_ASSERT_TRUE(log.append(record(1, 2000)));
+    TEST_ASSERT_EQUAL_size_t(1, flash->write_calls);
+    TEST_ASSERT_EQUAL_size_t(LOG_BATCH_RECORDS * sizeof(Log_record), flash->bytes_written);
+    TEST_ASSERT_EQUAL_size_t(0, log.pending());
+    TEST_ASSERT_EQUAL_size_t(LOG_BATCH_RECORDS, scanAll(log, 1, 0, UINT32_MAX).size());
+}
+
+void test_scan_out_of_order_times()
+{
+    std::unique_ptr<fs::FS> flash = newFlash();
+    SampleLog               log(*flash);
+    log.begin();
+
+    // Segment 0: recent times, segment 1: a late batch and a node on its time since boot, segment 2: recent again
+    for (uint32_t i = 0; i < LOG_SEGMENT_RECORDS; i++)
+    {
+        log.append(record(1, 1700000000 + i));
+    }
+    for (uint32_t i = 0; i < LOG_SEGMENT_RECORDS; i++)
+    {
+        log.append(record((i % 2 == 0) ? 1 : 2, (i % 2 == 0) ? 1699990000 + i : 120 + i));
+    }
+    for (uint32_t i = 0; i < LOG_BATCH_RECORDS; i++)
+    {
+        log.append(record(1, 1700005000 + i));
+    }
+    log.flush();
+    TEST_ASSERT_EQUAL_UINT32(3, log.segments());
+
+    // The first segment ends after "to" and the second one starts after it, both used to hide the late records
+    const std::vector<Log_record> late = scanAll(log, 1, 1699990000, 1699999999);
+    TEST_ASSERT_EQUAL_size_t(LOG_SEGMENT_RECORDS / 2, late.size());
+    TEST_ASSERT_EQUAL_UINT32(1699990000, late.front().time);
+
+    // Times since boot are older than any epoch
+    const std::vector<Log_record> boot = scanAll(log, 2, 0, 100000);
+    TEST_ASSERT_EQUAL_size_t(LOG_SEGMENT_RECORDS / 2, boot.size());
+
+    // Every record of the room, in the order they were logged
+    const std::vector<Log_record> all = scanAll(log, 1, 0, UINT32_MAX, 7);
+    TEST_ASSERT_EQUAL_size_t(LOG_SEGMENT_RECORDS + LOG_SEGMENT_RECORDS / 2 + LOG_BATCH_RECORDS, all.size());
+    TEST_ASSERT_EQUAL_UINT32(1700000000, all.front().time);
+    TEST_ASSERT_EQUAL_UINT32(1700005000 + LOG_BATCH_RECORDS - 1, all.back().time);
+
+    // Segments with no time in the range are not even opened
+    const Log_range first = log.range(0);
+    TEST_ASSERT_EQUAL_UINT32(1700000000, first.oldest);
+    TEST_ASSERT_EQUAL_UINT32(1700000000 + LOG_SEGMENT_RECORDS - 1, first.newest);
+    TEST_ASSERT_EQUAL_size_t(0, scanAll(log, 1, 1700001100, 1700004999).size());
+}
+
+void test_scan_between_appends()
+{
+    std::unique_ptr<fs::FS> flash = newFlash();
+    SampleLog               log(*flash);
+    log.begin();
+    for (uint32_t i = 0; i < LOG_SEGMENT_RECORDS - LOG_BATCH_RECORDS; i++)
+    {
+        log.append(record(i % 3, 1000 + i));
+    }
+
+    // A reader copying a chunk at a time while batches keep being written and a segment starts
+    Log_cursor              cursor = {0, 0};
+    Log_record              records[10];
+    std::vector<Log_record> found;
+    size_t                  count;
+    uint32_t                time   = 1000 + LOG_SEGMENT_RECORDS - LOG_BATCH_RECORDS;
+    do
+    {
+        count = log.scan(0, 0, UINT32_MAX, cursor, records, 10);
+        found.insert(found.end(), records, records + count);
+        for (uint32_t i = 0; (i < 4) && (time < 1000 + LOG_SEGMENT_RECORDS + 2 * LOG_BATCH_RECORDS); i++, time++)
+        {
+            log.append(record((time - 1000) % 3, time));
+        }
+    } while(count == 10);
+
+    // Each record once and in order, the ones written behind the cursor included
+    TEST_ASSERT_EQUAL_UINT32(2, log.segments());
+    TEST_ASSERT_GREATER_THAN((LOG_SEGMENT_RECORDS - LOG_BATCH_RECORDS) / 3, found.size());
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1000 + 3 * i, found[i].time);
+    }
+}
+
+void test_retention_and_reboot()
+{
+    std::unique_ptr<fs::FS> flash = newFlash();
+    {
+        SampleLog log(*flash);
+        log.begin();
+        for (uint32_t i = 0; i < (LOG_MAX_SEGMENTS + 2) * LOG_SEGMENT_RECORDS; i++)
+        {
+            log.append(record(i % 2, i));
+        }
+        TEST_ASSERT_EQUAL_UINT32(LOG_MAX_SEGMENTS, log.segments());
+        TEST_ASSERT_EQUAL_UINT32(2, log.stats().segments_removed);
+        TEST_ASSERT_FALSE(flash->exists("/log_00000000.bin"));
+        TEST_ASSERT_FALSE(flash->exists("/log_00000001.bin"));
+    }
+
+    // After a reboot the ranges are read again from flash
+    SampleLog log(*flash);
+    TEST_ASSERT_TRUE(log.begin());
+    TEST_ASSERT_EQUAL_UINT32(LOG_MAX_SEGMENTS, log.segments());
+    const Log_range oldest = log.range(2);
+    TEST_ASSERT_EQUAL_UINT32(2 * LOG_SEGMENT_RECORDS, oldest.oldest);
+    TEST_ASSERT_EQUAL_UINT32(3 * LOG_SEGMENT_RECORDS - 1, oldest.newest);
+    TEST_ASSERT_TRUE(log.range(1).oldest > log.range(1).newest);
+
+    const std::vector<Log_record> found = scanAll(log, 1, 0, UINT32_MAX);
+    TEST_ASSERT_EQUAL_size_t(LOG_MAX_SEGMENTS * LOG_SEGMENT_RECORDS / 2, found.size());
+    TEST_ASSERT_EQUAL_UINT32(2 * LOG_SEGMENT_RECORDS + 1, found.front().time);
+
+    // New records go to a new segment, the oldest one is removed
+    for (uint32_t i = 0; i < LOG_BATCH_RECORDS; i++)
+    {
+        log.append(record(0, 5000000 + i));
+    }
+    TEST_ASSERT_EQUAL_UINT32(LOG_MAX_SEGMENTS, log.segments());
+    TEST_ASSERT_EQUAL_size_t(LOG_BATCH_RECORDS, scanAll(log, 0, 5000000, UINT32_MAX).size());
+}
+
+void test_bad_crc_and_partial_record()
+{
+    std::unique_ptr<fs::FS> flash = newFlash();
+    {
+        SampleLog log(*flash);
+        log.begin();
+        for (uint32_t i = 0; i < LOG_BATCH_RECORDS; i++)
+        {
+            log.append(record(1, 100 + i));
+        }
+    }
+
+    // Flip a bit of the fifth record, then lose power in the middle of a record
+    const std::string path = root + "/log_00000000.bin";
+    FILE             *file = fopen(path.c_str(), "r+b");
+    TEST_ASSERT_NOT_NULL(file);
+    fseek(file, 4 * sizeof(Log_record) + 8, SEEK_SET);
+    fputc(0xFF, file);
+    fseek(file, 0, SEEK_END);
+    fwrite("torn", 1, 4, file);
+    fclose(file);
+
+    SampleLog log(*flash);
+    log.begin();
+    const std::vector<Log_record> found = scanAll(log, 1, 0, UINT32_MAX);
+    TEST_ASSERT_EQUAL_size_t(LOG_BATCH_RECORDS - 1, found.size());
+    TEST_ASSERT_EQUAL_UINT32(1, log.stats().crc_errors);
+    TEST_ASSERT_EQUAL_UINT32(105, found[4].time);
+
+    // The torn segment is left as it is, the next records start a new one
+    for (uint32_t i = 0; i < LOG_BATCH_RECORDS; i++)
+    {
+        log.append(record(1, 200 + i));
+    }
+    TEST_ASSERT_TRUE(flash->exists("/log_00000001.bin"));
+    TEST_ASSERT_EQUAL_size_t(2 * LOG_BATCH_RECORDS - 1, scanAll(log, 1, 0, UINT32_MAX).size());
+}
+
+void test_full_flash()
+{
+    std::unique_ptr<fs::FS> flash = newFlash();
+    SampleLog               log(*flash);
+    log.begin();
+    flash->capacity = LOG_BATCH_RECORDS * sizeof(Log_record) + 10;
+
+    for (uint32_t i = 0; i < 2 * LOG_BATCH_RECORDS; i++)
+    {
+        log.append(record(1, i));
+    }
+
+    // The second batch was cut, its records wait in RAM and the next ones are dropped
+    TEST_ASSERT_EQUAL_size_t(LOG_BATCH_RECORDS, log.pending());
+    TEST_ASSERT_FALSE(log.append(record(1, 999)));
+    TEST_ASSERT_EQUAL_UINT32(1, log.stats().dropped);
+    TEST_ASSERT_EQUAL_UINT32(LOG_BATCH_RECORDS, log.stats().written);
+
+    // Room again, the records kept are written to a new segment
+    flash->capacity = SIZE_MAX;
+    TEST_ASSERT_TRUE(log.flush());
+    TEST_ASSERT_EQUAL_size_t(2 * LOG_BATCH_RECORDS, scanAll(log, 1, 0, UINT32_MAX).size());
+}
+
+void test_benchmark_write_amplification()
+{
+    // One write per sample, what a log without batching would do, then batches
+    for (uint8_t batched = 0; batched < 2; batched++)
+    {
+        std::unique_ptr<fs::FS> flash = newFlash();
+        SampleLog               log(*flash);
+        log.begin();
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BENCH_RECORDS; i++)
+        {
+            log.append(record(i % BENCH_ROOMS, i));
+            if(batched == 0)
+            {
+                log.flush();
+            }
+        }
+        log.flush();
+        const auto end = std::chrono::steady_clock::now();
+
+        const double logged = BENCH_RECORDS * sizeof(Log_record);
+        char         line[192];
+        snprintf(line, sizeof(line), "%s: %.3f writes/record, %.2f pages of %u bytes programmed per record, amplification %.2f, %.1f us/record on the host",
+                 (batched == 1) ? "batched            " : "one write per record", (double)flash->write_calls / BENCH_RECORDS, (double)flash->pages_written / BENCH_RECORDS,
+                 (unsigned)flash->page_size, flash->pages_written * flash->page_size / logged,
+                 std::chrono::duration<double, std::micro>(end - start).count() / BENCH_RECORDS);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_size_t(BENCH_RECORDS * sizeof(Log_record), flash->bytes_written);
+        if(batched == 1)
+        {
+            TEST_ASSERT_EQUAL_size_t(BENCH_RECORDS / LOG_BATCH_RECORDS, flash->write_calls);
+        }
+        tearDown();
+    }
+}
+
+void test_benchmark_scan()
+{
+    std::unique_ptr<fs::FS> flash = newFlash();
+    SampleLog               log(*flash);
+    log.begin();
+    for (uint32_t i = 0; i < BENCH_RECORDS; i++)
+    {
+        log.append(record(i % BENCH_ROOMS, 1700000000 + i * 60));
+    }
+    log.flush();
+
+    // The whole log, then one hour that only one segment holds
+    const uint32_t froms[] = {0, 1700000000 + 3 * LOG_SEGMENT_RECORDS * 60};
+    const uint32_t tos[]   = {UINT32_MAX, froms[1] + 3600};
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        size_t expected = 0;
+        for (uint32_t r = 0; r < BENCH_RECORDS; r++)
+        {
+            const uint32_t time = 1700000000 + r * 60;
+            expected           += ((r % BENCH_ROOMS == 1) && (time >= froms[i]) && (time <= tos[i])) ? 1 : 0;
+        }
+
+        const uint32_t rounds = 20;
+        size_t         found  = 0;
+        const auto     start  = std::chrono::steady_clock::now();
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            found = scanAll(log, 1, froms[i], tos[i], 32).size();
+        }
+        const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+        char line[160];
+        snprintf(line, sizeof(line), "scan of %s: %u records found in %.0f us, %.1f M records/s of log",
+                 (i == 0) ? "the whole log" : "one hour   ", (unsigned)found, us, BENCH_RECORDS / us);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_size_t(expected, found);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_batches_writes);
+    RUN_TEST(test_scan_out_of_order_times);
+    RUN_TEST(test_scan_between_appends);
+    RUN_TEST(test_retention_and_reboot);
+    RUN_TEST(test_bad_crc_and_partial_record);
+    RUN_TEST(test_full_flash);
+    RUN_TEST(test_benchmark_write_amplification);
+    RUN_TEST(test_benchmark_scan);
+    return UNITY_END();
+}
@@ -0,0 +1,315 @@
+#include <unity.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "SeriesCodec.hpp"
+
+#define FIELDS                  5          // Like a BME680 sample
+#define BLOCK_BYTES             512        // Like SERIES_BLOCK_BYTES
+#define BENCH_SAMPLES           200000     // Samples encoded by the benchmark
+
+typedef SeriesEncoder<FIELDS, BLOCK_BYTES> Encoder;
+typedef SeriesDecoder<FIELDS, BLOCK_BYTES> Decoder;
+
+typedef struct
+{
+    uint32_t time;
+    float    values[FIELDS];
+} Sample;
+
+// Deterministic generator, the same samples on every run
+static uint32_t state = 2463534242U;
+
+static uint32_t random32()
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static float noise(const float amplitude)
+{
+    return amplitude * ((random32() % 2001) / 1000.0F - 1.0F);
+}
+
+/***********************************************************************
+ * @brief Encode samples in as many blocks as needed, then decode them
+ * and check the times exactly and the values at the 0.01 resolution
+ * @return Number of blocks used
+ ***********************************************************************/
+static size_t roundTrip(const std::vector<Sample> &samples)
+{
+    std::vector<Series_block<BLOCK_BYTES>> blocks;
+    Encoder                                encoder;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if(encoder.append(samples[i].time, samples[i].values) == false)
+        {
+            blocks.push_back(encoder.block());
+            encoder.reset();
+            TEST_ASSERT_TRUE(encoder.append(samples[i].time, samples[i].values));
+        }
+    }
+
+    // The block still being filled decodes like a sealed one
+    blocks.push_back(encoder.block());
+
+    size_t read = 0;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        Decoder  decoder(blocks[b]);
+        uint32_t time;
+        float    values[FIELDS];
+        while(decoder.next(time, values))
+        {
+            TEST_ASSERT_LESS_THAN_size_t(samples.size(), read);
+            TEST_ASSERT_EQUAL_UINT32(samples[read].time, time);
+            for (size_t f = 0; f < FIELDS; f++)
+            {
+                const float expected = SeriesCoding::dequantize(SeriesCoding::quantize(samples[read].values[f]));
+                TEST_ASSERT_EQUAL_FLOAT(expected, values[f]);
+            }
+            read++;
+        }
+    }
+    TEST_ASSERT_EQUAL_size_t(samples.size(), read);
+    return blocks.size();
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_zigzag()
+{
+    const int32_t  values[] = {0, -1, 1, -2, 2, 63, -64, 64, INT32_MAX, INT32_MIN};
+    const uint32_t coded[] = {0, 1, 2, 3, 4, 126, 127, 128, UINT32_MAX - 1, UINT32_MAX};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(coded[i], SeriesCoding::zigzag(values[i]));
+        TEST_ASSERT_EQUAL_INT32(values[i], SeriesCoding::unzigzag(coded[i]));
+    }
+    TEST_ASSERT_EQUAL_INT32(2138, SeriesCoding::quantize(21.375F));
+    TEST_ASSERT_EQUAL_INT32(-1, SeriesCoding::quantize(-0.005F));
+}
+
+void test_value_delta_sizes()
+{
+    // Deltas on both sides of every size, each way, down to the 32 bits ones
+    const int32_t       deltas[] = {0, 7, -8, 8, -9, 127, -128, 128, -129, 32767, -32768, 32768, -32769, 100000000, -100000000};
+    std::vector<Sample> samples;
+    Sample              sample = {1700000000, {21.0F, 45.0F, 1013.0F, 120.0F, 50000.0F}};
+    samples.push_back(sample);
+    for (size_t i = 0; i < sizeof(deltas) / sizeof(deltas[0]); i++)
+    {
+        sample.time += 60;
+        for (size_t f = 0; f < FIELDS; f++)
+        {
+            sample.values[f] = SeriesCoding::dequantize(SeriesCoding::quantize(sample.values[f]) + deltas[i]);
+        }
+        samples.push_back(sample);
+    }
+    TEST_ASSERT_EQUAL_size_t(1, roundTrip(samples));
+}
+
+void test_time_gaps()
+{
+    // Even spacing, then delta of delta on both sides of every size, late samples and a jump back to a boot time
+    const int32_t       steps[] = {60, 60, 60, 61, 59, 60, 123, 60, 124, 60, 4155, 60, 4156, 60, 86400, 60, -30, 60, 0, 0, 60};
+    std::vector<Sample> samples;
+    Sample              sample = {1700000000, {21.0F, 45.0F, 1013.0F, 120.0F, 50000.0F}};
+    samples.push_back(sample);
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+    {
+        sample.time += steps[i];
+        samples.push_back(sample);
+    }
+    sample.time = 42;
+    samples.push_back(sample);
+    sample.time = UINT32_MAX;
+    samples.push_back(sample);
+    sample.time = 1700000000;
+    samples.push_back(sample);
+    TEST_ASSERT_EQUAL_size_t(1, roundTrip(samples));
+}
+
+void test_nan_keeps_previous_value()
+{
+    Encoder     encoder;
+    const float first[FIELDS]  = {21.0F, 45.0F, 1013.0F, 120.0F, 50000.0F};
+    const float second[FIELDS] = {NAN, 46.0F, NAN, 121.0F, 50010.0F};
+    TEST_ASSERT_TRUE(encoder.append(100, first));
+    TEST_ASSERT_TRUE(encoder.append(160, second));
+
+    Decoder  decoder(encoder.block());
+    uint32_t time;
+    float    values[FIELDS];
+    TEST_ASSERT_TRUE(decoder.next(time, values));
+    TEST_ASSERT_TRUE(decoder.next(time, values));
+    TEST_ASSERT_EQUAL_FLOAT(21.0F, values[0]);
+    TEST_ASSERT_EQUAL_FLOAT(46.0F, values[1]);
+    TEST_ASSERT_EQUAL_FLOAT(1013.0F, values[2]);
+    TEST_ASSERT_FALSE(decoder.next(time, values));
+}
+
+void test_unusable_values()
+{
+    Encoder     encoder;
+    const float first[FIELDS]  = {NAN, INFINITY, -INFINITY, 30000000.0F, 21.0F};
+    const float second[FIELDS] = {22.0F, NAN, 45.0F, -SERIES_MAX_VALUE, INFINITY};
+
+    // Nothing to keep in the first sample: missing, decoded as NaN until a usable value comes
+    TEST_ASSERT_TRUE(encoder.append(100, first));
+    TEST_ASSERT_TRUE(encoder.append(160, second));
+    Decoder  decoder(encoder.block());
+    uint32_t time;
+    float    values[FIELDS];
+    TEST_ASSERT_TRUE(decoder.next(time, values));
+    for (size_t f = 0; f < FIELDS - 1; f++)
+    {
+        TEST_ASSERT_TRUE(isnan(values[f]));
+    }
+    TEST_ASSERT_EQUAL_FLOAT(21.0F, values[4]);
+
+    TEST_ASSERT_TRUE(decoder.next(time, values));
+    TEST_ASSERT_EQUAL_UINT32(160, time);
+    TEST_ASSERT_EQUAL_FLOAT(22.0F, values[0]);
+    TEST_ASSERT_TRUE(isnan(values[1]));
+    TEST_ASSERT_EQUAL_FLOAT(45.0F, values[2]);
+    TEST_ASSERT_EQUAL_FLOAT(-SERIES_MAX_VALUE, values[3]);
+    TEST_ASSERT_EQUAL_FLOAT(21.0F, values[4]);
+    TEST_ASSERT_FALSE(decoder.next(time, values));
+}
+
+void test_blocks_and_unsealed_tail()
+{
+    // Noisy random walk with gaps, spread over several blocks, the last one not full
+    std::vector<Sample> samples;
+    Sample              sample = {1700000000, {21.0F, 45.0F, 1013.0F, 120.0F, 50000.0F}};
+    for (size_t i = 0; i < 3000; i++)
+    {
+        sample.time += ((random32() % 50) == 0) ? 600 + random32() % 3600 : 60;
+        sample.values[0] += noise(0.05F);
+        sample.values[1] += noise(0.3F);
+        sample.values[2] += noise(0.1F);
+        sample.values[3]  = 120.0F + noise(0.5F);
+        sample.values[4] += noise(200.0F);
+        samples.push_back(sample);
+    }
+    TEST_ASSERT_GREATER_THAN_size_t(2, roundTrip(samples));
+}
+
+void test_history_seals_full_blocks()
+{
+    SeriesHistory<FIELDS, 64, 2> history;
+    Series_block<64>             blocks[2];
+    float                        values[FIELDS] = {21.0F, 45.0F, 1013.0F, 120.0F, 50000.0F};
+
+    // Nothing sealed while the first block fills
+    history.add(0, values);
+    TEST_ASSERT_EQUAL_size_t(0, history.snapshot(blocks, 2));
+
+    // Then only the last 2 sealed blocks are kept, each one decoding in order
+    uint32_t time = 0;
+    while(history.snapshot(blocks, 2) < 2)
+    {
+        time += 60;
+        values[0] += 0.01F;
+        history.add(time, values);
+    }
+    uint32_t last = 0;
+    for (size_t b = 0; b < 2; b++)
+    {
+        SeriesDecoder<FIELDS, 64> decoder(blocks[b]);
+        uint32_t                  decoded;
+        float                     out[FIELDS];
+        TEST_ASSERT_GREATER_THAN_UINT16(0, blocks[b].count);
+        while(decoder.next(decoded, out))
+        {
+            TEST_ASSERT_TRUE((b == 0 && last == 0) || (decoded == last + 60));
+            last = decoded;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(time / 60 + 1, history.samples());
+}
+
+void test_benchmark()
+{
+    // BME680 like samples, random walk plus sensor noise, 1 s period with occasional gaps
+    std::vector<Sample> samples;
+    Sample              sample = {1700000000, {21.0F, 45.0F, 1013.0F, 120.0F, 50000.0F}};
+    state                      = 88172645U;
+    for (size_t i = 0; i < BENCH_SAMPLES; i++)
+    {
+        sample.time += ((random32() % 500) == 0) ? 2 + random32() % 120 : 1;
+        sample.values[0] += noise(0.02F);
+        sample.values[1] += noise(0.1F);
+        sample.values[2] += noise(0.05F);
+        sample.values[3]  = 120.0F + noise(0.3F);
+        sample.values[4] += noise(100.0F);
+        samples.push_back(sample);
+    }
+
+    std::vector<Series_block<BLOCK_BYTES>> blocks;
+    Encoder                                encoder;
+    const auto                             start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if(encoder.append(samples[i].time, samples[i].values) == false)
+        {
+            blocks.push_back(encoder.block());
+            encoder.reset();
+            encoder.append(samples[i].time, samples[i].values);
+        }
+    }
+    blocks.push_back(encoder.block());
+    const auto encoded = std::chrono::steady_clock::now();
+
+    size_t   decoded  = 0;
+    uint32_t checksum = 0;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        Decoder  decoder(blocks[b]);
+        uint32_t time;
+        float    values[FIELDS];
+        while(decoder.next(time, values))
+        {
+            checksum += time;
+            decoded++;
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL_size_t(samples.size(), decoded);
+    TEST_ASSERT_NOT_EQUAL(0, checksum);
+
+    size_t bits = 0;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        bits += blocks[b].bits;
+    }
+    const double perSample = bits / 8.0 / samples.size();
+    char         line[192];
+    snprintf(line, sizeof(line), "%u samples in %u blocks of %u bytes: %.2f bytes/sample, %.1fx the %u bytes of a raw time and fields, %.0f samples/block",
+             (unsigned)samples.size(), (unsigned)blocks.size(), BLOCK_BYTES, perSample, (4 + FIELDS * 4) / perSample, 4 + FIELDS * 4, (double)samples.size() / blocks.size());
+    TEST_MESSAGE(line);
+    snprintf(line, sizeof(line), "encode %.2f M samples/s, decode %.2f M samples/s",
+             samples.size() / std::chrono::duration<double, std::micro>(encoded - start).count(),
+             decoded / std::chrono::duration<double, std::micro>(end - encoded).count());
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE(perSample < (4 + FIELDS * 4) / 3.0);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_zigzag);
+    RUN_TEST(test_value_delta_sizes);
+    RUN_TEST(test_time_gaps);
+    RUN_TEST(test_nan_keeps_previous_value);
+    RUN_TEST(test_unusable_values);
+    RUN_TEST(test_blocks_and_unsealed_tail);
+    RUN_TEST(test_history_seals_full_blocks);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,136 @@
+#include <unity.h>
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+#include "TaskMetrics.hpp"
+
+/*
+ * Host simulation of the sensor and Telegram tasks, before and after the
+ * Telegram I/O left the command handler. Times are the ones of the board
+ * divided by SCALE, sleeps stand for the BME680 read and the TLS round trip.
+ */
+#define SCALE                   20         // Board times are divided by this
+#define SENSOR_PERIOD_MS        (1000 / SCALE)
+#define SENSOR_READ_MS          (160 / SCALE)   // BME680 reading with its gas heater
+#define TLS_SEND_MS             (800 / SCALE)   // sendMessage() round trip to Telegram
+#define COMMAND_MS              1               // Handling a command, the reply built in RAM
+#define COMMAND_GAP_MS          (2400 / SCALE)  // Mean time between two commands, a busy chat
+#define RUN_MS                  4000
+
+typedef struct
+{
+    Mutex_counters mutex;
+    Task_counters  sensor;
+} Run_result;
+
+/***********************************************************************
+ * @brief Run both tasks for RUN_MS
+ * @param before True for the old loop: one mutex held by the sensor
+ *        read and by the command handler around sendMessage(), and a
+ *        vTaskDelay() after the read
+ ***********************************************************************/
+static Run_result run(const bool before)
+{
+    TimedMutex        mtx("mtx");
+    TaskProbe         sensorProbe("sensorTask", 4096, SENSOR_PERIOD_MS * 1000);
+    std::atomic<bool> stop(false);
+    mtx.begin();
+
+    std::thread sensor([&]()
+    {
+        TickType_t lastWake = xTaskGetTickCount();
+        sensorProbe.attach();
+        while(stop.load() == false)
+        {
+            sensorProbe.wake();
+            if(before == true)
+            {
+                mtx.take(portMAX_DELAY);
+                delay(SENSOR_READ_MS);
+                mtx.give();
+                sensorProbe.sleep();
+                vTaskDelay(SENSOR_PERIOD_MS);
+            }
+            else
+            {
+                delay(SENSOR_READ_MS);
+                sensorProbe.sleep();
+                vTaskDelayUntil(&lastWake, SENSOR_PERIOD_MS);
+            }
+        }
+    });
+
+    std::thread bot([&]()
+    {
+        uint32_t state = 2463534242U;
+        while(stop.load() == false)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            delay(state % (2 * COMMAND_GAP_MS));
+
+            // After, the reply is queued and sent by the Telegram task, out of any lock
+            mtx.take(portMAX_DELAY);
+            delay(COMMAND_MS);
+            if(before == true)
+            {
+                delay(TLS_SEND_MS);
+            }
+            mtx.give();
+            if(before == false)
+            {
+                delay(TLS_SEND_MS);
+            }
+        }
+    });
+
+    delay(RUN_MS);
+    stop = true;
+    sensor.join();
+    bot.join();
+
+    Run_result result;
+    mtx.snapshot(result.mutex);
+    sensorProbe.snapshot(result.sensor);
+    return result;
+}
+
+static void report(const char *label, const Run_result &result)
+{
+    const TimeHistogram &hold   = result.mutex.hold;
+    const TimeHistogram &wait   = result.mutex.wait;
+    const TimeHistogram &jitter = result.sensor.jitter;
+    char                 line[200];
+    snprintf(line, sizeof(line), "%s: mutex held %6.0f us mean, %6u us max | waited %6.0f us mean, %6u us max | sensor jitter %6.0f us mean, %6u us max over %u periods",
+             label, (double)hold.sum() / hold.count(), (unsigned)hold.max(), (double)wait.sum() / wait.count(), (unsigned)wait.max(),
+             (double)jitter.sum() / jitter.count(), (unsigned)jitter.max(), (unsigned)jitter.count());
+    TEST_MESSAGE(line);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_hold_time_and_jitter()
+{
+    const Run_result before = run(true);
+    const Run_result after  = run(false);
+    report("before", before);
+    report("after ", after);
+
+    // The lock no longer covers the round trip to Telegram
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(TLS_SEND_MS * 1000, before.mutex.hold.max());
+    TEST_ASSERT_LESS_THAN_UINT32(TLS_SEND_MS * 1000, after.mutex.hold.max());
+
+    // Before, every period is late by at least the read, after only by the scheduling
+    TEST_ASSERT_GREATER_THAN_UINT32(0, after.sensor.jitter.count());
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT64(before.sensor.jitter.count() * SENSOR_READ_MS * 1000, before.sensor.jitter.sum());
+    TEST_ASSERT_LESS_THAN_UINT64(after.sensor.jitter.count() * SENSOR_READ_MS * 1000 / 2, after.sensor.jitter.sum());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_hold_time_and_jitter);
+    return UNITY_END();
+}
@@ -0,0 +1,232 @@
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "TelegramOutbox.hpp"
+#include "TelegramPoll.hpp"
+
+#define LONG_POLL               20         // BOT_LONG_POLL
+#define RETRY_DELAY             800        // BOT_DELAY
+#define RTT_MS                  300        // Round trip of a request to Telegram over a kept-alive connection
+
+/***********************************************************************
+ * @brief Stand-in of the getUpdates endpoint of Telegram, on a simulated clock
+ *
+ * A poll is answered once a command is waiting or when its timeout ends,
+ * like the Bot API does. While the server is down, requests fail after
+ * one round trip without any message.
+ ***********************************************************************/
+class TelegramStandIn
+{
+    public:
+        TelegramStandIn() : now(0), requests(0), _downFrom(UINT32_MAX), _downTo(0), _next(0) {}
+
+        uint32_t now;           // Simulated millis()
+        uint32_t requests;      // Calls to getUpdates()
+
+        void command(const uint32_t at)
+        {
+            _commands.push_back(at);
+        }
+
+        void down(const uint32_t from, const uint32_t to)
+        {
+            _downFrom = from;
+            _downTo   = to;
+        }
+
+        /***********************************************************************
+         * @brief Poll, the clock moves to the answer
+         * @param timeout Seconds the poll may be held
+         * @param answered Set to the time each command returned was sent at
+         * @return Number of commands returned
+         ***********************************************************************/
+        int32_t getUpdates(const uint16_t timeout, std::vector<uint32_t> &answered)
+        {
+            requests++;
+            if((now >= _downFrom) && (now < _downTo))
+            {
+                now += RTT_MS;
+                return 0;
+            }
+
+            // Held open until a command is waiting or the timeout ends
+            const uint32_t arrived = now + RTT_MS / 2;
+            uint32_t       answer  = arrived + timeout * 1000;
+            if((_next < _commands.size()) && (_commands[_next] < answer))
+            {
+                answer = (_commands[_next] > arrived) ? _commands[_next] : arrived;
+            }
+
+            int32_t count = 0;
+            while((_next < _commands.size()) && (_commands[_next] <= answer))
+            {
+                answered.push_back(_commands[_next++]);
+                count++;
+            }
+            now = answer + RTT_MS / 2;
+            return count;
+        }
+
+    private:
+        uint32_t              _downFrom;
+        uint32_t              _downTo;
+        std::vector<uint32_t> _commands;
+        size_t                _next;
+};
+
+/***********************************************************************
+ * @brief Loop of telegramTask until the simulated clock reaches end
+ * @param latencies Set to the time between each command and its receipt
+ ***********************************************************************/
+static void runTask(TelegramStandIn &telegram, TelegramPoll &poll, const uint32_t end, std::vector<uint32_t> &latencies)
+{
+    while(telegram.now < end)
+    {
+        std::vector<uint32_t> answered;
+        const uint16_t        timeout = poll.timeout();
+        const uint32_t        start   = telegram.now;
+        const int32_t         count   = telegram.getUpdates(timeout, answered);
+        for (size_t i = 0; i < answered.size(); i++)
+        {
+            latencies.push_back(telegram.now - answered[i]);
+        }
+        telegram.now += poll.done(timeout, telegram.now - start, count);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_idle_polls()
+{
+    TelegramStandIn       telegram;
+    TelegramPoll          poll(LONG_POLL, RETRY_DELAY);
+    std::vector<uint32_t> latencies;
+
+    // About one request per long poll, against 75 a minute with the old 800 ms short polls
+    runTask(telegram, poll, 10 * 60000, latencies);
+    char line[96];
+    snprintf(line, sizeof(line), "idle: %.1f requests/min, %u failures", telegram.requests / 10.0, (unsigned)poll.failures());
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(30, telegram.requests);
+    TEST_ASSERT_EQUAL_UINT32(0, poll.failures());
+}
+
+void test_command_latency()
+{
+    TelegramStandIn       telegram;
+    TelegramPoll          poll(LONG_POLL, RETRY_DELAY);
+    std::vector<uint32_t> latencies;
+
+    // Commands in the middle of a poll, and two close together
+    telegram.command(37300);
+    telegram.command(90000);
+    telegram.command(90050);
+    runTask(telegram, poll, 120000, latencies);
+
+    // A command is received half a round trip after it arrives, the second one of a pair at most one poll later
+    TEST_ASSERT_EQUAL_size_t(3, latencies.size());
+    TEST_ASSERT_EQUAL_UINT32(RTT_MS / 2, latencies[0]);
+    TEST_ASSERT_EQUAL_UINT32(RTT_MS / 2, latencies[1]);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(RTT_MS * 2, latencies[2]);
+    TEST_ASSERT_EQUAL_UINT32(0, poll.failures());
+}
+
+void test_failed_polls_back_off()
+{
+    TelegramStandIn       telegram;
+    TelegramPoll          poll(LONG_POLL, RETRY_DELAY);
+    std::vector<uint32_t> latencies;
+
+    // One minute without network, then a command once it is back
+    telegram.down(0, 60000);
+    telegram.command(61000);
+    runTask(telegram, poll, 80000, latencies);
+
+    // Failed requests are spaced by the retry delay, not sent in a loop
+    const uint32_t failed = 60000 / (RTT_MS + RETRY_DELAY) + 1;
+    TEST_ASSERT_EQUAL_UINT32(failed, poll.failures());
+    TEST_ASSERT_EQUAL_size_t(1, latencies.size());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(RTT_MS, latencies[0]);
+}
+
+void test_short_timeout_never_failed()
+{
+    TelegramPoll poll(LONG_POLL, RETRY_DELAY);
+
+    TEST_ASSERT_EQUAL_UINT32(RETRY_DELAY, poll.done(LONG_POLL, 300, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, poll.done(LONG_POLL, 300, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, poll.done(LONG_POLL, LONG_POLL * 1000, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, poll.done(1, 300, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, poll.done(0, 300, 0));
+    TEST_ASSERT_EQUAL_UINT32(5, poll.polls());
+    TEST_ASSERT_EQUAL_UINT32(1, poll.failures());
+}
+
+/***********************************************************************
+ * @brief Time a reply takes to leave when its first send fails
+ * @param shorten True to shorten the polls while the outbox is not empty
+ ***********************************************************************/
+static uint32_t retriedReplyLatency(const bool shorten)
+{
+    TelegramStandIn             telegram;
+    TelegramPoll                poll(LONG_POLL, RETRY_DELAY);
+    TelegramOutbox<24, 128, 4>  outbox;
+    std::vector<uint32_t>       answered;
+    bool                        failOnce = true;
+
+    // A reply queued between two polls, its first send fails
+    telegram.now = 5000;
+    outbox.add("42", "LED is ON", telegram.now);
+    while(telegram.now < 120000)
+    {
+        TelegramOutbox<24, 128, 4>::Message *message = outbox.next(telegram.now);
+        if(message != NULL)
+        {
+            telegram.now += RTT_MS;
+            outbox.done(message, failOnce == false, telegram.now);
+            failOnce = false;
+            continue;
+        }
+        if(outbox.empty() == true)
+        {
+            return outbox.stats().last_latency_ms;
+        }
+
+        const uint16_t timeout = shorten ? poll.timeout(outbox.wait(telegram.now)) : poll.timeout();
+        const uint32_t start   = telegram.now;
+        const int32_t  count   = telegram.getUpdates(timeout, answered);
+        telegram.now          += poll.done(timeout, telegram.now - start, count);
+    }
+    return UINT32_MAX;
+}
+
+void test_outbox_flushed_during_poll()
+{
+    TelegramPoll poll(LONG_POLL, RETRY_DELAY);
+    TEST_ASSERT_EQUAL_UINT16(LONG_POLL, poll.timeout());
+    TEST_ASSERT_EQUAL_UINT16(0, poll.timeout(0));
+    TEST_ASSERT_EQUAL_UINT16(1, poll.timeout(1));
+    TEST_ASSERT_EQUAL_UINT16(2, poll.timeout(1001));
+    TEST_ASSERT_EQUAL_UINT16(LONG_POLL, poll.timeout(LONG_POLL * 1000 + 1));
+
+    // The retry leaves when its backoff ends, not when the long poll does
+    const uint32_t longPoll  = retriedReplyLatency(false);
+    const uint32_t shortened = retriedReplyLatency(true);
+    char           line[96];
+    snprintf(line, sizeof(line), "reply retried after a failure: %u ms, %u ms with polls shortened", (unsigned)longPoll, (unsigned)shortened);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(LONG_POLL * 1000, longPoll);
+    TEST_ASSERT_LESS_THAN_UINT32(LONG_POLL * 1000 / 4, shortened);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_idle_polls);
+    RUN_TEST(test_command_latency);
+    RUN_TEST(test_failed_polls_back_off);
+    RUN_TEST(test_short_timeout_never_failed);
+    RUN_TEST(test_outbox_flushed_during_poll);
+    return UNITY_END();
+}
@@ -0,0 +1,415 @@
+#include <unity.h>
+#include <chrono>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "RoomRegistry.hpp"
+#include "TextWriter.hpp"
+
+#define BENCH_ROOMS             20         // Rooms written by the benchmark, the deployment target
+#define BENCH_CALLS             1000       // Calls timed per case
+#define STREAM_DEFAULT_SIZE     1460       // Buffer of an AsyncResponseStream created without a size
+
+// Heap allocations made since the start, counted by the operators below
+static size_t allocations = 0;
+
+/***********************************************************************
+ * @brief malloc() counted, every new below gets its memory here and
+ * every delete gives it back with free(), so the pairs always match
+ ***********************************************************************/
+static void *countedMalloc(const size_t size)
+{
+    allocations++;
+    void *ptr = malloc(size);
+    if(ptr == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(size_t size)
+{
+    return countedMalloc(size);
+}
+
+void *operator new[](size_t size)
+{
+    return countedMalloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+/***********************************************************************
+ * @brief dtostrf() of the Arduino core (stdlib_noniso.c), what String(float) calls
+ ***********************************************************************/
+static char *dtostrf(double number, signed char width, unsigned char prec, char *s)
+{
+    bool negative = false;
+
+    if(isnan(number))
+    {
+        strcpy(s, "nan");
+        return s;
+    }
+    if(isinf(number))
+    {
+        strcpy(s, "inf");
+        return s;
+    }
+
+    char *out    = s;
+    int   fillme = width;
+    if(prec > 0)
+    {
+        fillme -= (prec + 1);
+    }
+    if(number < 0.0)
+    {
+        negative = true;
+        fillme--;
+        number = -number;
+    }
+
+    double rounding = 2.0;
+    for(uint8_t i = 0; i < prec; ++i)
+    {
+        rounding *= 10.0;
+    }
+    rounding = 1.0 / rounding;
+    number  += rounding;
+
+    double tenpow     = 1.0;
+    int    digitcount = 1;
+    while(number >= 10.0 * tenpow)
+    {
+        tenpow *= 10.0;
+        digitcount++;
+    }
+    number /= tenpow;
+    fillme -= digitcount;
+
+    while(fillme-- > 0)
+    {
+        *out++ = ' ';
+    }
+    if(negative)
+    {
+        *out++ = '-';
+    }
+
+    digitcount += prec;
+    int8_t digit = 0;
+    while(digitcount-- > 0)
+    {
+        digit = (int8_t)number;
+        if(digit > 9)
+        {
+            digit = 9;
+        }
+        *out++ = (char)('0' | digit);
+        if((digitcount == prec) && (prec > 0))
+        {
+            *out++ = '.';
+        }
+        number -= digit;
+        number *= 10.0;
+    }
+    *out = 0;
+    return s;
+}
+
+/***********************************************************************
+ * @brief Check writeFloat() against String(float), that is dtostrf(value, 4, 2)
+ ***********************************************************************/
+static void checkFloat(const float value)
+{
+    char expected[64];
+    char text[64];
+    dtostrf(value, 4, 2, expected);
+
+    TextWriter out(text, sizeof(text));
+    out.writeFloat(value);
+    if(strcmp(expected, text) != 0)
+    {
+        char message[192];
+        snprintf(message, sizeof(message), "%.9g: dtostrf gives \"%s\", writeFloat \"%s\"", value, expected, text);
+        TEST_FAIL_MESSAGE(message);
+    }
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), out.length());
+}
+
+/***********************************************************************
+ * @brief Print growing like AsyncResponseStream: its cbuf is reallocated
+ * to the size needed by each write that does not fit, one byte being
+ * always left empty
+ ***********************************************************************/
+class GrowingStream : public Print
+{
+    public:
+        explicit GrowingStream(const size_t size) : _data(new char[size]), _size(size), _length(0), resizes(0) {}
+
+        ~GrowingStream()
+        {
+            delete[] _data;
+        }
+
+        size_t write(const uint8_t c) override
+        {
+            return write(&c, 1);
+        }
+
+        size_t write(const uint8_t *buffer, const size_t size) override
+        {
+            const size_t room = _size - _length - 1;
+            if(size > room)
+            {
+                char *grown = new char[_size + size - room];
+                memcpy(grown, _data, _length);
+                delete[] _data;
+                _data  = grown;
+                _size += size - room;
+                resizes++;
+            }
+            memcpy(_data + _length, buffer, size);
+            _length += size;
+            return size;
+        }
+
+        size_t length() const
+        {
+            return _length;
+        }
+
+    private:
+        char   *_data;
+        size_t  _size;
+        size_t  _length;
+
+    public:
+        size_t  resizes;    // Reallocations of the buffer
+};
+
+// Rooms of the benchmark, full histories
+static RoomRegistry registry;
+
+/***********************************************************************
+ * @brief Same walk as writeData() in main.cpp, for /all_data
+ ***********************************************************************/
+static void writeData(TextWriter &out)
+{
+    for (size_t i = 0; i < registry.count(); i++)
+    {
+        if(i > 0)
+        {
+            out.write('\n');
+        }
+        registry.at(i)->writeHistory(out);
+    }
+}
+
+static void fillRooms()
+{
+    if(registry.count() > 0)
+    {
+        return;
+    }
+
+    for (uint8_t id = 0; id < BENCH_ROOMS; id++)
+    {
+        char name[ROOM_NAME_SIZE];
+        snprintf(name, sizeof(name), "Room %u", id);
+        if(id == 0)
+        {
+            TypedRoom<Message_bme680> *room = new TypedRoom<Message_bme680>(id, name);
+            registry.add(room);
+            for (uint32_t t = 0; t < MAX_DATA; t++)
+            {
+                const Message_bme680 sample = {id, 21.37F + t * 0.01F, 48.5F, 1013.25F, 112.4F, 51234.5F, 1700000000 + t * 60};
+                room->store(sample);
+            }
+            continue;
+        }
+
+        TypedRoom<Message_bme280> *room = new TypedRoom<Message_bme280>(id, name);
+        registry.add(room);
+        for (uint32_t t = 0; t < MAX_DATA; t++)
+        {
+            const Message_bme280 sample = {id, 19.0F + id * 0.1F - t * 0.03F, 55.25F, 1009.8F, 140.0F, 1700000000 + t * 60};
+            room->store(sample);
+        }
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_float_special_values()
+{
+    checkFloat(NAN);
+    checkFloat(-NAN);
+    checkFloat(INFINITY);
+    checkFloat(-INFINITY);
+    checkFloat(0.0F);
+    checkFloat(-0.0F);
+    checkFloat(3.4e38F);
+    checkFloat(-3.4e38F);
+    checkFloat(1.0e-30F);
+    checkFloat(-1.0e-30F);
+}
+
+void test_float_rounding()
+{
+    // Around the .005 the rounding adds, where float and double disagree most
+    const float values[] = {0.005F, 0.0049F, 0.0051F, -0.005F, 1.005F, 1.015F, 1.995F, 1.999F, 2.675F, 9.995F, 99.995F, 1013.245F, 1013.255F, -40.005F};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        checkFloat(values[i]);
+        checkFloat(nextafterf(values[i], INFINITY));
+        checkFloat(nextafterf(values[i], -INFINITY));
+    }
+
+    // Every hundredth and half hundredth a sensor gives
+    for (int32_t i = -100000; i <= 200000; i++)
+    {
+        checkFloat(i / 100.0F);
+        checkFloat(i / 100.0F + 0.005F);
+    }
+}
+
+void test_float_random()
+{
+    uint32_t state = 2463534242U;
+    for (uint32_t i = 0; i < 2000000; i++)
+    {
+        // Any bit pattern, NaN and infinities included
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        float value;
+        memcpy(&value, &state, sizeof(value));
+        checkFloat(value);
+    }
+}
+
+void test_integers()
+{
+    char       text[48];
+    TextWriter out(text, sizeof(text));
+    out.writeUInt(0);
+    out.write(' ');
+    out.writeUInt(UINT32_MAX);
+    out.write(' ');
+    out.writeUInt64(UINT64_MAX);
+    TEST_ASSERT_EQUAL_STRING("0 4294967295 18446744073709551615", text);
+}
+
+void test_buffer_truncated()
+{
+    char       text[8];
+    TextWriter out(text, sizeof(text));
+    out.write("Living room");
+
+    // The text is cut and terminated, the length is the whole text
+    TEST_ASSERT_TRUE(out.truncated());
+    TEST_ASSERT_EQUAL_size_t(11, out.length());
+    TEST_ASSERT_EQUAL_STRING("Living ", text);
+
+    TextWriter size(NULL, 0);
+    size.write("Living room");
+    TEST_ASSERT_EQUAL_size_t(11, size.length());
+}
+
+void test_benchmark_allocations()
+{
+    fillRooms();
+
+    TextWriter measure(NULL, 0);
+    writeData(measure);
+    const size_t length = measure.length();
+    char        *buffer = new char[length + 1];
+    char         line[160];
+
+    // Into a caller supplied buffer
+    size_t     before = allocations;
+    const auto start  = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_CALLS; i++)
+    {
+        TextWriter out(buffer, length + 1);
+        writeData(out);
+        TEST_ASSERT_FALSE(out.truncated());
+    }
+    const auto   end         = std::chrono::steady_clock::now();
+    const size_t bufferAlloc = allocations - before;
+    snprintf(line, sizeof(line), "/all_data, %u rooms, %u bytes: buffer %.1f us/call, %.2f allocations/call",
+             BENCH_ROOMS, (unsigned)length, std::chrono::duration<double, std::micro>(end - start).count() / BENCH_CALLS, (double)bufferAlloc / BENCH_CALLS);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_size_t(0, bufferAlloc);
+
+    // Into a response stream created without a size, then with the size measured first
+    for (uint8_t sized = 0; sized < 2; sized++)
+    {
+        size_t     resizes = 0;
+        before             = allocations;
+        const auto begin   = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BENCH_CALLS; i++)
+        {
+            size_t streamSize = STREAM_DEFAULT_SIZE;
+            if(sized == 1)
+            {
+                TextWriter size(NULL, 0);
+                writeData(size);
+                streamSize = size.length() + 1;
+            }
+            GrowingStream stream(streamSize);
+            TextWriter    out(stream);
+            writeData(out);
+            TEST_ASSERT_EQUAL_size_t(length, stream.length());
+            resizes += stream.resizes;
+        }
+        const auto finish = std::chrono::steady_clock::now();
+        snprintf(line, sizeof(line), "/all_data, stream %s: %.1f us/call, %.2f allocations/call",
+                 (sized == 1) ? "sized first   " : "of 1460 bytes ", std::chrono::duration<double, std::micro>(finish - begin).count() / BENCH_CALLS,
+                 (double)(allocations - before) / BENCH_CALLS);
+        TEST_MESSAGE(line);
+        if(sized == 1)
+        {
+            // Only the buffer of the stream itself
+            TEST_ASSERT_EQUAL_size_t(0, resizes);
+            TEST_ASSERT_EQUAL_size_t(BENCH_CALLS, allocations - before);
+        }
+    }
+    delete[] buffer;
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_float_special_values);
+    RUN_TEST(test_float_rounding);
+    RUN_TEST(test_float_random);
+    RUN_TEST(test_integers);
+    RUN_TEST(test_buffer_truncated);
+    RUN_TEST(test_benchmark_allocations);
+    return UNITY_END();
+}
@@ -1,17 +1,44 @@
 #include <Arduino.h>
+#include "LedEffects.hpp"
 
 #define LED     2
-#define DELAY   1000
+#define DELAY   5000
+
+LedEffects led;
+uint8_t effect = 0;
 
 void setup() 
 {
-    pinMode(LED, OUTPUT);
+    led.begin(LED);
 }
 
 void loop() 
 {
+    // Patterns run in the background, loop() only picks the next one
+    switch(effect)
+    {
+        case 0:
+            led.play(LedPatterns::off());
+            led.play(LedPatterns::blink(10));
+            break;
+
+        case 1:
+            led.play(LedPatterns::breathe(2));
+            break;
+
+        case 2:
+            led.play(LedPatterns::heartbeat(3));
+            break;
+
+        case 3:
+            led.play(LedPatterns::status(3));
+            break;
+
+        default:
+            led.play(LedPatterns::on());
+            break;
+    }
+
+    effect = (effect + 1) % 5;
     delay(DELAY);
-    digitalWrite(LED, HIGH);
-    delay(DELAY);
-    digitalWrite(LED, LOW);
-}
\ No newline at end of file
+}
@@ -3,7 +3,8 @@
 #include "CONFIGS.hpp"
 #include <PubSubClient.h> 
 #include "Adafruit_BME680.h"
-#include "NTPClient.h"
+#include "ClockService.hpp"
+#include "Bme680Driver.hpp"
 #include "WiFiUdp.h"
 
 // Define verbose
@@ -19,12 +20,13 @@
 WiFiClient espClient;
 PubSubClient client(espClient);
 
-// Create BME680 object
+// Create BME680 object, read a whole conversion at a time
 Adafruit_BME680 bme;
+Sampler<Bme680Driver<Adafruit_BME680> > bmeSampler(bme, SEALEVELPRESSURE_HPA);
 
-// Define NTP Client to get time
+// Define the clock kept from NTP in the background
 WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP);
+ClockService<WiFiUDP> clockService(ntpUDP);
 
 //Set static IP
 IPAddress ip(192, 168, 1, 250);
@@ -45,120 +47,33 @@ static unsigned long lastMsg;
 static Data data;
 
 /**
- * @brief Read temperature from BME680 sensor
+ * @brief Read epoch in seconds from the clock kept from NTP, never blocks
  */
-float readBME680Temperature()
-{
-    float t = bme.readTemperature();
-    static float t_mem;
-    if (isnan(t))
-    {
-        Serial.println("Failed to read temperature from BME680 sensor ! Kept the old value");
-        return t_mem;
-    }
-    t_mem = t;
-#if VERBOSE
-    Serial.println("Read temperature : " + String(t) + "°C");
-#endif
-    return t;
-}
-
-/**
- * @brief Read humidity from BME680 sensor
- */
-float readBME680Humidity()
-{
-    float h = bme.readHumidity();
-    static float h_mem;
-    if (isnan(h))
-    {
-        Serial.println("Failed to read humidity from BME680 sensor ! Kept the old value");
-        return h_mem;
-    }
-    h_mem = h;
-#if VERBOSE
-    Serial.println("Read humidity : " + String(h) + "°C");
-#endif
-    return h;
-}
-
-/**
- * @brief Read pressure from BME680 sensor
- */
-float readBME680Pressure()
+unsigned long readTime()
 {
-    float p = bme.readPressure() / 100.0F;
-    static float p_mem;
-    if (isnan(p))
-    {
-        Serial.println("Failed to read pressure from BME680 sensor ! Kept the old value");
-        return p_mem;
-    }
-    p_mem = p;
-#if VERBOSE
-    Serial.println("Read pressure : " + String(p) + "hPa");
-#endif
-    return p;
+    return clockService.now();
 }
 
 /**
- * @brief Read altitude from BME680 sensor
+ * @brief Collect the BME680 conversion started in loop()
  */
-float readBME680Altitude()
+void updateData()
 {
-    float a = bme.readAltitude(SEALEVELPRESSURE_HPA);
-    static float a_mem;
-    if (isnan(a))
+    Bme680_reading reading;
+    if (!bmeSampler.finish(reading))
     {
-        Serial.println("Failed to read altitude from BME680 sensor ! Kept the old value");
-        return a_mem;
+        Serial.println("Failed to read BME680 sensor ! Kept the old values");
     }
-    a_mem = a;
-#if VERBOSE
-    Serial.println("Read altitude : " + String(a) + "m");
-#endif
-    return a;
-}
 
-/**
- * @brief Read gas resistance from BME680 sensor
- */
-float readBME680GasResistance()
-{
-    float r = bme.gas_resistance / 1000.0F;
-    static float r_mem;
-    if (isnan(r))
-    {
-        Serial.println("Failed to read gas resistance from BME680 sensor ! Kept the old value");
-        return r_mem;
-    }
-    r_mem = r;
+    data.time            = readTime();
+    data.temperature     = reading.temperature;
+    data.humidity        = reading.humidity;
+    data.pressure        = reading.pressure;
+    data.altitude        = reading.altitude;
+    data.gas_resistance  = reading.gas_resistance;
 #if VERBOSE
-    Serial.println("Read gas resistance : " + String(r) + "kOhm");
+    bmeSampler.print(Serial, reading);
 #endif
-    return r;
-}
-
-/**
- * @brief Read epoch from NTP server in milliseconds
- */
-unsigned long readTime()
-{
-    timeClient.update();
-    return timeClient.getEpochTime();
-}
-
-/**
- * @brief Read temperature and humidity from DHT11 sensor
- */
-void updateData()
-{
-    data.time            = readTime();
-    data.temperature     = readBME680Temperature();
-    data.humidity        = readBME680Humidity();
-    data.pressure        = readBME680Pressure();
-    data.altitude        = readBME680Altitude();
-    data.gas_resistance  = readBME680GasResistance();
 }
 
 void setup()
@@ -187,10 +102,9 @@ void setup()
     WiFi.config(ip, WiFi.gatewayIP(), WiFi.subnetMask(), IPAddress(8, 8, 8, 8));
     Serial.println("Connected to WiFi network at " + String(WiFi.localIP()));
 
-    // Start NTP client
-    timeClient.begin();
-    timeClient.setTimeOffset(7200);
-    timeClient.setUpdateInterval(1000); 
+    // Start syncing the clock with NTP
+    clockService.setOffset(7200);
+    clockService.begin();
 
     client.setServer(MQTT_SERVER, 1883);
 }
@@ -232,11 +146,19 @@ void loop()
     }
     client.loop();
 
+    // Start a conversion when a message is due, client.loop() keeps running while it lasts
     unsigned long now = millis();
-    if (millis() - lastMsg > DELAY_BETWEEN_EMISSION_MS)
+    if (!bmeSampler.busy() && (millis() - lastMsg > DELAY_BETWEEN_EMISSION_MS))
     {
         lastMsg = now;
+        if (!bmeSampler.start())
+        {
+            Serial.println("Failed to start a BME680 reading");
+        }
+    }
 
+    if (bmeSampler.ready())
+    {
         updateData();
 
 #if VERBOSE
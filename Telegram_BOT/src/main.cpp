@@ -3,33 +3,88 @@
 #include <UniversalTelegramBot.h> 
 #include <ArduinoJson.h>
 #include "CONFIGS.hpp"
+#include "BotCommands.hpp"
+#include "LedEffects.hpp"
 
 #define LED 2
+#define BOT_LONG_POLL 20   // Seconds Telegram holds a poll open while no message arrives
+#define BOT_DELAY 1000     // Milliseconds before polling again after a failed poll
 
 WiFiClientSecure client;
 UniversalTelegramBot bot(BOT_TOKEN, client);
 
+LedEffects led;
+
 bool ledState = LOW;
 
-void blinkLED()
+// What a command handler gets
+struct Command_context
+{
+    String chatID;
+    String fromName;
+};
+
+String returnWelcomeMessage(String name);
+
+void commandStart(Command_context &context, const char *args)
+{
+    bot.sendMessage(context.chatID, returnWelcomeMessage(context.fromName), "");
+}
+
+void commandLedOn(Command_context &context, const char *args)
+{
+    bot.sendMessage(context.chatID, "LED state set to ON", "");
+    ledState = HIGH;
+    led.show(LedPatterns::on());
+}
+
+void commandLedOff(Command_context &context, const char *args)
+{
+    bot.sendMessage(context.chatID, "LED state set to OFF", "");
+    ledState = LOW;
+    led.show(LedPatterns::off());
+}
+
+void commandState(Command_context &context, const char *args)
 {
-    for (int i = 0; i < 50; i++)
+    if (ledState)
+    {
+        bot.sendMessage(context.chatID, "LED is ON", "");
+    }
+    else
     {
-        digitalWrite(LED, HIGH);
-        delay(100);
-        digitalWrite(LED, LOW);
-        delay(100);
+        bot.sendMessage(context.chatID, "LED is OFF", "");
     }
 }
 
+void commandBlink(Command_context &context, const char *args)
+{
+    // Plays in the background, the bot keeps answering meanwhile
+    bot.sendMessage(context.chatID, "LED will blink", "");
+    led.play(LedPatterns::blink(50));
+}
+
+// Commands of the bot, sorted by name
+constexpr Bot_command_entry<Command_context> botCommands[] =
+{
+    {"/blink",   "to blink LED",                   commandBlink},
+    {"/led_off", "to turn GPIO OFF",               commandLedOff},
+    {"/led_on",  "to turn GPIO ON",                commandLedOn},
+    {"/start",   NULL,                             commandStart},
+    {"/state",   "to request current GPIO state",  commandState},
+};
+static_assert(BotCommands::sorted(botCommands), "botCommands must be sorted by name");
+
+const CommandTable<Command_context, sizeof(botCommands) / sizeof(botCommands[0])> commandTable(botCommands);
+
+// Order of the commands in the welcome message
+const char *const botHelpOrder[] = {"/led_on", "/led_off", "/state", "/blink"};
+
 String returnWelcomeMessage(String name)
 {
     String welcome = "Welcome, " + name + ".\n";
     welcome += "Use the following commands to control your outputs.\n\n";
-    welcome += "/led_on to turn GPIO ON \n";
-    welcome += "/led_off to turn GPIO OFF \n";
-    welcome += "/state to request current GPIO state \n";
-    welcome += "/blink to blink LED \n";
+    commandTable.help(welcome, botHelpOrder);
     return welcome;
 }
 
@@ -53,45 +108,8 @@ void handleNewMessages(int numNewMessages)
         String text = bot.messages[i].text;
         Serial.println(text);
 
-        String fromName = bot.messages[i].from_name;
-
-        if (text == "/start")
-        {
-            
-            bot.sendMessage(chatID, returnWelcomeMessage(fromName), "");
-        }
-
-        if (text == "/led_on")
-        {
-            bot.sendMessage(chatID, "LED state set to ON", "");
-            ledState = HIGH;
-            digitalWrite(LED, ledState);
-        }
-
-        if (text == "/led_off")
-        {
-            bot.sendMessage(chatID, "LED state set to OFF", "");
-            ledState = LOW;
-            digitalWrite(LED, ledState);
-        }
-
-        if (text == "/state")
-        {
-            if (digitalRead(LED))
-            {
-                bot.sendMessage(chatID, "LED is ON", "");
-            }
-            else
-            {
-                bot.sendMessage(chatID, "LED is OFF", "");
-            }
-        }
-
-        if (text == "/blink")
-        {
-            bot.sendMessage(chatID, "LED will blink", "");
-            blinkLED();
-        }
+        Command_context context = {chatID, bot.messages[i].from_name};
+        commandTable.dispatch(context, text.c_str());
     }
 }
 
@@ -100,41 +118,46 @@ void setup()
     byte attempts = 0;
     Serial.begin(115200);
 
-    pinMode(LED, OUTPUT);
-    digitalWrite(LED, ledState);
+    led.begin(LED);
 
     // Connect to Wi-Fi
     WiFi.mode(WIFI_STA);
     WiFi.begin(SSID, PASSWORD);
     client.setCACert(TELEGRAM_CERTIFICATE_ROOT); 
+
+    // Long polling: one request per command or per BOT_LONG_POLL seconds, on a kept-alive connection
+    bot.longPoll = BOT_LONG_POLL;
+    led.play(LedPatterns::blink(0, 2000));
     while (WiFi.status() != WL_CONNECTED)
     {
         delay(1000);
         Serial.println("Connecting to WiFi.. Attempt " + String(++attempts));
-        digitalWrite(LED, ledState);
-        ledState = !ledState;
         if (attempts > 10)
         {
             Serial.println("Failed to connect to WiFi. Restarting... \n\n");
             ESP.restart();
         }
     }
+    led.show(LedPatterns::off());
     Serial.println(WiFi.localIP());
 }
 
 void loop()
 {
-    unsigned long lastTimeBotRan;
-    if (millis() > lastTimeBotRan + 1000)
+    unsigned long start = millis();
+    int numNewMessages = bot.getUpdates(bot.last_message_received + 1);
+    while (numNewMessages)
     {
-        int numNewMessages = bot.getUpdates(bot.last_message_received + 1);
-        Serial.println("numNewMessages = " + String(numNewMessages));
-        while (numNewMessages)
-        {
-            Serial.println("got response");
-            handleNewMessages(numNewMessages);
-            numNewMessages = bot.getUpdates(bot.last_message_received + 1);
-        }
-        lastTimeBotRan = millis();
+        Serial.println("got response");
+        handleNewMessages(numNewMessages);
+        start = millis();
+        numNewMessages = bot.getUpdates(bot.last_message_received + 1);
     }
-}
\ No newline at end of file
+
+    // An empty answer well before the long poll timeout means the request failed
+    if (millis() - start < BOT_LONG_POLL * 1000UL / 2)
+    {
+        Serial.println("Poll failed, retrying");
+        delay(BOT_DELAY);
+    }
+}
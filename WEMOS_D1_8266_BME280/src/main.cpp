@@ -1,10 +1,11 @@
 #include <Arduino.h>
-#include "Adafruit_BME280.h"
+#include <Wire.h>
+#include "Bme280Driver.hpp"
 
 #define SEALEVELPRESSURE_HPA 1025.0F
 
-// Create BME280 object
-Adafruit_BME280 bme;
+// Create BME280 object, one forced measure per sample
+Sampler<Bme280Driver<TwoWire> > bme(Wire, SEALEVELPRESSURE_HPA);
 
 // Create struct to store sensor data
 typedef struct bme280_data
@@ -13,74 +14,28 @@ typedef struct bme280_data
     float humidity;
     float pressure;
     float altitude;
+    float dew_point;
 } bme280_data;
 bme280_data data;
 
-float readBME280Temperature()
-{
-    float t = bme.readTemperature();
-    static float t_mem;
-    if (isnan(t))
-    {
-        Serial.println("Failed to read temperature from BME280 sensor ! Kept the old value");
-        return t_mem;
-    }
-    t_mem = t;
-    Serial.println("Read temperature : " + String(t) + "°C");
-    return t;
-}
-
-float readBME280Humidity()
-{
-    float h = bme.readHumidity();
-    static float h_mem;
-    if (isnan(h))
-    {
-        Serial.println("Failed to read humidity from BME280 sensor ! Kept the old value");
-        return h_mem;
-    }
-    h_mem = h;
-    Serial.println("Read humidity : " + String(h) + "%");
-    return h;
-}
-
-float readBME280Pressure()
-{
-    float p = bme.readPressure() / 100.0F;
-    static float p_mem;
-    if (isnan(p))
-    {
-        Serial.println("Failed to read pressure from BME280 sensor ! Kept the old value");
-        return p_mem;
-    }
-    p_mem = p;
-    Serial.println("Read pressure : " + String(p) + "hPa");
-    return p;
-}
-
-float readBME280Altitude()
-{
-    float a = bme.readAltitude(SEALEVELPRESSURE_HPA);
-    static float a_mem;
-    if (isnan(a))
-    {
-        Serial.println("Failed to read altitude from BME280 sensor ! Kept the old value");
-        return a_mem;
-    }
-    a_mem = a;
-    Serial.println("Read altitude : " + String(a) + "m\n");
-    return a;
-}
-
 /**
- * @brief Read temperature and humidity from DHT11 sensor
+ * @brief Read every value from one BME280 measure, the sensor sleeps in between
  */
 void updateData()
 {
-    data.temperature = readBME280Temperature();
-    data.humidity    = readBME280Humidity();
-    data.pressure    = readBME280Pressure();
-    data.altitude    = readBME280Altitude();
+    Bme280_reading reading;
+    if (!bme.read(reading))
+    {
+        Serial.println("Failed to read BME280 sensor ! Kept the old values");
+    }
+
+    data.temperature = reading.temperature;
+    data.humidity    = reading.humidity;
+    data.pressure    = reading.pressure;
+    data.altitude    = reading.altitude;
+    data.dew_point   = reading.dew_point;
+    bme.print(Serial, reading);
+    Serial.println();
 }
 
 void setup()
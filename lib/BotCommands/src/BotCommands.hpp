@@ -0,0 +1,199 @@
+#ifndef BOT_COMMANDS_HPP
+#define BOT_COMMANDS_HPP
+
+#include <stddef.h>
+#include <string.h>
+
+/***********************************************************************
+ * @brief One command of a Telegram bot
+ * @tparam Context What the handlers of a project need (chat, reply, ...)
+ ***********************************************************************/
+template <typename Context>
+struct Bot_command_entry
+{
+    const char *name;                                     // With the leading '/'
+    const char *help;                                     // Shown by /help, NULL to hide the command
+    void      (*handler)(Context &context, const char *args);
+};
+
+namespace BotCommands
+{
+    /***********************************************************************
+     * @brief strcmp usable at compile time
+     ***********************************************************************/
+    constexpr int compare(const char *a, const char *b)
+    {
+        return ((*a != *b) || (*a == '\0')) ? ((int)(unsigned char)*a - (int)(unsigned char)*b) : compare(a + 1, b + 1);
+    }
+
+    /***********************************************************************
+     * @brief Check at compile time that a table is sorted by name, without duplicates
+     ***********************************************************************/
+    template <typename Context, size_t N>
+    constexpr bool sorted(const Bot_command_entry<Context> (&table)[N], const size_t idx = 1)
+    {
+        return (idx >= N) || ((compare(table[idx - 1].name, table[idx].name) < 0) && sorted(table, idx + 1));
+    }
+}
+
+/***********************************************************************
+ * @brief Finds and runs the handler of a message by binary search in a sorted table
+ *
+ * The table is a constexpr array checked with BotCommands::sorted(), so
+ * a command costs O(log N) comparisons and no String. "/cmd@bot_name args"
+ * is accepted, as sent by Telegram in groups, and the handler gets "args"
+ * without the surrounding spaces.
+ * @tparam Context What the handlers of a project need
+ * @tparam N Number of commands
+ ***********************************************************************/
+template <typename Context, size_t N>
+class CommandTable
+{
+    public:
+        typedef Bot_command_entry<Context> Entry;
+
+        explicit constexpr CommandTable(const Entry (&table)[N]) : _table(table) {}
+
+        /***********************************************************************
+         * @brief Find the command of a message
+         * @param text Message received
+         * @param args Where to store the start of the arguments, never NULL
+         * @return NULL if the message is not a known command
+         ***********************************************************************/
+        const Entry *find(const char *text, const char *&args) const
+        {
+            while(*text == ' ')
+            {
+                text++;
+            }
+
+            // The name ends at the first space or at "@bot_name"
+            size_t length = 0;
+            while((text[length] != '\0') && (text[length] != ' ') && (text[length] != '@'))
+            {
+                length++;
+            }
+
+            args = text + length;
+            while((*args != '\0') && (*args != ' '))
+            {
+                args++;
+            }
+            while(*args == ' ')
+            {
+                args++;
+            }
+
+            size_t low  = 0;
+            size_t high = N;
+            while(low < high)
+            {
+                const size_t middle = low + (high - low) / 2;
+                int          diff   = strncmp(_table[middle].name, text, length);
+                if((diff == 0) && (_table[middle].name[length] != '\0'))
+                {
+                    diff = 1;
+                }
+
+                if(diff == 0)
+                {
+                    return &_table[middle];
+                }
+                if(diff < 0)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            return NULL;
+        }
+
+        /***********************************************************************
+         * @brief Run the handler of a message
+         * @param context Passed to the handler
+         * @param text Message received
+         * @return False if the message is not a known command
+         ***********************************************************************/
+        bool dispatch(Context &context, const char *text) const
+        {
+            const char  *args;
+            const Entry *entry = find(text, args);
+            if(entry == NULL)
+            {
+                return false;
+            }
+            entry->handler(context, args);
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Append one line per visible command: "<name> <help> \n", sorted by name
+         * @param out String or anything with a += operator taking a C string
+         ***********************************************************************/
+        template <typename Out>
+        void help(Out &out) const
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                helpLine(out, _table[i]);
+            }
+        }
+
+        /***********************************************************************
+         * @brief Append one line per visible command in a display order
+         * @param out String or anything with a += operator taking a C string
+         * @param order Names of the commands in the order to show them, the
+         *        commands left out follow, sorted by name
+         ***********************************************************************/
+        template <typename Out, size_t M>
+        void help(Out &out, const char *const (&order)[M]) const
+        {
+            const char *args;
+            for (size_t i = 0; i < M; i++)
+            {
+                const Entry *entry = find(order[i], args);
+                if(entry != NULL)
+                {
+                    helpLine(out, *entry);
+                }
+            }
+
+            for (size_t i = 0; i < N; i++)
+            {
+                bool listed = false;
+                for (size_t j = 0; (j < M) && (listed == false); j++)
+                {
+                    listed = (strcmp(_table[i].name, order[j]) == 0);
+                }
+                if(listed == false)
+                {
+                    helpLine(out, _table[i]);
+                }
+            }
+        }
+
+        static constexpr size_t size()
+        {
+            return N;
+        }
+
+    private:
+        template <typename Out>
+        static void helpLine(Out &out, const Entry &entry)
+        {
+            if(entry.help != NULL)
+            {
+                out += entry.name;
+                out += " ";
+                out += entry.help;
+                out += " \n";
+            }
+        }
+
+        const Entry (&_table)[N];
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef CLOCK_SERVICE_HPP
+#define CLOCK_SERVICE_HPP
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "DisciplinedClock.hpp"
+
+#define CLOCK_SERVER            "pool.ntp.org"
+#define CLOCK_NTP_PORT          123
+#define CLOCK_LOCAL_PORT        2390       // UDP port the answers come back to
+#define CLOCK_SYNC_MS           300000     // Time between two syncs once the clock is set
+#define CLOCK_RETRY_MS          2000       // Time before trying again after a failure
+#define CLOCK_TIMEOUT_MS        1000       // Longest wait for an answer
+#define CLOCK_MAX_RTT_US        500000     // Answers slower than this are too vague to be used
+#define CLOCK_STACK_SIZE        4096       // Stack of the sync task
+#define CLOCK_NTP_PACKET        48         // Size of an NTP packet without extensions
+#define CLOCK_NTP_EPOCH         2208988800UL // Seconds between 1900 and 1970
+
+/***********************************************************************
+ * @brief Keeps the time from NTP in the background
+ *
+ * A task asks the server every CLOCK_SYNC_MS and disciplines the local
+ * esp_timer with the answers, see DisciplinedClock. Reading the time never
+ * touches the network, it costs a few instructions and has µs resolution.
+ * The answer time is computed from the four NTP timestamps, so the round
+ * trip does not bias it.
+ * @tparam UDP WiFiUDP on the board, NtpStandIn in host tests
+ ***********************************************************************/
+template <typename UDP>
+class ClockService
+{
+    public:
+        explicit ClockService(UDP &udp) : _udp(udp), _server(CLOCK_SERVER), _interval(CLOCK_SYNC_MS), _offset(0) {}
+
+        /***********************************************************************
+         * @brief Start syncing in the background, WiFi must be connected
+         * @param server NTP server, must live as long as the service
+         * @param interval Time between two syncs in ms
+         * @return False if the task cannot be created
+         ***********************************************************************/
+        bool begin(const char *server = CLOCK_SERVER, const uint32_t interval = CLOCK_SYNC_MS)
+        {
+            _server   = server;
+            _interval = interval;
+            _udp.begin(CLOCK_LOCAL_PORT);
+            return xTaskCreate(task, "clock", CLOCK_STACK_SIZE, this, 1, NULL) == pdPASS;
+        }
+
+        /***********************************************************************
+         * @brief Time zone, added to every time read
+         * @param seconds Offset from UTC in seconds
+         ***********************************************************************/
+        void setOffset(const int32_t seconds)
+        {
+            _offset = seconds;
+        }
+
+        /***********************************************************************
+         * @return Epoch in seconds with the offset, time since boot until the first sync
+         ***********************************************************************/
+        uint32_t now() const
+        {
+            return (uint32_t)(nowMicros() / 1000000) + _offset;
+        }
+
+        /***********************************************************************
+         * @return UTC epoch in µs, time since boot until the first sync
+         ***********************************************************************/
+        int64_t nowMicros() const
+        {
+            return _clock.at(esp_timer_get_time());
+        }
+
+        bool synced() const
+        {
+            return _clock.synced();
+        }
+
+        /***********************************************************************
+         * @return Seconds since the last sync, UINT32_MAX if never synced
+         ***********************************************************************/
+        uint32_t age() const
+        {
+            return _clock.age(esp_timer_get_time());
+        }
+
+        /***********************************************************************
+         * @return True if synced and no more than three syncs were missed
+         ***********************************************************************/
+        bool healthy() const
+        {
+            return age() <= (4 * (_interval / 1000));
+        }
+
+        const Clock_health &health() const
+        {
+            return _clock.health();
+        }
+
+        /***********************************************************************
+         * @brief Ask the server once and correct the clock with the answer
+         * @return False if there is no answer or it cannot be trusted
+         * @note Called by the task, only call it directly if begin() is not used
+         ***********************************************************************/
+        bool sync()
+        {
+            uint8_t packet[CLOCK_NTP_PACKET] = {0};
+
+            // Drop late answers to a previous request
+            while(_udp.parsePacket() > 0)
+            {
+                _udp.flush();
+            }
+
+            // Version 4, client. Our send time goes in the transmit timestamp and
+            // comes back as the origin, which pairs the answer with this request.
+            packet[0]          = 0x23;
+            const int64_t sent = esp_timer_get_time();
+            writeU64(&packet[40], (uint64_t)sent);
+
+            if((_udp.beginPacket(_server, CLOCK_NTP_PORT) == 0) || (_udp.write(packet, sizeof(packet)) != sizeof(packet)) || (_udp.endPacket() == 0))
+            {
+                _clock.failed();
+                return false;
+            }
+
+            int64_t received = 0;
+            while(received == 0)
+            {
+                if(_udp.parsePacket() >= CLOCK_NTP_PACKET)
+                {
+                    received = esp_timer_get_time();
+                    _udp.read(packet, sizeof(packet));
+                }
+                else if(esp_timer_get_time() - sent > CLOCK_TIMEOUT_MS * 1000LL)
+                {
+                    _clock.failed();
+                    return false;
+                }
+                else
+                {
+                    delay(1);
+                }
+            }
+
+            // Server mode, synchronized, stratum 1 to 15, answer to this request
+            if(((packet[0] & 0x07) != 4) || ((packet[0] >> 6) == 3) || (packet[1] == 0) || (packet[1] > 15) || (readU64(&packet[24]) != (uint64_t)sent))
+            {
+                _clock.failed();
+                return false;
+            }
+
+            // Server receive and transmit times, the round trip excludes the time spent in the server
+            const int64_t serverReceived = ntpToMicros(&packet[32]);
+            const int64_t serverSent     = ntpToMicros(&packet[40]);
+            int64_t       rtt            = (received - sent) - (serverSent - serverReceived);
+            rtt                          = (rtt < 0) ? 0 : rtt;
+            if(rtt > CLOCK_MAX_RTT_US)
+            {
+                _clock.failed();
+                return false;
+            }
+
+            _clock.sync(received, serverSent + rtt / 2, (uint32_t)rtt);
+            return true;
+        }
+
+    private:
+        static void task(void *arg)
+        {
+            ClockService *self = (ClockService *)arg;
+            for(;;)
+            {
+                const bool ok = self->sync();
+                vTaskDelay(pdMS_TO_TICKS(ok ? self->_interval : CLOCK_RETRY_MS));
+            }
+        }
+
+        /***********************************************************************
+         * @brief Convert an NTP timestamp to the Unix epoch in µs
+         * @note Seconds below CLOCK_NTP_EPOCH belong to the era starting in 2036
+         ***********************************************************************/
+        static int64_t ntpToMicros(const uint8_t *p)
+        {
+            const uint32_t seconds  = readU32(p);
+            const uint32_t fraction = readU32(p + 4);
+            const int64_t  epoch    = (seconds >= CLOCK_NTP_EPOCH) ? (int64_t)(seconds - CLOCK_NTP_EPOCH) : (int64_t)seconds + (1LL << 32) - CLOCK_NTP_EPOCH;
+            return epoch * 1000000 + (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+        }
+
+        static uint32_t readU32(const uint8_t *p)
+        {
+            return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+
+        static uint64_t readU64(const uint8_t *p)
+        {
+            return ((uint64_t)readU32(p) << 32) | readU32(p + 4);
+        }
+
+        static void writeU64(uint8_t *p, const uint64_t value)
+        {
+            for (uint8_t i = 0; i < 8; i++)
+            {
+                p[i] = (uint8_t)(value >> (56 - 8 * i));
+            }
+        }
+
+        UDP              &_udp;
+        DisciplinedClock  _clock;
+        const char       *_server;
+        uint32_t          _interval;
+        int32_t           _offset;
+};
+
+#endif
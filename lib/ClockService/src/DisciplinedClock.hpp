@@ -0,0 +1,181 @@
+#ifndef DISCIPLINED_CLOCK_HPP
+#define DISCIPLINED_CLOCK_HPP
+
+#include <atomic>
+#include <stdint.h>
+
+#define CLOCK_STEP_US           128000     // Errors above this are stepped at once and do not train the drift
+#define CLOCK_MIN_DRIFT_US      10000000   // Shortest time between two syncs used to measure the drift
+#define CLOCK_MAX_DRIFT_PPB     500000     // Crystals are within 500 ppm, anything above is noise
+#define CLOCK_DRIFT_GAIN        2          // Each measure moves the drift 1 / CLOCK_DRIFT_GAIN of the way
+
+// Sync statistics of a clock
+typedef struct
+{
+    uint32_t syncs;                 // Samples accepted
+    uint32_t failures;              // Queries that got no usable answer
+    uint32_t steps;                 // Samples too far from the clock, stepped without training the drift
+    int32_t  last_error_us;         // Clock minus reference at the last sync, before correcting
+    int32_t  drift_ppb;             // Estimated speed error of the local clock, positive if it is slow
+    uint32_t last_rtt_us;           // Round trip of the last accepted query
+    int64_t  last_sync_us;          // Local time of the last sync, 0 if never
+} Clock_health;
+
+/***********************************************************************
+ * @brief Epoch time from a local monotonic clock corrected by a reference
+ *
+ * Each reference sample sets the phase and, when far enough from the
+ * previous one, nudges the drift estimate so the clock stays close to the
+ * reference between syncs. Reading the time is a subtraction, a multiply
+ * and a shift on a snapshot published with release ordering, so readers
+ * on any task never lock. A sequence per snapshot catches the rare reader
+ * that is held so long that the writer reuses the snapshot it reads.
+ * @note sync() and failed() must only be called from one task
+ ***********************************************************************/
+class DisciplinedClock
+{
+    public:
+        DisciplinedClock() : _sequences{{0}, {0}}, _active(0), _synced(false)
+        {
+            _bases[0] = {0, 0, 0};
+            _bases[1] = {0, 0, 0};
+            _health   = {0, 0, 0, 0, 0, 0, 0};
+        }
+
+        /***********************************************************************
+         * @param local Local monotonic time in µs
+         * @return Epoch in µs, time since boot until the first sync
+         ***********************************************************************/
+        int64_t at(const int64_t local) const
+        {
+            const Base    base = snapshot();
+            const int64_t dt   = local - base.local;
+            return base.epoch + dt + ((dt * base.skew) >> 32);
+        }
+
+        /***********************************************************************
+         * @brief Correct the clock with a reference sample
+         * @param local Local time in µs at which the reference was valid
+         * @param epoch Reference epoch in µs
+         * @param rtt Round trip of the query, only kept for the statistics
+         ***********************************************************************/
+        void sync(const int64_t local, const int64_t epoch, const uint32_t rtt)
+        {
+            int64_t error = at(local) - epoch;
+            int32_t drift = _health.drift_ppb;
+
+            // Before the first sync the clock counts from boot, its error means nothing
+            const bool first = (_synced.load(std::memory_order_relaxed) == false);
+            if(first == true)
+            {
+                error = 0;
+            }
+            else if((error > CLOCK_STEP_US) || (error < -CLOCK_STEP_US))
+            {
+                _health.steps++;
+            }
+            else if(local - _health.last_sync_us >= CLOCK_MIN_DRIFT_US)
+            {
+                // The clock ran error µs too far over the interval
+                const int64_t measured = -(error * 1000000000LL) / (local - _health.last_sync_us);
+                drift += (int32_t)(measured / CLOCK_DRIFT_GAIN);
+                drift  = (drift > CLOCK_MAX_DRIFT_PPB) ? CLOCK_MAX_DRIFT_PPB : drift;
+                drift  = (drift < -CLOCK_MAX_DRIFT_PPB) ? -CLOCK_MAX_DRIFT_PPB : drift;
+            }
+
+            // Write the unused snapshot between two sequence bumps, then publish it
+            const uint8_t  next     = _active.load(std::memory_order_relaxed) ^ 1;
+            const uint32_t sequence = _sequences[next].load(std::memory_order_relaxed);
+            _sequences[next].store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bases[next].local = local;
+            _bases[next].epoch = epoch;
+            _bases[next].skew  = ((int64_t)drift << 32) / 1000000000LL;
+            _sequences[next].store(sequence + 2, std::memory_order_release);
+            _active.store(next, std::memory_order_release);
+
+            // Only once a reader can see the synced snapshot
+            if(first == true)
+            {
+                _synced.store(true, std::memory_order_release);
+            }
+
+            _health.syncs++;
+            _health.last_error_us = (int32_t)((error > INT32_MAX) ? INT32_MAX : ((error < INT32_MIN) ? INT32_MIN : error));
+            _health.drift_ppb     = drift;
+            _health.last_rtt_us   = rtt;
+            _health.last_sync_us  = local;
+        }
+
+        /***********************************************************************
+         * @brief Count a query that got no usable answer
+         ***********************************************************************/
+        void failed()
+        {
+            _health.failures++;
+        }
+
+        bool synced() const
+        {
+            return _synced.load(std::memory_order_acquire);
+        }
+
+        /***********************************************************************
+         * @param local Local time in µs
+         * @return Seconds since the last sync, UINT32_MAX if never synced
+         ***********************************************************************/
+        uint32_t age(const int64_t local) const
+        {
+            return (synced() == true) ? (uint32_t)((local - _health.last_sync_us) / 1000000) : UINT32_MAX;
+        }
+
+        /***********************************************************************
+         * @note Written by the syncing task, a reader may see a sync half counted
+         ***********************************************************************/
+        const Clock_health &health() const
+        {
+            return _health;
+        }
+
+    private:
+        // Reference point of the clock
+        typedef struct
+        {
+            int64_t local;          // Local time of the last sync in µs
+            int64_t epoch;          // Epoch at that time in µs
+            int64_t skew;           // Drift as a fraction of 2^32
+        } Base;
+
+        /***********************************************************************
+         * @brief Copy of the active snapshot
+         *
+         * The writer never touches the active snapshot, so a copy only has to
+         * be taken again when the reader was held across two syncs and the
+         * slot it read was reused. Syncs are minutes apart, the loop never
+         * waits for the writer: it moves to the new active snapshot.
+         ***********************************************************************/
+        Base snapshot() const
+        {
+            for(;;)
+            {
+                const uint8_t  idx    = _active.load(std::memory_order_acquire);
+                const uint32_t before = _sequences[idx].load(std::memory_order_acquire);
+                const Base     base   = _bases[idx];
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(((before & 1) == 0) && (_sequences[idx].load(std::memory_order_relaxed) == before))
+                {
+                    return base;
+                }
+            }
+        }
+
+        // Two snapshots, readers use the active one while the other is written.
+        // A sequence per snapshot is odd while it is written.
+        Base                  _bases[2];
+        std::atomic<uint32_t> _sequences[2];
+        std::atomic<uint8_t>  _active;
+        std::atomic<bool>     _synced;
+        Clock_health          _health;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef NTP_STAND_IN_HPP
+#define NTP_STAND_IN_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <esp_timer.h>
+
+/***********************************************************************
+ * @brief Local NTP server behind the subset of WiFiUDP used by ClockService
+ *
+ * Lets the clock be tested on a host without network: the test moves
+ * esp_timer_get_time() (delay() must move it too) and gives the server an
+ * offset, a drift and a one way delay, then checks what
+ * ClockService<NtpStandIn> reads. An answer is only seen once the round
+ * trip has passed.
+ ***********************************************************************/
+class NtpStandIn
+{
+    public:
+        int64_t  epoch_us;          // Server epoch when the local clock reads 0
+        int32_t  drift_ppb;         // How fast the server runs compared to the local clock
+        uint32_t delay_us;          // One way delay of the network, both directions
+        uint32_t process_us;        // Time the server holds a request
+        uint8_t  stratum;           // 0 to answer as an unsynchronized server
+        bool     answer;            // False to drop the requests
+        uint32_t requests;          // Requests received
+
+        NtpStandIn() : epoch_us(1700000000LL * 1000000), drift_ppb(0), delay_us(0), process_us(0), stratum(2), answer(true), requests(0), _length(0), _pending(false), _readyAt(0) {}
+
+        /***********************************************************************
+         * @return Time of the server for a local time, in µs since 1970
+         ***********************************************************************/
+        int64_t serverTime(const int64_t local) const
+        {
+            return epoch_us + local + (local * drift_ppb) / 1000000000LL;
+        }
+
+        uint8_t begin(const uint16_t)
+        {
+            return 1;
+        }
+
+        int beginPacket(const char *, const uint16_t)
+        {
+            _length = 0;
+            return 1;
+        }
+
+        size_t write(const uint8_t *buffer, const size_t size)
+        {
+            const size_t length = (size < sizeof(_packet) - _length) ? size : sizeof(_packet) - _length;
+            memcpy(&_packet[_length], buffer, length);
+            _length += length;
+            return length;
+        }
+
+        /***********************************************************************
+         * @brief Answer the request, timestamps as if the network delay had passed
+         ***********************************************************************/
+        int endPacket()
+        {
+            requests++;
+            if((answer == false) || (_length < 48))
+            {
+                return 1;
+            }
+
+            const int64_t local = esp_timer_get_time();
+            memcpy(&_packet[24], &_packet[40], 8);
+            _packet[0] = 0x24;      // Version 4, server
+            _packet[1] = stratum;
+            writeTimestamp(&_packet[32], serverTime(local + delay_us));
+            writeTimestamp(&_packet[40], serverTime(local + delay_us + process_us));
+            _pending = true;
+            _readyAt = local + 2 * (int64_t)delay_us + process_us;
+            return 1;
+        }
+
+        int parsePacket()
+        {
+            return ((_pending == true) && (esp_timer_get_time() >= _readyAt)) ? 48 : 0;
+        }
+
+        int read(uint8_t *buffer, const size_t size)
+        {
+            const size_t length = (size < 48) ? size : 48;
+            memcpy(buffer, _packet, length);
+            _pending = false;
+            return (int)length;
+        }
+
+        void flush()
+        {
+            _pending = false;
+        }
+
+    private:
+        static void writeTimestamp(uint8_t *p, const int64_t epoch)
+        {
+            const uint32_t seconds  = (uint32_t)(epoch / 1000000 + 2208988800LL);
+            const uint32_t fraction = (uint32_t)((((uint64_t)(epoch % 1000000)) << 32) / 1000000);
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                p[i]     = (uint8_t)(seconds >> (24 - 8 * i));
+                p[i + 4] = (uint8_t)(fraction >> (24 - 8 * i));
+            }
+        }
+
+        uint8_t _packet[48];
+        size_t  _length;
+        bool    _pending;
+        int64_t _readyAt;           // Local time the answer arrives
+};
+
+#endif
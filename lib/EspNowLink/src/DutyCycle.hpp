@@ -0,0 +1,252 @@
+#ifndef DUTY_CYCLE_HPP
+#define DUTY_CYCLE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "NodeFrame.hpp"
+#include "SampleBatch.hpp"
+
+#define DUTY_MAGIC              0x59545544 // "DUTY", set once the state survived a first wake
+#define DUTY_MAX_SAMPLES        44         // Two full delta batches, kept while the gateway does not ack
+#define DUTY_UNSYNCED_AFTER     3          // Syncs failed before the first one, past which samples are sent with FRAME_NO_TIME
+
+// How a node wakes, measures and sends
+typedef struct
+{
+    uint8_t  node;                  // Id of the node, the room it measures
+    uint32_t period_s;              // Time between two wakes
+    uint8_t  send_every;            // Wakes between two sends, 1 to send each sample
+    uint8_t  batch_size;            // Samples per frame, see SampleBatch
+    bool     delta;                 // Delta encode the batches
+    uint32_t resync_s;              // Time between two syncs of the clock
+} Duty_config;
+
+// Everything a node keeps from one wake to the next, to place in RTC memory
+typedef struct
+{
+    uint32_t     magic;             // DUTY_MAGIC, anything else is a cold boot
+    uint32_t     wakes;             // Wakes since the cold boot, this one included
+    uint16_t     sequence;          // Sequence number of the next frame
+    uint8_t      count;             // Samples waiting to be sent
+    bool         synced;            // True once the clock was set once
+    int64_t      next_wake_us;      // Local time of the next wake, the period does not slip with the awake time
+    int64_t      clock_us;          // Local time of the last sync
+    int64_t      epoch_us;          // Epoch at that time, the clock counts from the cold boot until the first sync
+    int64_t      sync_tried_us;     // Local time of the last sync, failed or not, a failure is retried after resync_s
+    uint32_t     last_rtt_us;       // Round trip of the last frame, 0 if it was not acked
+    uint32_t     last_awake_us;     // Wake to sleep of the last wake
+    uint32_t     max_awake_us;
+    uint64_t     awake_us;          // Total time awake since the cold boot
+    uint32_t     frames;            // Frames acked
+    uint32_t     failed_sends;      // Frames not acked, their samples are sent again
+    uint32_t     failed_syncs;
+    uint32_t     dropped;           // Samples lost because the buffer was full
+    Batch_sample samples[DUTY_MAX_SAMPLES];
+} Duty_state;
+
+/***********************************************************************
+ * @brief One wake of a battery node, from its boot to the next deep sleep
+ *
+ * Every wake takes one sample and keeps it in the state, which survives
+ * deep sleep in RTC memory. The radio is only used every send_every
+ * wakes, to send the samples in as few frames as possible. Samples not
+ * acked wait for the next send, the oldest ones are dropped when the
+ * buffer is full. The clock is the local one of the board, which keeps
+ * running through deep sleep, set by syncTime() at the cold boot and
+ * every resync_s. A time request is a frame too, it takes the next
+ * sequence number so the gateway sees no gap. Until the first sync the
+ * samples are dated from the cold boot, so they are kept, and dated
+ * again once the clock is set. A gateway that never gives the time, like
+ * the Receiver example, would keep them forever: after DUTY_UNSYNCED_AFTER
+ * failed syncs they are sent with FRAME_NO_TIME, and dated by the gateway
+ * on receipt, up to send_every periods late.
+ *
+ * The object holds nothing, it is built again on each boot around the
+ * same state, so a host test can run it in a loop.
+ * @tparam Board Board of the node, SimulatedNode in host tests. It gives:
+ *   - int64_t clockUs() local time in µs, running through deep sleep
+ *   - uint32_t awakeUs() time since the wake in µs
+ *   - bool syncTime(const Frame_header &header, int64_t &epochUs) epoch in µs now, false if
+ *     unknown, asked with a frame using the header, see TimeClient
+ *   - bool measure(Batch_sample &sample) one sample, the time is set here
+ *   - bool send(const uint8_t *frame, size_t length, uint32_t &rttUs) false if not acked
+ *   - void sleep(uint64_t us) deep sleep, only returns in host tests
+ ***********************************************************************/
+template <typename Board>
+class DutyCycle
+{
+    public:
+        DutyCycle(Board &board, Duty_state &state, const Duty_config &config) : _board(board), _state(state), _config(config) {}
+
+        /***********************************************************************
+         * @brief Sync if due, take a sample and send the buffer if due
+         * @return True if frames were sent on this wake
+         ***********************************************************************/
+        bool wake()
+        {
+            if(_state.magic != DUTY_MAGIC)
+            {
+                memset(&_state, 0, sizeof(_state));
+                _state.magic        = DUTY_MAGIC;
+                _state.next_wake_us = _board.clockUs();
+            }
+            _state.wakes++;
+
+            const bool sendDue = (_state.wakes % _config.send_every == 0);
+            const bool syncDue = (_state.synced == true) ? (_board.clockUs() - _state.sync_tried_us >= (int64_t)_config.resync_s * 1000000) : ((_state.wakes == 1) || (sendDue == true));
+            if(syncDue == true)
+            {
+                sync();
+            }
+
+            Batch_sample sample;
+            if(_board.measure(sample) == true)
+            {
+                sample.time = (uint32_t)(epochUs() / 1000000);
+                store(sample);
+            }
+
+            const bool sendable = (_state.synced == true) || (_state.failed_syncs >= DUTY_UNSYNCED_AFTER);
+            if((sendDue == false) || (_state.count == 0) || (sendable == false))
+            {
+                return false;
+            }
+            flush();
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Account for the awake time and sleep until the next wake
+         ***********************************************************************/
+        void sleep()
+        {
+            const uint32_t awake    = _board.awakeUs();
+            _state.last_awake_us    = awake;
+            _state.max_awake_us     = (awake > _state.max_awake_us) ? awake : _state.max_awake_us;
+            _state.awake_us        += awake;
+
+            // Skip the wakes already missed, a long sync must not shorten the next sleeps
+            const int64_t period = (int64_t)_config.period_s * 1000000;
+            const int64_t now    = _board.clockUs();
+            _state.next_wake_us += period;
+            if(_state.next_wake_us <= now)
+            {
+                _state.next_wake_us += ((now - _state.next_wake_us) / period + 1) * period;
+            }
+            _board.sleep(_state.next_wake_us - now);
+        }
+
+        void run()
+        {
+            wake();
+            sleep();
+        }
+
+        /***********************************************************************
+         * @return Epoch in µs, time since the cold boot until the first sync
+         ***********************************************************************/
+        int64_t epochUs() const
+        {
+            return _state.epoch_us + (_board.clockUs() - _state.clock_us);
+        }
+
+        const Duty_state &state() const
+        {
+            return _state;
+        }
+
+    private:
+        void sync()
+        {
+            Frame_header header;
+            int64_t      epoch = 0;
+            memset(&header, 0, sizeof(header));
+            header.node          = _config.node;
+            header.sequence      = _state.sequence++;
+            header.timestamp     = (uint32_t)(epochUs() / 1000000);
+            _state.sync_tried_us = _board.clockUs();
+            if(_board.syncTime(header, epoch) == false)
+            {
+                _state.failed_syncs++;
+                return;
+            }
+            _state.clock_us = _board.clockUs();
+            _state.epoch_us = epoch;
+
+            // Samples kept so far count from the cold boot, like the clock did
+            if(_state.synced == false)
+            {
+                const int64_t shift = (epoch - _state.clock_us) / 1000000;
+                for (uint8_t i = 0; i < _state.count; i++)
+                {
+                    _state.samples[i].time += (uint32_t)shift;
+                }
+            }
+            _state.synced = true;
+        }
+
+        void store(const Batch_sample &sample)
+        {
+            if(_state.count >= DUTY_MAX_SAMPLES)
+            {
+                memmove(&_state.samples[0], &_state.samples[1], (DUTY_MAX_SAMPLES - 1) * sizeof(Batch_sample));
+                _state.count--;
+                _state.dropped++;
+            }
+            _state.samples[_state.count++] = sample;
+        }
+
+        /***********************************************************************
+         * @brief Send the buffered samples, stop at the first frame not acked
+         ***********************************************************************/
+        void flush()
+        {
+            Frame_header header;
+            uint8_t      sent = 0;
+            memset(&header, 0, sizeof(header));
+            header.node = _config.node;
+
+            while(sent < _state.count)
+            {
+                SampleBatch batch(_config.batch_size, _config.delta);
+                uint8_t     added = 0;
+                while(sent + added < _state.count)
+                {
+                    // Never synced: the gateway dates the samples instead
+                    Batch_sample sample = _state.samples[sent + added];
+                    sample.time         = (_state.synced == true) ? sample.time : FRAME_NO_TIME;
+                    if(batch.add(sample) == false)
+                    {
+                        break;
+                    }
+                    added++;
+                }
+
+                uint8_t frame[FRAME_MAX_SIZE];
+                header.sequence     = _state.sequence++;
+                header.rtt_us       = _state.last_rtt_us;
+                const size_t length = batch.write(frame, sizeof(frame), header);
+
+                uint32_t rtt = 0;
+                if(_board.send(frame, length, rtt) == false)
+                {
+                    _state.last_rtt_us = 0;
+                    _state.failed_sends++;
+                    break;
+                }
+                _state.last_rtt_us = rtt;
+                _state.frames++;
+                sent += added;
+            }
+
+            memmove(&_state.samples[0], &_state.samples[sent], (_state.count - sent) * sizeof(Batch_sample));
+            _state.count -= sent;
+        }
+
+        Board             &_board;
+        Duty_state        &_state;
+        const Duty_config &_config;
+};
+
+#endif
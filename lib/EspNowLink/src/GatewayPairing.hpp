@@ -0,0 +1,173 @@
+#ifndef GATEWAY_PAIRING_HPP
+#define GATEWAY_PAIRING_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "NodeFrame.hpp"
+
+#define PAIR_MAGIC              0x52494150 // "PAIR", set once a gateway answered
+#define PAIR_CHANNELS           13         // WiFi channels probed, 1 to 13
+#define PAIR_MAX_FAILURES       3          // Frames not acked in a row before looking for the gateway again
+#define PAIR_MAX_BACKOFF        5          // Searches failed in a row past which the wait stops doubling, 2^5 chances
+
+// Gateway a node sends to, small enough for RTC memory and NVS
+typedef struct
+{
+    uint32_t magic;                 // PAIR_MAGIC when the gateway is known
+    uint8_t  mac[6];                // Address of the gateway
+    uint8_t  channel;               // WiFi channel of the gateway
+    uint8_t  failures;              // Frames not acked in a row since the last one acked
+    uint8_t  searches;              // Searches failed in a row, up to PAIR_MAX_BACKOFF
+    uint8_t  wait;                  // Chances to send left to skip before the next search
+} Pair_state;
+
+/***********************************************************************
+ * @brief Answer of the gateway to a FRAME_PAIR_PROBE
+ ***********************************************************************/
+class PairingReply
+{
+    public:
+        /***********************************************************************
+         * @brief Build a FRAME_PAIR
+         * @param buffer Where to build it
+         * @param size Size of the buffer
+         * @param header Header of the frame, type and node are set here
+         * @param mac Address of the gateway, the one its ESP-NOW frames come from
+         * @param channel WiFi channel of the gateway
+         * @return Size of the frame, 0 if the buffer is too small
+         ***********************************************************************/
+        static size_t write(uint8_t *buffer, const size_t size, Frame_header header, const uint8_t mac[6], const uint8_t channel)
+        {
+            Payload_pair payload;
+            memcpy(payload.mac, mac, sizeof(payload.mac));
+            payload.channel = channel;
+            header.type     = FRAME_PAIR;
+            header.node     = FRAME_GATEWAY;
+            return NodeFrame::write(buffer, size, header, payload);
+        }
+};
+
+/***********************************************************************
+ * @brief Finds the gateway of a node and the channel it is on
+ *
+ * The node broadcasts a FRAME_PAIR_PROBE on a channel and listens a few
+ * ms for the FRAME_PAIR of the gateway, first on the channel it knows,
+ * then on every other one: a full scan takes PAIR_CHANNELS answer
+ * timeouts. The pairing is kept in a Pair_state the node stores in RTC
+ * memory and NVS, so it sends at once after a boot. It is only looked
+ * for again after PAIR_MAX_FAILURES frames not acked in a row, when the
+ * gateway moved to another channel or was replaced. A failed search
+ * keeps the old pairing, the gateway may only be off, and doubles the
+ * chances to send until the next one, up to 2^PAIR_MAX_BACKOFF:
+ * a node without its gateway does not spend its time scanning. The
+ * backoff lives in the Pair_state, so it goes on through deep sleep.
+ *
+ * Probes are not counted by the gateway and carry no sequence number.
+ * @tparam Radio Radio of the node, SimulatedGateway in host tests. It gives:
+ *   - size_t exchange(uint8_t channel, const uint8_t *probe, size_t length, uint8_t *reply, size_t size)
+ *     broadcast the probe on the channel, then copy the first FRAME_PAIR received in
+ *     time in reply, return its size or 0
+ ***********************************************************************/
+template <typename Radio>
+class GatewayPairing
+{
+    public:
+        GatewayPairing(Radio &radio, Pair_state &state) : _radio(radio), _state(state) {}
+
+        bool paired() const
+        {
+            return _state.magic == PAIR_MAGIC;
+        }
+
+        /***********************************************************************
+         * @brief Tell if the gateway must be looked for before sending
+         * @return False while the last searches failed and the backoff runs,
+         *         each call then counts one chance to send skipped
+         * @note Call it once per chance to send, it stays true until discover()
+         ***********************************************************************/
+        bool due()
+        {
+            if((paired() == true) && (_state.failures < PAIR_MAX_FAILURES))
+            {
+                return false;
+            }
+            if(_state.wait > 0)
+            {
+                _state.wait--;
+                return false;
+            }
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Look for the gateway, the channel known first
+         * @param node Id of the node
+         * @return True if the gateway answered, the state then holds it
+         ***********************************************************************/
+        bool discover(const uint8_t node)
+        {
+            uint8_t      probe[sizeof(Frame_header) + FRAME_CRC_SIZE];
+            Frame_header header;
+            memset(&header, 0, sizeof(header));
+            header.type         = FRAME_PAIR_PROBE;
+            header.node         = node;
+            const size_t length = NodeFrame::write(probe, sizeof(probe), header, NULL, 0);
+            const uint8_t first = ((paired() == true) && (_state.channel >= 1) && (_state.channel <= PAIR_CHANNELS)) ? _state.channel : 1;
+
+            for (uint8_t i = 0; i < PAIR_CHANNELS; i++)
+            {
+                // The channel known, then the others in order
+                const uint8_t channel = (i == 0) ? first : ((i < first) ? i : i + 1);
+                uint8_t       reply[FRAME_MAX_SIZE];
+                const size_t  got     = _radio.exchange(channel, probe, length, reply, sizeof(reply));
+
+                const Frame_header *frame = NULL;
+                if((got == 0) || (NodeFrame::parse(reply, got, frame) != FRAME_OK) || (frame->type != FRAME_PAIR) || (frame->node != FRAME_GATEWAY))
+                {
+                    continue;
+                }
+                const Payload_pair *pair = NodeFrame::payload<Payload_pair>(frame);
+                if((pair == NULL) || (pair->channel < 1) || (pair->channel > PAIR_CHANNELS))
+                {
+                    continue;
+                }
+
+                // The channel of the answer, it may come late from the channel probed before
+                memcpy(_state.mac, pair->mac, sizeof(_state.mac));
+                _state.channel  = pair->channel;
+                _state.failures = 0;
+                _state.searches = 0;
+                _state.wait     = 0;
+                _state.magic    = PAIR_MAGIC;
+                return true;
+            }
+
+            // Wait twice as long before the next search
+            _state.searches = (_state.searches < PAIR_MAX_BACKOFF) ? _state.searches + 1 : PAIR_MAX_BACKOFF;
+            _state.wait     = (uint8_t)((1U << _state.searches) - 1);
+            return false;
+        }
+
+        /***********************************************************************
+         * @brief Account for a frame sent to the gateway
+         * @param acked True if the gateway acked it, the backoff then ends
+         ***********************************************************************/
+        void sent(const bool acked)
+        {
+            _state.failures = (acked == true) ? 0 : ((_state.failures < UINT8_MAX) ? _state.failures + 1 : _state.failures);
+            _state.searches = (acked == true) ? 0 : _state.searches;
+            _state.wait     = (acked == true) ? 0 : _state.wait;
+        }
+
+        const Pair_state &state() const
+        {
+            return _state;
+        }
+
+    private:
+        Radio      &_radio;
+        Pair_state &_state;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef NODE_FRAME_HPP
+#define NODE_FRAME_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FRAME_MAGIC             0x4E48     // "HN" on the air, little-endian
+#define FRAME_VERSION           1          // Changed each time the layout of a frame changes
+#define FRAME_MAX_SIZE          250        // Max size of an ESP-NOW frame
+#define FRAME_CRC_SIZE          2          // CRC-16 after the payload
+#define FRAME_AIR_OVERHEAD_US   556        // Preamble, SIFS, ack and DIFS of a frame, see airtimeUs()
+#define FRAME_AIR_BYTE_US       8          // Airtime of a byte at 1 Mbps, the rate of ESP-NOW
+#define FRAME_AIR_HEADER_SIZE   43         // MAC header, vendor element and FCS around the frame
+#define FRAME_GATEWAY           0xFF       // Node id of the frames sent by the gateway
+#define TIME_REPLY              0x01       // Flag of Payload_time answering a request
+#define FRAME_NO_TIME           0          // Time of a sample the node could not date, the gateway dates it on receipt
+
+// What the payload of a frame is
+enum Frame_type
+{
+    FRAME_BME280 = 1,               // Payload_bme280, one sample taken at the timestamp of the header
+    FRAME_BME280_BATCH = 2,         // Several samples, see SampleBatch
+    FRAME_TIME = 3,                 // Payload_time, sent by the gateway, see TimeSync
+    FRAME_TIME_REQUEST = 4,         // No payload, the gateway answers with FRAME_TIME
+    FRAME_PAIR_PROBE = 5,           // No payload, broadcast by a node looking for the gateway, see GatewayPairing
+    FRAME_PAIR = 6                  // Payload_pair, the gateway answering a probe
+};
+
+// Why a frame was rejected
+enum Frame_error
+{
+    FRAME_OK,
+    FRAME_TOO_SHORT,                // Shorter than a header and a CRC
+    FRAME_BAD_MAGIC,                // Not a frame of this protocol
+    FRAME_BAD_VERSION,              // Sent by a node with another layout
+    FRAME_BAD_LENGTH,               // Payload length does not match the frame size
+    FRAME_BAD_CRC                   // Corrupted
+};
+
+// Header of every frame, all fields are little-endian
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;                 // FRAME_MAGIC
+    uint8_t  version;               // FRAME_VERSION
+    uint8_t  type;                  // Frame_type of the payload
+    uint8_t  node;                  // Id of the sender, the room it measures
+    uint8_t  length;                // Size of the payload in bytes
+    uint16_t sequence;              // Incremented by the sender for each frame, starts at 0 on boot
+    uint32_t timestamp;             // Epoch in seconds on the sender clock
+    uint32_t rtt_us;                // Time the previous frame took to be acknowledged, 0 if unknown
+} Frame_header;
+
+// Payload of FRAME_BME280
+typedef struct __attribute__((packed))
+{
+    float temperature;              // °C
+    float humidity;                 // %
+    float pressure;                 // hPa
+    float altitude;                 // m
+} Payload_bme280;
+
+// Payload of FRAME_TIME
+typedef struct __attribute__((packed))
+{
+    int64_t  epoch_us;              // UTC epoch of the gateway when it built the frame
+    uint16_t request;               // Sequence number of the request answered
+    uint8_t  flags;                 // TIME_REPLY when answering a request, else a broadcast beacon
+} Payload_time;
+
+// Payload of FRAME_PAIR
+typedef struct __attribute__((packed))
+{
+    uint8_t mac[6];                 // Address of the gateway, where to send the frames
+    uint8_t channel;                // WiFi channel of the gateway, the one of its AP
+} Payload_pair;
+
+/***********************************************************************
+ * @brief Frames exchanged over ESP-NOW between the nodes and the gateway
+ *
+ * A frame is a Frame_header, a payload of header.length bytes and a
+ * CRC-16 of both. Every struct is packed, so the layout does not depend
+ * on the compiler nor on the board, and the receiver reads the fields
+ * where the radio left them, without copy.
+ ***********************************************************************/
+class NodeFrame
+{
+    public:
+        /***********************************************************************
+         * @brief Build a frame
+         * @param buffer Where to build it, FRAME_MAX_SIZE bytes are always enough
+         * @param size Size of the buffer
+         * @param header Header of the frame, magic, version and length are set here
+         * @param payload Payload of the frame, may be NULL if length is 0
+         * @param length Size of the payload
+         * @return Size of the frame, 0 if it does not fit
+         ***********************************************************************/
+        static size_t write(uint8_t *buffer, const size_t size, Frame_header header, const void *payload, const size_t length)
+        {
+            const size_t total = sizeof(Frame_header) + length + FRAME_CRC_SIZE;
+            if((total > size) || (total > FRAME_MAX_SIZE))
+            {
+                return 0;
+            }
+
+            header.magic   = FRAME_MAGIC;
+            header.version = FRAME_VERSION;
+            header.length  = length;
+            memcpy(buffer, &header, sizeof(Frame_header));
+            if(length > 0)
+            {
+                memcpy(buffer + sizeof(Frame_header), payload, length);
+            }
+
+            const uint16_t crc = crc16(buffer, total - FRAME_CRC_SIZE);
+            buffer[total - 2]  = crc & 0xFF;
+            buffer[total - 1]  = crc >> 8;
+            return total;
+        }
+
+        template <typename Payload>
+        static size_t write(uint8_t *buffer, const size_t size, const Frame_header &header, const Payload &payload)
+        {
+            return write(buffer, size, header, &payload, sizeof(Payload));
+        }
+
+        /***********************************************************************
+         * @brief Check a frame where it was received
+         * @param data Frame received
+         * @param len Size of the frame
+         * @param header Set to the header inside data when the frame is valid
+         * @return FRAME_OK or why the frame is rejected
+         ***********************************************************************/
+        static Frame_error parse(const uint8_t *data, const size_t len, const Frame_header *&header)
+        {
+            if((data == NULL) || (len < sizeof(Frame_header) + FRAME_CRC_SIZE))
+            {
+                return FRAME_TOO_SHORT;
+            }
+
+            const Frame_header *frame = (const Frame_header *)data;
+            if(frame->magic != FRAME_MAGIC)
+            {
+                return FRAME_BAD_MAGIC;
+            }
+            if(frame->version != FRAME_VERSION)
+            {
+                return FRAME_BAD_VERSION;
+            }
+            if(sizeof(Frame_header) + frame->length + FRAME_CRC_SIZE != len)
+            {
+                return FRAME_BAD_LENGTH;
+            }
+
+            const uint16_t crc = data[len - 2] | (data[len - 1] << 8);
+            if(crc16(data, len - FRAME_CRC_SIZE) != crc)
+            {
+                return FRAME_BAD_CRC;
+            }
+            header = frame;
+            return FRAME_OK;
+        }
+
+        /***********************************************************************
+         * @brief Get the payload of a valid frame, in place
+         * @param header Header given by parse()
+         * @return NULL if the payload does not have the size of Payload
+         ***********************************************************************/
+        template <typename Payload>
+        static const Payload *payload(const Frame_header *header)
+        {
+            if(header->length != sizeof(Payload))
+            {
+                return NULL;
+            }
+            return (const Payload *)(header + 1);
+        }
+
+        /***********************************************************************
+         * @brief Estimate the time a frame holds the channel
+         *
+         * At 1 Mbps with a long preamble: 192 us of preamble, the frame and its
+         * 802.11 headers, then SIFS, a 304 us ack, and DIFS before the next one.
+         * Backoff and retries are left out.
+         * @param length Size of the frame
+         * @return Airtime in us
+         ***********************************************************************/
+        static uint32_t airtimeUs(const size_t length)
+        {
+            return FRAME_AIR_OVERHEAD_US + (FRAME_AIR_HEADER_SIZE + length) * FRAME_AIR_BYTE_US;
+        }
+
+        /***********************************************************************
+         * @brief CRC-16/CCITT-FALSE
+         ***********************************************************************/
+        static uint16_t crc16(const uint8_t *data, const size_t len)
+        {
+            uint16_t crc = 0xFFFF;
+            for (size_t i = 0; i < len; i++)
+            {
+                crc ^= (uint16_t)data[i] << 8;
+                for (uint8_t bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+                }
+            }
+            return crc;
+        }
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef PEER_STATS_HPP
+#define PEER_STATS_HPP
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "NodeFrame.hpp"
+
+#define PEER_WINDOW             32         // Sequence numbers remembered behind the highest one, to tell late frames from duplicates
+#define PEER_MAX_GAP            1024       // A larger jump ahead is taken as a restart of the node
+#define PEER_RTT_SHIFT          3          // The mean RTT moves by 1/8 of each new gap, like the SRTT of TCP
+
+// What a node sent, seen by the receiver
+typedef struct
+{
+    uint8_t  mac[6];
+    uint8_t  node;                  // Id given in the last frame
+    uint32_t received;              // Frames accepted, late ones included
+    uint32_t lost;                  // Sequence numbers skipped and not received since
+    uint32_t duplicates;            // Frames received twice, ESP-NOW resends when an ack is lost
+    uint32_t reordered;             // Frames received after a later one
+    uint32_t restarts;              // Sequence numbers starting over, the node rebooted
+    uint32_t samples;               // Samples carried by the frames accepted
+    uint32_t airtime_us;            // Estimated airtime of every frame, duplicates included
+    uint32_t last_rtt_us;           // Round trips reported by the node, up to the ESP-NOW ack
+    uint32_t mean_rtt_us;
+    uint32_t max_rtt_us;
+} Peer_stats;
+
+// What to do with a frame, given its sequence number
+enum Peer_verdict
+{
+    PEER_NEXT,                      // In order, or the first one of the node
+    PEER_LATE,                      // Missed so far, arrived after a later one
+    PEER_RESTART,                   // First frame after a reboot of the node
+    PEER_DUPLICATE,                 // Already received, to drop
+    PEER_UNTRACKED                  // No room left to track the node, the frame is still good
+};
+
+/***********************************************************************
+ * @brief Loss, duplicate, reorder and RTT statistics of one node
+ *
+ * The highest sequence number received and a bitmap of the PEER_WINDOW
+ * ones before it are enough to classify every frame. A sequence number
+ * skipped is counted lost until it shows up late. Frame 0 is sent after
+ * a boot, unless the previous frame was 65535: while the window holds a
+ * 0 reached that way, a 0 behind the highest one is late or a duplicate.
+ ***********************************************************************/
+class PeerTracker
+{
+    public:
+        PeerTracker() : _highest(0), _window(0), _wrapped(false)
+        {
+            memset(&_stats, 0, sizeof(_stats));
+        }
+
+        void begin(const uint8_t mac[6])
+        {
+            memcpy(_stats.mac, mac, sizeof(_stats.mac));
+        }
+
+        /***********************************************************************
+         * @brief Account for a valid frame
+         * @param node Id of the node given in the frame
+         * @param sequence Sequence number of the frame
+         * @param rttUs Round trip reported by the node, 0 if unknown
+         * @param samples Samples carried by the frame
+         * @param length Size of the frame
+         * @return What to do with the frame
+         ***********************************************************************/
+        Peer_verdict track(const uint8_t node, const uint16_t sequence, const uint32_t rttUs, const uint8_t samples, const size_t length)
+        {
+            _stats.node        = node;
+            _stats.airtime_us += NodeFrame::airtimeUs(length);
+            addRtt(rttUs);
+
+            const Peer_verdict verdict = classify(sequence);
+            _stats.samples += (verdict != PEER_DUPLICATE) ? samples : 0;
+            return verdict;
+        }
+
+        const Peer_stats &stats() const
+        {
+            return _stats;
+        }
+
+    private:
+        Peer_verdict classify(const uint16_t sequence)
+        {
+            const int32_t ahead = (int16_t)(sequence - _highest);
+            if(_window == 0)
+            {
+                restart(sequence);
+                return PEER_NEXT;
+            }
+            if((ahead > 0) && (ahead <= PEER_MAX_GAP) && ((sequence != 0) || (ahead == 1)))
+            {
+                _stats.lost += ahead - 1;
+                _window      = (ahead < PEER_WINDOW) ? ((_window << ahead) | 1) : 1;
+                _wrapped     = (sequence < _highest) || ((_wrapped == true) && (sequence < PEER_WINDOW));
+                _highest     = sequence;
+                _stats.received++;
+                return PEER_NEXT;
+            }
+            if((ahead <= 0) && (-ahead < PEER_WINDOW) && ((sequence != 0) || (ahead == 0) || (_wrapped == true)))
+            {
+                const uint32_t bit = 1UL << (-ahead);
+                if(_window & bit)
+                {
+                    _stats.duplicates++;
+                    return PEER_DUPLICATE;
+                }
+                _window |= bit;
+                _stats.lost -= (_stats.lost > 0) ? 1 : 0;
+                _stats.reordered++;
+                _stats.received++;
+                return PEER_LATE;
+            }
+
+            _stats.restarts++;
+            restart(sequence);
+            return PEER_RESTART;
+        }
+
+        void restart(const uint16_t sequence)
+        {
+            _highest = sequence;
+            _window  = 1;
+            _wrapped = false;
+            _stats.received++;
+        }
+
+        void addRtt(const uint32_t rttUs)
+        {
+            if(rttUs == 0)
+            {
+                return;
+            }
+            _stats.last_rtt_us = rttUs;
+            _stats.max_rtt_us  = (rttUs > _stats.max_rtt_us) ? rttUs : _stats.max_rtt_us;
+            if(_stats.mean_rtt_us == 0)
+            {
+                _stats.mean_rtt_us = rttUs;
+            }
+            else
+            {
+                _stats.mean_rtt_us += ((int32_t)rttUs - (int32_t)_stats.mean_rtt_us) >> PEER_RTT_SHIFT;
+            }
+        }
+
+        Peer_stats _stats;
+        uint16_t   _highest;        // Highest sequence number received
+        uint32_t   _window;         // Bit i set if _highest - i was received
+        bool       _wrapped;        // The window reaches back to 65535 or before
+};
+
+/***********************************************************************
+ * @brief Statistics of every node, found by MAC address
+ *
+ * One task tracks the frames, any task may read the statistics: nodes
+ * are only added, and published once their address is set. Counters of
+ * a node are read without lock, each one is consistent on its own.
+ * @tparam N Max number of nodes tracked
+ ***********************************************************************/
+template <size_t N>
+class PeerTable
+{
+    public:
+        PeerTable() : _count(0) {}
+
+        /***********************************************************************
+         * @brief Account for a valid frame, adding its sender on its first frame
+         * @note Must only be called from one task
+         ***********************************************************************/
+        Peer_verdict track(const uint8_t mac[6], const uint8_t node, const uint16_t sequence, const uint32_t rttUs, const uint8_t samples, const size_t length)
+        {
+            const size_t count = _count.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; i++)
+            {
+                if(memcmp(_peers[i].stats().mac, mac, 6) == 0)
+                {
+                    return _peers[i].track(node, sequence, rttUs, samples, length);
+                }
+            }
+            if(count >= N)
+            {
+                return PEER_UNTRACKED;
+            }
+
+            _peers[count].begin(mac);
+            const Peer_verdict verdict = _peers[count].track(node, sequence, rttUs, samples, length);
+            _count.store(count + 1, std::memory_order_release);
+            return verdict;
+        }
+
+        size_t count() const
+        {
+            return _count.load(std::memory_order_acquire);
+        }
+
+        /***********************************************************************
+         * @param idx Index of the node, lower than count()
+         ***********************************************************************/
+        const Peer_stats &at(const size_t idx) const
+        {
+            return _peers[idx].stats();
+        }
+
+    private:
+        PeerTracker         _peers[N];
+        std::atomic<size_t> _count;
+};
+
+#endif
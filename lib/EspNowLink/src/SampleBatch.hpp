@@ -0,0 +1,382 @@
+#ifndef SAMPLE_BATCH_HPP
+#define SAMPLE_BATCH_HPP
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "NodeFrame.hpp"
+
+#define BATCH_SCALE             100        // Delta encoded values are kept in hundredths
+#define BATCH_MAX_VALUE         20000000.0F // Largest value delta encoded, its hundredths fit an int32 once rounded to a float
+#define BATCH_VALUES            4          // Temperature, humidity, pressure, altitude
+
+// How the samples of a batch are written
+enum Batch_encoding
+{
+    BATCH_RAW,                      // Batch_raw for each sample
+    BATCH_DELTA                     // Batch_base for the first sample, then Batch_delta from the previous one
+};
+
+// Start of the payload of FRAME_BME280_BATCH
+typedef struct __attribute__((packed))
+{
+    uint8_t count;                  // Number of samples
+    uint8_t encoding;               // Batch_encoding
+} Batch_header;
+
+// Sample as sent, the time is the timestamp of the frame plus offset
+typedef struct __attribute__((packed))
+{
+    uint16_t offset;                // Seconds since the first sample
+    float    values[BATCH_VALUES];
+} Batch_raw;
+
+typedef struct __attribute__((packed))
+{
+    uint16_t offset;
+    int32_t  values[BATCH_VALUES];  // Hundredths of the values
+} Batch_base;
+
+typedef struct __attribute__((packed))
+{
+    uint16_t offset;
+    int16_t  values[BATCH_VALUES];  // Hundredths added to the previous sample
+} Batch_delta;
+
+// Sample of a BME280 node with its time
+typedef struct
+{
+    uint32_t time;                  // Epoch in seconds
+    float    temperature;           // °C
+    float    humidity;              // %
+    float    pressure;              // hPa
+    float    altitude;              // m
+} Batch_sample;
+
+/***********************************************************************
+ * @brief Samples of a node buffered and sent in one ESP-NOW frame
+ *
+ * Most of the airtime of a frame is spent on the preamble, the headers
+ * and the ack (see NodeFrame::airtimeUs()), not on a 16 byte sample, so
+ * sending samples together divides the airtime per sample. Delta
+ * encoding rounds the values to a hundredth, finer than the sensors,
+ * and fits 22 samples in a frame instead of 12. A batch of one sample
+ * is sent as a plain FRAME_BME280.
+ ***********************************************************************/
+class SampleBatch
+{
+    public:
+        static constexpr size_t ROOM      = FRAME_MAX_SIZE - sizeof(Frame_header) - FRAME_CRC_SIZE - sizeof(Batch_header);
+        static constexpr size_t MAX_RAW   = ROOM / sizeof(Batch_raw);
+        static constexpr size_t MAX_DELTA = 1 + (ROOM - sizeof(Batch_base)) / sizeof(Batch_delta);
+
+        /***********************************************************************
+         * @param capacity Samples per frame, bounded by MAX_RAW or MAX_DELTA
+         * @param delta True to delta encode the samples when they allow it
+         ***********************************************************************/
+        SampleBatch(const size_t capacity, const bool delta) : _capacity(capacity), _delta(delta), _encoding(BATCH_RAW), _count(0)
+        {
+            memset(_last, 0, sizeof(_last));
+        }
+
+        /***********************************************************************
+         * @brief Add a sample
+         * @return False if it does not fit, send the batch and add it again
+         ***********************************************************************/
+        bool add(const Batch_sample &sample)
+        {
+            int32_t scaled[BATCH_VALUES];
+
+            if(_count == 0)
+            {
+                _encoding = ((_delta == true) && (scale(sample, scaled) == true)) ? BATCH_DELTA : BATCH_RAW;
+            }
+            else
+            {
+                if((_count >= capacity()) || (sample.time < _samples[0].time) || (sample.time - _samples[0].time > UINT16_MAX))
+                {
+                    return false;
+                }
+                if(_encoding == BATCH_DELTA)
+                {
+                    if(scale(sample, scaled) == false)
+                    {
+                        return false;
+                    }
+                    for (uint8_t v = 0; v < BATCH_VALUES; v++)
+                    {
+                        const int32_t delta = scaled[v] - _last[v];
+                        if((delta > INT16_MAX) || (delta < INT16_MIN))
+                        {
+                            return false;
+                        }
+                    }
+                }
+            }
+
+            if(_encoding == BATCH_DELTA)
+            {
+                memcpy(_last, scaled, sizeof(_last));
+            }
+            _samples[_count++] = sample;
+            return true;
+        }
+
+        /***********************************************************************
+         * @return Max samples with the encoding of the current batch
+         ***********************************************************************/
+        size_t capacity() const
+        {
+            const size_t most = (_encoding == BATCH_DELTA) ? MAX_DELTA : MAX_RAW;
+            return (_capacity < most) ? _capacity : most;
+        }
+
+        size_t count() const
+        {
+            return _count;
+        }
+
+        bool full() const
+        {
+            return (_count > 0) && (_count >= capacity());
+        }
+
+        void clear()
+        {
+            _count = 0;
+        }
+
+        /***********************************************************************
+         * @brief Build the frame carrying the batch
+         * @param buffer Where to build it, FRAME_MAX_SIZE bytes are always enough
+         * @param size Size of the buffer
+         * @param header Header of the frame, type and timestamp are set here
+         * @return Size of the frame, 0 if the batch is empty or the buffer too small
+         ***********************************************************************/
+        size_t write(uint8_t *buffer, const size_t size, Frame_header header) const
+        {
+            if(_count == 0)
+            {
+                return 0;
+            }
+            header.timestamp = _samples[0].time;
+            if(_count == 1)
+            {
+                const Payload_bme280 payload = {_samples[0].temperature, _samples[0].humidity, _samples[0].pressure, _samples[0].altitude};
+                header.type                  = FRAME_BME280;
+                return NodeFrame::write(buffer, size, header, payload);
+            }
+
+            uint8_t       payload[ROOM + sizeof(Batch_header)];
+            Batch_header *batch  = (Batch_header *)payload;
+            size_t        length = sizeof(Batch_header);
+            int32_t       last[BATCH_VALUES];
+            batch->count         = _count;
+            batch->encoding      = _encoding;
+
+            for (size_t i = 0; i < _count; i++)
+            {
+                const uint16_t offset = _samples[i].time - _samples[0].time;
+                if(_encoding == BATCH_RAW)
+                {
+                    // Packed fields are not aligned, copy the floats bytewise
+                    Batch_raw *raw = (Batch_raw *)(payload + length);
+                    float      values[BATCH_VALUES];
+                    toValues(_samples[i], values);
+                    raw->offset    = offset;
+                    memcpy(raw->values, values, sizeof(values));
+                    length        += sizeof(Batch_raw);
+                }
+                else if(i == 0)
+                {
+                    Batch_base *base = (Batch_base *)(payload + length);
+                    base->offset     = offset;
+                    scale(_samples[i], last);
+                    memcpy(base->values, last, sizeof(last));
+                    length          += sizeof(Batch_base);
+                }
+                else
+                {
+                    int32_t      scaled[BATCH_VALUES];
+                    Batch_delta *delta = (Batch_delta *)(payload + length);
+                    delta->offset      = offset;
+                    scale(_samples[i], scaled);
+                    for (uint8_t v = 0; v < BATCH_VALUES; v++)
+                    {
+                        delta->values[v] = scaled[v] - last[v];
+                        last[v]          = scaled[v];
+                    }
+                    length += sizeof(Batch_delta);
+                }
+            }
+
+            header.type = FRAME_BME280_BATCH;
+            return NodeFrame::write(buffer, size, header, payload, length);
+        }
+
+        static void toValues(const Batch_sample &sample, float values[BATCH_VALUES])
+        {
+            values[0] = sample.temperature;
+            values[1] = sample.humidity;
+            values[2] = sample.pressure;
+            values[3] = sample.altitude;
+        }
+
+        static void fromValues(Batch_sample &sample, const float values[BATCH_VALUES])
+        {
+            sample.temperature = values[0];
+            sample.humidity    = values[1];
+            sample.pressure    = values[2];
+            sample.altitude    = values[3];
+        }
+
+    private:
+        /***********************************************************************
+         * @brief Round the values to hundredths
+         * @return False if a value is not finite or too large
+         ***********************************************************************/
+        static bool scale(const Batch_sample &sample, int32_t scaled[BATCH_VALUES])
+        {
+            float values[BATCH_VALUES];
+            toValues(sample, values);
+            for (uint8_t v = 0; v < BATCH_VALUES; v++)
+            {
+                if((isfinite(values[v]) == false) || (fabsf(values[v]) > BATCH_MAX_VALUE))
+                {
+                    return false;
+                }
+                scaled[v] = lroundf(values[v] * BATCH_SCALE);
+            }
+            return true;
+        }
+
+        const size_t   _capacity;
+        const bool     _delta;
+        Batch_encoding _encoding;
+        size_t         _count;
+        int32_t        _last[BATCH_VALUES];     // Scaled values of the last sample added
+        Batch_sample   _samples[MAX_DELTA];
+};
+
+/***********************************************************************
+ * @brief Samples of a frame, read where the frame was received
+ *
+ * Works for FRAME_BME280 as well, as a batch of one sample.
+ ***********************************************************************/
+class BatchReader
+{
+    public:
+        /***********************************************************************
+         * @param header Header of a frame checked by NodeFrame::parse()
+         ***********************************************************************/
+        explicit BatchReader(const Frame_header *header) :
+            _data((const uint8_t *)(header + 1)), _timestamp(header->timestamp), _type(header->type), _encoding(BATCH_RAW), _count(0), _index(0)
+        {
+            memset(_last, 0, sizeof(_last));
+            if(_type == FRAME_BME280)
+            {
+                _count = (header->length == sizeof(Payload_bme280)) ? 1 : 0;
+                return;
+            }
+            if((_type != FRAME_BME280_BATCH) || (header->length < sizeof(Batch_header)))
+            {
+                return;
+            }
+
+            const Batch_header *batch = (const Batch_header *)_data;
+            size_t              size  = 0;
+            if(batch->encoding == BATCH_RAW)
+            {
+                size = batch->count * sizeof(Batch_raw);
+            }
+            else if((batch->encoding == BATCH_DELTA) && (batch->count > 0))
+            {
+                size = sizeof(Batch_base) + (batch->count - 1) * sizeof(Batch_delta);
+            }
+            if(header->length == sizeof(Batch_header) + size)
+            {
+                _encoding = (Batch_encoding)batch->encoding;
+                _count    = batch->count;
+                _data    += sizeof(Batch_header);
+            }
+        }
+
+        /***********************************************************************
+         * @return Number of samples, 0 if the payload is not a valid batch
+         ***********************************************************************/
+        size_t count() const
+        {
+            return _count;
+        }
+
+        /***********************************************************************
+         * @brief Read the next sample
+         * @return False once every sample was read
+         ***********************************************************************/
+        bool next(Batch_sample &sample)
+        {
+            if(_index >= _count)
+            {
+                return false;
+            }
+
+            if(_type == FRAME_BME280)
+            {
+                const Payload_bme280 *payload = (const Payload_bme280 *)_data;
+                sample.time                   = _timestamp;
+                sample.temperature            = payload->temperature;
+                sample.humidity               = payload->humidity;
+                sample.pressure               = payload->pressure;
+                sample.altitude               = payload->altitude;
+            }
+            else if(_encoding == BATCH_RAW)
+            {
+                const Batch_raw *raw = (const Batch_raw *)_data + _index;
+                float            values[BATCH_VALUES];
+                memcpy(values, raw->values, sizeof(values));
+                sample.time = _timestamp + raw->offset;
+                SampleBatch::fromValues(sample, values);
+            }
+            else
+            {
+                uint16_t offset;
+                if(_index == 0)
+                {
+                    const Batch_base *base = (const Batch_base *)_data;
+                    offset                 = base->offset;
+                    memcpy(_last, base->values, sizeof(_last));
+                }
+                else
+                {
+                    const Batch_delta *delta = (const Batch_delta *)(_data + sizeof(Batch_base)) + (_index - 1);
+                    offset                   = delta->offset;
+                    for (uint8_t v = 0; v < BATCH_VALUES; v++)
+                    {
+                        _last[v] += delta->values[v];
+                    }
+                }
+
+                float values[BATCH_VALUES];
+                for (uint8_t v = 0; v < BATCH_VALUES; v++)
+                {
+                    values[v] = (float)_last[v] / BATCH_SCALE;
+                }
+                sample.time = _timestamp + offset;
+                SampleBatch::fromValues(sample, values);
+            }
+            _index++;
+            return true;
+        }
+
+    private:
+        const uint8_t  *_data;
+        const uint32_t  _timestamp;
+        const uint8_t   _type;
+        Batch_encoding  _encoding;
+        size_t          _count;
+        size_t          _index;
+        int32_t         _last[BATCH_VALUES];    // Scaled values of the last delta encoded sample
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SIMULATED_GATEWAY_HPP
+#define SIMULATED_GATEWAY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "GatewayPairing.hpp"
+#include "NodeFrame.hpp"
+
+/***********************************************************************
+ * @brief Radio of a node with a gateway on one channel, for GatewayPairing
+ *
+ * Lets the pairing be tested on a host: the test puts the gateway on a
+ * channel, or turns it off, runs GatewayPairing::discover(), then checks
+ * the state, the probes sent and the time spent waiting for answers.
+ ***********************************************************************/
+class SimulatedGateway
+{
+    public:
+        uint8_t  mac[6];            // Address given in the answers
+        uint8_t  channel;           // Channel the gateway listens on
+        bool     answer;            // False as if the gateway was off
+        uint32_t answer_ms;         // Time the answer takes
+        uint32_t timeout_ms;        // Time the node waits for an answer that does not come
+        uint32_t probes;            // Probes received, on any channel
+        uint32_t answers;           // Answers sent
+        uint32_t waited_ms;         // Time the node spent waiting
+        uint8_t  last_node;         // Node id of the last probe
+
+        SimulatedGateway() : channel(6), answer(true), answer_ms(3), timeout_ms(15), probes(0), answers(0), waited_ms(0), last_node(0)
+        {
+            const uint8_t address[6] = {0xC8, 0xF0, 0x9E, 0xA3, 0x52, 0xA8};
+            memcpy(mac, address, sizeof(mac));
+        }
+
+        size_t exchange(const uint8_t probeChannel, const uint8_t *probe, const size_t length, uint8_t *reply, const size_t size)
+        {
+            const Frame_header *frame = NULL;
+            probes++;
+            if((answer == false) || (probeChannel != channel) || (NodeFrame::parse(probe, length, frame) != FRAME_OK) || (frame->type != FRAME_PAIR_PROBE))
+            {
+                waited_ms += timeout_ms;
+                return 0;
+            }
+
+            Frame_header header;
+            memset(&header, 0, sizeof(header));
+            header.sequence = answers++;
+            last_node       = frame->node;
+            waited_ms      += answer_ms;
+            return PairingReply::write(reply, size, header, mac, channel);
+        }
+};
+
+#endif
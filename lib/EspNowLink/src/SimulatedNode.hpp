@@ -0,0 +1,148 @@
+#ifndef SIMULATED_NODE_HPP
+#define SIMULATED_NODE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "NodeFrame.hpp"
+#include "SampleBatch.hpp"
+
+/***********************************************************************
+ * @brief Board of a battery node with a simulated sleep clock, for DutyCycle
+ *
+ * Lets the duty cycle be tested on a host: each step spends its cost of
+ * awake time, sleep() moves the time by the duration asked, measured on
+ * the local clock which runs drift_ppm off the real time, then boots
+ * again. The test runs DutyCycle::run() in a loop on the same Duty_state,
+ * then checks the frames, the awake time and the time error of the
+ * samples. Frames are kept so they can be read back with BatchReader.
+ ***********************************************************************/
+class SimulatedNode
+{
+    public:
+        static constexpr size_t MAX_FRAMES = 8;   // Frames kept, the last ones sent
+
+        uint32_t     boot_us;       // From the wake to the code, the first wake included
+        uint32_t     measure_us;    // One forced measure
+        uint32_t     sync_us;       // Asking the gateway the time, up to its answer
+        uint32_t     send_us;       // Starting the radio and sending a frame up to its ack
+        int32_t      drift_ppm;     // How fast the local clock runs compared to the real time
+        int64_t      epoch_us;      // Real epoch at the cold boot
+        bool         sync_answer;   // False to fail syncTime()
+        bool         send_answer;   // False to fail send(), as if the gateway was off
+        bool         measure_answer;// False to fail measure()
+        Batch_sample reading;       // Values given by measure(), the time is left to DutyCycle
+
+        int64_t      now_us;        // Real time since the cold boot
+        uint32_t     awake_now_us;  // Time since the last wake
+        uint32_t     wakes;         // Boots, the cold one included
+        uint32_t     syncs;         // Calls to syncTime()
+        uint16_t     sync_sequence; // Sequence number of the last time request
+        uint32_t     sends;         // Calls to send()
+        uint64_t     slept_us;      // Real time spent in deep sleep
+        uint8_t      frames[MAX_FRAMES][FRAME_MAX_SIZE];
+        size_t       lengths[MAX_FRAMES];
+
+        SimulatedNode() : boot_us(30000), measure_us(10000), sync_us(5000), send_us(60000), drift_ppm(0), epoch_us(1700000000LL * 1000000),
+                          sync_answer(true), send_answer(true), measure_answer(true), now_us(0), awake_now_us(0), wakes(0), syncs(0), sync_sequence(0), sends(0), slept_us(0)
+        {
+            memset(&reading, 0, sizeof(reading));
+            memset(lengths, 0, sizeof(lengths));
+            reading.temperature = 20.0F;
+            reading.humidity    = 50.0F;
+            reading.pressure    = 1013.25F;
+            powerOn();
+        }
+
+        /***********************************************************************
+         * @brief Cold boot, the Duty_state must be cleared by the test like RTC memory
+         ***********************************************************************/
+        void powerOn()
+        {
+            now_us       = 0;
+            awake_now_us = 0;
+            wakes        = 1;
+            spend(boot_us);
+        }
+
+        /***********************************************************************
+         * @return Real epoch in µs, what a perfect clock would read
+         ***********************************************************************/
+        int64_t realEpochUs() const
+        {
+            return epoch_us + now_us;
+        }
+
+        /***********************************************************************
+         * @param idx 0 for the last frame sent, 1 for the one before...
+         * @return The frame, NULL if it was not kept
+         ***********************************************************************/
+        const uint8_t *frame(const size_t idx, size_t &length) const
+        {
+            if((idx >= MAX_FRAMES) || (idx >= sends))
+            {
+                return NULL;
+            }
+            const size_t slot = (sends - 1 - idx) % MAX_FRAMES;
+            length            = lengths[slot];
+            return frames[slot];
+        }
+
+        int64_t clockUs() const
+        {
+            return now_us + (now_us * drift_ppm) / 1000000;
+        }
+
+        uint32_t awakeUs() const
+        {
+            return awake_now_us;
+        }
+
+        bool syncTime(const Frame_header &header, int64_t &epochUs)
+        {
+            syncs++;
+            sync_sequence = header.sequence;
+            spend(sync_us);
+            epochUs = realEpochUs();
+            return sync_answer;
+        }
+
+        bool measure(Batch_sample &sample)
+        {
+            spend(measure_us);
+            sample = reading;
+            return measure_answer;
+        }
+
+        bool send(const uint8_t *frame, const size_t length, uint32_t &rttUs)
+        {
+            const size_t slot = sends++ % MAX_FRAMES;
+            memcpy(frames[slot], frame, length);
+            lengths[slot] = length;
+            spend(send_us);
+            rttUs         = (send_answer == true) ? send_us : 0;
+            return send_answer;
+        }
+
+        /***********************************************************************
+         * @brief Sleep us on the local clock, then boot again
+         ***********************************************************************/
+        void sleep(const uint64_t us)
+        {
+            const int64_t real = ((int64_t)us * 1000000) / (1000000 + drift_ppm);
+            now_us            += real;
+            slept_us          += real;
+            awake_now_us       = 0;
+            wakes++;
+            spend(boot_us);
+        }
+
+    private:
+        void spend(const uint32_t us)
+        {
+            now_us       += us;
+            awake_now_us += us;
+        }
+};
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef TIME_SYNC_HPP
+#define TIME_SYNC_HPP
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "DisciplinedClock.hpp"
+#include "NodeFrame.hpp"
+
+#define TIME_MAX_BACKOFF        6          // Requests failed in a row past which the wait stops doubling, 2^6 chances
+
+/***********************************************************************
+ * @brief Frames giving the time of the gateway to the nodes
+ *
+ * The gateway keeps its clock from NTP and broadcasts it every few
+ * seconds, and answers a FRAME_TIME_REQUEST at once, so a node never
+ * needs WiFi nor NTP. The epoch is read just before the frame is sent.
+ ***********************************************************************/
+class TimeBeacon
+{
+    public:
+        /***********************************************************************
+         * @brief Build a FRAME_TIME
+         * @param buffer Where to build it
+         * @param size Size of the buffer
+         * @param header Header of the frame, type is set here
+         * @param epochUs UTC epoch of the gateway in µs
+         * @param request Sequence number of the request answered, 0 for a beacon
+         * @param flags TIME_REPLY when answering a request
+         * @return Size of the frame, 0 if the buffer is too small
+         ***********************************************************************/
+        static size_t write(uint8_t *buffer, const size_t size, Frame_header header, const int64_t epochUs, const uint16_t request, const uint8_t flags)
+        {
+            Payload_time payload;
+            payload.epoch_us  = epochUs;
+            payload.request   = request;
+            payload.flags     = flags;
+            header.type       = FRAME_TIME;
+            header.node       = FRAME_GATEWAY;
+            header.timestamp  = (uint32_t)(epochUs / 1000000);
+            return NodeFrame::write(buffer, size, header, payload);
+        }
+};
+
+/***********************************************************************
+ * @brief Clock of a node disciplined by the FRAME_TIME of the gateway
+ *
+ * Only one delay is taken off the time received: the airtime of the
+ * FRAME_TIME itself, see NodeFrame::airtimeUs(). The gateway reads its
+ * clock right before the frame leaves, so the way back is that airtime
+ * plus the radio queues of both ends, not half the round trip: the way
+ * there also holds the time the request waits in the gateway, which would
+ * put the node ahead by half of it. The error left is the queues, a few
+ * hundred µs, far below the second of the samples. Beacons keep training
+ * the drift of the local clock, see DisciplinedClock, so a node awake
+ * between two beacons stays close to the gateway. An answer that does not match the
+ * last request is dropped, it is late.
+ *
+ * A request not answered in time doubles the chances to ask until the
+ * next one, up to 2^TIME_MAX_BACKOFF, like GatewayPairing does: a
+ * gateway without clock, like the Receiver example, is not asked on
+ * every sample.
+ * @note receive() must only be called from one task, the ESP-NOW one,
+ *       request(), due() and failed() from another one
+ ***********************************************************************/
+class TimeClient
+{
+    public:
+        TimeClient() : _pending(false), _request(0), _sentUs(0), _failures(0), _wait(0) {}
+
+        /***********************************************************************
+         * @brief Tell if the time must be asked
+         * @param localUs Local time
+         * @param maxAge Seconds since the last sync before asking
+         * @return False while the clock is fresh or the backoff runs, each
+         *         call then counts one chance to ask skipped
+         * @note Call it once per chance to ask
+         ***********************************************************************/
+        bool due(const int64_t localUs, const uint32_t maxAge)
+        {
+            if(age(localUs) <= maxAge)
+            {
+                _failures = 0;
+                _wait     = 0;
+                return false;
+            }
+            if(_wait > 0)
+            {
+                _wait--;
+                return false;
+            }
+            return true;
+        }
+
+        /***********************************************************************
+         * @brief Build a FRAME_TIME_REQUEST and wait for its answer
+         * @param buffer Where to build it
+         * @param size Size of the buffer
+         * @param header Header of the frame, its sequence number identifies the request
+         * @param localUs Local time the request is sent at
+         * @return Size of the frame, 0 if the buffer is too small
+         ***********************************************************************/
+        size_t request(uint8_t *buffer, const size_t size, Frame_header header, const int64_t localUs)
+        {
+            // A late answer to the previous request must not be timed against this one
+            _pending.store(false, std::memory_order_relaxed);
+            header.type         = FRAME_TIME_REQUEST;
+            const size_t length = NodeFrame::write(buffer, size, header, NULL, 0);
+            _request            = header.sequence;
+            _sentUs             = localUs;
+            _pending.store(length > 0, std::memory_order_release);
+            return length;
+        }
+
+        /***********************************************************************
+         * @brief Give up the last request, its answer did not come in time
+         ***********************************************************************/
+        void failed()
+        {
+            _pending.store(false, std::memory_order_relaxed);
+            _failures = (_failures < UINT8_MAX) ? _failures + 1 : _failures;
+            _wait     = (uint8_t)((1U << ((_failures < TIME_MAX_BACKOFF) ? _failures : TIME_MAX_BACKOFF)) - 1);
+            _clock.failed();
+        }
+
+        /***********************************************************************
+         * @return Requests not answered in a row since the clock was last fresh
+         ***********************************************************************/
+        uint8_t failures() const
+        {
+            return _failures;
+        }
+
+        /***********************************************************************
+         * @brief Correct the clock with a frame of the gateway
+         * @param header Header given by NodeFrame::parse()
+         * @param length Size of the frame
+         * @param receivedUs Local time the frame was received at
+         * @return False if the frame is not a time the clock can use
+         ***********************************************************************/
+        bool receive(const Frame_header *header, const size_t length, const int64_t receivedUs)
+        {
+            const Payload_time *time = NodeFrame::payload<Payload_time>(header);
+            if((header->type != FRAME_TIME) || (header->node != FRAME_GATEWAY) || (time == NULL))
+            {
+                return false;
+            }
+
+            uint32_t rtt = 0;
+            if(time->flags & TIME_REPLY)
+            {
+                if((_pending.load(std::memory_order_acquire) == false) || (time->request != _request))
+                {
+                    return false;
+                }
+                rtt = (uint32_t)(receivedUs - _sentUs);
+                _pending.store(false, std::memory_order_relaxed);
+            }
+            _clock.sync(receivedUs - NodeFrame::airtimeUs(length), time->epoch_us, rtt);
+            return true;
+        }
+
+        /***********************************************************************
+         * @param localUs Local time
+         * @return UTC epoch in µs, time since boot until the first sync
+         ***********************************************************************/
+        int64_t epochUs(const int64_t localUs) const
+        {
+            return _clock.at(localUs);
+        }
+
+        bool synced() const
+        {
+            return _clock.synced();
+        }
+
+        /***********************************************************************
+         * @return Seconds since the last sync, UINT32_MAX if never synced
+         ***********************************************************************/
+        uint32_t age(const int64_t localUs) const
+        {
+            return _clock.age(localUs);
+        }
+
+        const Clock_health &health() const
+        {
+            return _clock.health();
+        }
+
+    private:
+        DisciplinedClock  _clock;
+        std::atomic<bool> _pending;     // True while the answer to _request is awaited, set once _request and _sentUs are
+        uint16_t          _request;     // Sequence number of the last request
+        int64_t           _sentUs;      // Local time of the last request
+        uint8_t           _failures;    // Requests not answered in a row
+        uint8_t           _wait;        // Chances to ask left to skip before the next request
+};
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef LED_EFFECTS_HPP
+#define LED_EFFECTS_HPP
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#define LED_EFFECTS_CHANNEL     7          // LEDC channel used, the camera uses channel 0
+#define LED_EFFECTS_FREQUENCY   5000       // PWM frequency in Hz
+#define LED_EFFECTS_RESOLUTION  8          // PWM resolution in bits
+#define LED_EFFECTS_MAX         255        // Duty of a fully lit LED
+#define LED_EFFECTS_TICK_MS     10         // Milliseconds between two updates of the LED
+#define LED_EFFECTS_QUEUE_SIZE  4          // Max number of patterns waiting
+
+// Effects of a pattern
+enum Led_effect
+{
+    LED_OFF,                               // Steady off, becomes the idle state
+    LED_ON,                                // Steady on, becomes the idle state
+    LED_BLINK,                             // On half of the period, off the other half
+    LED_BREATHE,                           // Smooth fade in and out over the period
+    LED_HEARTBEAT,                         // Two short pulses per period
+    LED_STATUS                             // code short blinks, then a pause
+};
+
+// What the LED has to show
+typedef struct
+{
+    uint8_t  effect;                       // Led_effect
+    uint8_t  code;                         // Number of blinks of LED_STATUS
+    uint16_t period_ms;                    // Duration of one repetition
+    uint16_t count;                        // Number of repetitions, 0 to repeat until the next pattern
+    bool     interrupt;                    // Stop the current pattern instead of waiting for its end
+} Led_pattern;
+
+namespace LedPatterns
+{
+    inline Led_pattern off()
+    {
+        return {LED_OFF, 0, 0, 0, false};
+    }
+
+    inline Led_pattern on()
+    {
+        return {LED_ON, 0, 0, 0, false};
+    }
+
+    inline Led_pattern blink(const uint16_t count, const uint16_t period_ms = 200)
+    {
+        return {LED_BLINK, 0, period_ms, count, false};
+    }
+
+    inline Led_pattern breathe(const uint16_t count = 0, const uint16_t period_ms = 2000)
+    {
+        return {LED_BREATHE, 0, period_ms, count, false};
+    }
+
+    inline Led_pattern heartbeat(const uint16_t count = 0)
+    {
+        return {LED_HEARTBEAT, 0, 1200, count, false};
+    }
+
+    /***********************************************************************
+     * @brief Blink a number, e.g. an error code, then pause for a second
+     ***********************************************************************/
+    inline Led_pattern status(const uint8_t code, const uint16_t count = 1)
+    {
+        return {LED_STATUS, code, (uint16_t)(code * 500 + 1000), count, false};
+    }
+}
+
+/***********************************************************************
+ * @brief Plays LED patterns in the background
+ *
+ * Callers queue a pattern and return at once. An esp_timer ticks every
+ * LED_EFFECTS_TICK_MS and drives the LED through LEDC, so a pattern never
+ * holds a task. Finite patterns are played in order. A pattern repeated
+ * until the next one stops as soon as another is queued. Once nothing is
+ * left, the LED goes back to the last LED_ON / LED_OFF.
+ ***********************************************************************/
+class LedEffects
+{
+    public:
+        LedEffects() : _queue(NULL), _timer(NULL), _playing(false), _start(0), _idle(0), _duty(0), _channel(LED_EFFECTS_CHANNEL) {}
+
+        /***********************************************************************
+         * @brief Take control of the LED pin and start the timer
+         * @param pin Pin of the LED
+         * @param channel LEDC channel to use (default LED_EFFECTS_CHANNEL)
+         * @return False if the queue or the timer cannot be created
+         ***********************************************************************/
+        bool begin(const uint8_t pin, const uint8_t channel = LED_EFFECTS_CHANNEL)
+        {
+            _channel = channel;
+            _queue   = xQueueCreate(LED_EFFECTS_QUEUE_SIZE, sizeof(Led_pattern));
+            if(_queue == NULL)
+            {
+                return false;
+            }
+
+            ledcSetup(_channel, LED_EFFECTS_FREQUENCY, LED_EFFECTS_RESOLUTION);
+            ledcAttachPin(pin, _channel);
+            ledcWrite(_channel, 0);
+
+            esp_timer_create_args_t args = {};
+            args.callback                = onTick;
+            args.arg                     = this;
+            args.name                    = "led";
+            return (esp_timer_create(&args, &_timer) == ESP_OK) &&
+                   (esp_timer_start_periodic(_timer, LED_EFFECTS_TICK_MS * 1000ULL) == ESP_OK);
+        }
+
+        /***********************************************************************
+         * @brief Queue a pattern, never blocks
+         * @param pattern Pattern to play, see LedPatterns
+         * @return False if too many patterns are waiting
+         ***********************************************************************/
+        bool play(const Led_pattern &pattern)
+        {
+            return (_queue != NULL) && (xQueueSend(_queue, &pattern, 0) == pdTRUE);
+        }
+
+        /***********************************************************************
+         * @brief Queue a pattern that stops the current one, never blocks
+         ***********************************************************************/
+        bool show(Led_pattern pattern)
+        {
+            pattern.interrupt = true;
+            return play(pattern);
+        }
+
+        /***********************************************************************
+         * @brief Duty of a pattern at some point of its life
+         * @param pattern Pattern played
+         * @param elapsed Milliseconds since the pattern started
+         * @param done Set to true once the pattern is over
+         * @return Duty between 0 and LED_EFFECTS_MAX
+         ***********************************************************************/
+        static uint8_t duty(const Led_pattern &pattern, const uint32_t elapsed, bool &done)
+        {
+            if((pattern.effect == LED_OFF) || (pattern.effect == LED_ON) || (pattern.period_ms == 0))
+            {
+                done = true;
+                return (pattern.effect == LED_ON) ? LED_EFFECTS_MAX : 0;
+            }
+
+            done = (pattern.count > 0) && (elapsed >= (uint32_t)pattern.count * pattern.period_ms);
+            const uint32_t phase = elapsed % pattern.period_ms;
+
+            switch(pattern.effect)
+            {
+                case LED_BLINK:
+                    return (phase < pattern.period_ms / 2U) ? LED_EFFECTS_MAX : 0;
+
+                case LED_BREATHE:
+                {
+                    // Triangle squared, the eye sees the low levels better than the high ones
+                    const uint32_t half  = pattern.period_ms / 2U;
+                    const uint32_t ramp  = (phase < half) ? phase : (pattern.period_ms - phase);
+                    const uint32_t level = (ramp * LED_EFFECTS_MAX) / (half ? half : 1);
+                    return (level * level) / LED_EFFECTS_MAX;
+                }
+
+                case LED_HEARTBEAT:
+                    return ((phase < 100) || ((phase >= 250) && (phase < 350))) ? LED_EFFECTS_MAX : 0;
+
+                case LED_STATUS:
+                    return ((phase < pattern.code * 500U) && ((phase % 500U) < 200U)) ? LED_EFFECTS_MAX : 0;
+            }
+            return 0;
+        }
+
+    private:
+        static void onTick(void *arg)
+        {
+            ((LedEffects *)arg)->tick();
+        }
+
+        /***********************************************************************
+         * @brief Start the next pattern when it is time, then update the LED
+         * @note Runs in the esp_timer task
+         ***********************************************************************/
+        void tick()
+        {
+            const uint32_t now = esp_timer_get_time() / 1000;
+            bool           done = true;
+            uint8_t        level = _idle;
+
+            if(_playing == true)
+            {
+                level = duty(_current, now - _start, done);
+            }
+
+            Led_pattern next;
+            if((xQueuePeek(_queue, &next, 0) == pdTRUE) && ((_playing == false) || done || next.interrupt || (_current.count == 0)))
+            {
+                xQueueReceive(_queue, &next, 0);
+                if((next.effect == LED_ON) || (next.effect == LED_OFF))
+                {
+                    _idle    = (next.effect == LED_ON) ? LED_EFFECTS_MAX : 0;
+                    _playing = false;
+                    level    = _idle;
+                }
+                else
+                {
+                    _current = next;
+                    _start   = now;
+                    _playing = true;
+                    level    = duty(_current, 0, done);
+                }
+            }
+            else if((_playing == true) && (done == true))
+            {
+                _playing = false;
+                level    = _idle;
+            }
+
+            if(level != _duty)
+            {
+                _duty = level;
+                ledcWrite(_channel, level);
+            }
+        }
+
+        QueueHandle_t       _queue;
+        esp_timer_handle_t  _timer;
+        Led_pattern         _current;
+        bool                _playing;
+        uint32_t            _start;
+        uint8_t             _idle;
+        uint8_t             _duty;
+        uint8_t             _channel;
+};
+
+#endif
@@ -0,0 +1,322 @@
+#ifndef BME280_DRIVER_HPP
+#define BME280_DRIVER_HPP
+
+#include <Arduino.h>
+#include <stddef.h>
+#include "SensorCore.hpp"
+#include "Weather.hpp"
+
+#define BME280_CHIP_ID          0x60
+#define BME280_REG_CALIB_TP     0x88       // 24 bytes of temperature and pressure calibration
+#define BME280_REG_CALIB_H1     0xA1
+#define BME280_REG_CHIP_ID      0xD0
+#define BME280_REG_RESET        0xE0
+#define BME280_REG_CALIB_H2     0xE1       // 7 bytes of humidity calibration
+#define BME280_REG_CTRL_HUM     0xF2
+#define BME280_REG_STATUS       0xF3
+#define BME280_REG_CTRL_MEAS    0xF4
+#define BME280_REG_CONFIG       0xF5
+#define BME280_REG_DATA         0xF7       // 8 bytes: pressure (3), temperature (3), humidity (2)
+#define BME280_MODE_FORCED      0x01
+#define BME280_FIELD_COUNT      5          // Temperature, humidity, pressure, altitude, dew point
+
+// Oversampling of a measure, values of the registers
+enum Bme280_oversampling
+{
+    BME280_OS_SKIP,                        // Not measured
+    BME280_OS_1X,
+    BME280_OS_2X,
+    BME280_OS_4X,
+    BME280_OS_8X,
+    BME280_OS_16X
+};
+
+// IIR filter on pressure and temperature, values of the register
+enum Bme280_filter
+{
+    BME280_FILTER_OFF,
+    BME280_FILTER_2,
+    BME280_FILTER_4,
+    BME280_FILTER_8,
+    BME280_FILTER_16
+};
+
+// Every value of one BME280 measure
+typedef struct
+{
+    float temperature;              // °C
+    float humidity;                 // %
+    float pressure;                 // hPa
+    float altitude;                 // m, from the pressure above
+    float dew_point;                // °C, from the temperature and humidity above
+} Bme280_reading;
+
+/***********************************************************************
+ * @brief BME280 in forced mode, one burst of registers per sample, use it through Sampler
+ *
+ * Every read*() of Adafruit_BME280 reads its own registers and reads the
+ * temperature again to compensate, readAltitude() reads the pressure again.
+ * Here trigger() starts one forced measure, the sensor sleeps again once
+ * it is over, and collect() gets every raw value in one 8 byte I2C read.
+ * The compensation is the integer one of the Bosch datasheet, altitude
+ * and dew point come from the same values.
+ * @tparam Bus TwoWire, or SimulatedBme280 in host tests
+ ***********************************************************************/
+template <typename Bus>
+class Bme280Driver
+{
+    public:
+        typedef Bme280_reading Sample;
+        static constexpr size_t FIELDS = BME280_FIELD_COUNT;
+
+        /***********************************************************************
+         * @param wire I2C bus of the sensor
+         * @param seaLevel Sea level pressure in hPa, for the altitude
+         ***********************************************************************/
+        Bme280Driver(Bus &wire, const float seaLevel) : _wire(wire), _seaLevel(seaLevel), _address(0), _ctrlMeas(0), _measureUs(0)
+        {
+            memset(&_calib, 0, sizeof(_calib));
+        }
+
+        /***********************************************************************
+         * @brief Check the sensor, load its calibration and set it up, asleep
+         * @param address I2C address, 0x76 or 0x77
+         * @param temperature Oversampling of the temperature, must not be skipped
+         * @param pressure Oversampling of the pressure
+         * @param humidity Oversampling of the humidity
+         * @param filter IIR filter, it works across forced measures too
+         * @return False if there is no BME280 at this address
+         * @note Defaults are the "weather monitoring" settings of the datasheet
+         ***********************************************************************/
+        bool begin(const uint8_t address = 0x76, const Bme280_oversampling temperature = BME280_OS_1X, const Bme280_oversampling pressure = BME280_OS_1X,
+                   const Bme280_oversampling humidity = BME280_OS_1X, const Bme280_filter filter = BME280_FILTER_OFF)
+        {
+            uint8_t id = 0;
+            _address   = address;
+            _wire.begin();
+            if((readRegisters(BME280_REG_CHIP_ID, &id, 1) == false) || (id != BME280_CHIP_ID))
+            {
+                return false;
+            }
+
+            // Reset, then wait for the calibration to be copied from the NVM
+            uint8_t status = 1;
+            writeRegister(BME280_REG_RESET, 0xB6);
+            for (uint8_t i = 0; (i < 10) && ((status & 0x01) != 0); i++)
+            {
+                delay(2);
+                readRegisters(BME280_REG_STATUS, &status, 1);
+            }
+            if(readCalibration() == false)
+            {
+                return false;
+            }
+
+            // ctrl_hum is only taken into account by the next write of ctrl_meas
+            _ctrlMeas  = (temperature << 5) | (pressure << 2);
+            _measureUs = 1250 + 2300 * factor(temperature) +
+                         ((pressure != BME280_OS_SKIP) ? 2300 * factor(pressure) + 575 : 0) +
+                         ((humidity != BME280_OS_SKIP) ? 2300 * factor(humidity) + 575 : 0);
+            return writeRegister(BME280_REG_CTRL_HUM, humidity) &&
+                   writeRegister(BME280_REG_CONFIG, filter << 2) &&
+                   writeRegister(BME280_REG_CTRL_MEAS, _ctrlMeas);
+        }
+
+        static const Sensor_field &field(const size_t idx)
+        {
+            static const Sensor_field fields[BME280_FIELD_COUNT] = {{"Temperature", "°C"}, {"Humidity", "%"}, {"Pressure", "hPa"}, {"Altitude", "m"}, {"Dew point", "°C"}};
+            return fields[idx];
+        }
+
+        static void toValues(const Sample &sample, float values[BME280_FIELD_COUNT])
+        {
+            values[0] = sample.temperature;
+            values[1] = sample.humidity;
+            values[2] = sample.pressure;
+            values[3] = sample.altitude;
+            values[4] = sample.dew_point;
+        }
+
+        static void fromValues(Sample &sample, const float values[BME280_FIELD_COUNT])
+        {
+            sample.temperature = values[0];
+            sample.humidity    = values[1];
+            sample.pressure    = values[2];
+            sample.altitude    = values[3];
+            sample.dew_point   = values[4];
+        }
+
+    protected:
+        /***********************************************************************
+         * @brief Start a forced measure
+         * @param wait Set to the longest duration of the measure in ms, from the datasheet
+         ***********************************************************************/
+        bool trigger(uint32_t &wait)
+        {
+            wait = (_measureUs + 999) / 1000;
+            return writeRegister(BME280_REG_CTRL_MEAS, _ctrlMeas | BME280_MODE_FORCED);
+        }
+
+        /***********************************************************************
+         * @brief Read every value of the measure in one burst
+         * @note Skipped measures and the values derived from them are NAN
+         ***********************************************************************/
+        bool collect(Sample &sample)
+        {
+            uint8_t raw[8];
+            if(readRegisters(BME280_REG_DATA, raw, sizeof(raw)) == false)
+            {
+                return false;
+            }
+
+            const int32_t adcP = ((int32_t)raw[0] << 12) | ((int32_t)raw[1] << 4) | (raw[2] >> 4);
+            const int32_t adcT = ((int32_t)raw[3] << 12) | ((int32_t)raw[4] << 4) | (raw[5] >> 4);
+            const int32_t adcH = ((int32_t)raw[6] << 8) | raw[7];
+
+            // Skipped measures read 0x80000 and 0x8000, the others need the temperature
+            if(adcT == 0x80000)
+            {
+                return false;
+            }
+
+            int32_t tFine;
+            sample.temperature = compensateTemperature(adcT, tFine) / 100.0F;
+            sample.pressure    = (adcP != 0x80000) ? compensatePressure(adcP, tFine) / 25600.0F : NAN;
+            sample.humidity    = (adcH != 0x8000) ? compensateHumidity(adcH, tFine) / 1024.0F : NAN;
+            sample.altitude    = Weather::altitude(sample.pressure, _seaLevel);
+            sample.dew_point   = Weather::dewPoint(sample.temperature, sample.humidity);
+            return true;
+        }
+
+    private:
+        // Calibration stored in the sensor, names of the datasheet
+        typedef struct
+        {
+            uint16_t t1;
+            int16_t  t2, t3;
+            uint16_t p1;
+            int16_t  p2, p3, p4, p5, p6, p7, p8, p9;
+            uint8_t  h1, h3;
+            int16_t  h2, h4, h5;
+            int8_t   h6;
+        } Calibration;
+
+        static uint8_t factor(const Bme280_oversampling oversampling)
+        {
+            return (oversampling == BME280_OS_SKIP) ? 0 : (1 << (oversampling - 1));
+        }
+
+        bool readRegisters(const uint8_t reg, uint8_t *buffer, const uint8_t length)
+        {
+            _wire.beginTransmission(_address);
+            _wire.write(reg);
+            if((_wire.endTransmission() != 0) || (_wire.requestFrom(_address, length) != length))
+            {
+                return false;
+            }
+            for (uint8_t i = 0; i < length; i++)
+            {
+                buffer[i] = _wire.read();
+            }
+            return true;
+        }
+
+        bool writeRegister(const uint8_t reg, const uint8_t value)
+        {
+            _wire.beginTransmission(_address);
+            _wire.write(reg);
+            _wire.write(value);
+            return _wire.endTransmission() == 0;
+        }
+
+        bool readCalibration()
+        {
+            uint8_t tp[24];
+            uint8_t h[7];
+            if((readRegisters(BME280_REG_CALIB_TP, tp, sizeof(tp)) == false) ||
+               (readRegisters(BME280_REG_CALIB_H1, &_calib.h1, 1) == false) ||
+               (readRegisters(BME280_REG_CALIB_H2, h, sizeof(h)) == false))
+            {
+                return false;
+            }
+
+            // Little endian words
+            _calib.t1 = (uint16_t)(tp[1] << 8 | tp[0]);
+            _calib.t2 = (int16_t)(tp[3] << 8 | tp[2]);
+            _calib.t3 = (int16_t)(tp[5] << 8 | tp[4]);
+            _calib.p1 = (uint16_t)(tp[7] << 8 | tp[6]);
+            _calib.p2 = (int16_t)(tp[9] << 8 | tp[8]);
+            _calib.p3 = (int16_t)(tp[11] << 8 | tp[10]);
+            _calib.p4 = (int16_t)(tp[13] << 8 | tp[12]);
+            _calib.p5 = (int16_t)(tp[15] << 8 | tp[14]);
+            _calib.p6 = (int16_t)(tp[17] << 8 | tp[16]);
+            _calib.p7 = (int16_t)(tp[19] << 8 | tp[18]);
+            _calib.p8 = (int16_t)(tp[21] << 8 | tp[20]);
+            _calib.p9 = (int16_t)(tp[23] << 8 | tp[22]);
+
+            // h4 and h5 are 12 bits sharing a byte
+            _calib.h2 = (int16_t)(h[1] << 8 | h[0]);
+            _calib.h3 = h[2];
+            _calib.h4 = (int16_t)((int8_t)h[3] * 16 + (h[4] & 0x0F));
+            _calib.h5 = (int16_t)((int8_t)h[5] * 16 + (h[4] >> 4));
+            _calib.h6 = (int8_t)h[6];
+            return true;
+        }
+
+        /***********************************************************************
+         * @return Temperature in 0.01 °C, tFine is needed by the other values
+         ***********************************************************************/
+        int32_t compensateTemperature(const int32_t adc, int32_t &tFine) const
+        {
+            const int32_t var1 = ((((adc >> 3) - ((int32_t)_calib.t1 << 1))) * ((int32_t)_calib.t2)) >> 11;
+            const int32_t var2 = (((((adc >> 4) - ((int32_t)_calib.t1)) * ((adc >> 4) - ((int32_t)_calib.t1))) >> 12) * ((int32_t)_calib.t3)) >> 14;
+            tFine              = var1 + var2;
+            return (tFine * 5 + 128) >> 8;
+        }
+
+        /***********************************************************************
+         * @return Pressure in 1/256 Pa
+         ***********************************************************************/
+        uint32_t compensatePressure(const int32_t adc, const int32_t tFine) const
+        {
+            int64_t var1 = ((int64_t)tFine) - 128000;
+            int64_t var2 = var1 * var1 * (int64_t)_calib.p6;
+            var2         = var2 + ((var1 * (int64_t)_calib.p5) << 17);
+            var2         = var2 + (((int64_t)_calib.p4) << 35);
+            var1         = ((var1 * var1 * (int64_t)_calib.p3) >> 8) + ((var1 * (int64_t)_calib.p2) << 12);
+            var1         = (((((int64_t)1) << 47) + var1)) * ((int64_t)_calib.p1) >> 33;
+            if(var1 == 0)
+            {
+                return 0;
+            }
+            int64_t p = 1048576 - adc;
+            p         = (((p << 31) - var2) * 3125) / var1;
+            var1      = (((int64_t)_calib.p9) * (p >> 13) * (p >> 13)) >> 25;
+            var2      = (((int64_t)_calib.p8) * p) >> 19;
+            return (uint32_t)(((p + var1 + var2) >> 8) + (((int64_t)_calib.p7) << 4));
+        }
+
+        /***********************************************************************
+         * @return Relative humidity in 1/1024 %
+         ***********************************************************************/
+        uint32_t compensateHumidity(const int32_t adc, const int32_t tFine) const
+        {
+            int32_t v = tFine - ((int32_t)76800);
+            v = (((((adc << 14) - (((int32_t)_calib.h4) << 20) - (((int32_t)_calib.h5) * v)) + ((int32_t)16384)) >> 15) *
+                 (((((((v * ((int32_t)_calib.h6)) >> 10) * (((v * ((int32_t)_calib.h3)) >> 11) + ((int32_t)32768))) >> 10) + ((int32_t)2097152)) *
+                   ((int32_t)_calib.h2) + 8192) >> 14));
+            v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)_calib.h1)) >> 4));
+            v = (v < 0) ? 0 : v;
+            v = (v > 419430400) ? 419430400 : v;
+            return (uint32_t)(v >> 12);
+        }
+
+        Bus             &_wire;
+        const float      _seaLevel;
+        Calibration      _calib;
+        uint8_t          _address;
+        uint8_t          _ctrlMeas;     // Oversampling of ctrl_meas, without the mode
+        uint32_t         _measureUs;    // Longest duration of a measure, from the datasheet
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef BME680_DRIVER_HPP
+#define BME680_DRIVER_HPP
+
+#include <Arduino.h>
+#include <stddef.h>
+#include "SensorCore.hpp"
+#include "Weather.hpp"
+
+#define BME680_FIELD_COUNT      5          // Temperature, humidity, pressure, altitude, gas resistance
+
+// Every value of one BME680 conversion
+typedef struct
+{
+    float temperature;              // °C
+    float humidity;                 // %
+    float pressure;                 // hPa
+    float altitude;                 // m, from the pressure above
+    float gas_resistance;           // kOhm
+} Bme680_reading;
+
+/***********************************************************************
+ * @brief BME680 read one conversion at a time, use it through Sampler
+ *
+ * Each read*() of Adafruit_BME680 runs a whole forced mode conversion,
+ * gas heater included, so reading five values costs five conversions.
+ * Here one beginReading() / endReading() pair gives all of them and the
+ * altitude is computed from that pressure.
+ * @tparam Device Adafruit_BME680, or SimulatedBme680 in host tests
+ ***********************************************************************/
+template <typename Device>
+class Bme680Driver
+{
+    public:
+        typedef Bme680_reading Sample;
+        static constexpr size_t FIELDS = BME680_FIELD_COUNT;
+
+        /***********************************************************************
+         * @param device Sensor, its begin() must have succeeded
+         * @param seaLevel Sea level pressure in hPa, for the altitude
+         ***********************************************************************/
+        Bme680Driver(Device &device, const float seaLevel) : _device(device), _seaLevel(seaLevel) {}
+
+        static const Sensor_field &field(const size_t idx)
+        {
+            static const Sensor_field fields[BME680_FIELD_COUNT] = {{"Temperature", "°C"}, {"Humidity", "%"}, {"Pressure", "hPa"}, {"Altitude", "m"}, {"Gas resistance", "kOhm"}};
+            return fields[idx];
+        }
+
+        static void toValues(const Sample &sample, float values[BME680_FIELD_COUNT])
+        {
+            values[0] = sample.temperature;
+            values[1] = sample.humidity;
+            values[2] = sample.pressure;
+            values[3] = sample.altitude;
+            values[4] = sample.gas_resistance;
+        }
+
+        static void fromValues(Sample &sample, const float values[BME680_FIELD_COUNT])
+        {
+            sample.temperature    = values[0];
+            sample.humidity       = values[1];
+            sample.pressure       = values[2];
+            sample.altitude       = values[3];
+            sample.gas_resistance = values[4];
+        }
+
+    protected:
+        /***********************************************************************
+         * @brief Start a conversion, the gas heater included
+         * @param wait Set to the duration of the conversion in ms
+         ***********************************************************************/
+        bool trigger(uint32_t &wait)
+        {
+            const unsigned long end = _device.beginReading();
+            if(end == 0)
+            {
+                return false;
+            }
+            const int32_t left = (int32_t)(end - millis());
+            wait               = (left > 0) ? left : 0;
+            return true;
+        }
+
+        bool collect(Sample &sample)
+        {
+            if(_device.endReading() == false)
+            {
+                return false;
+            }
+            sample.temperature    = _device.temperature;
+            sample.humidity       = _device.humidity;
+            sample.pressure       = _device.pressure / 100.0F;
+            sample.altitude       = Weather::altitude(sample.pressure, _seaLevel);
+            sample.gas_resistance = _device.gas_resistance / 1000.0F;
+            return true;
+        }
+
+    private:
+        Device      &_device;
+        const float  _seaLevel;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef DHT11_DRIVER_HPP
+#define DHT11_DRIVER_HPP
+
+#include <Arduino.h>
+#include <stddef.h>
+#include "SensorCore.hpp"
+
+#define DHT11_FIELD_COUNT       2          // Temperature, humidity
+
+// Every value of one DHT11 read
+typedef struct
+{
+    float temperature;              // °C
+    float humidity;                 // %
+} Dht11_reading;
+
+/***********************************************************************
+ * @brief DHT11 (or DHT22), use it through Sampler
+ *
+ * The DHT library reads both values in one transfer and gives them back
+ * for 2 s, so the humidity is read first and the temperature comes from
+ * the same transfer. The transfer blocks for about 25 ms, there is
+ * nothing to wait for after it.
+ * @tparam Device DHT, or SimulatedDht in host tests
+ ***********************************************************************/
+template <typename Device>
+class Dht11Driver
+{
+    public:
+        typedef Dht11_reading Sample;
+        static constexpr size_t FIELDS = DHT11_FIELD_COUNT;
+
+        /***********************************************************************
+         * @param device Sensor, its begin() must have been called
+         ***********************************************************************/
+        explicit Dht11Driver(Device &device) : _device(device) {}
+
+        static const Sensor_field &field(const size_t idx)
+        {
+            static const Sensor_field fields[DHT11_FIELD_COUNT] = {{"Temperature", "°C"}, {"Humidity", "%"}};
+            return fields[idx];
+        }
+
+        static void toValues(const Sample &sample, float values[DHT11_FIELD_COUNT])
+        {
+            values[0] = sample.temperature;
+            values[1] = sample.humidity;
+        }
+
+        static void fromValues(Sample &sample, const float values[DHT11_FIELD_COUNT])
+        {
+            sample.temperature = values[0];
+            sample.humidity    = values[1];
+        }
+
+    protected:
+        bool trigger(uint32_t &wait)
+        {
+            wait = 0;
+            return true;
+        }
+
+        bool collect(Sample &sample)
+        {
+            sample.humidity    = _device.readHumidity();
+            sample.temperature = _device.readTemperature();
+            return !(isnan(sample.humidity) && isnan(sample.temperature));
+        }
+
+    private:
+        Device &_device;
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef SENSOR_CORE_HPP
+#define SENSOR_CORE_HPP
+
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+#include <utility>
+
+// Description of one value given by a sensor
+typedef struct
+{
+    const char *label;
+    const char *unit;
+} Sensor_field;
+
+/***********************************************************************
+ * @brief Measures of any sensor, with the same timing and fallback for all
+ *
+ * The driver only knows its device, it provides:
+ *  - Sample, a struct of float values, and FIELDS, their number
+ *  - field(i), toValues() and fromValues(), to handle any value by index
+ *  - trigger(wait), start a measure and tell how many ms it takes
+ *  - collect(sample), get the values, NAN for those the device failed to give
+ * Everything is resolved at compile time, there is no virtual call.
+ * Between start() and finish() the caller is free, read() waits with
+ * delay() so other tasks run meanwhile. A value the device fails to give
+ * is replaced by the last good one.
+ * @tparam Driver Bme280Driver, Bme680Driver, Dht11Driver, ...
+ ***********************************************************************/
+template <typename Driver>
+class Sampler : public Driver
+{
+    public:
+        typedef typename Driver::Sample Sample;
+
+        template <typename... Args>
+        explicit Sampler(Args &&...args) : Driver(std::forward<Args>(args)...), _readyAt(0), _busy(false), _samples(0), _failures(0)
+        {
+            memset(&_last, 0, sizeof(_last));
+        }
+
+        /***********************************************************************
+         * @brief Start a measure, never blocks
+         * @return False if one is running or the device does not answer
+         ***********************************************************************/
+        bool start()
+        {
+            uint32_t wait = 0;
+            if((_busy == true) || (Driver::trigger(wait) == false))
+            {
+                return false;
+            }
+            _readyAt = millis() + wait;
+            _busy    = true;
+            return true;
+        }
+
+        bool busy() const
+        {
+            return _busy;
+        }
+
+        /***********************************************************************
+         * @return True once the measure started by start() is over
+         ***********************************************************************/
+        bool ready() const
+        {
+            return (_busy == true) && ((int32_t)(millis() - _readyAt) >= 0);
+        }
+
+        /***********************************************************************
+         * @return Milliseconds before the measure is over, 0 if ready or idle
+         ***********************************************************************/
+        uint32_t remaining() const
+        {
+            const int32_t left = (int32_t)(_readyAt - millis());
+            return ((_busy == true) && (left > 0)) ? left : 0;
+        }
+
+        /***********************************************************************
+         * @brief Collect the values of the measure
+         * @param sample Filled with the new values, the last good ones where the device failed
+         * @return False if any value is missing
+         * @note Waits for the end of the measure if called before ready()
+         ***********************************************************************/
+        bool finish(Sample &sample)
+        {
+            if(_busy == false)
+            {
+                sample = _last;
+                return false;
+            }
+            const uint32_t left = remaining();
+            if(left > 0)
+            {
+                delay(left);
+            }
+            _busy = false;
+            _samples++;
+
+            Sample fresh;
+            bool   ok = Driver::collect(fresh);
+            if(ok == true)
+            {
+                float values[Driver::FIELDS];
+                float last[Driver::FIELDS];
+                Driver::toValues(fresh, values);
+                Driver::toValues(_last, last);
+                for (size_t i = 0; i < Driver::FIELDS; i++)
+                {
+                    if(isnan(values[i]))
+                    {
+                        values[i] = last[i];
+                        ok        = false;
+                    }
+                }
+                Driver::fromValues(_last, values);
+            }
+
+            _failures += (ok == true) ? 0 : 1;
+            sample     = _last;
+            return ok;
+        }
+
+        /***********************************************************************
+         * @brief Run a whole measure, waiting with delay() while it lasts
+         * @param sample Filled with the new values, the last good ones where the device failed
+         * @return False if any value is missing
+         ***********************************************************************/
+        bool read(Sample &sample)
+        {
+            if((_busy == false) && (start() == false))
+            {
+                _failures++;
+                sample = _last;
+                return false;
+            }
+            return finish(sample);
+        }
+
+        /***********************************************************************
+         * @return Last good values, zeroed before the first measure
+         ***********************************************************************/
+        const Sample &last() const
+        {
+            return _last;
+        }
+
+        /***********************************************************************
+         * @return Number of measures collected, and of those missing a value
+         ***********************************************************************/
+        uint32_t samples() const
+        {
+            return _samples;
+        }
+
+        uint32_t failures() const
+        {
+            return _failures;
+        }
+
+        /***********************************************************************
+         * @brief Print a sample, one "label : value unit" per line
+         * @param out Serial or any Print
+         * @param sample Sample to print
+         ***********************************************************************/
+        template <typename Out>
+        static void print(Out &out, const Sample &sample)
+        {
+            float values[Driver::FIELDS];
+            Driver::toValues(sample, values);
+            for (size_t i = 0; i < Driver::FIELDS; i++)
+            {
+                const Sensor_field &field = Driver::field(i);
+                out.print(field.label);
+                out.print(" : ");
+                out.print(values[i]);
+                out.println(field.unit);
+            }
+        }
+
+    private:
+        Sample   _last;
+        uint32_t _readyAt;          // millis() at which the measure is over
+        bool     _busy;
+        uint32_t _samples;
+        uint32_t _failures;
+};
+
+#endif
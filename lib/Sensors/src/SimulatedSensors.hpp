@@ -0,0 +1,185 @@
+#ifndef SIMULATED_SENSORS_HPP
+#define SIMULATED_SENSORS_HPP
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/***********************************************************************
+ * Devices standing in for the real ones, so that the drivers and Sampler
+ * can be tested on a host. The test provides millis() and delay(), sets
+ * the values the device must give, NAN for a failed value, then checks
+ * what the sampler reads.
+ ***********************************************************************/
+
+/***********************************************************************
+ * @brief DHT with the calls used by Dht11Driver
+ ***********************************************************************/
+class SimulatedDht
+{
+    public:
+        float    temperature;       // Given by readTemperature()
+        float    humidity;          // Given by readHumidity()
+        uint32_t reads;             // Calls to readHumidity() and readTemperature()
+
+        SimulatedDht() : temperature(20.0F), humidity(50.0F), reads(0) {}
+
+        void begin() {}
+
+        float readTemperature()
+        {
+            reads++;
+            return temperature;
+        }
+
+        float readHumidity()
+        {
+            reads++;
+            return humidity;
+        }
+};
+
+/***********************************************************************
+ * @brief Adafruit_BME680 with the calls used by Bme680Driver
+ ***********************************************************************/
+class SimulatedBme680
+{
+    public:
+        float    temperature;       // °C, left by endReading() like the real one
+        float    humidity;          // %
+        uint32_t pressure;          // Pa
+        float    gas_resistance;    // Ohm
+        uint32_t conversion_ms;     // Duration of a conversion, heater included
+        bool     answer;            // False to fail beginReading() and endReading()
+        uint32_t conversions;       // Conversions started
+
+        SimulatedBme680() : temperature(20.0F), humidity(50.0F), pressure(101325), gas_resistance(50000.0F), conversion_ms(180), answer(true), conversions(0) {}
+
+        unsigned long beginReading()
+        {
+            if(answer == false)
+            {
+                return 0;
+            }
+            conversions++;
+            return millis() + conversion_ms;
+        }
+
+        bool endReading()
+        {
+            return answer;
+        }
+};
+
+/***********************************************************************
+ * @brief BME280 behind the TwoWire calls used by Bme280Driver
+ *
+ * Holds the registers of the sensor. The calibration is the example of
+ * the Bosch datasheet, with which raw values 519888 and 415148 give
+ * 25.08 °C and 100653.27 Pa.
+ ***********************************************************************/
+class SimulatedBme280
+{
+    public:
+        uint8_t  registers[256];
+        bool     answer;            // False to NACK every transfer
+        uint32_t transfers;         // I2C transactions, reads and writes
+        uint32_t measures;          // Forced measures triggered
+
+        SimulatedBme280() : answer(true), transfers(0), measures(0), _register(0), _written(0)
+        {
+            static const int32_t calibration[12] = {27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000};
+
+            memset(registers, 0, sizeof(registers));
+            registers[0xD0] = 0x60;
+            for (uint8_t i = 0; i < 12; i++)
+            {
+                writeWord(0x88 + 2 * i, calibration[i]);
+            }
+            registers[0xA1] = 75;
+            writeWord(0xE1, 362);
+            registers[0xE4] = 313 >> 4;
+            registers[0xE5] = (313 & 0x0F) | ((50 & 0x0F) << 4);
+            registers[0xE6] = 50 >> 4;
+            registers[0xE7] = 30;
+            setRaw(519888, 415148, 30000);
+        }
+
+        /***********************************************************************
+         * @brief Set the raw values of the next burst, 0x80000 and 0x8000 for skipped ones
+         ***********************************************************************/
+        void setRaw(const int32_t temperature, const int32_t pressure, const int32_t humidity)
+        {
+            registers[0xF7] = pressure >> 12;
+            registers[0xF8] = (pressure >> 4) & 0xFF;
+            registers[0xF9] = (pressure & 0x0F) << 4;
+            registers[0xFA] = temperature >> 12;
+            registers[0xFB] = (temperature >> 4) & 0xFF;
+            registers[0xFC] = (temperature & 0x0F) << 4;
+            registers[0xFD] = humidity >> 8;
+            registers[0xFE] = humidity & 0xFF;
+        }
+
+        bool begin()
+        {
+            return true;
+        }
+
+        void beginTransmission(const uint8_t)
+        {
+            _written = 0;
+        }
+
+        size_t write(const uint8_t value)
+        {
+            if(_written == 0)
+            {
+                _register = value;
+            }
+            else
+            {
+                // Soft reset and status registers are not kept
+                if((_register == 0xF4) && ((value & 0x03) == 0x01))
+                {
+                    measures++;
+                }
+                if((_register != 0xE0) && (_register != 0xF3))
+                {
+                    registers[_register] = value;
+                }
+                _register++;
+            }
+            _written++;
+            return 1;
+        }
+
+        uint8_t endTransmission(const bool = true)
+        {
+            transfers++;
+            return (answer == true) ? 0 : 2;
+        }
+
+        uint8_t requestFrom(const uint8_t, const uint8_t length)
+        {
+            transfers++;
+            return (answer == true) ? length : 0;
+        }
+
+        int read()
+        {
+            return registers[_register++];
+        }
+
+    private:
+        void writeWord(const uint8_t reg, const int32_t value)
+        {
+            registers[reg]     = value & 0xFF;
+            registers[reg + 1] = (value >> 8) & 0xFF;
+        }
+
+        uint8_t _register;          // Register read or written next
+        uint8_t _written;           // Bytes written since beginTransmission()
+};
+
+#endif
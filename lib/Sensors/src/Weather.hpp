@@ -0,0 +1,37 @@
+#ifndef WEATHER_HPP
+#define WEATHER_HPP
+
+#include <math.h>
+
+// Values computed from the readings of a sensor
+namespace Weather
+{
+    /***********************************************************************
+     * @brief Altitude from a pressure, same formula as the Adafruit readAltitude()
+     * @param pressure Pressure in hPa
+     * @param seaLevel Sea level pressure in hPa
+     * @return Altitude in meters
+     ***********************************************************************/
+    inline float altitude(const float pressure, const float seaLevel)
+    {
+        return 44330.0F * (1.0F - powf(pressure / seaLevel, 0.1903F));
+    }
+
+    /***********************************************************************
+     * @brief Dew point by the Magnus formula, within 0.35 °C from -45 to 60 °C
+     * @param temperature Temperature in °C
+     * @param humidity Relative humidity in %
+     * @return Dew point in °C, NAN if the humidity is 0
+     ***********************************************************************/
+    inline float dewPoint(const float temperature, const float humidity)
+    {
+        if(humidity <= 0.0F)
+        {
+            return NAN;
+        }
+        const float gamma = logf(humidity / 100.0F) + (17.62F * temperature) / (243.12F + temperature);
+        return (243.12F * gamma) / (17.62F - gamma);
+    }
+}
+
+#endif